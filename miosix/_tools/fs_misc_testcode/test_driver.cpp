@@ -15,11 +15,25 @@ using namespace std;
 
 ///////////////////////// Stubs ///////////////////////////
 
-#define intrusive_ref_ptr shared_ptr
+//Like intrusive_ref_ptr, can be assigned a raw pointer to a shared object
+template<typename T>
+class intrusive_ref_ptr : public shared_ptr<T>
+{
+public:
+    using shared_ptr<T>::shared_ptr;
+
+    intrusive_ref_ptr& operator= (T *p)
+    {
+        if(p) shared_ptr<T>::operator=(p->shared_from_this());
+        else this->reset();
+        return *this;
+    }
+};
 
 class StringPart;
+class PathBuffer;
 
-class FilesystemBase
+class FilesystemBase : public enable_shared_from_this<FilesystemBase>
 {
 public:
     FilesystemBase() {}
@@ -32,9 +46,48 @@ private:
     FilesystemBase& operator= (const FilesystemBase&);
 };
 
+//Only what PathResolution uses, the path prefix cache is always empty
+class FilesystemManager
+{
+public:
+    struct MountpointNode
+    {
+        const MountpointNode *find(const char *s, size_t n) const
+        {
+            for(const MountpointNode *c=child;c;c=c->sibling)
+                if(c->len==n && memcmp(c->name,s,n)==0) return c;
+            return nullptr;
+        }
+
+        const char *name;
+        size_t len;
+        intrusive_ref_ptr<FilesystemBase> fs;
+        MountpointNode *child;
+        MountpointNode *sibling;
+    };
+
+    struct CachedPrefix
+    {
+        intrusive_ref_ptr<FilesystemBase> fs;
+        const MountpointNode *node;
+        unsigned short len;
+        unsigned short indexIntoFs;
+        unsigned short depthIntoFs;
+    };
+
+    const CachedPrefix *findCachedPrefix(const PathBuffer& path)
+    {
+        return nullptr;
+    }
+
+    void addCachedPrefix(const PathBuffer& path, const CachedPrefix& prefix) {}
+
+    MountpointNode *mountpoints;
+};
+
 ///////////////////////// Code under test /////////////////
 
-//Insert classes StringPart, ResolvedPAth and PathResolution
+//Insert classes StringPart, PathBuffer, ResolvedPAth and PathResolution
 
 ////////////////// end of test code //////////////////////////
 
@@ -65,20 +118,29 @@ int FilesystemBase::readlink(StringPart& name, std::string& target)
 
 int main(int argc, char *argv[])
 {
-	map<StringPart,intrusive_ref_ptr<FilesystemBase>> fs;
 	intrusive_ref_ptr<FilesystemBase> root(new FilesystemBase);
-    //cout<<"----------"<<endl;
-	fs.insert(make_pair(StringPart("/"),root));
-	fs.insert(make_pair(StringPart("/dev"),intrusive_ref_ptr<FilesystemBase>(new FilesystemBase)));
-    //cout<<"----------"<<endl;
-	PathResolution pr(fs);
-	string path=argv[1];
+	//Trie of mountpoints for / and /dev
+	FilesystemManager::MountpointNode rootNode, devNode;
+	rootNode.name="";
+	rootNode.len=0;
+	rootNode.fs=root;
+	rootNode.child=&devNode;
+	rootNode.sibling=nullptr;
+	devNode.name="dev";
+	devNode.len=3;
+	devNode.fs=intrusive_ref_ptr<FilesystemBase>(new FilesystemBase);
+	devNode.child=devNode.sibling=nullptr;
+	FilesystemManager fsm;
+	fsm.mountpoints=&rootNode;
+	PathResolution pr(fsm);
+	PathBuffer path;
+	path.assign(argv[1],strlen(argv[1]));
 	ResolvedPath rp=pr.resolvePath(path,true);
 	if(rp.result==0)
 	{
 		assert((unsigned)rp.off<=path.length());
-		string p2=path;
-		StringPart sp(path,string::npos,rp.off);
+		string p2=path.c_str();
+		StringPart sp(path.data(),string::npos,rp.off);
 		cout<<"resolved path="<<p2
 			<<" fs="<< (rp.fs==root ? "/" : "/dev")
 			<<" offset="<<rp.off
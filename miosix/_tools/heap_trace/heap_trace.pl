@@ -0,0 +1,91 @@
+#!/usr/bin/perl
+
+#
+# usage: perl heap_trace.pl main.elf log.txt
+#
+# This program symbolizes the output of HeapTrace::dump(), that is printed
+# when Miosix is compiled with WITH_HEAP_TRACE defined in miosix_settings.h.
+# Capture the serial output of the board in log.txt and pass it to this
+# script together with the elf file of the same build. Call sites are
+# translated into function, file and line with addr2line, which is
+# arm-miosix-eabi-addr2line unless overridden by the ADDR2LINE environment
+# variable.
+#
+# If the log contains more than one dump, the live bytes of each call site in
+# the last dump are compared with the first one, so that call sites whose
+# memory keeps growing over time, which are likely leaks, stand out.
+#
+
+use warnings;
+use strict;
+
+die "usage: perl heap_trace.pl main.elf log.txt\n" unless($#ARGV==1);
+my ($elf,$log)=@ARGV;
+my $addr2line=$ENV{'ADDR2LINE'} || 'arm-miosix-eabi-addr2line';
+
+# Parse all the dumps in the log
+my @dumps;
+my $cur;
+open(my $in,'<',$log) or die "Can't open $log\n";
+while(<$in>)
+{
+	s/\r//g;
+	if(/heap_trace begin/) { $cur={sites=>{},events=>[]}; next; }
+	next unless(defined $cur);
+	if(/heap_trace end/) { push(@dumps,$cur); undef $cur; next; }
+	if(/^live (\d+) peak (\d+)/) {
+		$cur->{live}=$1; $cur->{peak}=$2;
+	} elsif(/^site (0x[0-9a-f]+) allocs (\d+) frees (\d+) failures (\d+) live (\d+) peak (\d+)/) {
+		$cur->{sites}->{$1}={allocs=>$2,frees=>$3,failures=>$4,live=>$5,peak=>$6};
+	} elsif(/^event (\d+) (\w) (0x[0-9a-f]+) (0x[0-9a-f]+) (\d+) (0x[0-9a-f]+)/) {
+		push(@{$cur->{events}},{seq=>$1,type=>$2,caller=>$3,ptr=>$4,size=>$5,thread=>$6});
+	}
+}
+close($in);
+die "No heap trace found in $log\n" if($#dumps<0);
+my $first=$dumps[0];
+my $last=$dumps[-1];
+
+# Symbolize all the addresses at once, as addr2line is slow to start. Return
+# addresses point after the call instruction, and have the thumb bit set, so
+# subtract one to get the line of the call
+my %symbols;
+my @addrs=keys %{$last->{sites}};
+push(@addrs,$_->{caller}) foreach(@{$last->{events}});
+my %seen;
+@addrs=grep { !$seen{$_}++ && hex($_)!=0 } @addrs;
+if($#addrs>=0)
+{
+	my $list=join(' ',map { sprintf('0x%x',hex($_)-1) } @addrs);
+	my @out=`$addr2line -f -C -s -e $elf $list`;
+	die "Can't run $addr2line\n" if($?!=0);
+	foreach my $addr (@addrs)
+	{
+		my $func=shift(@out); my $line=shift(@out);
+		chomp($func); chomp($line);
+		$symbols{$addr}="$func ($line)";
+	}
+}
+sub symbol { my $a=shift; return hex($a)==0 ? 'other call sites' : $symbols{$a}; }
+
+print "Live bytes $last->{live}, peak $last->{peak}\n\n";
+print "Call sites by live bytes:\n";
+printf("%8s %8s %8s %8s %8s %9s  %s\n",
+	'live','peak','allocs','frees','failures','growth','call site');
+my $s=$last->{sites};
+foreach my $addr (sort { $s->{$b}->{live} <=> $s->{$a}->{live} } keys %{$s})
+{
+	my $old=$first->{sites}->{$addr};
+	my $growth=$s->{$addr}->{live}-(defined $old ? $old->{live} : 0);
+	printf("%8d %8d %8d %8d %8d %+9d  %s\n",$s->{$addr}->{live},
+		$s->{$addr}->{peak},$s->{$addr}->{allocs},$s->{$addr}->{frees},
+		$s->{$addr}->{failures},$growth,symbol($addr));
+}
+
+print "\nMost recent heap operations:\n";
+my %types=('a'=>'alloc','f'=>'free','x'=>'FAILED');
+foreach my $e (@{$last->{events}})
+{
+	printf("%8d %-6s %s size %6d thread %s  %s\n",$e->{seq},$types{$e->{type}},
+		$e->{ptr},$e->{size},$e->{thread},symbol($e->{caller}));
+}
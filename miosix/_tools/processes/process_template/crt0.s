@@ -202,6 +202,62 @@ system:
 	blt  syscallfailed
 	bx   lr
 
+/**
+ * pwrite, write to file at a given offset
+ * \param fd file descriptor
+ * \param buf data to be written
+ * \param len buffer length
+ * \param offset 64 bit file offset, passed on the stack
+ * \return number of written bytes or -1 if errors
+ */
+.section .text.pwrite
+.global pwrite
+.type pwrite, %function
+pwrite:
+	movs r3, #25
+	b    offsetsyscall
+
+/**
+ * pread, read from file at a given offset
+ * \param fd file descriptor
+ * \param buf data to be read
+ * \param len buffer length
+ * \param offset 64 bit file offset, passed on the stack
+ * \return number of read bytes or -1 if errors
+ */
+.section .text.pread
+.global pread
+.type pread, %function
+pread:
+	movs r3, #26
+	b    offsetsyscall
+
+.section .text.offsetsyscall
+/* common code for pread and pwrite, expects the syscall id in r3 */
+offsetsyscall:
+	/* the kernel takes a struct iovec, build it on the stack */
+	push {r1, r2}
+	mov  r1, sp
+	ldr  r2, [sp, #8]
+	ldr  r12, [sp, #12]
+	svc  0
+	add  sp, sp, #8
+	cmp  r0, #0
+	blt  syscallfailed
+	bx   lr
+
+/**
+ * __getTimePage, get the address of the time page exported by the kernel
+ * \return the address of the time page
+ */
+.section .text.__getTimePage
+.global __getTimePage
+.type __getTimePage, %function
+__getTimePage:
+	movs r3, #30
+	svc  0
+	bx   lr
+
 .section .text.__seterrno
 /* common jump target for all failing syscalls */
 syscallfailed:
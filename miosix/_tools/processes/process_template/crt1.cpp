@@ -32,6 +32,7 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <sys/times.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <sys/fcntl.h>
 #include <reent.h>
@@ -205,7 +206,6 @@ int _stat_r(struct _reent *ptr, const char *file, struct stat *pstat) { return -
 int _isatty_r(struct _reent *ptr, int fd) { return -1; }
 int mkdir(const char *path, mode_t mode) { return -1; }
 int _unlink_r(struct _reent *ptr, const char *file) { return -1; }
-clock_t _times_r(struct _reent *ptr, struct tms *tim) { return -1; }
 int _link_r(struct _reent *ptr, const char *f_old, const char *f_new) { return -1; }
 int _kill(int pid, int sig) { return -1; }
 int _kill_r(struct _reent* ptr, int pid, int sig) { return -1; }
@@ -214,6 +214,97 @@ int _getpid_r(struct _reent* ptr) { return 1; }
 int _fork_r(struct _reent *ptr) { return -1; }
 int _wait_r(struct _reent *ptr, int *status) { return -1; }
 
+//
+// Time API, reading the time page exported by the kernel without syscalls
+// ======================================================================
+
+/**
+ * \internal
+ * Layout of the time page, must match struct TimePage in kernel/time_page.h
+ */
+struct TimePage
+{
+    volatile unsigned int sequence;
+    volatile unsigned int tickLo;
+    volatile unsigned int tickHi;
+    unsigned int tick2nsInt;
+    unsigned int tick2nsFrac;
+    const volatile unsigned int *counter;
+    const volatile unsigned int *status;
+    unsigned int overflowMask;
+};
+
+const TimePage *__getTimePage(); //Syscall, in crt0.s
+
+/**
+ * \internal
+ * Multiply a 64 bit number by a 32.32 fixed point number, same algorithm as
+ * mul64x32d32() in kernel/timeconversion.cpp
+ */
+static unsigned long long mul64x32d32(unsigned long long a,
+                                      unsigned int bi, unsigned int bf)
+{
+    unsigned int aLo=a & 0xffffffff;
+    unsigned int aHi=a>>32;
+    unsigned long long result=static_cast<unsigned long long>(bi)*aLo;
+    result+=static_cast<unsigned long long>(bf)*aHi;
+    unsigned long long fracLo=static_cast<unsigned long long>(bf)*aLo;
+    result+=fracLo>>32;
+    result+=static_cast<unsigned long long>(bi*aHi)<<32;
+    return result;
+}
+
+int clock_gettime(clockid_t clock_id, struct timespec *tp)
+{
+    if(tp==nullptr) return -1;
+    //Like in the kernel, CLOCK_REALTIME is the time since boot
+    if(clock_id!=CLOCK_MONOTONIC && clock_id!=CLOCK_REALTIME)
+    {
+        errno=EINVAL;
+        return -1;
+    }
+    static const TimePage *page=nullptr;
+    if(page==nullptr) page=__getTimePage();
+    unsigned int seq, lo, hi;
+    do {
+        seq=page->sequence;
+        asm volatile("":::"memory");
+        lo=page->tickLo;
+        hi=page->tickHi;
+        if(page->counter)
+        {
+            //The page holds the upper bits, extend the hardware counter with
+            //the same pending bit trick as TimerAdapter::IRQgetTimeTick().
+            //An overflow interrupt while reading changes the sequence counter
+            unsigned int counter=*page->counter;
+            if((*page->status & page->overflowMask) && *page->counter>=counter)
+                hi++;
+            lo|=counter;
+        }
+        asm volatile("":::"memory");
+    } while((seq & 1) || seq!=page->sequence);
+    unsigned long long tick=static_cast<unsigned long long>(hi)<<32 | lo;
+    long long ns=mul64x32d32(tick,page->tick2nsInt,page->tick2nsFrac);
+    tp->tv_sec=ns/1000000000;
+    tp->tv_nsec=static_cast<long>(ns%1000000000);
+    return 0;
+}
+
+clock_t _times_r(struct _reent *ptr, struct tms *tim)
+{
+    struct timespec tp;
+    //No CLOCK_PROCESS_CPUTIME_ID support, use CLOCK_MONOTONIC
+    if(clock_gettime(CLOCK_MONOTONIC,&tp)) return static_cast<clock_t>(-1);
+    constexpr int divFactor=1000000000/CLOCKS_PER_SEC;
+    clock_t utime=tp.tv_sec*CLOCKS_PER_SEC + tp.tv_nsec/divFactor;
+    if(tim==nullptr) return utime;
+    tim->tms_utime=utime;
+    tim->tms_stime=0;
+    tim->tms_cutime=0;
+    tim->tms_cstime=0;
+    return 0;
+}
+
 // TODO: implement when processes can spawn threads
 int pthread_mutex_unlock(pthread_mutex_t *mutex)  { return 0; }
 int pthread_mutex_lock(pthread_mutex_t *mutex)    { return 0; }
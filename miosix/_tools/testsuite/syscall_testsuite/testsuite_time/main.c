@@ -0,0 +1,62 @@
+#include <time.h>
+#include <errno.h>
+
+#define error(x)	(x)
+
+/* Bound on the clock reads before the clock must advance */
+#define MAX_READS	1000
+/* Bound on the attempts to read the clock without being preempted */
+#define MAX_ATTEMPTS	10
+
+/* Only the first field of the time page, see kernel/time_page.h. Its sequence
+   counter advances every time the kernel resumes the process, including on
+   return from a syscall */
+struct TimePage {
+	volatile unsigned int sequence;
+};
+
+const struct TimePage *__getTimePage(void); /* Syscall, in crt0.s */
+
+long long ts2ns(const struct timespec *tp){
+	return tp->tv_sec * 1000000000LL + tp->tv_nsec;
+}
+
+int main(){
+	const struct TimePage *page;
+	struct timespec tp;
+	long long first, prev, now;
+	unsigned int seq;
+	int i, attempt;
+	
+	errno = 0;
+	if(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tp) != -1 || errno != EINVAL)
+		return error(1);
+	
+	/* Also maps the time page, so that the loop below makes no syscall */
+	if(clock_gettime(CLOCK_MONOTONIC, &tp) != 0)
+		return error(2);
+	page = __getTimePage();
+	
+	/* Back-to-back reads must advance the clock without syscalls. Being
+	   preempted also advances the sequence counter, so retry a few times */
+	for(attempt = 0; attempt < MAX_ATTEMPTS; attempt++){
+		seq = page->sequence;
+		clock_gettime(CLOCK_MONOTONIC, &tp);
+		first = prev = ts2ns(&tp);
+		for(i = 0; i < MAX_READS; i++){
+			if(clock_gettime(CLOCK_MONOTONIC, &tp) != 0)
+				return error(3);
+			now = ts2ns(&tp);
+			if(now < prev)
+				return error(4);
+			prev = now;
+			if(now > first)
+				break;
+		}
+		if(i == MAX_READS)
+			return error(5);
+		if(page->sequence == seq)
+			return 0;
+	}
+	return error(6);
+}
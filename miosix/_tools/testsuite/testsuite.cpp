@@ -43,6 +43,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/select.h>
 #include <signal.h>
 #include <pthread.h>
 #include <errno.h>
@@ -61,6 +62,10 @@
 #include "interfaces/endianness.h"
 #include "e20/e20.h"
 #include "kernel/intrusive.h"
+#include "filesystem/file.h"
+#include "filesystem/file_access.h"
+#include "filesystem/mountpointfs/mountpointfs.h"
+#include "filesystem/fat32/diskio.h"
 #include "util/crc16.h"
 
 #ifdef WITH_PROCESSES
@@ -130,6 +135,7 @@ static void test_23();
 static void test_24();
 static void test_25();
 static void test_26();
+static void test_27();
 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
 void testCacheAndDMA();
 #endif //_ARCH_CORTEXM7_STM32F7/H7
@@ -139,6 +145,13 @@ static void fs_test_1();
 static void fs_test_2();
 static void fs_test_3();
 static void fs_test_4();
+static void fs_test_5();
+static void fs_test_6();
+static void fs_test_7();
+static void fs_test_8();
+static void fs_test_9();
+static void fs_test_10();
+static void fs_test_11();
 #endif //WITH_FILESYSTEM
 //Benchmark functions
 static void benchmark_1();
@@ -154,6 +167,7 @@ static void exception_test();
 void syscall_test_sleep();
 void process_test_process_ret();
 void syscall_test_system();
+void syscall_test_time();
 #ifdef WITH_FILESYSTEM
 void syscall_test_files();
 void process_test_file_concurrency();
@@ -236,6 +250,7 @@ int main()
                 test_24();
                 test_25();
                 test_26();
+                test_27();
                 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
                 testCacheAndDMA();
                 #endif //_ARCH_CORTEXM7_STM32F7/H7
@@ -252,6 +267,13 @@ int main()
                 fs_test_2();
                 fs_test_3();
                 fs_test_4();
+                fs_test_5();
+                fs_test_6();
+                fs_test_7();
+                fs_test_8();
+                fs_test_9();
+                fs_test_10();
+                fs_test_11();
                 #else //WITH_FILESYSTEM
                 iprintf("Error, filesystem support is disabled\n");
                 #endif //WITH_FILESYSTEM
@@ -300,6 +322,7 @@ int main()
 
                 syscall_test_sleep();
                 syscall_test_system();
+                syscall_test_time();
                 #else //WITH_PROCESSES
                 iprintf("Error, process support is disabled\n");
                 #endif //WITH_PROCESSES
@@ -548,6 +571,23 @@ void syscall_test_sleep()
 	pass();
 }
 
+void syscall_test_time()
+{
+	test_name("System Call: clock_gettime");
+	ElfProgram prog(reinterpret_cast<const unsigned int*>(testsuite_time_elf),testsuite_time_elf_len);
+	int ret = 0;
+	pid_t p = Process::create(prog);
+	Process::waitpid(p, &ret, 0);
+	if(WIFEXITED(ret)==false) fail("Process did not terminate normally");
+	int code = WEXITSTATUS(ret);
+	if(code == 1) fail("Unsupported clock should fail with EINVAL");
+	if(code == 2 || code == 3) fail("clock_gettime(CLOCK_MONOTONIC) failed");
+	if(code == 4) fail("Clock went backwards");
+	if(code == 5) fail("Clock did not advance without blocking");
+	if(code != 0) fail("clock_gettime made a syscall");
+	pass();
+}
+
 void syscall_test_files()
 {
 	test_name("System Call: open, read, write, seek, close, system");
@@ -2011,6 +2051,74 @@ void test_11()
         fail("getCurrentFreeHeap");
     if(MemoryProfiling::getAbsoluteFreeHeap()>heapSize)
         fail("getAbsoluteFreeHeap");
+    //Largest free block
+    unsigned int largest=MemoryProfiling::getLargestFreeHeapBlock();
+    if(largest>MemoryProfiling::getCurrentFreeHeap())
+        fail("getLargestFreeHeapBlock (1)");
+    void *p=malloc(largest/2);
+    if(p==0) fail("getLargestFreeHeapBlock (2)");
+    free(p);
+    if(MemoryProfiling::getHeapFragmentation()>100)
+        fail("getHeapFragmentation");
+    //Heap regions, fall back to the main heap if not defined
+    MemoryKind kinds[]={MemoryKind::Default,MemoryKind::Fast,
+                        MemoryKind::Dma,MemoryKind::Bulk};
+    for(MemoryKind k : kinds)
+    {
+        size_t regionFree=getHeapRegionFree(k);
+        if(hasHeapRegion(k)==false && regionFree!=0) fail("getHeapRegionFree");
+        char *r=reinterpret_cast<char*>(malloc_region(k,100));
+        if(r==0) fail("malloc_region");
+        memset(r,0x55,100);
+        if(hasHeapRegion(k) && getHeapRegionFree(k)>=regionFree)
+            fail("malloc_region (2)");
+        free_region(r);
+        if(getHeapRegionFree(k)!=regionFree) fail("free_region");
+    }
+    {
+        vector<int,RegionAllocator<int,MemoryKind::Fast>> v;
+        for(int i=0;i<100;i++) v.push_back(i);
+        for(int i=0;i<100;i++) if(v[i]!=i) fail("RegionAllocator");
+    }
+    //Object caches
+    {
+        ObjectCache oc("t11",20,4);
+        if(oc.getObjectSize()!=24) fail("ObjectCache size");
+        void *o[5];
+        for(int i=0;i<5;i++)
+        {
+            o[i]=oc.allocate();
+            if(o[i]==0) fail("ObjectCache allocate");
+            memset(o[i],i,20);
+        }
+        if(oc.getSlabs()!=2 || oc.getInUse()!=5) fail("ObjectCache stats");
+        for(int i=0;i<5;i++)
+        {
+            for(int j=0;j<20;j++)
+                if(reinterpret_cast<char*>(o[i])[j]!=i) fail("ObjectCache");
+            oc.deallocate(o[i]);
+        }
+        //Freed objects are reused without growing the cache
+        for(int i=0;i<5;i++) o[i]=oc.allocate();
+        for(int i=0;i<5;i++) oc.deallocate(o[i]);
+        if(oc.getSlabs()!=2 || oc.getInUse()!=0 || oc.getPeakInUse()!=5 ||
+           oc.getAllocations()!=10) fail("ObjectCache stats (2)");
+    }
+    {
+        //The init function runs once per object, and the object state is
+        //preserved across deallocation
+        ObjectCache oc("t11init",sizeof(int),2,[](void *p){
+            *reinterpret_cast<int*>(p)=0x1234;
+        });
+        int *i1=reinterpret_cast<int*>(oc.allocate());
+        if(i1==0 || *i1!=0x1234) fail("ObjectCache init");
+        *i1=42;
+        oc.deallocate(i1);
+        int *i2=reinterpret_cast<int*>(oc.allocate());
+        if(i2!=i1 || *i2!=42) fail("ObjectCache init (2)");
+        oc.deallocate(i2);
+        if(oc.reserve(5)==false || oc.getSlabs()!=3) fail("reserve");
+    }
     //Multithread test
     Thread *t=Thread::create(t11_p1,STACK_SMALL,0,0,Thread::JOINABLE);
     t11_v1=MemoryProfiling::getCurrentFreeHeap();
@@ -3009,6 +3117,27 @@ void t20_t2(void* arg)
     Thread::sleep(10);
     eq->post(thrower);
 }
+
+const int t20_numEvents=200;
+volatile int t20_runs[t20_numEvents];
+
+void t20_f3(int i)
+{
+    atomicAdd(&t20_runs[i],1);
+    //Let the other threads in run() dequeue events meanwhile
+    if(i % 4==0) Thread::yield();
+}
+
+void t20_t3(void* arg)
+{
+    FixedEventQueue<4,20,0,2> *eq=reinterpret_cast<FixedEventQueue<4,20,0,2>*>(arg);
+    try {
+        eq->run();
+        fail("run() returned");
+    } catch(int i) {
+        if(i!=5) fail("Wrong");
+    }
+}
 #endif //__NO_EXCEPTIONS
 
 static void test_20()
@@ -3144,6 +3273,156 @@ static void test_20()
     if(feq.empty()==false || feq.size()!=0) fail("Empty EventQueue");
     #endif //__NO_EXCEPTIONS
     
+    //
+    // Testing PooledEventQueue
+    //
+    PooledEventQueue<20,2> peq(2);
+    if(peq.empty()==false || peq.size()!=0) fail("Empty EventQueue");
+    if(peq.slots()!=0) fail("Slots");
+    
+    peq.runOne(); //This tests that runOne() does not block
+    
+    t20_v1=0;
+    peq.post(t20_f1);
+    peq.post(bind(t20_f2,2,3));
+    if(peq.slots()!=2) fail("Slots");
+    peq.post(t20_f1); //Grows the queue
+    if(peq.slots()!=4) fail("Slots");
+    if(t20_v1!=0) fail("Too early");
+    if(peq.empty() || peq.size()!=3) fail("Not empty EventQueue");
+    peq.runOne();
+    if(t20_v1!=1234) fail("Not called");
+    peq.runOne();
+    if(t20_v1!=5) fail("Not called");
+    peq.runOne();
+    if(t20_v1!=1234) fail("Not called");
+    if(peq.empty()==false || peq.size()!=0) fail("Empty EventQueue");
+    
+    //Slots are recycled, and the queue does not grow beyond maxChunks
+    for(int i=0;i<4;i++)
+        if(peq.postNonBlocking(bind(t20_f2,i,1))==false) fail("PostNonBlocking 1");
+    if(peq.postNonBlocking(t20_f1)==true) fail("PostNonBlocking 2");
+    if(peq.slots()!=4) fail("Slots");
+    for(int i=0;i<4;i++)
+    {
+        peq.runOne();
+        if(t20_v1!=i+1) fail("Not called");
+    }
+    if(peq.empty()==false || peq.size()!=0) fail("Empty EventQueue");
+    
+    //
+    // Testing priorities
+    //
+    FixedEventQueue<4,20,1,3> pfeq;
+    t20_v1=0;
+    pfeq.post(bind(t20_f2,1,1));    //Priority 0
+    pfeq.post(bind(t20_f2,2,1),2);
+    pfeq.post(bind(t20_f2,3,1),1);
+    pfeq.post(bind(t20_f2,4,1),2);
+    if(pfeq.size()!=4) fail("Not empty EventQueue");
+    pfeq.runOne(1);
+    if(t20_v1!=3) fail("Priority");
+    pfeq.runOne(1);
+    if(t20_v1!=5) fail("Priority");
+    pfeq.runOne(1);
+    if(t20_v1!=4) fail("Priority");
+    pfeq.runOne(1); //Only a priority 0 event left, must not run it
+    if(t20_v1!=4 || pfeq.size()!=1) fail("minPriority");
+    //A due timed event runs before queued events of lower priority
+    pfeq.post(bind(t20_f2,5,1),1);
+    if(pfeq.postAt(t20_f1,getTime(),2)<0) fail("postAt");
+    pfeq.runOne();
+    if(t20_v1!=1234) fail("Priority");
+    pfeq.runOne();
+    if(t20_v1!=6) fail("Priority");
+    pfeq.runOne();
+    if(t20_v1!=2 || pfeq.empty()==false) fail("Priority");
+    
+    #ifndef __NO_EXCEPTIONS
+    //
+    // Testing multiple threads in run()
+    //
+    FixedEventQueue<4,20,0,2> cfeq;
+    for(int i=0;i<t20_numEvents;i++) t20_runs[i]=0;
+    const int numThreads=3;
+    Thread *threads[numThreads];
+    for(int i=0;i<numThreads;i++)
+        threads[i]=Thread::create(t20_t3,STACK_SMALL,0,&cfeq,Thread::JOINABLE);
+    //The queue is smaller than the events, so this blocks while the threads
+    //run them
+    for(int i=0;i<t20_numEvents;i++) cfeq.post(bind(t20_f3,i),i % 2);
+    //Posted last, each one makes a thread return from run()
+    for(int i=0;i<numThreads;i++) cfeq.post(thrower);
+    for(int i=0;i<numThreads;i++) threads[i]->join();
+    for(int i=0;i<t20_numEvents;i++)
+        if(t20_runs[i]!=1) fail("Event not run exactly once");
+    if(cfeq.empty()==false || cfeq.size()!=0) fail("Empty EventQueue");
+    #endif //__NO_EXCEPTIONS
+    
+    //
+    // Testing timed events
+    //
+    t20_v1=0;
+    long long t1=getTime();
+    eq.postDelayed(t20_f1,20000000);
+    eq.postAt(bind(t20_f2,3,4),t1+10000000);
+    if(eq.pendingTimers()!=2 || eq.empty()==false) fail("pendingTimers");
+    eq.runOne();
+    if(t20_v1!=0) fail("Too early");
+    Thread::nanoSleepUntil(t1+15000000);
+    eq.runOne();
+    if(t20_v1!=7) fail("Not called");
+    int id=eq.postPeriodic(t20_f1,1000000);
+    if(eq.cancel(id)==false) fail("cancel");
+    if(eq.cancel(id)==true) fail("cancel (2)");
+    Thread::nanoSleepUntil(t1+25000000);
+    eq.runOne();
+    if(t20_v1!=1234) fail("Not called");
+    if(eq.pendingTimers()!=0) fail("pendingTimers");
+    
+    FixedEventQueue<2,20,2> tfeq;
+    t20_v1=0;
+    t1=getTime();
+    if(tfeq.postDelayed(t20_f1,20000000)<0) fail("postDelayed");
+    if(tfeq.postAt(bind(t20_f2,3,4),t1+10000000)<0) fail("postAt");
+    if(tfeq.postDelayed(t20_f1,1)>=0) fail("postDelayed (2)");
+    tfeq.runOne();
+    if(t20_v1!=0) fail("Too early");
+    Thread::nanoSleepUntil(t1+15000000);
+    tfeq.runOne();
+    if(t20_v1!=7) fail("Not called");
+    Thread::nanoSleepUntil(t1+25000000);
+    tfeq.runOne();
+    if(t20_v1!=1234) fail("Not called");
+    id=tfeq.postPeriodic(t20_f1,1000000);
+    if(tfeq.cancel(id)==false) fail("cancel");
+    if(tfeq.cancel(id)==true) fail("cancel (2)");
+    
+    #ifndef __NO_EXCEPTIONS
+    //run() must sleep till the next timed event and run periodic events
+    t20_v1=0;
+    t1=getTime();
+    tfeq.postPeriodic([]{ t20_v1++; },10000000);
+    tfeq.postDelayed(thrower,55000000);
+    try {
+        tfeq.run();
+        fail("run() returned");
+    } catch(int i) {
+        if(i!=5) fail("Wrong");
+    }
+    long long t2=getTime();
+    if(t20_v1!=5 || t2-t1<55000000 || t2-t1>57000000) fail("run() timing");
+    t1=getTime();
+    eq.postDelayed(thrower,10000000);
+    try {
+        eq.run();
+        fail("run() returned");
+    } catch(int i) {
+        if(i!=5) fail("Wrong");
+    }
+    t2=getTime();
+    if(t2-t1<10000000 || t2-t1>12000000) fail("run() timing");
+    #endif //__NO_EXCEPTIONS
     
     pass();
 }
@@ -4060,6 +4339,89 @@ static void test_26()
     pass();
 }
 
+//
+// Test 27
+//
+/*
+tests:
+class MemoryPool
+Thread::IRQenableIrqAndTimedWait
+*/
+
+typedef MemoryPool<unsigned int,2> T27Pool;
+
+static void t27_p1(void *argv)
+{
+    T27Pool *pool=reinterpret_cast<T27Pool*>(argv);
+    unsigned int *a=pool->tryAllocate();
+    unsigned int *b=pool->tryAllocate();
+    if(a==nullptr || b==nullptr) fail("tryAllocate");
+    Thread::sleep(20);
+    *b=0xdeadbeef;
+    pool->deallocate(b); //Wakes the main thread
+    Thread::sleep(20);
+    pool->deallocate(a);
+}
+
+static volatile long long t27_v1;
+
+static void t27_p2(void *argv)
+{
+    long long t1=getTime();
+    Thread::sleep(20);
+    t27_v1=getTime()-t1;
+}
+
+static void test_27()
+{
+    test_name("MemoryPool");
+    T27Pool pool;
+    if(pool.capacity()!=2 || pool.available()!=2) fail("capacity");
+    unsigned int *a=pool.allocate();
+    unsigned int *b=pool.allocate();
+    if(a==nullptr || b==nullptr || a==b) fail("allocate");
+    if(pool.isEmpty()==false || pool.available()!=0) fail("isEmpty");
+    if(pool.tryAllocate()!=nullptr) fail("tryAllocate");
+    {
+        FastInterruptDisableLock dLock;
+        if(pool.IRQallocate()!=nullptr) fail("IRQallocate");
+        bool hppw=false;
+        pool.IRQdeallocate(a,hppw);
+        if(hppw) fail("hppw");
+        if(pool.IRQallocate()!=a) fail("IRQallocate (2)");
+    }
+    //Timeout
+    long long t1=getTime();
+    if(pool.timedAllocate(t1+10000000)!=nullptr) fail("timedAllocate");
+    long long t2=getTime();
+    if(t2-t1<10000000 || t2-t1>12000000) fail("timedAllocate timeout");
+    pool.deallocate(a);
+    pool.deallocate(b);
+    //Wakeup before timeout
+    Thread *t=Thread::create(t27_p1,STACK_SMALL,1,&pool,Thread::JOINABLE);
+    Thread::sleep(5);
+    if(pool.available()!=0) fail("thread did not allocate");
+    t1=getTime();
+    b=pool.timedAllocate(t1+1000000000);
+    t2=getTime();
+    if(b==nullptr || *b!=0xdeadbeef) fail("timedAllocate (2)");
+    if(t2-t1>20000000) fail("timedAllocate not woken");
+    a=pool.allocate(); //Blocks until the other thread frees it
+    if(a==nullptr || a==b) fail("allocate (2)");
+    t->join();
+    pool.deallocate(a);
+    pool.deallocate(b);
+    if(pool.available()!=2) fail("deallocate");
+    //Plain sleeps must not be affected by wakeup()
+    t27_v1=0;
+    t=Thread::create(t27_p2,STACK_SMALL,1,nullptr,Thread::JOINABLE);
+    Thread::sleep(5);
+    t->wakeup();
+    t->join();
+    if(t27_v1<20000000) fail("sleep woken by wakeup()");
+    pass();
+}
+
 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
 static Thread *waiting=nullptr; /// Thread waiting on DMA completion IRQ
 
@@ -4476,6 +4838,94 @@ static void fs_test_1()
         fail("ftell() 2");
     }
     if(fclose(f)!=0) fail("Can't close r2 file_4.txt");
+    //Testing write-back policies
+    {
+        int fd=open("/sd/testdir/file_5.txt",O_WRONLY|O_CREAT|O_TRUNC|O_SYNC,0);
+        if(fd<0) fail("open O_SYNC file_5.txt");
+        if(write(fd,"line 1\n",7)!=7) fail("write O_SYNC file_5.txt");
+        if(close(fd)!=0) fail("Can't close O_SYNC file_5.txt");
+        fd=open("/sd/testdir/file_5.txt",O_WRONLY|O_APPEND);
+        if(fd<0) fail("open a file_5.txt");
+        if(write(fd,"line 2\n",7)!=7) fail("write a file_5.txt");
+        if(fdatasync(fd)!=0) fail("fdatasync");
+        if(write(fd,"line 3\n",7)!=7) fail("write a file_5.txt");
+        if(fsync(fd)!=0) fail("fsync");
+        if(close(fd)!=0) fail("Can't close a file_5.txt");
+        struct stat st;
+        if(stat("/sd/testdir/file_5.txt",&st)!=0 || st.st_size!=21)
+            fail("file_5.txt size");
+        int fds[2];
+        if(pipe(fds)!=0) fail("pipe");
+        if(fsync(fds[0])!=-1 || errno!=EINVAL) fail("fsync on pipe");
+        close(fds[0]);
+        close(fds[1]);
+        if(fsync(fds[0])!=-1 || errno!=EBADF) fail("fsync on closed fd");
+    }
+    //Testing preallocation
+    {
+        struct statvfs before, after;
+        if(statvfs("/sd/testdir",&before)!=0) fail("statvfs");
+        if(before.f_bfree==0 || before.f_bfree>before.f_blocks)
+            fail("statvfs free space");
+        int fd=open("/sd/testdir/file_6.txt",O_RDWR|O_CREAT|O_TRUNC,0);
+        if(fd<0) fail("open file_6.txt");
+        struct stat st;
+        if(fallocate(fd,FALLOC_FL_KEEP_SIZE,0,8192)!=0) fail("fallocate");
+        if(fstat(fd,&st)!=0 || st.st_size!=0) fail("fallocate size");
+        if(fstatvfs(fd,&after)!=0) fail("fstatvfs");
+        if(after.f_bfree!=before.f_bfree-(8192+after.f_frsize-1)/after.f_frsize)
+            fail("fallocate free space");
+        if(write(fd,"abc",3)!=3) fail("write file_6.txt");
+        if(posix_fallocate(fd,512,488)!=0) fail("posix_fallocate");
+        if(fstat(fd,&st)!=0 || st.st_size!=1000) fail("posix_fallocate size");
+        if(lseek(fd,0,SEEK_CUR)!=3) fail("posix_fallocate moved file pointer");
+        char buf[1000];
+        if(pread(fd,buf,sizeof(buf),0)!=1000) fail("read file_6.txt");
+        if(memcmp(buf,"abc",3)!=0) fail("posix_fallocate overwrote data");
+        for(int i=3;i<1000;i++) if(buf[i]!=0) fail("posix_fallocate not zero");
+        if(posix_fallocate(fd,0,0)!=EINVAL) fail("posix_fallocate len 0");
+        if(close(fd)!=0) fail("Can't close file_6.txt");
+        //Closing frees the clusters preallocated past the end of file
+        if(statvfs("/sd/testdir",&after)!=0 || after.f_bfree!=before.f_bfree
+            -(1000+after.f_frsize-1)/after.f_frsize) fail("close free space");
+        fd=open("/sd/testdir/file_7.txt",O_RDWR|O_CREAT|O_TRUNC,0);
+        if(fd<0) fail("open file_7.txt");
+        if(fallocate(fd,FALLOC_FL_KEEP_SIZE,0,4096)!=0) fail("fallocate empty");
+        if(close(fd)!=0) fail("Can't close file_7.txt");
+        if(statvfs("/sd/testdir",&after)!=0 || after.f_bfree!=before.f_bfree
+            -(1000+after.f_frsize-1)/after.f_frsize) fail("close empty free space");
+        if(stat("/sd/testdir/file_7.txt",&st)!=0 || st.st_size!=0)
+            fail("stat file_7.txt");
+        if(unlink("/sd/testdir/file_7.txt")!=0) fail("unlink file_7.txt");
+        int fds[2];
+        if(pipe(fds)!=0) fail("pipe");
+        if(posix_fallocate(fds[1],0,1)!=ENODEV) fail("posix_fallocate on pipe");
+        close(fds[0]);
+        close(fds[1]);
+        if(unlink("/sd/testdir/file_6.txt")!=0) fail("unlink file_6.txt");
+        if(statvfs("/sd/testdir",&after)!=0 || after.f_bfree!=before.f_bfree)
+            fail("unlink free space");
+    }
+    //Testing that lookups see renamed and removed files
+    {
+        struct stat st;
+        if((f=fopen("/sd/testdir/file_7.txt","w"))==NULL) fail("open file_7.txt");
+        if(fputs("seven",f)<0) fail("write file_7.txt");
+        if(fclose(f)!=0) fail("Can't close file_7.txt");
+        if(stat("/sd/testdir/file_7.txt",&st)!=0) fail("stat file_7.txt");
+        if(rename("/sd/testdir/file_7.txt","/sd/testdir/file_8.txt")!=0)
+            fail("rename file_7.txt");
+        if(stat("/sd/testdir/file_7.txt",&st)==0) fail("stat renamed file");
+        if(stat("/sd/testdir/file_8.txt",&st)!=0 || st.st_size!=5)
+            fail("stat file_8.txt");
+        if((f=fopen("/sd/testdir/file_7.txt","w"))==NULL) fail("open file_7.txt");
+        if(fclose(f)!=0) fail("Can't close file_7.txt");
+        if(stat("/sd/testdir/file_7.txt",&st)!=0 || st.st_size!=0)
+            fail("stat new file_7.txt");
+        if(unlink("/sd/testdir/file_7.txt")!=0) fail("unlink file_7.txt");
+        if(unlink("/sd/testdir/file_8.txt")!=0) fail("unlink file_8.txt");
+        if(stat("/sd/testdir/file_8.txt",&st)==0) fail("stat removed file");
+    }
     //Testing remove()
     if((f=fopen("/sd/testdir/deleteme.txt","w"))==NULL)
         fail("can't open deleteme.txt");
@@ -4553,6 +5003,12 @@ static void checkInDir(const std::string& d, bool createFile)
 static void fs_test_2()
 {
     test_name("mkdir/rename/unlink");
+    //Paths longer than the buffer used to resolve short paths on the stack
+    std::string longPath="/";
+    while(longPath.length()<2*64) longPath+="./";
+    struct stat st1, st2;
+    if(stat("/",&st1) || stat(longPath.c_str(),&st2)) fail("stat long path");
+    if(st1.st_ino!=st2.st_ino || st1.st_dev!=st2.st_dev) fail("long path");
     checkInDir("/",false);
     DIR *d=opendir("/sd");
     if(d!=NULL)
@@ -4607,6 +5063,47 @@ static void fs_test_3()
     delete[] buf;
     
     if(checksum!=outChecksum) fail("checksum");
+    
+    //Vectored and positional I/O
+    int fd=open(name,O_RDWR);
+    if(fd<0) fail("open 3");
+    char a[10], b[20], c[30];
+    for(unsigned int i=0;i<sizeof(a);i++) a[i]='a'+i;
+    for(unsigned int i=0;i<sizeof(b);i++) b[i]='A'+i;
+    for(unsigned int i=0;i<sizeof(c);i++) c[i]='0'+i;
+    struct iovec iov[3]={{a,sizeof(a)},{b,sizeof(b)},{c,sizeof(c)}};
+    if(writev(fd,iov,3)!=60) fail("writev");
+    if(lseek(fd,0,SEEK_CUR)!=60) fail("writev position");
+    char d[60];
+    if(pread(fd,d,sizeof(d),0)!=60) fail("pread");
+    if(memcmp(d,a,10) || memcmp(d+10,b,20) || memcmp(d+30,c,30))
+        fail("pread data");
+    if(lseek(fd,0,SEEK_CUR)!=60) fail("pread position");
+    if(pwrite(fd,"xyz",3,5)!=3) fail("pwrite");
+    if(lseek(fd,0,SEEK_CUR)!=60) fail("pwrite position");
+    memset(a,0,sizeof(a));
+    memset(b,0,sizeof(b));
+    if(lseek(fd,0,SEEK_SET)!=0) fail("lseek");
+    struct iovec iov2[2]={{a,sizeof(a)},{b,sizeof(b)}};
+    if(readv(fd,iov2,2)!=30) fail("readv");
+    if(memcmp(a,"abcdexyzij",10) || memcmp(b,d+10,20)) fail("readv data");
+    if(pread(fd,d,sizeof(d),size*numBlocks)!=0) fail("pread EOF");
+    
+    //Regular files are always ready, closed descriptors are reported
+    struct pollfd pfd[2]={{fd,POLLIN | POLLOUT,0},{fd+1,POLLIN,0}};
+    if(poll(pfd,2,-1)!=2) fail("poll");
+    if(pfd[0].revents!=(POLLIN | POLLOUT)) fail("poll revents");
+    if(pfd[1].revents!=POLLNVAL) fail("poll POLLNVAL");
+    long long t=getTime();
+    if(poll(nullptr,0,50)!=0) fail("poll timeout");
+    if(getTime()-t<50000000) fail("poll timeout (2)");
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(fd,&rfds);
+    struct timeval tv={0,0};
+    if(select(fd+1,&rfds,nullptr,nullptr,&tv)!=1 || !FD_ISSET(fd,&rfds))
+        fail("select");
+    if(close(fd)!=0) fail("close 3");
     pass();
 }
 
@@ -4746,6 +5243,562 @@ static void fs_test_4()
     checkInodes("/sd/testdir",testdirIno,sdInode,sdDevice,sdDevice);
     pass();
 }
+
+//
+// Filesystem test 5
+//
+/*
+tests:
+pipe()
+mkfifo()
+fcntl(F_SETFL,O_NONBLOCK)
+growing the file descriptor table
+*/
+
+static void fs_test_5()
+{
+    test_name("Pipes and FIFOs");
+    int fds[2];
+    if(pipe(fds)!=0) fail("pipe");
+    char buf[PIPE_BUFFER_SIZE+32];
+    if(write(fds[1],"Hello",5)!=5) fail("write 1");
+    memset(buf,0,sizeof(buf));
+    if(read(fds[0],buf,sizeof(buf))!=5 || strcmp(buf,"Hello")) fail("read 1");
+    if(lseek(fds[0],0,SEEK_SET)!=-1 || errno!=ESPIPE) fail("lseek");
+    struct stat st;
+    if(fstat(fds[0],&st)!=0 || !S_ISFIFO(st.st_mode)) fail("fstat");
+    //An empty pipe in non blocking mode
+    if(fcntl(fds[0],F_SETFL,O_NONBLOCK)!=0) fail("fcntl");
+    if(read(fds[0],buf,1)!=-1 || errno!=EAGAIN) fail("EAGAIN");
+    if(fcntl(fds[0],F_SETFL,0)!=0) fail("fcntl 2");
+    //Writes larger than the buffer complete as the other thread reads
+    std::thread reader([&]{
+        for(unsigned int i=0;i<sizeof(buf);)
+        {
+            int r=read(fds[0],buf+i,sizeof(buf)-i);
+            if(r<=0) fail("read 2");
+            i+=r;
+        }
+    });
+    char data[sizeof(buf)];
+    for(unsigned int i=0;i<sizeof(data);i++) data[i]=i;
+    if(write(fds[1],data,sizeof(data))!=sizeof(data)) fail("write 2");
+    reader.join();
+    if(memcmp(buf,data,sizeof(data))) fail("data mismatch");
+    //Closing the write end gives EOF, closing the read end gives EPIPE
+    if(close(fds[1])!=0) fail("close 1");
+    if(read(fds[0],buf,1)!=0) fail("EOF");
+    if(close(fds[0])!=0) fail("close 2");
+    if(pipe(fds)!=0) fail("pipe 2");
+    if(close(fds[0])!=0) fail("close 3");
+    if(write(fds[1],"x",1)!=-1 || errno!=EPIPE) fail("EPIPE");
+    if(close(fds[1])!=0) fail("close 4");
+    //Closing a file descriptor while another thread is blocked reading it
+    //does not release the file until the read completes
+    if(pipe(fds)!=0) fail("pipe 3");
+    std::thread blocked([&]{
+        memset(buf,0,sizeof(buf));
+        if(read(fds[0],buf,sizeof(buf))!=5 || strcmp(buf,"Close"))
+            fail("read 4");
+    });
+    Thread::sleep(10);
+    if(close(fds[0])!=0) fail("close 5");
+    if(read(fds[0],buf,1)!=-1 || errno!=EBADF) fail("EBADF");
+    if(write(fds[1],"Close",5)!=5) fail("write 4");
+    blocked.join();
+    if(close(fds[1])!=0) fail("close 6");
+    //The file descriptor table grows past its initial size, and the lowest
+    //free file descriptor is reused
+    const int numPipes=FILE_TABLE_CHUNK_SIZE+2;
+    int many[numPipes][2];
+    for(int i=0;i<numPipes;i++) if(pipe(many[i])!=0) fail("pipe 4");
+    if(many[numPipes-1][1]<2*FILE_TABLE_CHUNK_SIZE) fail("grow");
+    int reused=many[1][0];
+    if(close(reused)!=0) fail("close 7");
+    if(pipe(fds)!=0 || fds[0]!=reused) fail("lowest fd");
+    if(close(fds[0])!=0 || close(fds[1])!=0) fail("close 8");
+    for(int i=0;i<numPipes;i++)
+    {
+        if(i!=1 && close(many[i][0])!=0) fail("close 9");
+        if(close(many[i][1])!=0) fail("close 10");
+    }
+    #ifdef WITH_DEVFS
+    if(mkfifo("/dev/testfifo",0600)!=0) fail("mkfifo");
+    if(mkfifo("/dev/testfifo",0600)!=-1 || errno!=EEXIST) fail("EEXIST");
+    if(stat("/dev/testfifo",&st)!=0 || !S_ISFIFO(st.st_mode)) fail("stat");
+    //Opening a FIFO for writing without readers fails in non blocking mode
+    if(open("/dev/testfifo",O_WRONLY | O_NONBLOCK)!=-1 || errno!=ENXIO)
+        fail("ENXIO");
+    //Opening blocks until the other end is opened
+    int wr=-1;
+    std::thread writer([&]{
+        wr=open("/dev/testfifo",O_WRONLY);
+        if(wr<0 || write(wr,"FIFO",5)!=5) fail("write 3");
+    });
+    int rd=open("/dev/testfifo",O_RDONLY);
+    if(rd<0) fail("open");
+    writer.join();
+    if(read(rd,buf,sizeof(buf))!=5 || strcmp(buf,"FIFO")) fail("read 3");
+    if(close(wr)!=0 || close(rd)!=0) fail("close 11");
+    if(unlink("/dev/testfifo")!=0) fail("unlink");
+    //O_NONBLOCK on devices
+    int dn=open("/dev/null",O_RDWR | O_NONBLOCK);
+    if(dn<0) fail("open /dev/null");
+    if(fcntl(dn,F_GETFL)!=(O_RDWR | O_NONBLOCK)) fail("F_GETFL");
+    if(write(dn,"x",1)!=1) fail("write 5");
+    if(fcntl(dn,F_SETFL,0)!=0 || fcntl(dn,F_GETFL)!=O_RDWR) fail("F_SETFL");
+    if(close(dn)!=0) fail("close 12");
+    #endif //WITH_DEVFS
+    pass();
+}
+
+//
+// Filesystem test 6
+//
+/*
+tests:
+nested mountpoints
+umount
+rename and rmdir of cached path prefixes
+*/
+
+static void fs_test_6()
+{
+    test_name("Mountpoints and path cache");
+    FilesystemManager& fsm=FilesystemManager::instance();
+    intrusive_ref_ptr<FilesystemBase> outerFs(new MountpointFs);
+    intrusive_ref_ptr<FilesystemBase> innerFs(new MountpointFs);
+    struct stat st, outer, inner;
+    if(mkdir("/sd/testdir/mnt",0755)!=0) fail("mkdir mnt");
+    if(fsm.kmount("/sd/testdir/mnt",outerFs)!=0) fail("mount outer");
+    if(mkdir("/sd/testdir/mnt/sub",0755)!=0) fail("mkdir sub");
+    if(fsm.kmount("/sd/testdir/mnt/sub",innerFs)!=0) fail("mount inner");
+    if(mkdir("/sd/testdir/mnt/sub/dir",0755)!=0) fail("mkdir dir");
+    if(stat("/sd/testdir/mnt",&outer)!=0) fail("stat mnt");
+    if(stat("/sd/testdir/mnt/sub",&inner)!=0) fail("stat sub");
+    if(outer.st_dev==inner.st_dev) fail("nested mount");
+    //The second time the path is resolved from the cached prefix
+    for(int i=0;i<2;i++)
+        if(stat("/sd/testdir/mnt/sub/dir",&st)!=0 || st.st_dev!=inner.st_dev)
+            fail("stat nested");
+    if(stat("/sd/testdir/mnt/sub/dir/../..",&st)!=0
+        || st.st_dev!=outer.st_dev || st.st_ino!=outer.st_ino) fail("..");
+    if(rmdir("/sd/testdir/mnt/sub")!=-1 || errno!=EBUSY)
+        fail("rmdir mountpoint");
+    if(rename("/sd/testdir/mnt/sub","/sd/testdir/mnt/sub2")!=-1 || errno!=EBUSY)
+        fail("rename mountpoint");
+    //After umount, the cached prefix no longer leads to the inner filesystem
+    if(fsm.umount("/sd/testdir/mnt/sub")!=0) fail("umount inner");
+    if(stat("/sd/testdir/mnt/sub/dir",&st)==0) fail("stat after umount");
+    if(stat("/sd/testdir/mnt/sub",&st)!=0 || st.st_dev!=outer.st_dev)
+        fail("stat sub after umount");
+    //Umounting a filesystem also umounts the ones mounted inside it
+    if(fsm.kmount("/sd/testdir/mnt/sub",innerFs)!=0) fail("mount inner 2");
+    if(stat("/sd/testdir/mnt/sub/dir",&st)!=0) fail("stat after mount");
+    if(fsm.umount("/sd/testdir/mnt")!=0) fail("umount outer");
+    if(stat("/sd/testdir/mnt/sub",&st)==0) fail("stat sub after umount 2");
+    if(stat("/sd/testdir/mnt",&st)!=0 || st.st_dev==outer.st_dev)
+        fail("stat mnt after umount");
+    if(rmdir("/sd/testdir/mnt")!=0) fail("rmdir mnt");
+    //Renaming or removing a directory drops it from the cache
+    FILE *f;
+    if(mkdir("/sd/testdir/c1",0755)!=0) fail("mkdir c1");
+    if((f=fopen("/sd/testdir/c1/file","w"))==NULL || fclose(f)!=0)
+        fail("create c1/file");
+    if(stat("/sd/testdir/c1/file",&st)!=0) fail("stat c1/file");
+    if(rename("/sd/testdir/c1","/sd/testdir/c2")!=0) fail("rename c1");
+    if(stat("/sd/testdir/c1/file",&st)==0) fail("stat renamed directory");
+    if(stat("/sd/testdir/c2/file",&st)!=0) fail("stat c2/file");
+    if(unlink("/sd/testdir/c2/file")!=0) fail("unlink c2/file");
+    if(rmdir("/sd/testdir/c2")!=0) fail("rmdir c2");
+    if(stat("/sd/testdir/c2/file",&st)==0) fail("stat removed directory");
+    if(stat("/sd/testdir/c2",&st)==0) fail("stat c2");
+    pass();
+}
+
+//
+// Filesystem test 7
+//
+/*
+tests:
+FAT32 block cache hits, misses and write back
+pinning of FAT sectors
+*/
+
+/**
+ * A drive in RAM, that counts the transfers that reach it
+ */
+class RamDrive : public FileBase
+{
+public:
+    RamDrive(unsigned int numSectors)
+        : FileBase(intrusive_ref_ptr<FilesystemBase>()), reads(0), writes(0),
+          size(numSectors*512), data(new unsigned char[size]()) {}
+
+    virtual ssize_t write(const void *buf, size_t len) { return -EBADF; }
+    virtual ssize_t read(void *buf, size_t len) { return -EBADF; }
+
+    virtual ssize_t pwrite(const void *buf, size_t len, off_t pos)
+    {
+        if(pos<0 || pos+len>size) return -EIO;
+        memcpy(data+pos,buf,len);
+        writes++;
+        return len;
+    }
+
+    virtual ssize_t pread(void *buf, size_t len, off_t pos)
+    {
+        if(pos<0 || pos+len>size) return -EIO;
+        memcpy(buf,data+pos,len);
+        reads++;
+        return len;
+    }
+
+    virtual off_t lseek(off_t pos, int whence) { return -ESPIPE; }
+
+    virtual int fstat(struct stat *pstat) const
+    {
+        memset(pstat,0,sizeof(struct stat));
+        return 0;
+    }
+
+    virtual int ioctl(int cmd, void *arg) { return 0; }
+
+    const unsigned char *sector(unsigned int i) const { return data+i*512; }
+
+    ~RamDrive() { delete[] data; }
+
+    unsigned int reads;  ///< Number of pread() calls
+    unsigned int writes; ///< Number of pwrite() calls
+
+private:
+    unsigned int size;
+    unsigned char *data;
+};
+
+static void fs_test_7()
+{
+    test_name("Block cache");
+    const unsigned int n=FAT32_CACHE_SECTORS;
+    intrusive_ref_ptr<RamDrive> ram(new RamDrive(2*n+2));
+    DiskDrive drv;
+    drv.file=ram;
+    BYTE buf[512], out[2*512];
+    DiskCacheStats before, after;
+    disk_cache_stats(&before);
+    //Sector 0 is the FAT of the drive
+    disk_cache_pin(drv,0,1);
+    if(disk_read(drv,out,0,1)!=RES_OK) fail("read 1");
+    memset(buf,0x5a,sizeof(buf));
+    if(disk_write(drv,buf,1,1)!=RES_OK) fail("write 1");
+    if(ram->writes!=0) fail("write not cached");
+    if(disk_read(drv,out,1,1)!=RES_OK || memcmp(out,buf,512)) fail("read 2");
+    disk_cache_stats(&after);
+    if(after.misses-before.misses<2 || after.hits==before.hits)
+        fail("hits and misses");
+    //Filling the cache evicts the dirty sector, but not the pinned one
+    for(unsigned int i=0;i<n;i++)
+        if(disk_read(drv,out,2+i,1)!=RES_OK) fail("read 3");
+    disk_cache_stats(&after);
+    if(after.writebacks==before.writebacks || ram->writes!=1
+        || memcmp(ram->sector(1),buf,512)) fail("write back");
+    unsigned int reads=ram->reads;
+    if(disk_read(drv,out,0,1)!=RES_OK || ram->reads!=reads)
+        fail("pinned sector evicted");
+    if(disk_read(drv,out,1,1)!=RES_OK || ram->reads!=reads+1
+        || memcmp(out,buf,512)) fail("read evicted sector");
+    //Multi sector transfers bypass the cache, but see its dirty sectors
+    memset(buf,0xa5,sizeof(buf));
+    if(disk_write(drv,buf,2*n,1)!=RES_OK) fail("write 2");
+    if(disk_read(drv,out,2*n,2)!=RES_OK || memcmp(out,buf,512)) fail("read 4");
+    disk_cache_stats(&after);
+    if(after.bypassed-before.bypassed<2) fail("bypassed");
+    if(disk_release(drv)!=RES_OK || memcmp(ram->sector(2*n),buf,512))
+        fail("release");
+    pass();
+}
+
+//
+// Filesystem test 8
+//
+/*
+tests:
+many files open at the same time on a FAT volume
+*/
+
+static void fs_test_8()
+{
+    test_name("Many open files");
+    //More than the files FatFs allowed to open before, less than the
+    //file descriptors left after stdin, stdout, stderr
+    const int numFiles=16;
+    int fd[numFiles];
+    char name[32];
+    for(int i=0;i<numFiles;i++)
+    {
+        snprintf(name,sizeof(name),"/sd/testdir/many_%d.txt",i);
+        fd[i]=open(name,O_RDWR|O_CREAT|O_TRUNC,0);
+        if(fd[i]<0) fail("open");
+    }
+    for(int i=0;i<numFiles;i++)
+        if(write(fd[i],&i,sizeof(int))!=sizeof(int)) fail("write");
+    for(int i=0;i<numFiles;i++)
+    {
+        int j=-1;
+        if(lseek(fd[i],0,SEEK_SET)!=0) fail("lseek");
+        if(read(fd[i],&j,sizeof(int))!=sizeof(int) || j!=i) fail("read");
+    }
+    for(int i=0;i<numFiles;i++)
+    {
+        if(close(fd[i])!=0) fail("close");
+        snprintf(name,sizeof(name),"/sd/testdir/many_%d.txt",i);
+        if(unlink(name)!=0) fail("unlink");
+    }
+    pass();
+}
+
+//
+// Filesystem test 9
+//
+/*
+tests:
+concurrent reads and writes of different files on the same volume
+*/
+
+static volatile bool fs_9_error;
+
+/**
+ * \return the byte at a given position of the file written by a thread
+ */
+static unsigned char fs_9_pattern(int id, int pos)
+{
+    return (pos*(2*id+1)+id) & 0xff;
+}
+
+static void fs_t9_p1(void *argv)
+{
+    const int id=reinterpret_cast<int>(argv);
+    //Chunks spanning several sectors, not sector aligned
+    const int chunk=3*512+100;
+    const int chunks=64;
+    char name[32];
+    snprintf(name,sizeof(name),"/sd/testdir/file_9_%d.dat",id);
+    int fd=open(name,O_RDWR|O_CREAT|O_TRUNC,0);
+    if(fd<0)
+    {
+        fs_9_error=true;
+        return;
+    }
+    unsigned char *buf=new unsigned char[chunk];
+    for(int i=0;i<chunks && fs_9_error==false;i++)
+    {
+        for(int j=0;j<chunk;j++) buf[j]=fs_9_pattern(id,i*chunk+j);
+        if(write(fd,buf,chunk)!=chunk) fs_9_error=true;
+    }
+    if(lseek(fd,0,SEEK_SET)!=0) fs_9_error=true;
+    for(int i=0;i<chunks && fs_9_error==false;i++)
+    {
+        if(read(fd,buf,chunk)!=chunk) fs_9_error=true;
+        for(int j=0;j<chunk;j++)
+            if(buf[j]!=fs_9_pattern(id,i*chunk+j)) fs_9_error=true;
+    }
+    delete[] buf;
+    if(close(fd)!=0 || unlink(name)!=0) fs_9_error=true;
+}
+
+static void fs_test_9()
+{
+    test_name("Concurrent file access");
+    fs_9_error=false;
+    Thread *t1=Thread::create(fs_t9_p1,2048+512,1,reinterpret_cast<void*>(0),
+        Thread::JOINABLE);
+    Thread *t2=Thread::create(fs_t9_p1,2048+512,1,reinterpret_cast<void*>(1),
+        Thread::JOINABLE);
+    t1->join();
+    t2->join();
+    if(fs_9_error) fail("Concurrent read and write");
+    pass();
+}
+
+//
+// Filesystem test 10
+//
+/*
+tests:
+IOCTL_FAST_SEEK on a fragmented file
+*/
+
+/**
+ * \return the byte at a given position of the file
+ */
+static unsigned char fs_10_pattern(int id, int pos)
+{
+    return (pos*(id+3)+(pos>>9)) & 0xff;
+}
+
+/**
+ * Append data to a file
+ * \param fd file descriptor
+ * \param id selects the content of the file
+ * \param pos current file size
+ * \param len bytes to append
+ */
+static void fs_t10_append(int fd, int id, int pos, int len)
+{
+    unsigned char buf[512];
+    while(len>0)
+    {
+        int n=min<int>(len,sizeof(buf));
+        for(int i=0;i<n;i++) buf[i]=fs_10_pattern(id,pos+i);
+        if(write(fd,buf,n)!=n) fail("write");
+        pos+=n;
+        len-=n;
+    }
+}
+
+/**
+ * Seek to random positions, and check the data read
+ * \param fd file descriptor
+ * \param size file size
+ */
+static void fs_t10_check(int fd, int size)
+{
+    const int maxLen=1600;
+    unsigned char *buf=new unsigned char[maxLen];
+    for(int i=0;i<100;i++)
+    {
+        int pos=rand() % size;
+        int len=min(1+rand() % maxLen,size-pos);
+        if(lseek(fd,pos,SEEK_SET)!=pos) fail("lseek");
+        if(read(fd,buf,len)!=len) fail("read");
+        for(int j=0;j<len;j++)
+            if(buf[j]!=fs_10_pattern(0,pos+j)) fail("data after lseek");
+        //pread too, it seeks and then restores the file position
+        pos=rand() % size;
+        len=min(1+rand() % maxLen,size-pos);
+        if(pread(fd,buf,len,pos)!=len) fail("pread");
+        for(int j=0;j<len;j++)
+            if(buf[j]!=fs_10_pattern(0,pos+j)) fail("data after pread");
+    }
+    delete[] buf;
+}
+
+static void fs_test_10()
+{
+    test_name("Fast seek");
+    const char name1[]="/sd/testdir/fastseek_1.dat";
+    const char name2[]="/sd/testdir/fastseek_2.dat";
+    int fd1=open(name1,O_RDWR|O_CREAT|O_TRUNC,0);
+    if(fd1<0) fail("open 1");
+    int fd2=open(name2,O_RDWR|O_CREAT|O_TRUNC,0);
+    if(fd2<0) fail("open 2");
+    //Interleaving the writes to the two files fragments both, unless the
+    //cluster size is greater than the slabs
+    const int slab=16*1024;
+    int size=0;
+    for(int i=0;i<6;i++)
+    {
+        fs_t10_append(fd1,0,size,slab);
+        fs_t10_append(fd2,1,size,slab);
+        size+=slab;
+    }
+    if(close(fd2)!=0) fail("close 2");
+    //Leave free clusters between the fragments of the first file
+    if(unlink(name2)!=0) fail("unlink 2");
+    if(getFileDescriptorTable().ioctl(fd1,IOCTL_FAST_SEEK,nullptr)!=0)
+        fail("ioctl");
+    fs_t10_check(fd1,size);
+    //Writing past the end extends the cluster chain, the link map built
+    //by the previous seeks is stale and seeks in the new part would fail
+    if(lseek(fd1,0,SEEK_END)!=size) fail("lseek end");
+    fs_t10_append(fd1,0,size,2*slab+100);
+    size+=2*slab+100;
+    fs_t10_check(fd1,size);
+    //Also when the write starts after a seek with the link map
+    if(lseek(fd1,size/2,SEEK_SET)!=size/2) fail("lseek middle");
+    if(lseek(fd1,0,SEEK_END)!=size) fail("lseek end");
+    fs_t10_append(fd1,0,size,slab);
+    size+=slab;
+    fs_t10_check(fd1,size);
+    struct stat st;
+    if(fstat(fd1,&st)!=0 || st.st_size!=size) fail("file size");
+    if(close(fd1)!=0) fail("close 1");
+    if(unlink(name1)!=0) fail("unlink 1");
+    pass();
+}
+
+//
+// Filesystem test 11
+//
+/*
+tests:
+reads and writes of several sectors at once, across clusters
+*/
+
+/**
+ * Write a buffer at a given position with a single write(), read it back with
+ * a single read() and check it, as well as the data before it
+ * \param fd file descriptor
+ * \param offset where to write the buffer
+ * \param size buffer size
+ * \param id selects the content of the file before offset
+ */
+static void fs_t11_check(int fd, int offset, int size, int id)
+{
+    unsigned char *buf=new unsigned char[size];
+    for(int i=0;i<size;i++) buf[i]=fs_10_pattern(2,offset+i);
+    if(lseek(fd,offset,SEEK_SET)!=offset) fail("lseek");
+    if(write(fd,buf,size)!=size) fail("write");
+    memset(buf,0,size);
+    if(lseek(fd,offset,SEEK_SET)!=offset) fail("lseek");
+    if(read(fd,buf,size)!=size) fail("read");
+    for(int i=0;i<size;i++)
+        if(buf[i]!=fs_10_pattern(2,offset+i)) fail("data");
+    if(pread(fd,buf,offset,0)!=offset) fail("pread");
+    for(int i=0;i<offset;i++)
+        if(buf[i]!=fs_10_pattern(id,i)) fail("data before offset");
+    delete[] buf;
+}
+
+static void fs_test_11()
+{
+    test_name("Multi sector transfers");
+    const char name1[]="/sd/testdir/multi_1.dat";
+    const char name2[]="/sd/testdir/multi_2.dat";
+    const char name3[]="/sd/testdir/multi_3.dat";
+    int fd1=open(name1,O_RDWR|O_CREAT|O_TRUNC,0);
+    if(fd1<0) fail("open 1");
+    struct statvfs sv;
+    if(fstatvfs(fd1,&sv)!=0) fail("fstatvfs");
+    const int cluster=sv.f_bsize;
+    const int numClusters=4;
+    //Not sector aligned, spanning at least two clusters
+    const int offset=100;
+    const int size=min(3*cluster,32*1024);
+    //Contiguous clusters, fallocate() allocates a contiguous block
+    if(fallocate(fd1,FALLOC_FL_KEEP_SIZE,0,numClusters*cluster)!=0)
+        fail("fallocate");
+    fs_t10_append(fd1,0,0,offset);
+    fs_t11_check(fd1,offset,size,0);
+    if(close(fd1)!=0) fail("close 1");
+    if(unlink(name1)!=0) fail("unlink 1");
+    //Fragmented clusters, interleaving the writes to two files
+    int fd2=open(name2,O_RDWR|O_CREAT|O_TRUNC,0);
+    if(fd2<0) fail("open 2");
+    int fd3=open(name3,O_RDWR|O_CREAT|O_TRUNC,0);
+    if(fd3<0) fail("open 3");
+    for(int i=0;i<numClusters;i++)
+    {
+        fs_t10_append(fd2,1,i*cluster,cluster);
+        fs_t10_append(fd3,1,i*cluster,cluster);
+    }
+    if(close(fd3)!=0) fail("close 3");
+    if(unlink(name3)!=0) fail("unlink 3");
+    fs_t11_check(fd2,offset,size,1);
+    if(close(fd2)!=0) fail("close 2");
+    if(unlink(name2)!=0) fail("unlink 2");
+    pass();
+}
 #endif //WITH_FILESYSTEM
 
 //
@@ -41,8 +41,8 @@ static const unsigned int cacheLine=32; //Cortex-M7 cache line size
  * - non-shareable
  * - readable/writable/executable only by privileged code (for compatibility
  *   with the way processes use the MPU)
- * \param region MPU region. Note that region 6 and 7 are used by processes, and
- * should be avoided here
+ * \param region MPU region. Note that region 4, 5, 6 and 7 are used by
+ * processes, and should be avoided here
  * \param base base address, aligned to a 32Byte cache line
  * \param size size, must be at least 32 and a power of 2, or it is rounded to
  * the next power of 2
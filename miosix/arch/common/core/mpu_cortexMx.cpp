@@ -42,6 +42,29 @@ unsigned int sizeToMpu(unsigned int size)
 
 #ifdef WITH_PROCESSES
 
+void IRQconfigureSharedRegion(const void *base, unsigned int size)
+{
+    //Not shareable, see the comment in the MPUConfiguration constructor
+    MPU->RBAR=(reinterpret_cast<unsigned int>(base) & (~0x1f))
+             | MPU_RBAR_VALID_Msk | 5; //Region 5
+    MPU->RASR=2<<MPU_RASR_AP_Pos //Privileged: RW, unprivileged: RO
+             | MPU_RASR_XN_Msk
+             | MPU_RASR_C_Msk
+             | 1 //Enable bit
+             | sizeToMpu(size)<<1;
+}
+
+void IRQconfigureSharedDeviceRegion(const void *base, unsigned int size)
+{
+    MPU->RBAR=(reinterpret_cast<unsigned int>(base) & (~0x1f))
+             | MPU_RBAR_VALID_Msk | 4; //Region 4
+    MPU->RASR=2<<MPU_RASR_AP_Pos //Privileged: RW, unprivileged: RO
+             | MPU_RASR_XN_Msk
+             | MPU_RASR_B_Msk    //Device memory
+             | 1 //Enable bit
+             | sizeToMpu(size)<<1;
+}
+
 //
 // class MPUConfiguration
 //
@@ -52,6 +52,27 @@ inline void IRQenableMPUatBoot()
 
 #ifdef WITH_PROCESSES
 
+/**
+ * \internal
+ * Configure MPU region 5 to make an area of kernel memory readable, but not
+ * writable nor executable, by all processes. It is used for the time page.
+ * Region 5 is not touched when switching between processes.
+ * \param base base address, aligned to size
+ * \param size size, must be at least 32 and a power of 2
+ */
+void IRQconfigureSharedRegion(const void *base, unsigned int size);
+
+/**
+ * \internal
+ * Configure MPU region 4 to make peripheral registers readable, but not
+ * writable nor executable, by all processes. It is used to let processes read
+ * the os timer counter. Region 4 is not touched when switching between
+ * processes.
+ * \param base base address, aligned to size
+ * \param size size, must be at least 32 and a power of 2
+ */
+void IRQconfigureSharedDeviceRegion(const void *base, unsigned int size);
+
 /**
  * \internal
  * This class is used to manage the MemoryProtectionUnit
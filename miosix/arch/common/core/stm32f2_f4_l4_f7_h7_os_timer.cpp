@@ -36,11 +36,20 @@ class STM32Timer5 : public TimerAdapter<STM32Timer5, 32>
 public:
     static inline unsigned int IRQgetTimerCounter() { return TIM5->CNT; }
     static inline void IRQsetTimerCounter(unsigned int v) { TIM5->CNT=v; }
+    static inline const volatile unsigned int *IRQgetTimerCounterAddress()
+    {
+        return reinterpret_cast<const volatile unsigned int*>(&TIM5->CNT);
+    }
 
     static inline unsigned int IRQgetTimerMatchReg() { return TIM5->CCR1; }
     static inline void IRQsetTimerMatchReg(unsigned int v) { TIM5->CCR1=v; }
 
     static inline bool IRQgetOverflowFlag() { return TIM5->SR & TIM_SR_UIF; }
+    static inline const volatile unsigned int *IRQgetOverflowFlagAddress()
+    {
+        return reinterpret_cast<const volatile unsigned int*>(&TIM5->SR);
+    }
+    static inline unsigned int IRQgetOverflowFlagMask() { return TIM_SR_UIF; }
     static inline void IRQclearOverflowFlag() { TIM5->SR = ~TIM_SR_UIF; }
     
     static inline bool IRQgetMatchFlag() { return TIM5->SR & TIM_SR_CC1IF; }
@@ -145,6 +145,40 @@ ssize_t ATSAMSerial::writeBlock(const void *buffer, size_t size, off_t where)
     return size;
 }
 
+ssize_t ATSAMSerial::tryReadBlock(void *buffer, size_t size, off_t where)
+{
+    if(size==0) return 0;
+    if(rxMutex.tryLock()==false) return -EAGAIN;
+    char *buf=reinterpret_cast<char*>(buffer);
+    size_t result=0;
+    {
+        FastInterruptDisableLock dLock;
+        for(;result<size;result++)
+        {
+            if(rxQueue.tryGet(buf[result])==false) break;
+            //This is here just not to keep IRQ disabled for the whole loop
+            FastInterruptEnableLock eLock(dLock);
+        }
+    }
+    rxMutex.unlock();
+    return result>0 ? static_cast<ssize_t>(result) : -EAGAIN;
+}
+
+ssize_t ATSAMSerial::tryWriteBlock(const void *buffer, size_t size, off_t where)
+{
+    if(size==0) return 0;
+    if(txMutex.tryLock()==false) return -EAGAIN;
+    const char *buf=reinterpret_cast<const char*>(buffer);
+    size_t result=0;
+    for(;result<size;result++)
+    {
+        if((port->US_CSR & US_CSR_TXRDY) == 0) break;
+        port->US_THR =*buf++;
+    }
+    txMutex.unlock();
+    return result>0 ? static_cast<ssize_t>(result) : -EAGAIN;
+}
+
 void ATSAMSerial::IRQwrite(const char *str)
 {
     // We can reach here also with only kernel paused, so make sure
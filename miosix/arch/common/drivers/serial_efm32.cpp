@@ -176,6 +176,40 @@ ssize_t EFM32Serial::writeBlock(const void *buffer, size_t size, off_t where)
     return size;
 }
 
+ssize_t EFM32Serial::tryReadBlock(void *buffer, size_t size, off_t where)
+{
+    if(size==0) return 0;
+    if(rxMutex.tryLock()==false) return -EAGAIN;
+    char *buf=reinterpret_cast<char*>(buffer);
+    size_t result=0;
+    {
+        FastInterruptDisableLock dLock;
+        for(;result<size;result++)
+        {
+            if(rxQueue.tryGet(buf[result])==false) break;
+            //This is here just not to keep IRQ disabled for the whole loop
+            FastInterruptEnableLock eLock(dLock);
+        }
+    }
+    rxMutex.unlock();
+    return result>0 ? static_cast<ssize_t>(result) : -EAGAIN;
+}
+
+ssize_t EFM32Serial::tryWriteBlock(const void *buffer, size_t size, off_t where)
+{
+    if(size==0) return 0;
+    if(txMutex.tryLock()==false) return -EAGAIN;
+    const char *buf=reinterpret_cast<const char*>(buffer);
+    size_t result=0;
+    for(;result<size;result++)
+    {
+        if((port->STATUS & USART_STATUS_TXBL)==0) break;
+        port->TXDATA=*buf++;
+    }
+    txMutex.unlock();
+    return result>0 ? static_cast<ssize_t>(result) : -EAGAIN;
+}
+
 void EFM32Serial::IRQwrite(const char *str)
 {
     // We can reach here also with only kernel paused, so make sure
@@ -190,6 +190,46 @@ ssize_t LPC2000Serial::writeBlock(const void *buffer, size_t size, off_t where)
     return size;
 }
 
+ssize_t LPC2000Serial::tryReadBlock(void *buffer, size_t size, off_t where)
+{
+    if(size==0) return 0;
+    if(rxMutex.tryLock()==false) return -EAGAIN;
+    char *buf=reinterpret_cast<char*>(buffer);
+    size_t result=0;
+    {
+        FastInterruptDisableLock dLock;
+        for(;result<size;result++)
+        {
+            if(rxQueue.tryGet(buf[result])==false) break;
+            //This is here just not to keep IRQ disabled for the whole loop
+            FastInterruptEnableLock eLock(dLock);
+        }
+    }
+    rxMutex.unlock();
+    return result>0 ? static_cast<ssize_t>(result) : -EAGAIN;
+}
+
+ssize_t LPC2000Serial::tryWriteBlock(const void *buffer, size_t size, off_t where)
+{
+    if(size==0) return 0;
+    if(txMutex.tryLock()==false) return -EAGAIN;
+    const char *buf=reinterpret_cast<const char*>(buffer);
+    size_t result=0;
+    {
+        FastInterruptDisableLock dLock;
+        //If no data in software and hardware queue, fill hardware queue first
+        if((serial->LSR & (1<<5)) && (txQueue.isEmpty()))
+        {
+            for(int i=0;i<hwTxQueueLen && result<size;i++)
+                serial->THR=buf[result++];
+        }
+        for(;result<size;result++)
+            if(txQueue.IRQput(buf[result])==false) break;
+    }
+    txMutex.unlock();
+    return result>0 ? static_cast<ssize_t>(result) : -EAGAIN;
+}
+
 void LPC2000Serial::IRQwrite(const char *str)
 {
     while((*str)!='\0')
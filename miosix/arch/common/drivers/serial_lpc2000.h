@@ -74,6 +74,27 @@ public:
      */
     ssize_t writeBlock(const void *buffer, size_t size, off_t where);
     
+    /**
+     * Read a block of data without blocking
+     * \param buffer buffer where read data will be stored
+     * \param size buffer size
+     * \param where where to read from
+     * \return number of bytes read, -EAGAIN if the rx queue is empty or
+     * another thread is reading, or a negative number on failure
+     */
+    ssize_t tryReadBlock(void *buffer, size_t size, off_t where);
+    
+    /**
+     * Write a block of data without blocking. Characters are written as long
+     * as the hardware fifo or the tx software queue have room.
+     * \param buffer buffer where take data to write
+     * \param size buffer size
+     * \param where where to write to
+     * \return number of bytes written, -EAGAIN if no character could be
+     * written, or a negative number on failure
+     */
+    ssize_t tryWriteBlock(const void *buffer, size_t size, off_t where);
+    
     /**
      * Write a string.
      * An extension to the Device interface that adds a new member function,
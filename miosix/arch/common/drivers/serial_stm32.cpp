@@ -820,6 +820,66 @@ ssize_t STM32Serial::writeBlock(const void *buffer, size_t size, off_t where)
     return size;
 }
 
+ssize_t STM32Serial::tryReadBlock(void *buffer, size_t size, off_t where)
+{
+    if(size==0) return 0;
+    if(rxMutex.tryLock()==false) return -EAGAIN;
+    char *buf=reinterpret_cast<char*>(buffer);
+    size_t result=0;
+    {
+        FastInterruptDisableLock dLock;
+        for(;result<size;result++)
+        {
+            if(rxQueue.tryGet(buf[result])==false) break;
+            //This is here just not to keep IRQ disabled for the whole loop
+            FastInterruptEnableLock eLock(dLock);
+        }
+    }
+    rxMutex.unlock();
+    return result>0 ? static_cast<ssize_t>(result) : -EAGAIN;
+}
+
+ssize_t STM32Serial::tryWriteBlock(const void *buffer, size_t size, off_t where)
+{
+    if(size==0) return 0;
+    if(txMutex.tryLock()==false) return -EAGAIN;
+    DeepSleepLock dpLock;
+    const char *buf=reinterpret_cast<const char*>(buffer);
+    size_t result=0;
+    #ifdef SERIAL_DMA
+    if(dmaTx)
+    {
+        bool busy;
+        {
+            FastInterruptDisableLock dLock;
+            busy=dmaTxInProgress;
+        }
+        if(busy==false)
+        {
+            result=min(size,static_cast<size_t>(txBufferSize));
+            memcpy(txBuffer,buf,result);
+            writeDma(txBuffer,result);
+        }
+        txMutex.unlock();
+        return result>0 ? static_cast<ssize_t>(result) : -EAGAIN;
+    }
+    #endif //SERIAL_DMA
+    for(;result<size;result++)
+    {
+        #if !defined(_ARCH_CORTEXM7_STM32F7) && !defined(_ARCH_CORTEXM7_STM32H7) \
+         && !defined(_ARCH_CORTEXM0_STM32)   && !defined(_ARCH_CORTEXM4_STM32F3) \
+         && !defined(_ARCH_CORTEXM4_STM32L4)
+        if((port->SR & USART_SR_TXE)==0) break;
+        port->DR=*buf++;
+        #else //_ARCH_CORTEXM7_STM32F7/H7
+        if((port->ISR & USART_ISR_TXE)==0) break;
+        port->TDR=*buf++;
+        #endif //_ARCH_CORTEXM7_STM32F7/H7
+    }
+    txMutex.unlock();
+    return result>0 ? static_cast<ssize_t>(result) : -EAGAIN;
+}
+
 void STM32Serial::IRQwrite(const char *str)
 {
     // We can reach here also with only kernel paused, so make sure
@@ -866,6 +926,15 @@ void STM32Serial::IRQwrite(const char *str)
     if(interrupts) fastEnableInterrupts();
 }
 
+short STM32Serial::poll(short events, PollEntry *entry)
+{
+    if(events & (POLLIN | POLLRDNORM)) pollQueue.add(entry);
+    short result=events & (POLLOUT | POLLWRNORM);
+    FastInterruptDisableLock dLock;
+    if(rxQueue.isEmpty()==false) result|=events & (POLLIN | POLLRDNORM);
+    return result;
+}
+
 int STM32Serial::ioctl(int cmd, void* arg)
 {
     if(reinterpret_cast<unsigned>(arg) & 0b11) return -EFAULT; //Unaligned
@@ -949,6 +1018,12 @@ void STM32Serial::IRQhandleInterrupt()
                     Scheduler::IRQfindNextThread();
             rxWaiting=0;
         }
+        if(rxQueue.isEmpty()==false)
+        {
+            bool hppw=false;
+            pollQueue.IRQnotify(hppw);
+            if(hppw) Scheduler::IRQfindNextThread();
+        }
     }
 }
 
@@ -967,6 +1042,9 @@ void STM32Serial::IRQhandleDMArx()
 {
     IRQreadDma();
     idle=false;
+    bool hppw=false;
+    pollQueue.IRQnotify(hppw);
+    if(hppw) Scheduler::IRQfindNextThread();
     if(rxWaiting==0) return;
     rxWaiting->IRQwakeup();
     if(rxWaiting->IRQgetPriority()>Thread::IRQgetCurrentThread()->IRQgetPriority())
@@ -153,6 +153,28 @@ public:
      */
     ssize_t writeBlock(const void *buffer, size_t size, off_t where);
     
+    /**
+     * Read a block of data without blocking
+     * \param buffer buffer where read data will be stored
+     * \param size buffer size
+     * \param where where to read from
+     * \return number of bytes read, -EAGAIN if the rx queue is empty or
+     * another thread is reading, or a negative number on failure
+     */
+    ssize_t tryReadBlock(void *buffer, size_t size, off_t where);
+    
+    /**
+     * Write a block of data without blocking. Without DMA, characters are
+     * written as long as the transmit register is empty, with DMA at most
+     * one DMA buffer is queued, if no transfer is in progress.
+     * \param buffer buffer where take data to write
+     * \param size buffer size
+     * \param where where to write to
+     * \return number of bytes written, -EAGAIN if no character could be
+     * written, or a negative number on failure
+     */
+    ssize_t tryWriteBlock(const void *buffer, size_t size, off_t where);
+    
     /**
      * Write a string.
      * An extension to the Device interface that adds a new member function,
@@ -173,6 +195,16 @@ public:
      */
     int ioctl(int cmd, void *arg);
     
+    /**
+     * Check whether the serial port is ready for reading or writing.
+     * Writes never block waiting for other threads, so the port is always
+     * writable.
+     * \param events the events the caller is interested in
+     * \param entry entry to add to the PollQueue of the port, or nullptr
+     * \return the subset of events that are ready
+     */
+    short poll(short events, PollEntry *entry);
+    
     /**
      * \internal the serial port interrupts call this member function.
      * Never call this from user code.
@@ -262,6 +294,7 @@ private:
     DynUnsyncQueue<char> rxQueue;     ///< Receiving queue
     static const unsigned int rxQueueMin=16; ///< Minimum queue size
     Thread *rxWaiting=0;              ///< Thread waiting for rx, or 0
+    PollQueue pollQueue;              ///< Threads polling for rx
     
     USART_TypeDef *port;              ///< Pointer to USART peripheral
     #ifdef SERIAL_DMA
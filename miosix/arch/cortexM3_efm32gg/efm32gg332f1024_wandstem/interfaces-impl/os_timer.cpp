@@ -81,6 +81,24 @@ unsigned int osTimerGetFrequency()
     return b->getTimerFrequency();
 }
 
+long long IRQosTimerGetTick() noexcept
+{
+    //The virtual clock corrections are not linear in the hardware timer
+    //ticks, so convert back the corrected time
+    return tc.ns2tick(IRQgetTime());
+}
+
+TimeConversionFactor IRQosTimerGetTick2ns() noexcept
+{
+    return tc.getTick2nsConversion();
+}
+
+bool IRQosTimerGetRegisters(OsTimerRegisters& regs, long long& upperTick) noexcept
+{
+    //Processes can't apply the virtual clock corrections
+    return false;
+}
+
 } //namespace internal
 
 } //namespace miosix
@@ -183,6 +183,11 @@ inline unsigned int SyscallParameters::getThirdParameter() const
     return registers[2];
 }
 
+inline unsigned int SyscallParameters::getFourthParameter() const
+{
+    return registers[4]; //r12, as r3 holds the syscall id
+}
+
 inline void SyscallParameters::setReturnValue(unsigned int ret)
 {
     registers[0]=ret;
@@ -89,18 +89,41 @@ namespace miosix {
 /// Allows to enable/disable DevFs support to save code size
 /// By default it is defined (DevFs is enabled)
 #define WITH_DEVFS
-    
-/// \def SYNC_AFTER_WRITE
-/// Increases filesystem write robustness. After each write operation the
-/// filesystem is synced so that a power failure happens data is not lost
-/// (unless power failure happens exactly between the write and the sync)
-/// Unfortunately write latency and throughput becomes twice as worse
-/// By default it is defined (slow but safe)
-#define SYNC_AFTER_WRITE
-
-/// Maximum number of open files. Trying to open more will fail.
+
+/// Maximum number of open files per file descriptor table, that is per
+/// process. Trying to open more will fail. The table grows on demand, so
+/// increasing this value costs little RAM, and the limit can be lowered for
+/// each table with FileDescriptorTable::setMaxOpenFiles().
 /// Cannot be lower than 3, as the first three are stdin, stdout, stderr
-const unsigned char MAX_OPEN_FILES=8;
+const int MAX_OPEN_FILES=64;
+
+/// The file descriptor table grows in chunks of this many file descriptors
+const int FILE_TABLE_CHUNK_SIZE=8;
+
+/// Size in bytes of the buffer of pipes and FIFOs. Writes of up to this many
+/// bytes are atomic
+const unsigned int PIPE_BUFFER_SIZE=256;
+
+/// Number of 512 byte sectors in the write-back block cache between the Fat32
+/// filesystem and the block devices, shared by all mounted Fat32 volumes.
+/// Cannot be lower than 1
+const unsigned int FAT32_CACHE_SECTORS=8;
+
+/// Data written to Fat32 files is kept in memory and written back to the disk
+/// by a background thread once it has been dirty for this many milliseconds,
+/// unless the file was opened with O_SYNC or O_DSYNC, or fsync()/fdatasync()
+/// is called earlier. Lowering it reduces the data lost on power failure, at
+/// the cost of write throughput. Zero disables the background thread, so
+/// data is written back only on fsync() and close()
+const unsigned int FAT32_WRITEBACK_DEADLINE=5000;
+
+/// Maximum size in bytes of the map of which sectors of the FAT have free
+/// clusters, kept in RAM for each mounted Fat32 volume to allocate clusters
+/// and count the free space without scanning the FAT. The map has one bit per
+/// FAT sector, that is per 128 clusters, so 1024 bytes are enough for a 32GB
+/// volume with 32KB clusters. Volumes requiring a larger map are used without
+/// it. Zero disables the map
+const unsigned int FAT32_FREE_MAP_SIZE=1024;
 
 /// \def WITH_PROCESSES
 /// If uncommented enables support for processes as well as threads.
@@ -121,6 +144,36 @@ const unsigned char MAX_OPEN_FILES=8;
 #error Processes require devfs support
 #endif //defined(WITH_PROCESSES) && !defined(WITH_DEVFS)
 
+//
+// Memory allocation options
+//
+
+/// \def WITH_TLSF_ALLOCATOR
+/// Uncomment to replace the newlib malloc with a Two-Level Segregated Fit
+/// allocator, whose worst case allocation time is bounded and does not depend
+/// on heap size or usage, and that fragments less over long uptimes.
+/// By default it is not defined (newlib malloc is used)
+//#define WITH_TLSF_ALLOCATOR
+
+/// \def WITH_HEAP_TRACE
+/// Uncomment to record which call sites allocate heap memory, how much memory
+/// each one keeps allocated, and the most recent heap operations, to find
+/// memory leaks and the causes of fragmentation. See HeapTrace in
+/// util/heap_trace.h. Adds 8 bytes to each allocation, and requires the TLSF
+/// allocator. By default it is not defined (heap is not traced)
+//#define WITH_HEAP_TRACE
+
+/// Number of call sites tracked by HeapTrace. Allocations from further call
+/// sites are accounted together
+const unsigned int HEAP_TRACE_SITES=64;
+
+/// Number of most recent heap operations recorded by HeapTrace
+const unsigned int HEAP_TRACE_EVENTS=64;
+
+#if defined(WITH_HEAP_TRACE) && !defined(WITH_TLSF_ALLOCATOR)
+#error Heap trace requires the TLSF allocator
+#endif //defined(WITH_HEAP_TRACE) && !defined(WITH_TLSF_ALLOCATOR)
+
 //
 // C/C++ standard library I/O (stdin, stdout and stderr related)
 //
@@ -42,14 +42,36 @@ void EventQueue::post(function<void ()> event)
     cv.signal();
 }
 
+bool EventQueue::cancel(int id)
+{
+    Lock<FastMutex> l(m);
+    for(auto it=timers.begin();it!=timers.end();++it)
+    {
+        if(it->id!=id) continue;
+        timers.erase(it);
+        return true;
+    }
+    return false;
+}
+
 void EventQueue::run()
 {
     Lock<FastMutex> l(m);
     for(;;)
     {
-        while(events.empty()) cv.wait(l);
-        function<void ()> f=events.front();
-        events.pop_front();
+        function<void ()> f;
+        if(getDueTimer(f)==false)
+        {
+            if(events.empty())
+            {
+                //Sleep till the next timed event, or till something is posted
+                if(timers.empty()) cv.wait(l);
+                else cv.timedWait(l,timers.front().when);
+                continue;
+            }
+            f=events.front();
+            events.pop_front();
+        }
         {
             Unlock<FastMutex> u(l);
             f();
@@ -62,11 +84,60 @@ void EventQueue::runOne()
     function<void ()> f;
     {
         Lock<FastMutex> l(m);
-        if(events.empty()) return;
-        f=events.front();
-        events.pop_front();
+        if(getDueTimer(f)==false)
+        {
+            if(events.empty()) return;
+            f=events.front();
+            events.pop_front();
+        }
     }
     f();
 }
 
+int EventQueue::addTimer(function<void ()>& event, long long when,
+        long long period)
+{
+    //Allocate outside the lock
+    list<TimedEvent> l(1);
+    l.front().event.swap(event);
+    l.front().when=when;
+    l.front().period=period;
+    Lock<FastMutex> lock(m);
+    int id=nextId++;
+    l.front().id=id;
+    insertTimer(l);
+    cv.signal(); //The next timed event may have changed
+    return id;
+}
+
+void EventQueue::insertTimer(list<TimedEvent>& l)
+{
+    long long when=l.front().when;
+    auto it=timers.begin();
+    while(it!=timers.end() && it->when<=when) ++it;
+    timers.splice(it,l);
+}
+
+bool EventQueue::getDueTimer(function<void ()>& f)
+{
+    if(timers.empty()) return false;
+    long long now=getTime();
+    if(timers.front().when>now) return false;
+    if(timers.front().period==0)
+    {
+        f.swap(timers.front().event);
+        timers.pop_front();
+        return true;
+    }
+    f=timers.front().event;
+    //Reschedule without allocating, if we fell behind skip the missed periods
+    list<TimedEvent> l;
+    l.splice(l.begin(),timers,timers.begin());
+    TimedEvent& t=l.front();
+    t.when+=t.period;
+    if(t.when<=now) t.when=now+t.period;
+    insertTimer(l);
+    return true;
+}
+
 } //namespace miosix
@@ -55,7 +55,7 @@ public:
     /**
      * Constructor
      */
-    EventQueue() {}
+    EventQueue() : nextId(0) {}
 
     /**
      * Post an event to the queue. This function never blocks.
@@ -67,23 +67,80 @@ public:
     void post(std::function<void ()> event);
 
     /**
-     * This function blocks waiting for events being posted, and when available
-     * it calls the event function. To return from this event loop an event
-     * function must throw an exception.
+     * Post an event to the queue, that will be run after a delay.
+     * This function never blocks.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \param delayNs delay in nanoseconds after which the event is run
+     * \return an id that can be passed to cancel()
+     * \throws std::bad_alloc if there is not enough heap memory
+     */
+    int postDelayed(std::function<void ()> event, long long delayNs)
+    {
+        return postAt(event,getTime()+delayNs);
+    }
+
+    /**
+     * Post an event to the queue, that will be run at the given absolute time.
+     * This function never blocks.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \param absoluteNs absolute time in nanoseconds when the event is run
+     * \return an id that can be passed to cancel()
+     * \throws std::bad_alloc if there is not enough heap memory
+     */
+    int postAt(std::function<void ()> event, long long absoluteNs)
+    {
+        return addTimer(event,absoluteNs,0);
+    }
+
+    /**
+     * Post an event to the queue, that will be run periodically, the first
+     * time one period from now, until cancel() is called.
+     * This function never blocks.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \param periodNs period in nanoseconds, must be greater than zero
+     * \return an id that can be passed to cancel()
+     * \throws std::bad_alloc if there is not enough heap memory
+     */
+    int postPeriodic(std::function<void ()> event, long long periodNs)
+    {
+        return addTimer(event,getTime()+periodNs,periodNs);
+    }
+
+    /**
+     * Cancel an event posted with postDelayed(), postAt() or postPeriodic().
+     * \param id id returned when the event was posted
+     * \return true if the event was cancelled, false if it was not found,
+     * for example because it was not periodic and it was already run
+     */
+    bool cancel(int id);
+
+    /**
+     * This function blocks waiting for events being posted or for timed
+     * events to become due, and when available it calls the event function.
+     * To return from this event loop an event function must throw an
+     * exception.
      * 
      * \throws any exception that is thrown by the event functions
      */
     void run();
 
     /**
-     * Run at most one event. This function does not block.
+     * Run at most one event, either a due timed event or a posted one.
+     * This function does not block.
      * 
      * \throws any exception that is thrown by the event functions
      */
     void runOne();
 
     /**
-     * \return the number of events in the queue
+     * \return the number of events in the queue, not counting timed events
+     * that are not yet due
      */
     unsigned int size() const
     {
@@ -92,7 +149,8 @@ public:
     }
     
     /**
-     * \return true if the queue has no events
+     * \return true if the queue has no events, not counting timed events
+     * that are not yet due
      */
     bool empty() const
     {
@@ -100,11 +158,58 @@ public:
         return events.empty();
     }
 
+    /**
+     * \return the number of timed events that are waiting to become due
+     */
+    unsigned int pendingTimers() const
+    {
+        Lock<FastMutex> l(m);
+        return timers.size();
+    }
+
 private:
     EventQueue(const EventQueue&);
     EventQueue& operator= (const EventQueue&);
 
+    /**
+     * An event that has to be run at a given time
+     */
+    struct TimedEvent
+    {
+        std::function<void ()> event; ///< Event to run
+        long long when;               ///< When to run the event
+        long long period;             ///< Period, 0 if not periodic
+        int id;                       ///< Id returned to the caller
+    };
+
+    /**
+     * Add a timed event
+     * \param event event to run
+     * \param when absolute time when to run the event
+     * \param period period, 0 if not periodic
+     * \return the timed event id
+     */
+    int addTimer(std::function<void ()>& event, long long when,
+            long long period);
+
+    /**
+     * Move the only element of l in the timers list, keeping it sorted.
+     * Must be called with the mutex locked
+     * \param l list with exactly one element
+     */
+    void insertTimer(std::list<TimedEvent>& l);
+
+    /**
+     * If a timed event is due, get it, rescheduling it if it is periodic.
+     * Must be called with the mutex locked
+     * \param f the event will be stored here
+     * \return true if a timed event was due
+     */
+    bool getDueTimer(std::function<void ()>& f);
+
     std::list<std::function<void ()> > events; ///< Event queue
+    std::list<TimedEvent> timers; ///< Timed events, sorted by time
+    int nextId; ///< Id of the next timed event
     mutable FastMutex m; ///< Mutex for synchronisation
     ConditionVariable cv; ///< Condition variable for synchronisation
 };
@@ -112,56 +217,108 @@ private:
 /**
  * This class is to extract from FixedEventQueue code that
  * does not depend on the NumSlots template parameters.
+ * 
+ * Event slots are linked in a free list and in one FIFO list per priority
+ * band, so that posting and getting an event is O(1) in the number of slots.
  */
 template<unsigned SlotSize>
 class FixedEventQueueBase
 {
 protected:
     /**
-     * Constructor.
+     * An event that has to be run at a given time
+     */
+    struct TimedEvent
+    {
+        TimedEvent() : when(0), period(0), gen(0), priority(0), used(false) {}
+
+        Callback<SlotSize> event; ///< Event to run
+        long long when;           ///< When to run the event
+        long long period;         ///< Period, 0 if not periodic
+        unsigned short gen;       ///< Incremented every time the slot is used
+        unsigned char priority;   ///< Priority band of the event
+        bool used;                ///< True if the slot is in use
+    };
+
+    /**
+     * A priority band, FIFO list of event slots
+     */
+    struct Band
+    {
+        unsigned short head; ///< First slot in the band
+        unsigned short tail; ///< Last slot in the band
+    };
+
+    /**
+     * Constructor. The storage is owned by the derived class and can be not
+     * yet constructed, only links and bands are accessed, which are trivial.
+     * \param events pointer to event slots
+     * \param links pointer to slot links, one per event slot
+     * \param size number of event slots
+     * \param bands pointer to priority bands
+     * \param numBands number of priority bands
+     * \param timers pointer to timed events
+     * \param numTimers number of timed events
      */
-    FixedEventQueueBase() : put(0), get(0), n(0), waitingGet(0), waitingPut(0)
-    {}
+    FixedEventQueueBase(Callback<SlotSize> *events, unsigned short *links,
+            unsigned int size, Band *bands, unsigned int numBands,
+            TimedEvent *timers, unsigned int numTimers);
 
     /**
      * Post an event. Blocks if event queue is full.
      * \param event event to post
-     * \param events pointer to event queue
-     * \param size event queue size
+     * \param priority priority band of the event
      */
-    void postImpl(Callback<SlotSize>& event, Callback<SlotSize> *events,
-            unsigned int size);
+    void postImpl(Callback<SlotSize>& event, unsigned int priority);
 
     /**
      * Post an event from an interrupt, or with interrupts disabled.
      * \param event event to post
-     * \param events pointer to event queue
-     * \param size event queue size
+     * \param priority priority band of the event
      * \param hppw set to true if a higher priority thread is awakened,
      * otherwise the variable is not modified
      */
-    bool IRQpostImpl(Callback<SlotSize>& event, Callback<SlotSize> *events,
-            unsigned int size, bool *hppw=0);
+    bool IRQpostImpl(Callback<SlotSize>& event, unsigned int priority,
+            bool *hppw=0);
 
     /**
-     * This function blocks waiting for events being posted, and when available
-     * it calls the event function. To return from this event loop an event
-     * function must throw an exception.
+     * Post a timed event from an interrupt, or with interrupts disabled.
+     * \param event event to post
+     * \param when absolute time when to run the event
+     * \param period period, 0 if not periodic
+     * \param priority priority band of the event
+     * \param hppw set to true if a higher priority thread is awakened,
+     * otherwise the variable is not modified
+     * \return the timed event id, or -1 if there are no free timed events
+     */
+    int IRQpostTimerImpl(Callback<SlotSize>& event, long long when,
+            long long period, unsigned int priority, bool *hppw=0);
+
+    /**
+     * Cancel a timed event.
+     * \param id timed event id
+     * \return true if the timed event was cancelled
+     */
+    bool cancelImpl(int id);
+
+    /**
+     * This function blocks waiting for events being posted or for timed
+     * events to become due, and when available it calls the event function.
+     * To return from this event loop an event function must throw an
+     * exception.
      * 
-     * \param events pointer to event queue
-     * \param size event queue size
+     * \param minPriority only events with at least this priority are run
      * \throws any exception that is thrown by the event functions
      */
-    void runImpl(Callback<SlotSize> *events, unsigned int size);
+    void runImpl(unsigned int minPriority);
 
     /**
      * Run at most one event. This function does not block.
      * 
-     * \param events pointer to event queue
-     * \param size event queue size
+     * \param minPriority only events with at least this priority are run
      * \throws any exception that is thrown by the event functions
      */
-    void runOneImpl(Callback<SlotSize> *events, unsigned int size);
+    void runOneImpl(unsigned int minPriority);
 
     /**
      * \return the number of events in the queue
@@ -172,27 +329,92 @@ protected:
         return n;
     }
 
+    /**
+     * \param priority a priority band
+     * \return the priority band clamped to the available ones
+     */
+    unsigned int clamp(unsigned int priority) const
+    {
+        return priority<numBands ? priority : numBands-1;
+    }
+
 private:
     /**
      * To allow multiple threads waiting on put and get
      */
     struct WaitingList
     {
-        WaitingList *next; ///< Pointer to next element of the list
-        Thread *t;         ///< Thread waiting
-        bool token;        ///< To tolerate spurious wakeups
+        WaitingList *next;        ///< Pointer to next element of the list
+        Thread *t;                ///< Thread waiting
+        unsigned int minPriority; ///< Minimum event priority it accepts
+        bool token;               ///< To tolerate spurious wakeups
     };
 
-    unsigned int put; ///< Put position into events
-    unsigned int get; ///< Get position into events
-    unsigned int n;   ///< Number of occupied event slots
+    /**
+     * Get the next event to run, that is the highest priority one, with due
+     * timed events coming before queued events in the same priority band.
+     * Must be called with interrupts disabled.
+     * \param f the event will be stored here
+     * \param minPriority only events with at least this priority are taken
+     * \return true if an event was found
+     */
+    bool IRQgetEvent(Callback<SlotSize>& f, unsigned int minPriority);
+
+    /**
+     * Must be called with interrupts disabled.
+     * \param minPriority only events with at least this priority are checked
+     * \return the time when the next timed event is due, or -1 if there are
+     * no timed events
+     */
+    long long IRQnextTimer(unsigned int minPriority) const;
+
+    /**
+     * Add a thread to the list of threads waiting for an event. The list is
+     * sorted by thread priority, so events are handed to the highest priority
+     * consumer first. Must be called with interrupts disabled.
+     * \param w list item
+     */
+    void IRQaddGetter(WaitingList *w);
+
+    /**
+     * Wake the highest priority thread waiting for an event that accepts the
+     * given event priority, if any. Must be called with interrupts disabled.
+     * \param priority priority band of the event
+     * \param hppw set to true if a higher priority thread is awakened,
+     * otherwise the variable is not modified
+     */
+    void IRQwakeGetter(unsigned int priority, bool *hppw);
+
+    static const unsigned short none=0xffff; ///< End of slot list
+
+    Callback<SlotSize> * const events; ///< Event slots
+    unsigned short * const links;      ///< Slot links
+    Band * const bands;                ///< Priority bands
+    TimedEvent * const timers;         ///< Timed events
+    const unsigned short size;         ///< Number of event slots
+    const unsigned short numBands;     ///< Number of priority bands
+    const unsigned short numTimers;    ///< Number of timed events
+    unsigned short freeHead; ///< First free slot
+    unsigned int n;          ///< Number of occupied event slots
     WaitingList *waitingGet; ///< List of threads waiting to get an event
     WaitingList *waitingPut; ///< List of threads waiting to put an event
 };
 
+template<unsigned SlotSize>
+FixedEventQueueBase<SlotSize>::FixedEventQueueBase(Callback<SlotSize> *events,
+        unsigned short *links, unsigned int size, Band *bands,
+        unsigned int numBands, TimedEvent *timers, unsigned int numTimers)
+        : events(events), links(links), bands(bands), timers(timers),
+          size(size), numBands(numBands), numTimers(numTimers), freeHead(0),
+          n(0), waitingGet(0), waitingPut(0)
+{
+    for(unsigned int i=0;i<size;i++) links[i]=i+1<size ? i+1 : none;
+    for(unsigned int i=0;i<numBands;i++) bands[i].head=bands[i].tail=none;
+}
+
 template<unsigned SlotSize>
 void FixedEventQueueBase<SlotSize>::postImpl(Callback<SlotSize>& event,
-        Callback<SlotSize> *events, unsigned int size)
+        unsigned int priority)
 {
     //Not FastInterruptDisableLock as the operator= of the bound
     //parameters of the Callback may allocate
@@ -213,62 +435,101 @@ void FixedEventQueueBase<SlotSize>::postImpl(Callback<SlotSize>& event,
             }
         }
     }
-    IRQpostImpl(event,events,size);
+    IRQpostImpl(event,priority);
 }
 
 template<unsigned SlotSize>
 bool FixedEventQueueBase<SlotSize>::IRQpostImpl(Callback<SlotSize>& event,
-        Callback<SlotSize> *events, unsigned int size, bool *hppw)
+        unsigned int priority, bool *hppw)
 {
     if(n>=size) return false;
-    events[put]=event; //This may allocate memory
-    if(++put>=size) put=0;
+    unsigned short slot=freeHead;
+    freeHead=links[slot];
+    events[slot]=event; //This may allocate memory
+    links[slot]=none;
+    Band& band=bands[priority];
+    if(band.tail==none) band.head=slot; else links[band.tail]=slot;
+    band.tail=slot;
     n++;
-    if(waitingGet)
+    IRQwakeGetter(priority,hppw);
+    return true;
+}
+
+template<unsigned SlotSize>
+int FixedEventQueueBase<SlotSize>::IRQpostTimerImpl(Callback<SlotSize>& event,
+        long long when, long long period, unsigned int priority, bool *hppw)
+{
+    for(unsigned int i=0;i<numTimers;i++)
     {
-        Thread *t=Thread::IRQgetCurrentThread();
-        if(hppw && waitingGet->t->IRQgetPriority()>t->IRQgetPriority())
-            *hppw=true;
-        waitingGet->token=true;
-        waitingGet->t->IRQwakeup();
-        waitingGet=waitingGet->next;
+        if(timers[i].used) continue;
+        timers[i].event=event; //This may allocate memory
+        timers[i].when=when;
+        timers[i].period=period;
+        timers[i].priority=priority;
+        timers[i].used=true;
+        timers[i].gen++;
+        //Wake a thread in run() as the next timed event may have changed
+        IRQwakeGetter(priority,hppw);
+        return (timers[i].gen & 0x7fff)<<8 | i;
     }
+    return -1;
+}
+
+template<unsigned SlotSize>
+bool FixedEventQueueBase<SlotSize>::cancelImpl(int id)
+{
+    unsigned int i=id & 0xff;
+    //Not FastInterruptDisableLock as the destructor of the bound
+    //parameters of the Callback may deallocate
+    InterruptDisableLock dLock;
+    if(id<0 || i>=numTimers || timers[i].used==false) return false;
+    if((timers[i].gen & 0x7fff)!=(id>>8)) return false;
+    timers[i].used=false;
+    timers[i].event.clear();
     return true;
 }
 
 template<unsigned SlotSize>
-void FixedEventQueueBase<SlotSize>::runImpl(Callback<SlotSize> *events,
-        unsigned int size)
+void FixedEventQueueBase<SlotSize>::runImpl(unsigned int minPriority)
 {
     //Not FastInterruptDisableLock as the operator= of the bound
     //parameters of the Callback may allocate
     InterruptDisableLock dLock;
     for(;;)
     {
-        while(n<=0)
+        Callback<SlotSize> f;
+        if(IRQgetEvent(f,minPriority)==false)
         {
+            //Sleep till the next timed event, or till something is posted
+            long long next=IRQnextTimer(minPriority);
             WaitingList w;
             w.token=false;
             w.t=Thread::IRQgetCurrentThread();
-            w.next=waitingGet;
-            waitingGet=&w;
+            w.minPriority=minPriority;
+            IRQaddGetter(&w);
             while(w.token==false)
             {
-                Thread::IRQwait();
+                if(next<0)
                 {
-                    InterruptEnableLock eLock(dLock);
-                    Thread::yield();
+                    Thread::IRQwait();
+                    {
+                        InterruptEnableLock eLock(dLock);
+                        Thread::yield();
+                    }
+                } else if(Thread::IRQenableIrqAndTimedWait(dLock,next)==
+                        TimedWaitResult::Timeout) break;
+            }
+            if(w.token==false)
+            {
+                //Timeout, we are still in the list, remove ourselves
+                for(WaitingList **it=&waitingGet;*it;it=&(*it)->next)
+                {
+                    if(*it!=&w) continue;
+                    *it=w.next;
+                    break;
                 }
             }
-        }
-        Callback<SlotSize> f=events[get]; //This may allocate memory
-        if(++get>=size) get=0;
-        n--;
-        if(waitingPut)
-        {
-            waitingPut->token=true;
-            waitingPut->t->IRQwakeup();
-            waitingPut=waitingPut->next;
+            continue;
         }
         {
             InterruptEnableLock eLock(dLock);
@@ -278,26 +539,108 @@ void FixedEventQueueBase<SlotSize>::runImpl(Callback<SlotSize> *events,
 }
 
 template<unsigned SlotSize>
-void FixedEventQueueBase<SlotSize>::runOneImpl(Callback<SlotSize> *events,
-        unsigned int size)
+void FixedEventQueueBase<SlotSize>::runOneImpl(unsigned int minPriority)
 {
     Callback<SlotSize> f;
     {
         //Not FastInterruptDisableLock as the operator= of the bound
         //parameters of the Callback may allocate
         InterruptDisableLock dLock;
-        if(n<=0) return;
-        f=events[get]; //This may allocate memory
-        if(++get>=size) get=0;
-        n--;
-        if(waitingPut)
+        if(IRQgetEvent(f,minPriority)==false) return;
+    }
+    f();
+}
+
+template<unsigned SlotSize>
+bool FixedEventQueueBase<SlotSize>::IRQgetEvent(Callback<SlotSize>& f,
+        unsigned int minPriority)
+{
+    //Highest priority due timed event, the earliest one among equals
+    TimedEvent *due=0;
+    if(numTimers>0)
+    {
+        long long now=IRQgetTime();
+        for(unsigned int i=0;i<numTimers;i++)
         {
-            waitingPut->token=true;
-            waitingPut->t->IRQwakeup();
-            waitingPut=waitingPut->next;
+            TimedEvent& t=timers[i];
+            if(t.used==false || t.when>now || t.priority<minPriority) continue;
+            if(due==0 || t.priority>due->priority ||
+               (t.priority==due->priority && t.when<due->when)) due=&t;
         }
     }
-    f();
+    //Highest priority non empty band
+    int b=numBands-1;
+    while(b>=static_cast<int>(minPriority) && bands[b].head==none) b--;
+    if(due && static_cast<int>(due->priority)>=b)
+    {
+        f=due->event; //This may allocate memory
+        if(due->period==0) due->used=false;
+        else {
+            //If we fell behind skip the missed periods
+            long long now=IRQgetTime();
+            due->when+=due->period;
+            if(due->when<=now) due->when=now+due->period;
+        }
+        return true;
+    }
+    if(b<static_cast<int>(minPriority)) return false;
+    Band& band=bands[b];
+    unsigned short slot=band.head;
+    f=events[slot]; //This may allocate memory
+    band.head=links[slot];
+    if(band.head==none) band.tail=none;
+    links[slot]=freeHead;
+    freeHead=slot;
+    n--;
+    if(waitingPut)
+    {
+        waitingPut->token=true;
+        waitingPut->t->IRQwakeup();
+        waitingPut=waitingPut->next;
+    }
+    return true;
+}
+
+template<unsigned SlotSize>
+long long FixedEventQueueBase<SlotSize>::IRQnextTimer(
+        unsigned int minPriority) const
+{
+    long long result=-1;
+    for(unsigned int i=0;i<numTimers;i++)
+    {
+        const TimedEvent& t=timers[i];
+        if(t.used==false || t.priority<minPriority) continue;
+        if(result<0 || t.when<result) result=t.when;
+    }
+    return result;
+}
+
+template<unsigned SlotSize>
+void FixedEventQueueBase<SlotSize>::IRQaddGetter(WaitingList *w)
+{
+    //Insert after threads of higher or equal priority, FIFO among equals
+    WaitingList **it=&waitingGet;
+    while(*it && !((*it)->t->IRQgetPriority()<w->t->IRQgetPriority()))
+        it=&(*it)->next;
+    w->next=*it;
+    *it=w;
+}
+
+template<unsigned SlotSize>
+void FixedEventQueueBase<SlotSize>::IRQwakeGetter(unsigned int priority,
+        bool *hppw)
+{
+    for(WaitingList **it=&waitingGet;*it;it=&(*it)->next)
+    {
+        WaitingList *w=*it;
+        if(w->minPriority>priority) continue;
+        *it=w->next;
+        Thread *t=Thread::IRQgetCurrentThread();
+        if(hppw && w->t->IRQgetPriority()>t->IRQgetPriority()) *hppw=true;
+        w->token=true;
+        w->t->IRQwakeup();
+        return;
+    }
 }
 
 /**
@@ -314,21 +657,38 @@ void FixedEventQueueBase<SlotSize>::runOneImpl(Callback<SlotSize> *events,
  * Events are function that are posted by a thread through post() but executed
  * in the context of the thread that calls run() or runOne()
  * 
+ * Events can also be posted to run at a later time, or periodically. These
+ * timed events are stored separately from the queue, in NumTimers slots.
+ * 
+ * Events can be posted with a priority band, from 0 (the default and lowest)
+ * to NumPriorities-1. Events with higher priority are run first, events with
+ * the same priority are run in FIFO order. Threads calling run() can specify
+ * the minimum priority of the events they run, so that for example a high
+ * priority thread only runs urgent events while a low priority thread runs
+ * all of them. When an event is posted, it is handed to the highest priority
+ * thread among those waiting that accept the event priority.
+ * 
  * \param NumSlots maximum queue length
  * \param SlotSize size of the Callback objects. This limits the maximum number
  * of parameters that can be bound to a function. If you get compile-time
  * errors in callback.h, consider increasing this value. The default is 20
  * bytes, which is enough to bind a member function pointer, a "this" pointer
  * and two byte or pointer sized parameters.
+ * \param NumTimers maximum number of pending timed events. The default is
+ * zero, which disables timed events
+ * \param NumPriorities number of priority bands. The default is one, so all
+ * events are run in FIFO order
  */
-template<unsigned NumSlots, unsigned SlotSize=20>
+template<unsigned NumSlots, unsigned SlotSize=20, unsigned NumTimers=0,
+         unsigned NumPriorities=1>
 class FixedEventQueue : private FixedEventQueueBase<SlotSize>
 {
 public:
     /**
      * Constructor.
      */
-    FixedEventQueue() {}
+    FixedEventQueue() : FixedEventQueueBase<SlotSize>(events,links,NumSlots,
+            bands,NumPriorities,timers,NumTimers) {}
 
     /**
      * Post an event, blocking if the event queue is full.
@@ -339,10 +699,11 @@ public:
      * the restriction that they need to be callable from inside a
      * InterruptDisableLock without causing undefined behaviour, so they
      * must not, open files, print, ... but can allocate memory.
+     * \param priority priority band of the event
      */
-    void post(Callback<SlotSize> event)
+    void post(Callback<SlotSize> event, unsigned int priority=0)
     {
-        this->postImpl(event,events,NumSlots);
+        this->postImpl(event,this->clamp(priority));
     }
     
     /**
@@ -354,12 +715,13 @@ public:
      * the restriction that they need to be callable from inside a
      * InterruptDisableLock without causing undefined behaviour, so they
      * must not open files, print, ... but can allocate memory.
+     * \param priority priority band of the event
      * \return false if there was no space in the queue
      */
-    bool postNonBlocking(Callback<SlotSize> event)
+    bool postNonBlocking(Callback<SlotSize> event, unsigned int priority=0)
     {
         InterruptDisableLock dLock;
-        return this->IRQpostImpl(event,events,NumSlots);
+        return this->IRQpostImpl(event,this->clamp(priority));
     }
 
     /**
@@ -377,11 +739,12 @@ public:
      * constructors can allocate memory, while if the call is made from an
      * interrupt handler or a FastInterruptFisableLock memory allocation is
      * forbidden.
+     * \param priority priority band of the event
      * \return false if there was no space in the queue
      */
-    bool IRQpost(Callback<SlotSize> event)
+    bool IRQpost(Callback<SlotSize> event, unsigned int priority=0)
     {
-        return this->IRQpostImpl(event,events,NumSlots);
+        return this->IRQpostImpl(event,this->clamp(priority));
     }
     
     /**
@@ -402,38 +765,142 @@ public:
      * \param hppw returns true if a higher priority thread was awakened as
      * part of posting the event. Can be used inside an IRQ to call the
      * scheduler.
+     * \param priority priority band of the event
      * \return false if there was no space in the queue
      */
-    bool IRQpost(Callback<SlotSize> event, bool& hppw)
+    bool IRQpost(Callback<SlotSize> event, bool& hppw,
+            unsigned int priority=0)
     {
         hppw=false;
-        return this->IRQpostImpl(event,events,NumSlots,&hppw);
+        return this->IRQpostImpl(event,this->clamp(priority),&hppw);
     }
 
     /**
-     * This function blocks waiting for events being posted, and when available
-     * it calls the event function. To return from this event loop an event
-     * function must throw an exception.
+     * Post an event that will be run after a delay. This function never
+     * blocks. The same restrictions of postNonBlocking() apply to the
+     * operator= of the bound parameters.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \param delayNs delay in nanoseconds after which the event is run
+     * \param priority priority band of the event
+     * \return an id that can be passed to cancel(), or -1 if all the NumTimers
+     * timed event slots are in use
+     */
+    int postDelayed(Callback<SlotSize> event, long long delayNs,
+            unsigned int priority=0)
+    {
+        return postAt(event,getTime()+delayNs,priority);
+    }
+
+    /**
+     * Post an event that will be run at the given absolute time. This
+     * function never blocks. The same restrictions of postNonBlocking() apply
+     * to the operator= of the bound parameters.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \param absoluteNs absolute time in nanoseconds when the event is run
+     * \param priority priority band of the event
+     * \return an id that can be passed to cancel(), or -1 if all the NumTimers
+     * timed event slots are in use
+     */
+    int postAt(Callback<SlotSize> event, long long absoluteNs,
+            unsigned int priority=0)
+    {
+        InterruptDisableLock dLock;
+        return this->IRQpostTimerImpl(event,absoluteNs,0,
+                this->clamp(priority));
+    }
+
+    /**
+     * Post an event that will be run periodically, the first time one period
+     * from now, until cancel() is called. This function never blocks. The
+     * same restrictions of postNonBlocking() apply to the operator= of the
+     * bound parameters.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \param periodNs period in nanoseconds, must be greater than zero
+     * \param priority priority band of the event
+     * \return an id that can be passed to cancel(), or -1 if all the NumTimers
+     * timed event slots are in use
+     */
+    int postPeriodic(Callback<SlotSize> event, long long periodNs,
+            unsigned int priority=0)
+    {
+        InterruptDisableLock dLock;
+        return this->IRQpostTimerImpl(event,IRQgetTime()+periodNs,periodNs,
+                this->clamp(priority));
+    }
+
+    /**
+     * Same as postAt(), but can be called only with interrupts disabled or
+     * within an interrupt handler. The same restrictions of IRQpost() apply to
+     * the operator= of the bound parameters.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \param absoluteNs absolute time in nanoseconds when the event is run
+     * \param hppw returns true if a higher priority thread was awakened as
+     * part of posting the event. Can be used inside an IRQ to call the
+     * scheduler.
+     * \param priority priority band of the event
+     * \return an id that can be passed to cancel(), or -1 if all the NumTimers
+     * timed event slots are in use
+     */
+    int IRQpostAt(Callback<SlotSize> event, long long absoluteNs, bool& hppw,
+            unsigned int priority=0)
+    {
+        hppw=false;
+        return this->IRQpostTimerImpl(event,absoluteNs,0,this->clamp(priority),
+                &hppw);
+    }
+
+    /**
+     * Cancel an event posted with postDelayed(), postAt(), postPeriodic() or
+     * IRQpostAt().
+     * \param id id returned when the event was posted
+     * \return true if the event was cancelled, false if it was not found,
+     * for example because it was not periodic and it was already run
+     */
+    bool cancel(int id)
+    {
+        return this->cancelImpl(id);
+    }
+
+    /**
+     * This function blocks waiting for events being posted or for timed
+     * events to become due, and when available it calls the event function.
+     * To return from this event loop an event function must throw an
+     * exception.
      * 
+     * Multiple threads can call run() concurrently, also with different
+     * values of minPriority.
+     * 
+     * \param minPriority only events with at least this priority are run
      * \throws any exception that is thrown by the event functions
      */
-    void run()
+    void run(unsigned int minPriority=0)
     {
-        this->runImpl(events,NumSlots);
+        this->runImpl(this->clamp(minPriority));
     }
 
     /**
-     * Run at most one event. This function does not block.
+     * Run at most one event, either a due timed event or a posted one, the
+     * one with highest priority. This function does not block.
      * 
+     * \param minPriority only events with at least this priority are run
      * \throws any exception that is thrown by the event functions
      */
-    void runOne()
+    void runOne(unsigned int minPriority=0)
     {
-        this->runOneImpl(events,NumSlots);
+        this->runOneImpl(this->clamp(minPriority));
     }
     
     /**
-     * \return the number of events in the queue
+     * \return the number of events in the queue, not counting timed events
+     * that are not yet due
      */
     unsigned int size() const
     {
@@ -441,7 +908,8 @@ public:
     }
     
     /**
-     * \return true if the queue has no events
+     * \return true if the queue has no events, not counting timed events
+     * that are not yet due
      */
     unsigned int empty() const
     {
@@ -452,9 +920,382 @@ private:
     FixedEventQueue(const FixedEventQueue&);
     FixedEventQueue& operator= (const FixedEventQueue&);
 
-    Callback<SlotSize> events[NumSlots]; ///< Fixed size queue of events
+    //Timed event ids store the slot index in 8 bits
+    static_assert(NumTimers<=256,"Too many timers");
+    //Slot links are 16 bits, with 0xffff marking the end of a list
+    static_assert(NumSlots<0xffff,"Too many slots");
+    static_assert(NumPriorities>=1 && NumPriorities<=256,"Bad NumPriorities");
+
+    typedef typename FixedEventQueueBase<SlotSize>::TimedEvent TimedEvent;
+    typedef typename FixedEventQueueBase<SlotSize>::Band Band;
+
+    Callback<SlotSize> events[NumSlots]; ///< Event slots
+    unsigned short links[NumSlots];      ///< Slot links
+    Band bands[NumPriorities];           ///< Priority bands
+    /// Timed events, zero sized arrays are not allowed
+    TimedEvent timers[NumTimers>0 ? NumTimers : 1];
+};
+
+/**
+ * A variable sized event queue that does not allocate in the steady state.
+ * 
+ * Like EventQueue it grows as needed, but instead of storing events as
+ * std::function in a std::list, it stores them as Callback objects in
+ * preallocated slots. Slots are allocated from the heap in chunks of
+ * ChunkSize when all the existing ones are in use, and are then recycled
+ * through a free list and never returned to the heap until the queue is
+ * destroyed. Thus, once the queue has grown to the size required by the
+ * application, posting events never calls malloc. Optionally, the number of
+ * slots can be bounded, making post() block when the queue is full.
+ * 
+ * As it may allocate memory, it is not possible to post events from within
+ * interrupt service routines. For this, use FixedEventQueue.
+ * 
+ * This class acts as a synchronization point, multiple threads can post
+ * events, and multiple threads can call run() or runOne() (thread pooling).
+ * 
+ * Events are function that are posted by a thread through post() but executed
+ * in the context of the thread that calls run() or runOne()
+ * 
+ * \param SlotSize size of the Callback objects. This limits the maximum number
+ * of parameters that can be bound to a function. If you get compile-time
+ * errors in callback.h, consider increasing this value. The default is 20
+ * bytes, which is enough to bind a member function pointer, a "this" pointer
+ * and two byte or pointer sized parameters.
+ * \param ChunkSize number of slots allocated every time the queue grows
+ */
+template<unsigned SlotSize=20, unsigned ChunkSize=8>
+class PooledEventQueue
+{
+public:
+    /**
+     * Constructor
+     * \param maxChunks maximum number of chunks the queue can grow to, so the
+     * queue can hold at most maxChunks*ChunkSize events. Zero means no limit.
+     * \param initialChunks number of chunks to preallocate, to avoid heap
+     * allocations also while the queue is growing
+     * \throws std::bad_alloc if there is not enough heap memory
+     */
+    PooledEventQueue(unsigned int maxChunks=0, unsigned int initialChunks=0);
+
+    /**
+     * Post an event to the queue. Blocks only if the queue has a maximum size
+     * and it is full.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \throws std::bad_alloc if the queue needs to grow and there is not
+     * enough heap memory
+     */
+    void post(Callback<SlotSize> event);
+
+    /**
+     * Post an event to the queue, or return if the queue has a maximum size
+     * and it is full. This function never blocks.
+     * 
+     * \param event function function to be called in the thread that calls
+     * run() or runOne(). Bind can be used to bind parameters to the function.
+     * \return false if there was no space in the queue
+     * \throws std::bad_alloc if the queue needs to grow and there is not
+     * enough heap memory
+     */
+    bool postNonBlocking(Callback<SlotSize> event);
+
+    /**
+     * This function blocks waiting for events being posted, and when available
+     * it calls the event function. To return from this event loop an event
+     * function must throw an exception.
+     * 
+     * \throws any exception that is thrown by the event functions
+     */
+    void run();
+
+    /**
+     * Run at most one event. This function does not block.
+     * 
+     * \throws any exception that is thrown by the event functions
+     */
+    void runOne();
+
+    /**
+     * \return the number of events in the queue
+     */
+    unsigned int size() const
+    {
+        Lock<FastMutex> l(m);
+        return n;
+    }
+
+    /**
+     * \return true if the queue has no events
+     */
+    bool empty() const
+    {
+        Lock<FastMutex> l(m);
+        return n==0;
+    }
+
+    /**
+     * \return the number of event slots currently allocated, either in use or
+     * free. This is the memory footprint of the queue, in slots
+     */
+    unsigned int slots() const
+    {
+        Lock<FastMutex> l(m);
+        return numChunks*ChunkSize;
+    }
+
+    /**
+     * Destructor, frees all the slots
+     */
+    ~PooledEventQueue();
+
+private:
+    PooledEventQueue(const PooledEventQueue&);
+    PooledEventQueue& operator= (const PooledEventQueue&);
+
+    /**
+     * An event slot
+     */
+    struct Slot
+    {
+        Slot *next;                ///< Next slot in the event or free list
+        Callback<SlotSize> event;  ///< Posted event
+    };
+
+    /**
+     * A group of slots allocated together
+     */
+    struct Chunk
+    {
+        Chunk *next;               ///< Next allocated chunk
+        Slot slots[ChunkSize];     ///< Slots in this chunk
+    };
+
+    /**
+     * Returns a slot to the free list when going out of scope, so that slots
+     * are not lost if an event function throws
+     */
+    class SlotReleaser
+    {
+    public:
+        SlotReleaser(PooledEventQueue *q, Slot *s) : q(q), s(s) {}
+        ~SlotReleaser()
+        {
+            s->event.clear(); //Destroy bound parameters outside the lock
+            Lock<FastMutex> l(q->m);
+            q->releaseSlot(s);
+        }
+    private:
+        SlotReleaser(const SlotReleaser&);
+        SlotReleaser& operator= (const SlotReleaser&);
+
+        PooledEventQueue *q;
+        Slot *s;
+    };
+
+    /**
+     * Add the slots of a chunk to the free list.
+     * Must be called with the mutex locked
+     * \param c chunk
+     */
+    void addChunk(Chunk *c);
+
+    /**
+     * Get a free slot, growing the queue if needed and possible.
+     * Must be called with the mutex locked, may temporarily unlock it
+     * \param l lock on the mutex
+     * \return a free slot, or nullptr if the queue is at its maximum size
+     */
+    Slot *getFreeSlot(Lock<FastMutex>& l);
+
+    /**
+     * Add a filled slot at the end of the event list.
+     * Must be called with the mutex locked
+     * \param s slot
+     */
+    void enqueue(Slot *s);
+
+    /**
+     * Remove the slot at the front of the event list.
+     * Must be called with the mutex locked, and the list must not be empty
+     * \return the slot
+     */
+    Slot *dequeue();
+
+    /**
+     * Put a slot back into the free list.
+     * Must be called with the mutex locked
+     * \param s slot
+     */
+    void releaseSlot(Slot *s);
+
+    Slot *head;             ///< First event in the queue
+    Slot *tail;             ///< Last event in the queue
+    Slot *freeList;         ///< List of free slots
+    Chunk *chunks;          ///< List of allocated chunks
+    unsigned int n;         ///< Number of events in the queue
+    unsigned int numChunks; ///< Number of allocated chunks
+    unsigned int maxChunks; ///< Maximum number of chunks, 0 means no limit
+    bool growing;           ///< A thread is allocating a chunk
+    mutable FastMutex m;    ///< Mutex for synchronisation
+    ConditionVariable cvGet;///< To wait for events
+    ConditionVariable cvPut;///< To wait for free slots
 };
 
+template<unsigned SlotSize, unsigned ChunkSize>
+PooledEventQueue<SlotSize,ChunkSize>::PooledEventQueue(unsigned int maxChunks,
+        unsigned int initialChunks) : head(0), tail(0), freeList(0), chunks(0),
+        n(0), numChunks(0), maxChunks(maxChunks), growing(false)
+{
+    if(maxChunks>0 && initialChunks>maxChunks) initialChunks=maxChunks;
+    for(unsigned int i=0;i<initialChunks;i++) addChunk(new Chunk);
+}
+
+template<unsigned SlotSize, unsigned ChunkSize>
+void PooledEventQueue<SlotSize,ChunkSize>::post(Callback<SlotSize> event)
+{
+    Lock<FastMutex> l(m);
+    Slot *s;
+    while((s=getFreeSlot(l))==0) cvPut.wait(l);
+    s->event=event;
+    enqueue(s);
+}
+
+template<unsigned SlotSize, unsigned ChunkSize>
+bool PooledEventQueue<SlotSize,ChunkSize>::postNonBlocking(
+        Callback<SlotSize> event)
+{
+    Lock<FastMutex> l(m);
+    Slot *s=getFreeSlot(l);
+    if(s==0) return false;
+    s->event=event;
+    enqueue(s);
+    return true;
+}
+
+template<unsigned SlotSize, unsigned ChunkSize>
+void PooledEventQueue<SlotSize,ChunkSize>::run()
+{
+    for(;;)
+    {
+        Slot *s;
+        {
+            Lock<FastMutex> l(m);
+            while(n==0) cvGet.wait(l);
+            s=dequeue();
+        }
+        //The event is called directly from its slot to avoid copying it
+        SlotReleaser r(this,s);
+        s->event();
+    }
+}
+
+template<unsigned SlotSize, unsigned ChunkSize>
+void PooledEventQueue<SlotSize,ChunkSize>::runOne()
+{
+    Slot *s;
+    {
+        Lock<FastMutex> l(m);
+        if(n==0) return;
+        s=dequeue();
+    }
+    SlotReleaser r(this,s);
+    s->event();
+}
+
+template<unsigned SlotSize, unsigned ChunkSize>
+PooledEventQueue<SlotSize,ChunkSize>::~PooledEventQueue()
+{
+    while(chunks)
+    {
+        Chunk *c=chunks;
+        chunks=chunks->next;
+        delete c;
+    }
+}
+
+template<unsigned SlotSize, unsigned ChunkSize>
+void PooledEventQueue<SlotSize,ChunkSize>::addChunk(Chunk *c)
+{
+    c->next=chunks;
+    chunks=c;
+    numChunks++;
+    for(unsigned int i=0;i<ChunkSize;i++) releaseSlot(&c->slots[i]);
+}
+
+template<unsigned SlotSize, unsigned ChunkSize>
+typename PooledEventQueue<SlotSize,ChunkSize>::Slot *
+PooledEventQueue<SlotSize,ChunkSize>::getFreeSlot(Lock<FastMutex>& l)
+{
+    for(;;)
+    {
+        if(freeList)
+        {
+            Slot *s=freeList;
+            freeList=s->next;
+            return s;
+        }
+        if(maxChunks>0 && numChunks>=maxChunks) return 0;
+        if(growing)
+        {
+            //Another thread is allocating a chunk, wait for it
+            cvPut.wait(l);
+            continue;
+        }
+        //Allocate outside the lock to not stall consumers and other producers
+        growing=true;
+        Chunk *c;
+        #ifndef __NO_EXCEPTIONS
+        try {
+            Unlock<FastMutex> u(l);
+            c=new Chunk;
+        } catch(...) {
+            growing=false;
+            cvPut.broadcast();
+            throw;
+        }
+        #else //__NO_EXCEPTIONS
+        {
+            Unlock<FastMutex> u(l);
+            c=new Chunk;
+        }
+        #endif //__NO_EXCEPTIONS
+        growing=false;
+        addChunk(c);
+        cvPut.broadcast(); //Wake threads waiting for the chunk
+    }
+}
+
+template<unsigned SlotSize, unsigned ChunkSize>
+void PooledEventQueue<SlotSize,ChunkSize>::enqueue(Slot *s)
+{
+    s->next=0;
+    if(tail) tail->next=s; else head=s;
+    tail=s;
+    n++;
+    cvGet.signal();
+}
+
+template<unsigned SlotSize, unsigned ChunkSize>
+typename PooledEventQueue<SlotSize,ChunkSize>::Slot *
+PooledEventQueue<SlotSize,ChunkSize>::dequeue()
+{
+    Slot *s=head;
+    head=s->next;
+    if(head==0) tail=0;
+    n--;
+    return s;
+}
+
+template<unsigned SlotSize, unsigned ChunkSize>
+void PooledEventQueue<SlotSize,ChunkSize>::releaseSlot(Slot *s)
+{
+    s->next=freeList;
+    freeList=s;
+    cvPut.signal();
+}
+
 } //namespace miosix
 
 #endif //E20_H
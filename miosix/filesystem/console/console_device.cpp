@@ -28,6 +28,7 @@
 #include "console_device.h"
 #include "filesystem/ioctl.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <termios.h>
 
 using namespace std;
@@ -40,34 +41,67 @@ namespace miosix {
 
 TerminalDevice::TerminalDevice(intrusive_ref_ptr<Device> device)
         : FileBase(intrusive_ref_ptr<FilesystemBase>()), device(device),
-          mutex(), echo(true), binary(false), skipNewline(false) {}
+          mutex(), writeMutex(), echo(true), binary(false), skipNewline(false),
+          nonblock(false), pendingNewline(false) {}
 
 ssize_t TerminalDevice::write(const void *data, size_t length)
 {
-    if(binary) return device->writeBlock(data,length,0);
-    //No mutex here to avoid blocking writes while reads are in progress
+    //Writes are serialized with their own mutex, to avoid blocking writes
+    //while reads are in progress
+    if(nonblock==false)
+    {
+        Lock<FastMutex> l(writeMutex);
+        return writeLocked(data,length);
+    }
+    if(writeMutex.tryLock()==false) return -EAGAIN;
+    ssize_t result=writeLocked(data,length);
+    writeMutex.unlock();
+    return result;
+}
+
+ssize_t TerminalDevice::writeLocked(const void *data, size_t length)
+{
+    if(pendingNewline)
+    {
+        //Complete the \r\n that a previous write counted as written
+        ssize_t r=writeDevice("\n",1);
+        if(r<=0) return r;
+        pendingNewline=false;
+    }
+    if(binary) return writeDevice(data,length);
     const char *buffer=static_cast<const char*>(data);
     const char *start=buffer;
     //Try to write data in chunks, stop at every \n to replace with \r\n
     //Although it may be tempting to call echoBack() from here since it performs
     //a similar task, it is not possible, as echoBack() uses a class field,
-    //chunkStart, and write is not mutexed to allow concurrent writing
+    //chunkStart, that is protected by the read mutex.
+    //In non blocking mode the device may accept less characters than asked,
+    //if so return how many characters of the caller's buffer were written
     for(size_t i=0;i<length;i++,buffer++)
     {
         if(*buffer!='\n') continue;
         if(buffer>start)
         {
-            ssize_t r=device->writeBlock(start,buffer-start,0);
-            if(r<=0) return r;
+            ssize_t r=writeDevice(start,buffer-start);
+            if(r<=0) return shortWrite(data,start,r);
+            if(r<buffer-start) return shortWrite(data,start+r,r);
+        }
+        ssize_t r=writeDevice("\r\n",2);//Add \r\n
+        if(r<=0) return shortWrite(data,buffer,r);
+        if(r<2)
+        {
+            //The \r was written, so the \n is counted as written, and the
+            //next write completes it instead of writing \r\n again
+            pendingNewline=true;
+            return shortWrite(data,buffer+1,-EAGAIN);
         }
-        ssize_t r=device->writeBlock("\r\n",2,0);//Add \r\n
-        if(r<=0) return r;
         start=buffer+1;
     }
     if(buffer>start)
     {
-        ssize_t r=device->writeBlock(start,buffer-start,0);
-        if(r<=0) return r;
+        ssize_t r=writeDevice(start,buffer-start);
+        if(r<=0) return shortWrite(data,start,r);
+        if(r<buffer-start) return shortWrite(data,start+r,r);
     }
     return length;
 }
@@ -76,16 +110,30 @@ ssize_t TerminalDevice::read(void *data, size_t length)
 {
     if(binary)
     {
-        ssize_t result=device->readBlock(data,length,0);
+        ssize_t result=readDevice(data,length);
         if(echo && result>0) device->writeBlock(data,result,0);//Ignore write errors
         return result;
     }
-    Lock<FastMutex> l(mutex); //Reads are serialized
+    //Reads are serialized
+    if(nonblock==false)
+    {
+        Lock<FastMutex> l(mutex);
+        return readLine(data,length);
+    }
+    if(mutex.tryLock()==false) return -EAGAIN;
+    ssize_t result=readLine(data,length);
+    mutex.unlock();
+    return result;
+}
+
+ssize_t TerminalDevice::readLine(void *data, size_t length)
+{
     char *buffer=static_cast<char*>(data);
     size_t readBytes=0;
     for(;;)
     {
-        ssize_t r=device->readBlock(buffer+readBytes,length-readBytes,0);
+        ssize_t r=readDevice(buffer+readBytes,length-readBytes);
+        if(r==-EAGAIN && readBytes>0) return readBytes; //Partial line
         if(r<0) return r;
         pair<size_t,bool> result=normalize(buffer,readBytes,readBytes+r);
         readBytes=result.first;
@@ -107,6 +155,12 @@ int TerminalDevice::fstat(struct stat *pstat) const
 
 int TerminalDevice::isatty() const { return device->isatty(); }
 
+short TerminalDevice::poll(short events, PollEntry *entry)
+{
+    //In non binary mode a read may still block until a whole line is received
+    return device->poll(events,entry);
+}
+
 #endif //WITH_FILESYSTEM
 
 int TerminalDevice::ioctl(int cmd, void *arg)
@@ -131,6 +185,21 @@ int TerminalDevice::ioctl(int cmd, void *arg)
     return 0;
 }
 
+int TerminalDevice::fcntl(int cmd, int opt)
+{
+    switch(cmd)
+    {
+        case F_GETFL:
+            return O_RDWR | (nonblock ? O_NONBLOCK : 0);
+        case F_SETFL:
+            //Only O_NONBLOCK can be changed
+            nonblock=(opt & O_NONBLOCK) ? true : false;
+            return 0;
+        default:
+            return FileBase::fcntl(cmd,opt);
+    }
+}
+
 pair<size_t,bool> TerminalDevice::normalize(char *buffer, ssize_t begin,
         ssize_t end)
 {
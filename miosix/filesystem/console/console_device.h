@@ -31,6 +31,7 @@
 #include "config/miosix_settings.h"
 #include "filesystem/devfs/devfs.h"
 #include "kernel/sync.h"
+#include "kernel/slab.h"
 
 namespace miosix {
 
@@ -38,7 +39,7 @@ namespace miosix {
  * Teriminal device, proxy object supporting additional terminal-specific
  * features
  */
-class TerminalDevice : public FileBase
+class TerminalDevice : public FileBase, public SlabAllocated<TerminalDevice>
 {
 public:
     /**
@@ -91,6 +92,14 @@ public:
      */
     virtual int isatty() const;
     
+    /**
+     * Check whether the terminal is ready for reading or writing
+     * \param events the events the caller is interested in
+     * \param entry entry to add to the PollQueue of the device, or nullptr
+     * \return the subset of events that are ready
+     */
+    virtual short poll(short events, PollEntry *entry);
+    
     #endif //WITH_FILESYSTEM
     
     /**
@@ -101,6 +110,18 @@ public:
      */
     virtual int ioctl(int cmd, void *arg);
     
+    /**
+     * Perform various operations on a file descriptor. F_GETFL and F_SETFL
+     * are supported, to set or clear O_NONBLOCK. In non binary mode, a non
+     * blocking read returns the characters received so far even if they do
+     * not form a complete line, and backspace can only erase characters
+     * received by the same read.
+     * \param cmd specifies the operation to perform
+     * \param opt optional argument that some operation require
+     * \return the exact return value depends on CMD, -1 is returned on error
+     */
+    virtual int fcntl(int cmd, int opt);
+    
     /**
      * Enables or disables echo of commands on the terminal
      * \param echo true to enable echo, false to disable it
@@ -145,12 +166,67 @@ private:
      */
     void echoBack(const char *chunkEnd, const char *sep=0, size_t sepLen=0);
     
+    /**
+     * Read a line, or as many characters as available in non blocking mode.
+     * Must be called with mutex locked
+     * \param data buffer to store read data
+     * \param length the number of bytes to read
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    ssize_t readLine(void *data, size_t length);
+    
+    /**
+     * Write data, replacing \n with \r\n if not in binary mode.
+     * Must be called with writeMutex locked
+     * \param data buffer with data to write
+     * \param length the number of bytes to write
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    ssize_t writeLocked(const void *data, size_t length);
+    
+    /**
+     * Read from the device, honoring O_NONBLOCK
+     */
+    ssize_t readDevice(void *data, size_t length)
+    {
+        if(nonblock) return device->tryReadBlock(data,length,0);
+        return device->readBlock(data,length,0);
+    }
+    
+    /**
+     * Write to the device, honoring O_NONBLOCK
+     */
+    ssize_t writeDevice(const void *data, size_t length)
+    {
+        if(nonblock) return device->tryWriteBlock(data,length,0);
+        return device->writeBlock(data,length,0);
+    }
+    
+    /**
+     * Compute the return value of write() when the device accepted less
+     * characters than requested
+     * \param data the buffer passed to write()
+     * \param pos first character not written
+     * \param r return value of the last device write, or a negative number
+     * \return the number of characters written, or r if none was written
+     */
+    static ssize_t shortWrite(const void *data, const char *pos, ssize_t r)
+    {
+        ssize_t done=pos-static_cast<const char*>(data);
+        return done>0 ? done : r;
+    }
+    
     intrusive_ref_ptr<Device> device; ///< Underlying TTY device
     FastMutex mutex;                  ///< Mutex to serialze concurrent reads
+    FastMutex writeMutex;             ///< Mutex to serialze concurrent writes
     const char *chunkStart;           ///< First character to echo in echoBack()
     bool echo;                        ///< True if echo enabled
     bool binary;                      ///< True if binary mode enabled
     bool skipNewline;                 ///< Used by normalize()
+    bool nonblock;                    ///< True if O_NONBLOCK is set
+    bool pendingNewline;              ///< \n of a \r\n yet to be written
 };
 
 /**
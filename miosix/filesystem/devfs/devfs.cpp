@@ -30,6 +30,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include "filesystem/stringpart.h"
+#include "kernel/slab.h"
+#include "filesystem/pipe/pipe.h"
 
 using namespace std;
 
@@ -51,7 +53,7 @@ static void fillStatHelper(struct stat* pstat, unsigned int st_ino,
 /**
  * This file type is for reading and writing from devices
  */
-class DevFsFile : public FileBase
+class DevFsFile : public FileBase, public SlabAllocated<DevFsFile>
 {
 public:
     /**
@@ -82,6 +84,44 @@ public:
      */
     virtual ssize_t read(void *data, size_t len);
     
+    /**
+     * Write data from multiple buffers to the file, as a single write.
+     * \param iov buffers to write
+     * \param iovcnt number of buffers
+     * \return the number of written characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Read data from the file into multiple buffers, as a single read.
+     * \param iov buffers to fill
+     * \param iovcnt number of buffers
+     * \return the number of read characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Write data at a given position without moving the file pointer.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+    
+    /**
+     * Read data from a given position without moving the file pointer.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+    
     /**
      * Move file pointer, if the file supports random-access.
      * \param pos offset to sum to the beginning of the file, current position
@@ -113,8 +153,43 @@ public:
      * \return the exact return value depends on CMD, -1 is returned on error
      */
     virtual int ioctl(int cmd, void *arg);
+    
+    /**
+     * Perform various operations on a file descriptor. F_GETFL and F_SETFL
+     * are supported, to set or clear O_NONBLOCK
+     * \param cmd specifies the operation to perform
+     * \param opt optional argument that some operation require
+     * \return the exact return value depends on CMD, -1 is returned on error
+     */
+    virtual int fcntl(int cmd, int opt);
+    
+    /**
+     * Check whether the file is ready for reading or writing
+     * \param events the events the caller is interested in
+     * \param entry entry to add to the PollQueue of the file, or nullptr
+     * \return the subset of events that are ready
+     */
+    virtual short poll(short events, PollEntry *entry);
 
 private:
+    /**
+     * Read from the device, honoring O_NONBLOCK
+     */
+    ssize_t readDevice(void *data, size_t len, off_t where)
+    {
+        if(flags & O_NONBLOCK) return dev->tryReadBlock(data,len,where);
+        return dev->readBlock(data,len,where);
+    }
+    
+    /**
+     * Write to the device, honoring O_NONBLOCK
+     */
+    ssize_t writeDevice(const void *data, size_t len, off_t where)
+    {
+        if(flags & O_NONBLOCK) return dev->tryWriteBlock(data,len,where);
+        return dev->writeBlock(data,len,where);
+    }
+    
     intrusive_ref_ptr<Device> dev; ///< Device file
     off_t seekPoint;               ///< Seek point (note that off_t is 64bit)
     int flags;                     ///< File open flags
@@ -125,7 +200,7 @@ ssize_t DevFsFile::write(const void *data, size_t len)
     if((flags & _FWRITE)==0) return -EINVAL;
     if(seekPoint+static_cast<off_t>(len)<0)
         len=numeric_limits<off_t>::max()-seekPoint-len;
-    ssize_t result=dev->writeBlock(data,len,seekPoint);
+    ssize_t result=writeDevice(data,len,seekPoint);
     if(result>0 && ((flags & _NOSEEK)==0)) seekPoint+=result;
     return result;
 }
@@ -135,11 +210,80 @@ ssize_t DevFsFile::read(void *data, size_t len)
     if((flags & _FREAD)==0) return -EINVAL;
     if(seekPoint+static_cast<off_t>(len)<0)
         len=numeric_limits<off_t>::max()-seekPoint-len;
-    ssize_t result=dev->readBlock(data,len,seekPoint);
+    ssize_t result=readDevice(data,len,seekPoint);
     if(result>0 && ((flags & _NOSEEK)==0)) seekPoint+=result;
     return result;
 }
 
+ssize_t DevFsFile::writev(const struct iovec *iov, int iovcnt)
+{
+    if((flags & _FWRITE)==0) return -EINVAL;
+    //Pass the buffers straight to the device, with a single seek point update
+    off_t where=seekPoint;
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        size_t len=iov[i].iov_len;
+        if(len==0) continue;
+        if(where+static_cast<off_t>(len)<0)
+            len=numeric_limits<off_t>::max()-where;
+        ssize_t result=writeDevice(iov[i].iov_base,len,where);
+        if(result<0)
+        {
+            if(total>0) break;
+            return result;
+        }
+        total+=result;
+        if((flags & _NOSEEK)==0) where+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    seekPoint=where;
+    return total;
+}
+
+ssize_t DevFsFile::readv(const struct iovec *iov, int iovcnt)
+{
+    if((flags & _FREAD)==0) return -EINVAL;
+    off_t where=seekPoint;
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        size_t len=iov[i].iov_len;
+        if(len==0) continue;
+        if(where+static_cast<off_t>(len)<0)
+            len=numeric_limits<off_t>::max()-where;
+        ssize_t result=readDevice(iov[i].iov_base,len,where);
+        if(result<0)
+        {
+            if(total>0) break;
+            return result;
+        }
+        total+=result;
+        if((flags & _NOSEEK)==0) where+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    seekPoint=where;
+    return total;
+}
+
+ssize_t DevFsFile::pwrite(const void *data, size_t len, off_t pos)
+{
+    if((flags & _FWRITE)==0) return -EINVAL;
+    if(flags & _NOSEEK) return -ESPIPE;
+    if(pos+static_cast<off_t>(len)<0)
+        len=numeric_limits<off_t>::max()-pos;
+    return writeDevice(data,len,pos);
+}
+
+ssize_t DevFsFile::pread(void *data, size_t len, off_t pos)
+{
+    if((flags & _FREAD)==0) return -EINVAL;
+    if(flags & _NOSEEK) return -ESPIPE;
+    if(pos+static_cast<off_t>(len)<0)
+        len=numeric_limits<off_t>::max()-pos;
+    return readDevice(data,len,pos);
+}
+
 off_t DevFsFile::lseek(off_t pos, int whence)
 {
     if(flags & _NOSEEK) return -EBADF; //No seek support
@@ -176,6 +320,29 @@ int DevFsFile::ioctl(int cmd, void *arg)
     return dev->ioctl(cmd,arg);
 }
 
+int DevFsFile::fcntl(int cmd, int opt)
+{
+    switch(cmd)
+    {
+        case F_GETFL:
+            //Convert back from _FREAD, _FWRITE to O_RDONLY, O_WRONLY, ...
+            return ((flags & (_FREAD | _FWRITE))-1) | (flags & O_NONBLOCK);
+        case F_SETFL:
+            //Only O_NONBLOCK can be changed
+            flags=(flags & ~O_NONBLOCK) | (opt & O_NONBLOCK);
+            return 0;
+        default:
+            return FileBase::fcntl(cmd,opt);
+    }
+}
+
+short DevFsFile::poll(short events, PollEntry *entry)
+{
+    if((flags & _FREAD)==0) events&=~(POLLIN | POLLRDNORM);
+    if((flags & _FWRITE)==0) events&=~(POLLOUT | POLLWRNORM);
+    return dev->poll(events,entry);
+}
+
 //
 // class Device
 //
@@ -212,6 +379,16 @@ ssize_t Device::writeBlock(const void *buffer, size_t size, off_t where)
     return size; //Act as /dev/null
 }
 
+ssize_t Device::tryReadBlock(void *buffer, size_t size, off_t where)
+{
+    return readBlock(buffer,size,where);
+}
+
+ssize_t Device::tryWriteBlock(const void *buffer, size_t size, off_t where)
+{
+    return writeBlock(buffer,size,where);
+}
+
 void Device::IRQwrite(const char *str) {}
 
 int Device::ioctl(int cmd, void *arg)
@@ -219,6 +396,11 @@ int Device::ioctl(int cmd, void *arg)
     return -ENOTTY; //Means the operation does not apply to this descriptor
 }
 
+short Device::poll(short events, PollEntry *entry)
+{
+    return events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+}
+
 Device::~Device() {}
 
 #ifdef WITH_DEVFS
@@ -226,7 +408,8 @@ Device::~Device() {}
 /**
  * Directory class for DevFs 
  */
-class DevFsDirectory : public DirectoryBase
+class DevFsDirectory : public DirectoryBase,
+                       public SlabAllocated<DevFsDirectory>
 {
 public:
     /**
@@ -342,18 +525,24 @@ int DevFs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
         int flags, int mode)
 {
     if(flags & (O_APPEND | O_EXCL)) return -EACCES;
-    Lock<FastMutex> l(mutex);
-    if(name.empty()) //Trying to open the root directory of the fs
+    intrusive_ref_ptr<Device> dev;
     {
-        if(flags & (O_WRONLY | O_RDWR)) return -EACCES;
-        file=intrusive_ref_ptr<FileBase>(
-            new DevFsDirectory(shared_from_this(),
-                mutex,files,rootDirInode,parentFsMountpointInode));
-        return 0;
+        Lock<FastMutex> l(mutex);
+        if(name.empty()) //Trying to open the root directory of the fs
+        {
+            if(flags & (O_WRONLY | O_RDWR)) return -EACCES;
+            file=intrusive_ref_ptr<FileBase>(
+                new DevFsDirectory(shared_from_this(),
+                    mutex,files,rootDirInode,parentFsMountpointInode));
+            return 0;
+        }
+        map<StringPart,intrusive_ref_ptr<Device> >::iterator it=files.find(name);
+        if(it==files.end()) return -ENOENT;
+        dev=it->second;
     }
-    map<StringPart,intrusive_ref_ptr<Device> >::iterator it=files.find(name);
-    if(it==files.end()) return -ENOENT;
-    return it->second->open(file,shared_from_this(),flags,mode);
+    //Opening a FIFO may block waiting for the other end, which is opened
+    //through this same function, so the mutex must not be held here
+    return dev->open(file,shared_from_this(),flags,mode);
 }
 
 int DevFs::lstat(StringPart& name, struct stat *pstat)
@@ -400,6 +589,19 @@ int DevFs::rmdir(StringPart& name)
     return -EACCES; // No directories support in DevFs yet
 }
 
+int DevFs::mkfifo(StringPart& name, int mode)
+{
+    if(name.empty()) return -EEXIST;
+    for(unsigned int i=0;i<name.length();i++)
+        if(name[i]=='/')
+            return -EACCES; //DevFs does not support subdirectories
+    intrusive_ref_ptr<Device> fifo(new FifoDevice(mode));
+    Lock<FastMutex> l(mutex);
+    if(files.insert(make_pair(name,fifo)).second==false) return -EEXIST;
+    fifo->setFileInfo(atomicAddExchange(&inodeCount,1),filesystemId);
+    return 0;
+}
+
 #endif //WITH_DEVFS
 
 } //namespace miosix
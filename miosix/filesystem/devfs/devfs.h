@@ -81,7 +81,7 @@ public:
      * \param mode file permissions
      * \return 0 on success, or a negative number on failure
      */
-    int open(intrusive_ref_ptr<FileBase>& file,
+    virtual int open(intrusive_ref_ptr<FileBase>& file,
             intrusive_ref_ptr<FilesystemBase> fs, int flags, int mode);
     
     /**
@@ -89,7 +89,7 @@ public:
      * \param pstat file information is stored here
      * \return 0 on success, or a negative number on failure
      */
-    int fstat(struct stat *pstat) const;
+    virtual int fstat(struct stat *pstat) const;
     
     /**
      * Check whether the file refers to a terminal.
@@ -130,6 +130,32 @@ public:
      */
     virtual ssize_t writeBlock(const void *buffer, size_t size, off_t where);
     
+    /**
+     * Read a block of data without blocking, used for files opened with
+     * O_NONBLOCK. This default implementation calls readBlock(), and is
+     * suitable for devices that never block. Devices that may block, such as
+     * serial ports, must override it.
+     * \param buffer buffer where read data will be stored
+     * \param size buffer size
+     * \param where where to read from
+     * \return number of bytes read, -EAGAIN if no data is available, or a
+     * negative number on failure
+     */
+    virtual ssize_t tryReadBlock(void *buffer, size_t size, off_t where);
+    
+    /**
+     * Write a block of data without blocking, used for files opened with
+     * O_NONBLOCK. This default implementation calls writeBlock(), and is
+     * suitable for devices that never block. Devices that may block, such as
+     * serial ports, must override it.
+     * \param buffer buffer where take data to write
+     * \param size buffer size
+     * \param where where to write to
+     * \return number of bytes written, which may be less than size, -EAGAIN
+     * if no data could be written, or a negative number on failure
+     */
+    virtual ssize_t tryWriteBlock(const void *buffer, size_t size, off_t where);
+    
     /**
      * Write a string.
      * An extension to the Device interface that adds a new member function,
@@ -150,6 +176,18 @@ public:
      */
     virtual int ioctl(int cmd, void *arg);
     
+    /**
+     * Check whether the device is ready for reading or writing.
+     * The default implementation reports the device as always readable and
+     * writable. Devices that can block must override it, and if entry is not
+     * nullptr, add it to a PollQueue they notify, possibly from their IRQ,
+     * when their readiness changes, before checking readiness.
+     * \param events the events the caller is interested in (POLLIN, ...)
+     * \param entry entry to add to the PollQueue of the device, or nullptr
+     * \return the subset of events that are ready
+     */
+    virtual short poll(short events, PollEntry *entry);
+    
     /**
      * Destructor
      */
@@ -257,6 +295,14 @@ public:
      */
     virtual int rmdir(StringPart& name);
     
+    /**
+     * Create a named FIFO
+     * \param name FIFO name
+     * \param mode FIFO permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int mkfifo(StringPart& name, int mode);
+    
 private:
     
     FastMutex mutex;
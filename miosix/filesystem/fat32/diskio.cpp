@@ -5,12 +5,229 @@
 
 #include "diskio.h"
 #include "filesystem/ioctl.h"
+#include "kernel/sync.h"
 #include "config/miosix_settings.h"
+#include <cstring>
 
 #ifdef WITH_FILESYSTEM
 
 using namespace miosix;
 
+static_assert(FAT32_CACHE_SECTORS>=1,"FAT32_CACHE_SECTORS must be at least 1");
+
+/*
+ * FatFs only caches one sector per volume and one per file, so a write-back
+ * LRU cache of FAT32_CACHE_SECTORS sectors sits between it and the drives.
+ * Single sector transfers, which FatFs uses for the FAT, directories and
+ * partial sectors of file data, go through the cache. Multi sector transfers
+ * are only used for whole sectors of file data, and would just flush the
+ * cache, so they go straight to the drive, keeping the cache coherent.
+ * Sectors of the FAT are pinned, that is they are only evicted to make room
+ * for other FAT sectors once they take up half the cache, or when there is
+ * nothing else to evict, as FAT chain walks touch them over and over.
+ *
+ * Single sector transfers, including the write back of evicted sectors, are
+ * done with the cache lock held, so they are serialized across all drives.
+ * Multi sector transfers are done with the cache lock released, so that other
+ * threads can use the cache meanwhile. This relies on no other thread
+ * accessing the same sectors during the transfer, which holds as file data
+ * sectors belong to a single file, whose lock is held, and FatFs does not let
+ * a file be opened for writing more than once, or while it is open for
+ * reading. The free cluster scan reads the FAT holding the volume lock, which
+ * all FAT accesses take. Note that block device drivers also serialize their
+ * transfers, so transfers on the same drive never overlap.
+ */
+
+namespace {
+
+/**
+ * \internal
+ * A sector in the cache
+ */
+struct CacheEntry
+{
+    const DiskDrive *drv; ///< Drive the sector belongs to, nullptr if unused
+    DWORD sector;         ///< Sector address (LBA)
+    unsigned int lastUse; ///< Value of cacheClock when last accessed
+    bool dirty;           ///< Modified and not yet written to the drive
+    bool pinned;          ///< Sector belongs to the FAT
+    BYTE data[512] __attribute__((aligned(4))); ///< Sector content
+};
+
+/**
+ * \internal
+ * The sectors of the FAT of a drive, set by disk_cache_pin()
+ */
+struct PinnedRange
+{
+    const DiskDrive *drv; ///< Drive
+    DWORD first;          ///< First sector of the FAT
+    DWORD end;            ///< One past the last sector of the FAT
+    PinnedRange *next;    ///< Next drive
+};
+
+} //anon namespace
+
+static FastMutex cacheMutex;                     ///< Protects all the below
+static CacheEntry cache[FAT32_CACHE_SECTORS];    ///< Cached sectors
+static PinnedRange *pinnedRanges=nullptr;        ///< FATs of mounted drives
+static unsigned int cacheClock=0;                ///< Incremented at each access
+static DiskCacheStats stats;                     ///< Cache statistics
+
+/**
+ * \internal
+ * Read sectors from a drive, bypassing the cache
+ * \param drv drive
+ * \param buff data buffer
+ * \param sector first sector address
+ * \param count number of sectors
+ * \return RES_OK on success
+ */
+static DRESULT readSectors(const DiskDrive& drv, BYTE *buff, DWORD sector,
+        UINT count)
+{
+    size_t size=count*512;
+    off_t where=static_cast<off_t>(sector)*512;
+    ssize_t result;
+    if(drv.dev) result=drv.dev->readBlock(buff,size,where);
+    else result=drv.file->pread(buff,size,where);
+    return result==static_cast<ssize_t>(size) ? RES_OK : RES_ERROR;
+}
+
+/**
+ * \internal
+ * Write sectors to a drive, bypassing the cache
+ * \param drv drive
+ * \param buff data to write
+ * \param sector first sector address
+ * \param count number of sectors
+ * \return RES_OK on success
+ */
+static DRESULT writeSectors(const DiskDrive& drv, const BYTE *buff,
+        DWORD sector, UINT count)
+{
+    size_t size=count*512;
+    off_t where=static_cast<off_t>(sector)*512;
+    ssize_t result;
+    if(drv.dev) result=drv.dev->writeBlock(buff,size,where);
+    else result=drv.file->pwrite(buff,size,where);
+    return result==static_cast<ssize_t>(size) ? RES_OK : RES_ERROR;
+}
+
+/**
+ * \internal
+ * Flush the caches of a drive, if any, not including the block cache
+ * \param drv drive
+ * \return RES_OK on success
+ */
+static DRESULT syncDrive(const DiskDrive& drv)
+{
+    int result;
+    if(drv.dev) result=drv.dev->ioctl(IOCTL_SYNC,0);
+    else result=drv.file->ioctl(IOCTL_SYNC,0);
+    return result==0 ? RES_OK : RES_ERROR;
+}
+
+/**
+ * \internal
+ * \param drv drive
+ * \param sector sector address
+ * \return the sector if it is cached, or nullptr
+ */
+static CacheEntry *findSector(const DiskDrive *drv, DWORD sector)
+{
+    for(auto& e : cache) if(e.drv==drv && e.sector==sector) return &e;
+    return nullptr;
+}
+
+/**
+ * \internal
+ * \param drv drive
+ * \param sector sector address
+ * \return true if the sector belongs to the FAT of the drive
+ */
+static bool isPinned(const DiskDrive *drv, DWORD sector)
+{
+    for(PinnedRange *r=pinnedRanges;r;r=r->next)
+        if(r->drv==drv) return sector>=r->first && sector<r->end;
+    return false;
+}
+
+/**
+ * \internal
+ * Write a sector to the drive if it is dirty
+ * \param e sector
+ * \return RES_OK on success
+ */
+static DRESULT writeBack(CacheEntry *e)
+{
+    if(e->dirty==false) return RES_OK;
+    if(writeSectors(*e->drv,e->data,e->sector,1)!=RES_OK) return RES_ERROR;
+    e->dirty=false;
+    stats.writebacks++;
+    return RES_OK;
+}
+
+/**
+ * \internal
+ * Make room for a sector in the cache, evicting another one if needed
+ * \param drv drive
+ * \param sector sector address
+ * \return the cache entry, whose content is undefined, or nullptr if writing
+ * back the evicted sector failed
+ */
+static CacheEntry *allocateSector(const DiskDrive *drv, DWORD sector)
+{
+    bool pin=isPinned(drv,sector);
+    CacheEntry *victim=nullptr;
+    CacheEntry *lruPinned=nullptr, *lruUnpinned=nullptr;
+    unsigned int numPinned=0;
+    for(auto& e : cache)
+    {
+        if(e.drv==nullptr)
+        {
+            victim=&e;
+            break;
+        }
+        if(e.pinned) numPinned++;
+        CacheEntry *& lru= e.pinned ? lruPinned : lruUnpinned;
+        //Comparing ages works also when cacheClock wraps around
+        if(lru==nullptr || cacheClock-e.lastUse>cacheClock-lru->lastUse)
+            lru=&e;
+    }
+    if(victim==nullptr)
+    {
+        if(lruPinned && (lruUnpinned==nullptr
+            || (pin && numPinned>=FAT32_CACHE_SECTORS/2))) victim=lruPinned;
+        else victim=lruUnpinned;
+        if(writeBack(victim)!=RES_OK) return nullptr;
+    }
+    victim->drv=drv;
+    victim->sector=sector;
+    victim->dirty=false;
+    victim->pinned=pin;
+    return victim;
+}
+
+/**
+ * \internal
+ * Write all the dirty sectors of a drive, in ascending sector order
+ * \param drv drive
+ * \return RES_OK on success
+ */
+static DRESULT flushDrive(const DiskDrive *drv)
+{
+    for(;;)
+    {
+        CacheEntry *next=nullptr;
+        for(auto& e : cache)
+            if(e.drv==drv && e.dirty && (next==nullptr || e.sector<next->sector))
+                next=&e;
+        if(next==nullptr) return RES_OK;
+        if(writeBack(next)!=RES_OK) return RES_ERROR;
+    }
+}
+
 // #ifdef __cplusplus
 // extern "C" {
 // #endif
@@ -20,7 +237,7 @@ using namespace miosix;
 // * Initializes drive.
 // */
 //DSTATUS disk_initialize (
-//    intrusive_ref_ptr<FileBase> pdrv		/* Physical drive nmuber (0..) */
+//    DiskDrive pdrv		/* Physical drive nmuber (0..) */
 //)
 //{
 //    if(Disk::isAvailable()==false) return STA_NODISK;
@@ -34,7 +251,7 @@ using namespace miosix;
 // * Return status of drive.
 // */
 //DSTATUS disk_status (
-//    intrusive_ref_ptr<FileBase> pdrv		/* Physical drive nmuber (0..) */
+//    DiskDrive pdrv		/* Physical drive nmuber (0..) */
 //)
 //{
 //    if(Disk::isInitialized()) return RES_OK;
@@ -46,15 +263,39 @@ using namespace miosix;
  * Read one or more sectors from drive
  */
 DRESULT disk_read (
-    intrusive_ref_ptr<FileBase> pdrv,		/* Physical drive nmuber (0..) */
+    const DiskDrive& pdrv,		/* Physical drive nmuber (0..) */
 	BYTE *buff,		/* Data buffer to store read data */
 	DWORD sector,           /* Sector address (LBA) */
 	UINT count		/* Number of sectors to read (1..255) */
 )
 {
-    if(pdrv->lseek(static_cast<off_t>(sector)*512,SEEK_SET)<0) return RES_ERROR;
-    if(pdrv->read(buff,count*512)!=static_cast<ssize_t>(count)*512) return RES_ERROR;
-    return RES_OK;
+    const DiskDrive *drv=&pdrv;
+    Lock<FastMutex> l(cacheMutex);
+    if(count==1)
+    {
+        CacheEntry *e=findSector(drv,sector);
+        if(e) stats.hits++;
+        else {
+            stats.misses++;
+            if((e=allocateSector(drv,sector))==nullptr) return RES_ERROR;
+            if(readSectors(pdrv,e->data,sector,1)!=RES_OK)
+            {
+                e->drv=nullptr;
+                return RES_ERROR;
+            }
+        }
+        e->lastUse=++cacheClock;
+        memcpy(buff,e->data,512);
+        return RES_OK;
+    }
+    //Dirty sectors in the cache are newer than the drive content, so write
+    //them back first, as they could be evicted during the transfer
+    for(auto& e : cache)
+        if(e.drv==drv && e.sector-sector<count && writeBack(&e)!=RES_OK)
+            return RES_ERROR;
+    stats.bypassed+=count;
+    Unlock<FastMutex> u(l);
+    return readSectors(pdrv,buff,sector,count);
 }
 
 /**
@@ -62,15 +303,34 @@ DRESULT disk_read (
  * Write one or more sectors to drive
  */
 DRESULT disk_write (
-    intrusive_ref_ptr<FileBase> pdrv,		/* Physical drive nmuber (0..) */
+    const DiskDrive& pdrv,		/* Physical drive nmuber (0..) */
 	const BYTE *buff,	/* Data to be written */
 	DWORD sector,		/* Sector address (LBA) */
 	UINT count		/* Number of sectors to write (1..255) */
 )
 {
-    if(pdrv->lseek(static_cast<off_t>(sector)*512,SEEK_SET)<0) return RES_ERROR;
-    if(pdrv->write(buff,count*512)!=static_cast<ssize_t>(count)*512) return RES_ERROR;
-    return RES_OK;
+    const DiskDrive *drv=&pdrv;
+    Lock<FastMutex> l(cacheMutex);
+    if(count==1)
+    {
+        CacheEntry *e=findSector(drv,sector);
+        if(e) stats.hits++;
+        else {
+            stats.misses++;
+            if((e=allocateSector(drv,sector))==nullptr) return RES_ERROR;
+        }
+        e->lastUse=++cacheClock;
+        e->dirty=true;
+        memcpy(e->data,buff,512);
+        return RES_OK;
+    }
+    //Cached copies of the sectors are about to become stale, drop them before
+    //the transfer, so that a dirty one is not written back over the new data
+    for(auto& e : cache)
+        if(e.drv==drv && e.sector-sector<count) e.drv=nullptr;
+    stats.bypassed+=count;
+    Unlock<FastMutex> u(l);
+    return writeSectors(pdrv,buff,sector,count);
 }
 
 /**
@@ -78,7 +338,7 @@ DRESULT disk_write (
  * To perform disk functions other thar read/write
  */
 DRESULT disk_ioctl (
-    intrusive_ref_ptr<FileBase> pdrv,		/* Physical drive nmuber (0..) */
+    const DiskDrive& pdrv,		/* Physical drive nmuber (0..) */
 	BYTE ctrl,		/* Control code */
 	void *buff		/* Buffer to send/receive control data */
 )
@@ -86,7 +346,11 @@ DRESULT disk_ioctl (
     switch(ctrl)
     {
         case CTRL_SYNC:
-            if(pdrv->ioctl(IOCTL_SYNC,0)==0) return RES_OK; else return RES_ERROR;
+        {
+            Lock<FastMutex> l(cacheMutex);
+            if(flushDrive(&pdrv)!=RES_OK) return RES_ERROR;
+            return syncDrive(pdrv);
+        }
         case GET_SECTOR_COUNT:
             return RES_ERROR; //unimplemented, so f_mkfs() does not work
         case GET_BLOCK_SIZE:
@@ -96,6 +360,70 @@ DRESULT disk_ioctl (
     }
 }
 
+/**
+ * \internal
+ * Set the sectors of a drive that hold the FAT
+ */
+void disk_cache_pin (
+    const DiskDrive& pdrv,	/* Physical drive */
+	DWORD sector,		/* First sector of the FAT */
+	DWORD count		/* Number of sectors, for all the copies of the FAT */
+)
+{
+    const DiskDrive *drv=&pdrv;
+    Lock<FastMutex> l(cacheMutex);
+    PinnedRange *r=pinnedRanges;
+    while(r && r->drv!=drv) r=r->next;
+    if(r==nullptr)
+    {
+        r=new PinnedRange;
+        r->drv=drv;
+        r->next=pinnedRanges;
+        pinnedRanges=r;
+    }
+    r->first=sector;
+    r->end=sector+count;
+    for(auto& e : cache)
+        if(e.drv==drv) e.pinned=e.sector-sector<count;
+}
+
+/**
+ * \internal
+ * Write back and drop all the cached sectors of a drive, then sync it
+ */
+DRESULT disk_release (
+    const DiskDrive& pdrv	/* Physical drive */
+)
+{
+    const DiskDrive *drv=&pdrv;
+    Lock<FastMutex> l(cacheMutex);
+    DRESULT result=flushDrive(drv);
+    if(syncDrive(pdrv)!=RES_OK) result=RES_ERROR;
+    //Even if writing failed, sectors can't be kept as the drive may go away
+    for(auto& e : cache) if(e.drv==drv) e.drv=nullptr;
+    for(PinnedRange **r=&pinnedRanges;*r;r=&(*r)->next)
+    {
+        if((*r)->drv!=drv) continue;
+        PinnedRange *toDelete=*r;
+        *r=toDelete->next;
+        delete toDelete;
+        break;
+    }
+    return result;
+}
+
+/**
+ * \internal
+ * Get the statistics of the block cache
+ */
+void disk_cache_stats (
+	DiskCacheStats *s	/* Statistics are stored here */
+)
+{
+    Lock<FastMutex> l(cacheMutex);
+    *s=stats;
+}
+
 /**
  * \internal
  * Return current time, used to save file creation time
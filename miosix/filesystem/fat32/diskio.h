@@ -14,10 +14,19 @@
 
 #include "integer.h"
 #include <filesystem/file.h>
+#include <filesystem/devfs/devfs.h>
 #include "config/miosix_settings.h"
 
 #ifdef WITH_FILESYSTEM
 
+/* Drive a volume is on. Block devices are accessed directly, with a single
+   readBlock()/writeBlock() per transfer, while files, such as disk images
+   to loop mount, through pread()/pwrite(). Only one of the two is set */
+struct DiskDrive {
+	miosix::intrusive_ref_ptr<miosix::Device> dev;		/* Block device */
+	miosix::intrusive_ref_ptr<miosix::FileBase> file;	/* File */
+};
+
 
 /* Status of Disk Functions */
 typedef BYTE	DSTATUS;
@@ -36,14 +45,28 @@ typedef enum {
 /* Prototypes for disk control functions */
 
 
-DSTATUS disk_initialize (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv);
-DSTATUS disk_status (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv);
-DRESULT disk_read (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv,
-        BYTE*buff, DWORD sector, UINT count);
-DRESULT disk_write (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv,
-        const BYTE* buff, DWORD sector, UINT count);
-DRESULT disk_ioctl (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv,
-        BYTE cmd, void* buff);
+DSTATUS disk_initialize (const DiskDrive& pdrv);
+DSTATUS disk_status (const DiskDrive& pdrv);
+DRESULT disk_read (const DiskDrive& pdrv, BYTE*buff, DWORD sector, UINT count);
+DRESULT disk_write (const DiskDrive& pdrv, const BYTE* buff, DWORD sector,
+        UINT count);
+DRESULT disk_ioctl (const DiskDrive& pdrv, BYTE cmd, void* buff);
+
+
+/*---------------------------------------*/
+/* Block cache between FatFs and drives  */
+
+/* Block cache statistics, in sectors */
+typedef struct {
+	DWORD	hits;		/* Single sector transfers served by the cache */
+	DWORD	misses;		/* Single sector transfers that had to fill a cache entry */
+	DWORD	writebacks;	/* Dirty sectors written to the drives */
+	DWORD	bypassed;	/* Sectors of multi sector transfers, not cached */
+} DiskCacheStats;
+
+void disk_cache_pin (const DiskDrive& pdrv, DWORD sector, DWORD count);
+DRESULT disk_release (const DiskDrive& pdrv);
+void disk_cache_stats (DiskCacheStats *s);
 
 
 /* Disk Status Bits (DSTATUS) */
@@ -35,9 +35,14 @@
 #include <cstring>
 #include <string>
 #include <cstdio>
+#include <memory>
+#include <limits>
+#include <algorithm>
 #include "filesystem/stringpart.h"
 #include "filesystem/ioctl.h"
+#include "diskio.h"
 #include "util/unicode.h"
+#include "kernel/slab.h"
 
 using namespace std;
 
@@ -45,6 +50,8 @@ namespace miosix {
     
 #ifdef WITH_FILESYSTEM
 
+static_assert(_FS_LOCK>=MAX_OPEN_FILES,"_FS_LOCK in ffconf.h too small");
+
 /**
  * Translate between FATFS error codes and POSIX ones
  * \param ec FATS error code
@@ -79,7 +86,8 @@ static int translateError(int ec)
 /**
  * Directory class for Fat32Fs
  */
-class Fat32Directory : public DirectoryBase
+class Fat32Directory : public DirectoryBase,
+                       public SlabAllocated<Fat32Directory>
 {
 public:
     /**
@@ -182,14 +190,18 @@ Fat32Directory::~Fat32Directory()
 /**
  * Files of the Fat32Fs filesystem
  */
-class Fat32File : public FileBase
+class Fat32File : public FileBase, public SlabAllocated<Fat32File>
 {
 public:
     /**
      * Constructor
      * \param parent the filesystem to which this file belongs
+     * \param mutex volume mutex, to lock when accessing the FAT or directories
+     * \param flags file open flags, O_SYNC and O_DSYNC select when written
+     * data is written back to the disk
      */
-    Fat32File(intrusive_ref_ptr<FilesystemBase> parent, FastMutex& mutex);
+    Fat32File(intrusive_ref_ptr<FilesystemBase> parent, FastMutex& mutex,
+            int flags);
     
     /**
      * Write data to the file, if the file supports writing.
@@ -209,6 +221,44 @@ public:
      */
     virtual ssize_t read(void *data, size_t len);
     
+    /**
+     * Write data from multiple buffers to the file, as a single write.
+     * \param iov buffers to write
+     * \param iovcnt number of buffers
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Read data from the file into multiple buffers, as a single read.
+     * \param iov buffers to fill
+     * \param iovcnt number of buffers
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Write data at a given position without moving the file pointer.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+    
+    /**
+     * Read data from a given position without moving the file pointer.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+    
     /**
      * Move file pointer, if the file supports random-access.
      * \param pos offset to sum to the beginning of the file, current position
@@ -218,6 +268,18 @@ public:
      * completed, or a negative number in case of errors
      */
     virtual off_t lseek(off_t pos, int whence);
+
+    /**
+     * Allocate the clusters for a range of the file, as a contiguous run if
+     * possible, so that writing to it won't need to allocate clusters.
+     * \param mode 0 to extend the file with zeros if the range goes past the
+     * end of file, or FALLOC_FL_KEEP_SIZE to leave the file size unchanged,
+     * which also skips writing zeros
+     * \param offset start of the range
+     * \param len length of the range, must be positive
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fallocate(int mode, off_t offset, off_t len);
     
     /**
      * Return file information.
@@ -243,6 +305,54 @@ public:
      * \param inode file inode
      */
     void setInode(int inode) { this->inode=inode; }
+
+    /**
+     * Seek using a cluster link map, built at the first seek, instead of
+     * following the FAT chain
+     */
+    void enableFastSeek() { fastSeek=true; }
+
+    /**
+     * Apply the write-back policy after the file has been written: write back
+     * now if opened with O_SYNC or O_DSYNC, or else leave it to the
+     * background flusher. Must be called with the file mutex locked
+     * \return 0 on success, or a negative number on failure
+     */
+    int written();
+
+    /**
+     * Write back the file data and directory entry. Must be called with the
+     * file mutex locked, or with the volume mutex locked when no other thread
+     * can access the file
+     * \return 0 on success, or a negative number on failure
+     */
+    int sync();
+
+    /**
+     * Write back the file data, but the directory entry only if it is needed
+     * to read the data back, that is if the file size changed. Must be called
+     * with the file mutex locked
+     * \return 0 on success, or a negative number on failure
+     */
+    int dataSync();
+
+    /**
+     * Called by the background flusher, with the volume mutex locked, once
+     * the file has been dirty for longer than the write-back deadline. Errors
+     * are reported by the next fsync() or fdatasync()
+     * \return false if the file is in use by another thread, and thus was not
+     * written back, as taking the file mutex while holding the volume mutex
+     * could deadlock
+     */
+    bool writeBack()
+    {
+        if(fileMutex.tryLock()==false) return false;
+        if(int result=sync()) writebackError=result;
+        fileMutex.unlock();
+        return true;
+    }
+
+    Fat32Fs::DirtyFile dirty; ///< To be in the files to write back
     
     /**
      * Destructor
@@ -250,40 +360,130 @@ public:
     ~Fat32File();
     
 private:
+    /**
+     * Build the cluster link map, if fast seek is enabled and it is not
+     * already built
+     */
+    void buildLinkMap();
+
+    /**
+     * Drop the cluster link map, as FatFs can't extend a file while seeking
+     * with it. It will be built again at the next seek
+     */
+    void dropLinkMap();
+
     FIL file;
-    FastMutex& mutex;
+    FastMutex fileMutex; ///< Serializes accesses to this file
+    FastMutex& mutex;    ///< Volume mutex, always locked after fileMutex
+    Fat32Fs *fs;        ///< Parent filesystem
+    DWORD *linkMap;     ///< Cluster link map, or nullptr
+    DWORD syncedSize;   ///< File size when the directory entry was written
     int inode;
+    int flags;          ///< Open flags
+    int writebackError; ///< Error writing back in the background
+    bool fastSeek;      ///< Use a cluster link map to seek
+    bool preallocated;  ///< Clusters may be allocated past the end of file
 };
 
 //
 // class Fat32File
 //
 
-Fat32File::Fat32File(intrusive_ref_ptr<FilesystemBase> parent, FastMutex& mutex)
-        : FileBase(parent), mutex(mutex), inode(0) {}
+Fat32File::Fat32File(intrusive_ref_ptr<FilesystemBase> parent, FastMutex& mutex,
+        int flags) : FileBase(parent), mutex(mutex),
+        fs(static_cast<Fat32Fs*>(parent.get())), linkMap(nullptr),
+        syncedSize(0xffffffff), inode(0), flags(flags), writebackError(0),
+        fastSeek(false), preallocated(false)
+{
+    dirty.file=this;
+}
 
 ssize_t Fat32File::write(const void *data, size_t len)
 {
-    Lock<FastMutex> l(mutex);
+    Lock<FastMutex> l(fileMutex);
+    dropLinkMap();
     unsigned int bytesWritten;
     if(int res=translateError(f_write(&file,data,len,&bytesWritten))) return res;
-    #ifdef SYNC_AFTER_WRITE
-    if(f_sync(&file)!=FR_OK) return -EIO;
-    #endif //SYNC_AFTER_WRITE    
+    if(int res=written()) return res;
     return static_cast<int>(bytesWritten);
 }
 
 ssize_t Fat32File::read(void *data, size_t len)
 {
-    Lock<FastMutex> l(mutex);
+    Lock<FastMutex> l(fileMutex);
     unsigned int bytesRead;
     if(int res=translateError(f_read(&file,data,len,&bytesRead))) return res;
     return static_cast<int>(bytesRead);
 }
 
+ssize_t Fat32File::writev(const struct iovec *iov, int iovcnt)
+{
+    Lock<FastMutex> l(fileMutex);
+    dropLinkMap();
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        unsigned int bytesWritten;
+        int res=translateError(f_write(&file,iov[i].iov_base,iov[i].iov_len,
+                                       &bytesWritten));
+        if(res && total==0) return res;
+        total+=bytesWritten;
+        if(res || bytesWritten<iov[i].iov_len) break;
+    }
+    //Write back once for all the buffers
+    if(int res=written()) return res;
+    return total;
+}
+
+ssize_t Fat32File::readv(const struct iovec *iov, int iovcnt)
+{
+    Lock<FastMutex> l(fileMutex);
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        unsigned int bytesRead;
+        int res=translateError(f_read(&file,iov[i].iov_base,iov[i].iov_len,
+                                      &bytesRead));
+        if(res && total==0) return res;
+        total+=bytesRead;
+        if(res || bytesRead<iov[i].iov_len) break;
+    }
+    return total;
+}
+
+ssize_t Fat32File::pwrite(const void *data, size_t len, off_t pos)
+{
+    Lock<FastMutex> l(fileMutex);
+    //We don't support seek past EOF for Fat32
+    if(pos>static_cast<off_t>(f_size(&file))) return -EOVERFLOW;
+    dropLinkMap();
+    DWORD old=f_tell(&file);
+    if(int res=translateError(f_lseek(&file,pos))) return res;
+    unsigned int bytesWritten;
+    int res=translateError(f_write(&file,data,len,&bytesWritten));
+    if(int res2=translateError(f_lseek(&file,old))) return res2;
+    if(res) return res;
+    if(int res=written()) return res;
+    return static_cast<int>(bytesWritten);
+}
+
+ssize_t Fat32File::pread(void *data, size_t len, off_t pos)
+{
+    Lock<FastMutex> l(fileMutex);
+    if(pos>=static_cast<off_t>(f_size(&file))) return 0;
+    DWORD old=f_tell(&file);
+    if(pos!=static_cast<off_t>(old)) buildLinkMap();
+    if(int res=translateError(f_lseek(&file,pos))) return res;
+    unsigned int bytesRead;
+    int res=translateError(f_read(&file,data,len,&bytesRead));
+    if(int res2=translateError(f_lseek(&file,old))) return res2;
+    if(res) return res;
+    return static_cast<int>(bytesRead);
+}
+
 off_t Fat32File::lseek(off_t pos, int whence)
 {
-    Lock<FastMutex> l(mutex);
+    Lock<FastMutex> l(fileMutex);
     off_t offset;
     switch(whence)
     {
@@ -301,11 +501,48 @@ off_t Fat32File::lseek(off_t pos, int whence)
     }
     //We don't support seek past EOF for Fat32
     if(offset<0 || offset>static_cast<off_t>(f_size(&file))) return -EOVERFLOW;
+    if(offset!=static_cast<off_t>(f_tell(&file))) buildLinkMap();
     if(int result=translateError(
         f_lseek(&file,static_cast<unsigned long>(offset)))) return result;
     return offset;
 }
 
+int Fat32File::fallocate(int mode, off_t offset, off_t len)
+{
+    if(mode & ~FALLOC_FL_KEEP_SIZE) return -EOPNOTSUPP;
+    //Can't open files larger than INT_MAX
+    if(static_cast<long long>(offset)+len>numeric_limits<int>::max())
+        return -EFBIG;
+    DWORD end=offset+len;
+    Lock<FastMutex> l(fileMutex);
+    if((file.flag & FA_WRITE)==0) return -EBADF;
+    //FatFs allocates clusters from the start of the file, so the clusters
+    //before offset are allocated as well
+    //Also if f_expand fails, as it may have allocated some of the clusters
+    if(end>f_size(&file)) preallocated=true;
+    if(int res=translateError(f_expand(&file,end))) return res;
+    if((mode & FALLOC_FL_KEEP_SIZE)==0 && end>f_size(&file))
+    {
+        //Fill with zeros, the writes go straight to the allocated clusters
+        const unsigned int zeroSize=4096;
+        unique_ptr<char[]> zeros(new (nothrow) char[zeroSize]());
+        if(!zeros) return -ENOMEM;
+        dropLinkMap();
+        DWORD old=f_tell(&file);
+        int res=translateError(f_lseek(&file,f_size(&file)));
+        while(res==0 && f_size(&file)<end)
+        {
+            unsigned int bytesWritten;
+            res=translateError(f_write(&file,zeros.get(),
+                    min<DWORD>(end-f_size(&file),zeroSize),&bytesWritten));
+            if(res==0 && bytesWritten==0) res=-ENOSPC;
+        }
+        if(int res2=translateError(f_lseek(&file,old))) return res2;
+        if(res) return res;
+    }
+    return written();
+}
+
 int Fat32File::fstat(struct stat *pstat) const
 {
     memset(pstat,0,sizeof(struct stat));
@@ -321,26 +558,129 @@ int Fat32File::fstat(struct stat *pstat) const
 
 int Fat32File::ioctl(int cmd, void *arg)
 {
-    if(cmd!=IOCTL_SYNC) return -ENOTTY;
-    Lock<FastMutex> l(mutex);
-    return translateError(f_sync(&file));
+    Lock<FastMutex> l(fileMutex);
+    switch(cmd)
+    {
+        case IOCTL_SYNC:
+        case IOCTL_DATASYNC:
+        {
+            int error=writebackError;
+            writebackError=0;
+            int result= cmd==IOCTL_SYNC ? sync() : dataSync();
+            return result ? result : error;
+        }
+        case IOCTL_FAST_SEEK:
+            fastSeek=true;
+            return 0;
+        default:
+            return -ENOTTY;
+    }
 }
 
 Fat32File::~Fat32File()
 {
     Lock<FastMutex> l(mutex);
+    fs->markClean(this);
+    //Like Linux vfat, clusters preallocated past the end of file are freed
+    if(inode && preallocated) f_trim(&file);
     if(inode) f_close(&file); //TODO: what to do with error code?
+    delete[] linkMap;
+}
+
+int Fat32File::written()
+{
+    if(flags & O_SYNC) return sync();
+    #ifdef O_DSYNC
+    if(flags & O_DSYNC) return dataSync();
+    #endif //O_DSYNC
+    Lock<FastMutex> l(mutex);
+    fs->markDirty(this);
+    return 0;
+}
+
+int Fat32File::sync()
+{
+    Lock<FastMutex> l(mutex);
+    fs->markClean(this);
+    if(f_sync(&file)!=FR_OK)
+    {
+        //Try again later
+        fs->markDirty(this);
+        return -EIO;
+    }
+    syncedSize=f_size(&file);
+    return 0;
+}
+
+int Fat32File::dataSync()
+{
+    if(f_size(&file)!=syncedSize) return sync();
+    Lock<FastMutex> l(mutex);
+    if(f_datasync(&file)!=FR_OK) return -EIO;
+    //Only the modification time is left to write back
+    if(file.flag & FA__WRITTEN) fs->markDirty(this);
+    return 0;
+}
+
+void Fat32File::buildLinkMap()
+{
+    if(fastSeek==false || linkMap) return;
+    //Most files have few fragments, so try with a small table first, and
+    //walk the FAT chain a second time only if the file is more fragmented
+    const DWORD probeSize=16;
+    DWORD probe[probeSize];
+    probe[0]=probeSize;
+    file.cltbl=probe;
+    FRESULT res=f_lseek(&file,CREATE_LINKMAP);
+    file.cltbl=nullptr;
+    if(res!=FR_OK && res!=FR_NOT_ENOUGH_CORE) return;
+    DWORD size=probe[0]; //Number of items the table requires
+    //If there's not enough memory, just seek following the FAT chain
+    linkMap=new (nothrow) DWORD[size];
+    if(linkMap==nullptr) return;
+    if(res==FR_OK) memcpy(linkMap,probe,size*sizeof(DWORD));
+    else {
+        linkMap[0]=size;
+        file.cltbl=linkMap;
+        if(f_lseek(&file,CREATE_LINKMAP)!=FR_OK)
+        {
+            file.cltbl=nullptr;
+            dropLinkMap();
+            return;
+        }
+    }
+    file.cltbl=linkMap;
+}
+
+void Fat32File::dropLinkMap()
+{
+    file.cltbl=nullptr;
+    delete[] linkMap;
+    linkMap=nullptr;
 }
 
 //
 // class Fat32Fs
 //
 
+Fat32Fs::Fat32Fs(intrusive_ref_ptr<Device> disk)
+        : mutex(FastMutex::RECURSIVE), flusherThread(nullptr),
+          writebackDeadline(FAT32_WRITEBACK_DEADLINE*1000000LL),
+          quitFlusher(false), failed(true)
+{
+    filesystem.drv.dev=disk;
+    filesystem.mutex=&mutex;
+    mount();
+}
+
 Fat32Fs::Fat32Fs(intrusive_ref_ptr<FileBase> disk)
-        : mutex(FastMutex::RECURSIVE), failed(true)
+        : mutex(FastMutex::RECURSIVE), flusherThread(nullptr),
+          writebackDeadline(FAT32_WRITEBACK_DEADLINE*1000000LL),
+          quitFlusher(false), failed(true)
 {
-    filesystem.drv=disk;
-    failed=f_mount(&filesystem,1,false)!=FR_OK;
+    filesystem.drv.file=disk;
+    filesystem.mutex=&mutex;
+    mount();
 }
 
 int Fat32Fs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
@@ -375,7 +715,8 @@ int Fat32Fs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
         else if(flags & _FCREAT) openflags|=FA_OPEN_ALWAYS;//If !exists create
         else openflags|=FA_OPEN_EXISTING;//If not exists fail
 
-        intrusive_ref_ptr<Fat32File> f(new Fat32File(shared_from_this(),mutex));
+        intrusive_ref_ptr<Fat32File> f(
+            new Fat32File(shared_from_this(),mutex,flags));
         Lock<FastMutex> l(mutex);
         if(int res=translateError(f_open(&filesystem,f->fil(),name.c_str(),openflags)))
             return res;
@@ -389,9 +730,12 @@ int Fat32Fs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
         //Can't open files larger than INT_MAX
         if(static_cast<int>(f_size(f->fil()))<0) return -EOVERFLOW;
 
-        #ifdef SYNC_AFTER_WRITE
-        if(f_sync(f->fil())!=FR_OK) return -EFAULT;
-        #endif //SYNC_AFTER_WRITE
+        //Files opened read only can't grow, so always seek them fast
+        if((flags & _FWRITE)==0) f->enableFastSeek();
+
+        //Creating or truncating the file changed its directory entry
+        if(f->fil()->flag & FA__WRITTEN)
+            if(int result=f->written()) return result;
 
         //If file opened for appending, seek to end of file
         if(flags & _FAPPEND)
@@ -484,12 +828,130 @@ int Fat32Fs::rmdir(StringPart& name)
     return unlinkRmdirHelper(name,true);
 }
 
+int Fat32Fs::statvfs(struct statvfs *buf)
+{
+    if(failed) return -ENOENT;
+    Lock<FastMutex> l(mutex);
+    DWORD freeClusters;
+    if(int res=translateError(f_getfree(&filesystem,&freeClusters))) return res;
+    memset(buf,0,sizeof(struct statvfs));
+    buf->f_bsize=filesystem.csize*512;
+    buf->f_frsize=buf->f_bsize;
+    buf->f_blocks=filesystem.n_fatent-2;
+    buf->f_bfree=freeClusters;
+    buf->f_bavail=freeClusters;
+    buf->f_fsid=getFsId();
+    buf->f_namemax=_MAX_LFN;
+    return 0;
+}
+
+void Fat32Fs::setWritebackDeadline(unsigned int ms)
+{
+    Lock<FastMutex> l(mutex);
+    writebackDeadline=ms*1000000LL;
+    if(dirtyFiles.empty()) return;
+    if(flusherThread) flusherCond.signal();
+    else startFlusher();
+}
+
 Fat32Fs::~Fat32Fs()
 {
-    if(failed) return;
-    f_mount(&filesystem,0,true); //TODO: what to do with error code?
-    filesystem.drv->ioctl(IOCTL_SYNC,0);
-    filesystem.drv.reset();
+    if(flusherThread)
+    {
+        {
+            Lock<FastMutex> l(mutex);
+            quitFlusher=true;
+            flusherCond.signal();
+        }
+        flusherThread->join();
+    }
+    if(!failed) f_mount(&filesystem,0,true); //TODO: what to do with error code?
+    delete[] filesystem.fmap;
+    //Also if mounting failed, as sectors read while trying are in the cache
+    disk_release(filesystem.drv);
+    filesystem.drv.dev.reset();
+    filesystem.drv.file.reset();
+}
+
+void Fat32Fs::markDirty(Fat32File *file)
+{
+    if(file->dirty.since>=0) return;
+    file->dirty.since=getTime();
+    bool wasEmpty=dirtyFiles.empty();
+    dirtyFiles.push_back(&file->dirty);
+    if(writebackDeadline==0) return;
+    if(flusherThread==nullptr) startFlusher();
+    else if(wasEmpty) flusherCond.signal();
+}
+
+void Fat32Fs::markClean(Fat32File *file)
+{
+    if(file->dirty.since<0) return;
+    file->dirty.since=-1;
+    dirtyFiles.erase(IntrusiveList<DirtyFile>::iterator(&file->dirty));
+}
+
+void Fat32Fs::startFlusher()
+{
+    //If the thread can't be created, files are written back only on fsync()
+    //and close(), and another attempt is made when more files get dirty
+    flusherThread=Thread::create(flusherLauncher,STACK_DEFAULT_FOR_PTHREAD,
+            Priority(),this,Thread::JOINABLE);
+}
+
+void *Fat32Fs::flusherLauncher(void *arg)
+{
+    reinterpret_cast<Fat32Fs*>(arg)->flusher();
+    return nullptr;
+}
+
+void Fat32Fs::flusher()
+{
+    const unsigned int scanSectors=4; //FAT sectors scanned at a time
+    const long long scanPause=1000000LL; //1ms pause between chunks
+    const long long never=numeric_limits<long long>::max();
+    unique_ptr<BYTE[]> scanBuffer;
+    Lock<FastMutex> l(mutex);
+    //If there's not enough memory, the map is built as clusters are allocated
+    if(scanPending()) scanBuffer.reset(new (nothrow) BYTE[scanSectors*_MAX_SS]);
+    while(quitFlusher==false)
+    {
+        //Files are in the order they got dirty, so the first is the oldest
+        long long deadline=never;
+        if(!dirtyFiles.empty() && writebackDeadline!=0)
+            deadline=dirtyFiles.front()->since+writebackDeadline;
+        long long now=getTime();
+        if(now>=deadline)
+        {
+            if(dirtyFiles.front()->file->writeBack()==false)
+                flusherCond.timedWait(l,now+10000000LL); //Retry in 10ms
+        } else if(scanBuffer && scanPending()) {
+            f_scanfree(&filesystem,scanBuffer.get(),scanSectors);
+            if(scanPending()==false) scanBuffer.reset();
+            //Sleep between chunks, as yielding would not let lower priority
+            //threads run. Dirty files can still wake up the flusher earlier
+            flusherCond.timedWait(l,getTime()+scanPause);
+        } else if(deadline==never) flusherCond.wait(l);
+        else flusherCond.timedWait(l,deadline);
+    }
+}
+
+void Fat32Fs::mount()
+{
+    filesystem.fmap=nullptr;
+    failed=f_mount(&filesystem,1,false)!=FR_OK;
+    if(failed || filesystem.fs_type!=FS_FAT32) return;
+    unsigned int mapSize=(filesystem.fsize+7)/8;
+    if(mapSize>FAT32_FREE_MAP_SIZE) return;
+    //If there's not enough memory, clusters are allocated scanning the FAT
+    filesystem.fmap=new (nothrow) BYTE[mapSize];
+    if(filesystem.fmap==nullptr) return;
+    //Until scanned, every FAT sector may have free clusters
+    memset(filesystem.fmap,0xff,mapSize);
+    filesystem.fmap_scan=0;
+    filesystem.fmap_free=0;
+    Lock<FastMutex> l(mutex);
+    startFlusher();
 }
 
 int Fat32Fs::unlinkRmdirHelper(StringPart& name, bool delDir)
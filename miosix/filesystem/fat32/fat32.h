@@ -37,14 +37,28 @@ namespace miosix {
     
 #ifdef WITH_FILESYSTEM
 
+class Fat32File;
+
 /**
  * Fat32 Filesystem.
+ * Each open file has its own mutex, so that threads accessing different files
+ * only contend when reading or updating the FAT or directories, which is
+ * protected by the volume mutex. When both are needed, the file mutex is
+ * locked first.
  */
 class Fat32Fs : public FilesystemBase
 {
 public:
     /**
      * Constructor
+     * \param disk block device the filesystem is on, accessed directly
+     */
+    Fat32Fs(intrusive_ref_ptr<Device> disk);
+
+    /**
+     * Constructor
+     * \param disk file the filesystem is on, such as a disk image to loop
+     * mount
      */
     Fat32Fs(intrusive_ref_ptr<FileBase> disk);
     
@@ -98,11 +112,29 @@ public:
      * \return 0 on success, or a negative number on failure
      */
     virtual int rmdir(StringPart& name);
+
+    /**
+     * Obtain information on the filesystem. The free space is known without
+     * scanning the FAT if it was unmounted cleanly, or once the free cluster
+     * map has been built
+     * \param buf filesystem information is stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int statvfs(struct statvfs *buf);
     
     /**
      * \return true if the filesystem failed to mount 
      */
     bool mountFailed() const { return failed; }
+
+    /**
+     * Set after how long data written to files not opened with O_SYNC or
+     * O_DSYNC is written back to the disk by a background thread. The
+     * default is FAT32_WRITEBACK_DEADLINE
+     * \param ms deadline in milliseconds, or zero to write back data only
+     * on fsync(), fdatasync() and close()
+     */
+    void setWritebackDeadline(unsigned int ms);
     
     /**
      * Destructor
@@ -112,9 +144,72 @@ public:
 private:
     
     int unlinkRmdirHelper(StringPart& name, bool delDir);
-    
+
+    /**
+     * Mount the filesystem, called by the constructors. If the volume is
+     * FAT32 and its free cluster map fits in FAT32_FREE_MAP_SIZE bytes, also
+     * start building the map in the background
+     */
+    void mount();
+
+    /**
+     * \return true if the free cluster map is still being built
+     */
+    bool scanPending() const
+    {
+        return filesystem.fmap && filesystem.fmap_scan<filesystem.fsize;
+    }
+
+    /**
+     * Add a file to the files to write back, if not already there. Must be
+     * called with the mutex locked
+     * \param file file that has been written
+     */
+    void markDirty(Fat32File *file);
+
+    /**
+     * Remove a file from the files to write back. Must be called with the
+     * mutex locked
+     * \param file file that has been written back, or is being closed
+     */
+    void markClean(Fat32File *file);
+
+    /**
+     * Start the background flusher thread. Must be called with the mutex
+     * locked
+     */
+    void startFlusher();
+
+    /**
+     * Entry point of the background flusher thread
+     * \param arg the filesystem
+     */
+    static void *flusherLauncher(void *arg);
+
+    /**
+     * Write back files that have been dirty for longer than the deadline,
+     * and build the free cluster map while there's nothing to write back
+     */
+    void flusher();
+
+    /**
+     * Entry in the list of files to write back, one in each Fat32File
+     */
+    struct DirtyFile : public IntrusiveListItem
+    {
+        Fat32File *file=nullptr; ///< The file
+        long long since=-1;      ///< When the file got dirty, -1 if clean
+    };
+
+    friend class Fat32File;
+
     FATFS filesystem;
-    FastMutex mutex;
+    FastMutex mutex; ///< Volume mutex, for the FAT and directories
+    IntrusiveList<DirtyFile> dirtyFiles; ///< Files to write back, oldest first
+    ConditionVariable flusherCond;       ///< To wake the flusher thread
+    Thread *flusherThread;               ///< Background flusher, or nullptr
+    long long writebackDeadline;         ///< In nanoseconds, 0 if disabled
+    bool quitFlusher;                    ///< Asks the flusher to terminate
     bool failed; ///< Failed to mount
 };
 
@@ -928,6 +928,26 @@ DWORD get_fat (	/* 0xFFFFFFFF:Disk error, 1:Internal error, Else:Cluster status
 /*-----------------------------------------------------------------------*/
 #if !_FS_READONLY
 
+/* The free cluster map has a bit for each FAT sector, cleared only once the
+   sector is known to have no free cluster, so it is always safe to set it */
+
+static
+void fmap_changed (
+	FATFS* fs,	/* File system object with a free cluster map */
+	DWORD clst,	/* Cluster# that has been changed */
+	DWORD old,	/* Previous value of the cluster */
+	DWORD val	/* New value of the cluster */
+)
+{
+	DWORD sect = clst / (SS(fs) / 4);	/* FAT sector of the cluster */
+
+	if (val == 0) fs->fmap[sect / 8] |= 1 << (sect % 8);
+	if (sect < fs->fmap_scan && (old == 0) != (val == 0)) {	/* Keep the count of the scan right */
+		if (val == 0) fs->fmap_free++;
+		else fs->fmap_free--;
+	}
+}
+
 FRESULT put_fat (
 	FATFS* fs,	/* File system object */
 	DWORD clst,	/* Cluster# to be changed in range of 2 to fs->n_fatent - 1 */
@@ -969,6 +989,7 @@ FRESULT put_fat (
 			res = move_window(fs, fs->fatbase + (clst / (SS(fs) / 4)));
 			if (res != FR_OK) break;
 			p = &fs->win[clst * 4 % SS(fs)];
+			if (fs->fmap) fmap_changed(fs, clst, LD_DWORD(p) & 0x0FFFFFFF, val & 0x0FFFFFFF);
 			val |= LD_DWORD(p) & 0xF0000000;
 			ST_DWORD(p, val);
 			break;
@@ -1049,7 +1070,7 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 	DWORD clst			/* Cluster# to stretch. 0 means create a new chain. */
 )
 {
-	DWORD cs, ncl, scl;
+	DWORD cs, ncl, scl, eps, fsect;
 	FRESULT res;
 
 
@@ -1065,12 +1086,25 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 	}
 
 	ncl = scl;				/* Start cluster */
+	eps = SS(fs) / 4;		/* FAT entries per sector */
+	fsect = 0xFFFFFFFF;		/* FAT sector searched from its start, with no free cluster so far */
 	for (;;) {
 		ncl++;							/* Next cluster */
 		if (ncl >= fs->n_fatent) {		/* Wrap around */
 			ncl = 2;
 			if (ncl > scl) return 0;	/* No free cluster */
 		}
+		if (fs->fmap && (ncl % eps == 0 || ncl == 2)) {	/* Start of a FAT sector */
+			if (fsect != 0xFFFFFFFF)	/* The previous one has no free cluster */
+				fs->fmap[fsect / 8] &= ~(1 << (fsect % 8));
+			fsect = ncl / eps;
+			if (!(fs->fmap[fsect / 8] & (1 << (fsect % 8)))) {	/* Skip it without reading it */
+				if (scl >= ncl && scl / eps == fsect) return 0;	/* No free cluster */
+				ncl = fsect * eps + eps - 1;
+				fsect = 0xFFFFFFFF;
+				continue;
+			}
+		}
 		cs = get_fat(fs, ncl);			/* Get the cluster status */
 		if (cs == 0) break;				/* Found a free cluster */
 		if (cs == 0xFFFFFFFF || cs == 1)/* An error occurred */
@@ -1099,6 +1133,42 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 
 
 
+
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Access from file data transfers                        */
+/*-----------------------------------------------------------------------*/
+/* f_read(), f_write() and f_lseek() are called with only the lock of the
+   file held, so that transfers on different files can overlap, and take
+   the volume lock only while accessing the FAT. Within the contiguous run
+   of clusters allocated by f_expand(), the FAT is not accessed at all */
+
+static
+DWORD get_fat_locked (	/* Same as get_fat() */
+	FIL* fp,			/* Pointer to the file object */
+	DWORD clst			/* Cluster# to get the link information */
+)
+{
+	if (clst >= fp->crun_start && clst + 1 < fp->crun_end) return clst + 1;
+	miosix::Lock<miosix::FastMutex> l(*fp->fs->mutex);
+	return get_fat(fp->fs, clst);
+}
+
+#if !_FS_READONLY
+static
+DWORD create_chain_locked (	/* Same as create_chain() */
+	FIL* fp,			/* Pointer to the file object */
+	DWORD clst			/* Cluster# to stretch. 0 means create a new chain. */
+)
+{
+	if (clst >= fp->crun_start && clst + 1 < fp->crun_end) return clst + 1;
+	miosix::Lock<miosix::FastMutex> l(*fp->fs->mutex);
+	return create_chain(fp->fs, clst);
+}
+#endif /* !_FS_READONLY */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT handling - Convert offset into cluster with link map table        */
 /*-----------------------------------------------------------------------*/
@@ -1494,8 +1564,10 @@ BYTE sum_sfn (
 /*-----------------------------------------------------------------------*/
 
 static
-FRESULT dir_find (
-	DIR_* dp			/* Pointer to the directory object linked to the file name */
+FRESULT dir_scan (
+	DIR_* dp,			/* Pointer to the directory object linked to the file name */
+	WORD start,			/* Index of the first entry to compare */
+	WORD last			/* Index of the last entry to compare */
 )
 {
 	FRESULT res;
@@ -1504,7 +1576,7 @@ FRESULT dir_find (
 	BYTE a, ord, sum;
 #endif
 
-	res = dir_sdi(dp, 0);			/* Rewind directory object */
+	res = dir_sdi(dp, start);		/* Seek to the first entry */
 	if (res != FR_OK) return res;
 
 #if _USE_LFN
@@ -1541,6 +1613,7 @@ FRESULT dir_find (
 		if (!(dir[DIR_Attr] & AM_VOL) && !mem_cmp(dir, dp->fn, 11)) /* Is it a valid entry? */
 			break;
 #endif
+		if (dp->index >= last) { res = FR_NO_FILE; break; }	/* Reached the last entry */
 		res = dir_next(dp, 0);		/* Next entry */
 	} while (res == FR_OK);
 
@@ -1548,6 +1621,108 @@ FRESULT dir_find (
 }
 
 
+static
+FRESULT dir_find (
+	DIR_* dp			/* Pointer to the directory object linked to the file name */
+)
+{
+	return dir_scan(dp, 0, 0xFFFF);	/* Scan the whole directory */
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Cache of the objects found by name               */
+/*-----------------------------------------------------------------------*/
+/* Only where an object was found is remembered, the entry is then compared
+   with the name again, so hash collisions only cost a directory scan.
+   Entries don't move within a directory, and are invalidated when removed */
+#if _DCACHE_SIZE
+
+static
+DWORD dcache_hash (	/* Hash of the name to find, case insensitive as names are */
+	DIR_* dp		/* Directory object with the name to find */
+)
+{
+	DWORD h = 2166136261UL;	/* FNV-1a */
+	UINT i;
+
+#if _USE_LFN
+	if (dp->lfn) {
+		for (i = 0; dp->lfn[i]; i++) {
+			h ^= ff_wtoupper(dp->lfn[i]);
+			h *= 16777619UL;
+		}
+		return h;
+	}
+#endif
+	for (i = 0; i < 11; i++) {
+		h ^= dp->fn[i];
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+
+static
+FRESULT dir_find_cached (	/* Same as dir_find() */
+	DIR_* dp			/* Pointer to the directory object linked to the file name */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->fs;
+	DCENT *dc;
+	DWORD hash;
+	UINT i;
+
+
+	hash = dcache_hash(dp);
+	for (i = 0; i < _DCACHE_SIZE; i++) {
+		dc = &fs->dcache[i];
+		if (dc->index == 0xFFFF || dc->sclust != dp->sclust || dc->hash != hash) continue;
+		res = dir_scan(dp, (dc->lfn_idx == 0xFFFF) ? dc->index : dc->lfn_idx, dc->index);
+		if (res != FR_NO_FILE) return res;	/* Found, or an error occurred */
+		dc->index = 0xFFFF;				/* Another name with the same hash */
+		break;
+	}
+
+	res = dir_find(dp);
+	if (res == FR_OK) {					/* Remember where it was found */
+		dc = &fs->dcache[fs->dcache_next];
+		fs->dcache_next = (fs->dcache_next + 1) % _DCACHE_SIZE;
+		dc->sclust = dp->sclust;
+		dc->hash = hash;
+		dc->index = dp->index;
+#if _USE_LFN
+		dc->lfn_idx = dp->lfn_idx;
+#else
+		dc->lfn_idx = 0xFFFF;
+#endif
+	}
+	return res;
+}
+
+
+static
+void dcache_remove (
+	FATFS* fs,		/* File system object */
+	DWORD sclust,	/* Start cluster of the directory */
+	WORD idx		/* Index of the removed SFN entry, 0xFFFF for the whole directory */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < _DCACHE_SIZE; i++) {
+		if (fs->dcache[i].sclust == sclust && (idx == 0xFFFF || fs->dcache[i].index == idx))
+			fs->dcache[i].index = 0xFFFF;
+	}
+}
+
+#endif /* _DCACHE_SIZE */
+
+
 
 
 /*-----------------------------------------------------------------------*/
@@ -1700,6 +1875,9 @@ FRESULT dir_remove (	/* FR_OK: Successful, FR_DISK_ERR: A disk error */
 #if _USE_LFN	/* LFN configuration */
 	WORD i;
 
+#if _DCACHE_SIZE
+	dcache_remove(dp->fs, dp->sclust, dp->index);
+#endif
 	i = dp->index;	/* SFN index */
 	res = dir_sdi(dp, (WORD)((dp->lfn_idx == 0xFFFF) ? i : dp->lfn_idx));	/* Goto the SFN or top of the LFN entries */
 	if (res == FR_OK) {
@@ -1715,6 +1893,9 @@ FRESULT dir_remove (	/* FR_OK: Successful, FR_DISK_ERR: A disk error */
 	}
 
 #else			/* Non LFN configuration */
+#if _DCACHE_SIZE
+	dcache_remove(dp->fs, dp->sclust, dp->index);
+#endif
 	res = dir_sdi(dp, dp->index);
 	if (res == FR_OK) {
 		res = move_window(dp->fs, dp->sect);
@@ -2105,7 +2286,11 @@ FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 		for (;;) {
 			res = create_name(dp, &path);	/* Get a segment name of the path */
 			if (res != FR_OK) break;
+#if _DCACHE_SIZE
+			res = dir_find_cached(dp);		/* Find an object with the sagment name */
+#else
 			res = dir_find(dp);				/* Find an object with the sagment name */
+#endif
 			ns = dp->fn[NS];
 			if (res != FR_OK) {				/* Failed to find the object */
 				if (res == FR_NO_FILE) {	/* Object is not found */
@@ -2179,6 +2364,9 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	DSTATUS stat;
 	DWORD bsect, fasize, tsect, sysect, nclst, szbfat;
 	WORD nrsv;
+#if _DCACHE_SIZE
+	UINT i;
+#endif
 	//FATFS *fs;
 
 
@@ -2292,6 +2480,7 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	}
 	if (fs->fsize < (szbfat + (SS(fs) - 1)) / SS(fs))	/* (BPB_FATSz must not be less than required) */
 		return FR_NO_FILESYSTEM;
+	disk_cache_pin(fs->drv, fs->fatbase, fs->fsize * fs->n_fats);	/* Keep FAT sectors in the block cache */
 
 #if !_FS_READONLY
 	/* Initialize cluster allocation information */
@@ -2317,6 +2506,11 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 #endif
 	fs->fs_type = fmt;	/* FAT sub-type */
 	fs->id = miosix::atomicAddExchange(&Fsid,1)/*++Fsid*/;	/* File system mount ID */
+#if _DCACHE_SIZE
+	for (i = 0; i < _DCACHE_SIZE; i++)	/* Clear the directory entry cache */
+		fs->dcache[i].index = 0xFFFF;
+	fs->dcache_next = 0;
+#endif
 #if _FS_RPATH
 	fs->cdir = 0;		/* Current directory (root dir) */
 #endif
@@ -2535,6 +2729,7 @@ FRESULT f_open (
 			fp->fsize = LD_DWORD(dir+DIR_FileSize);	/* File size */
 			fp->fptr = 0;						/* File pointer */
 			fp->dsect = 0;
+			fp->crun_start = fp->crun_end = 0;	/* No known contiguous run */
 #if _USE_FASTSEEK
 			fp->cltbl = 0;						/* Normal seek mode */
 #endif
@@ -2562,7 +2757,7 @@ FRESULT f_read (
 {
 	FRESULT res;
 	DWORD clst, sect, remain;
-	UINT rcnt, cc;
+	UINT rcnt, cc, ncc;
 	BYTE csect, *rbuff = (BYTE*)buff;
 
 
@@ -2590,7 +2785,7 @@ FRESULT f_read (
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
 					else
 #endif
-						clst = get_fat(fp->fs, fp->clust);	/* Follow cluster chain on the FAT */
+						clst = get_fat_locked(fp, fp->clust);	/* Follow cluster chain on the FAT */
 				}
 				if (clst < 2) ABORT(fp->fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
@@ -2601,8 +2796,17 @@ FRESULT f_read (
 			sect += csect;
 			cc = btr / SS(fp->fs);				/* When remaining bytes >= sector size, */
 			if (cc) {							/* Read maximum contiguous sectors directly */
-				if (csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
-					cc = fp->fs->csize - csect;
+				if (csect + cc > fp->fs->csize) {	/* Clip at cluster boundary, */
+					ncc = fp->fs->csize - csect;
+					while (ncc < cc) {			/* unless the following clusters are contiguous */
+						clst = get_fat_locked(fp, fp->clust);
+						if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
+						if (clst != fp->clust + 1 || clst >= fp->fs->n_fatent) break;
+						fp->clust = clst;
+						ncc += (cc - ncc < fp->fs->csize) ? cc - ncc : fp->fs->csize;
+					}
+					cc = ncc;
+				}
 				if (disk_read(fp->fs->drv, rbuff, sect, cc))
 					ABORT(fp->fs, FR_DISK_ERR);
 #if !_FS_READONLY && _FS_MINIMIZE <= 2			/* Replace one of the read sectors with cached data if it contains a dirty sector */
@@ -2663,7 +2867,7 @@ FRESULT f_write (
 {
 	FRESULT res;
 	DWORD clst, sect;
-	UINT wcnt, cc;
+	UINT wcnt, cc, ncc;
 	const BYTE *wbuff = (const BYTE*)buff;
 	BYTE csect;
 
@@ -2686,14 +2890,14 @@ FRESULT f_write (
 				if (fp->fptr == 0) {		/* On the top of the file? */
 					clst = fp->sclust;		/* Follow from the origin */
 					if (clst == 0)			/* When no cluster is allocated, */
-						fp->sclust = clst = create_chain(fp->fs, 0);	/* Create a new cluster chain */
+						fp->sclust = clst = create_chain_locked(fp, 0);	/* Create a new cluster chain */
 				} else {					/* Middle or end of the file */
 #if _USE_FASTSEEK
 					if (fp->cltbl)
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
 					else
 #endif
-						clst = create_chain(fp->fs, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+						clst = create_chain_locked(fp, fp->clust);	/* Follow or stretch cluster chain on the FAT */
 				}
 				if (clst == 0) break;		/* Could not allocate a new cluster (disk full) */
 				if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
@@ -2715,8 +2919,21 @@ FRESULT f_write (
 			sect += csect;
 			cc = btw / SS(fp->fs);			/* When remaining bytes >= sector size, */
 			if (cc) {						/* Write maximum contiguous sectors directly */
-				if (csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
-					cc = fp->fs->csize - csect;
+				if (csect + cc > fp->fs->csize) {	/* Clip at cluster boundary, */
+					ncc = fp->fs->csize - csect;
+#if _USE_FASTSEEK
+					if (!fp->cltbl)
+#endif
+					while (ncc < cc) {		/* unless the following clusters are contiguous */
+						clst = create_chain_locked(fp, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+						if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
+						if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
+						if (clst != fp->clust + 1 || clst >= fp->fs->n_fatent) break;
+						fp->clust = clst;
+						ncc += (cc - ncc < fp->fs->csize) ? cc - ncc : fp->fs->csize;
+					}
+					cc = ncc;
+				}
 				if (disk_write(fp->fs->drv, wbuff, sect, cc))
 					ABORT(fp->fs, FR_DISK_ERR);
 #if _FS_MINIMIZE <= 2
@@ -2815,6 +3032,258 @@ FRESULT f_sync (
 	LEAVE_FF(fp->fs, res);
 }
 
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Synchronize the File Data                                             */
+/*-----------------------------------------------------------------------*/
+/* Unlike f_sync(), the directory entry is not updated, so this is only
+   enough when the file size and start cluster have not changed */
+
+FRESULT f_datasync (
+	FIL* fp		/* Pointer to the file object */
+)
+{
+	FRESULT res;
+
+
+	res = validate(fp);					/* Check validity of the object */
+	if (res == FR_OK) {
+#if !_FS_TINY
+		if (fp->flag & FA__DIRTY) {		/* Write-back dirty buffer */
+			if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1))
+				LEAVE_FF(fp->fs, FR_DISK_ERR);
+			fp->flag &= ~FA__DIRTY;
+		}
+#endif
+		if (disk_ioctl(fp->fs->drv, CTRL_SYNC, 0) != RES_OK)	/* Flush the block cache */
+			res = FR_DISK_ERR;
+	}
+
+	LEAVE_FF(fp->fs, res);
+}
+
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Allocate a Contiguous Block to the File                               */
+/*-----------------------------------------------------------------------*/
+/* Clusters are allocated for the first fsz bytes of the file. The missing
+   ones are allocated as a single contiguous run, preferably right after the
+   last cluster of the file, so that transfers on them need no FAT access,
+   and one by one only if there is no large enough free block. The file
+   size is not changed, so clusters may be allocated past the end of file */
+
+FRESULT f_expand (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD fsz		/* Number of bytes to allocate */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD csz, tcl, ncl, lcl, clst, scl, stcl, cs, n;
+
+
+	res = validate(fp);						/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->err)							/* Check error */
+		LEAVE_FF(fp->fs, (FRESULT)fp->err);
+	if (!(fp->flag & FA_WRITE))				/* Check access mode */
+		LEAVE_FF(fp->fs, FR_DENIED);
+	fs = fp->fs;
+	miosix::Lock<miosix::FastMutex> l(*fs->mutex);
+
+	csz = (DWORD)fs->csize * SS(fs);
+	tcl = fsz / csz + ((fsz % csz) ? 1 : 0);	/* Number of clusters required */
+	ncl = lcl = 0;
+	for (clst = fp->sclust; clst && ncl < tcl; ) {	/* Count the clusters already allocated */
+		if (clst >= fp->crun_start && clst < fp->crun_end) {	/* Skip the known run */
+			n = fp->crun_end - 1 - clst;
+			ncl += n; clst += n;
+		}
+		lcl = clst; ncl++;
+		clst = get_fat(fs, clst);
+		if (clst == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+		if (clst < 2) LEAVE_FF(fs, FR_INT_ERR);
+		if (clst >= fs->n_fatent) clst = 0;	/* End of the chain */
+	}
+	if (ncl >= tcl) LEAVE_FF(fs, FR_OK);		/* Already allocated */
+	tcl -= ncl;								/* Number of clusters to allocate */
+	fp->flag |= FA__WRITTEN;				/* The start cluster may change */
+
+	stcl = lcl ? lcl + 1 : fs->last_clust;	/* Search a free block, from where the chain can go on */
+	if (stcl < 2 || stcl >= fs->n_fatent) stcl = 2;
+	scl = clst = stcl; ncl = 0;
+	for (;;) {
+		cs = get_fat(fs, clst);
+		if (cs == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+		if (cs == 1) LEAVE_FF(fs, FR_INT_ERR);
+		clst++;
+		if (cs == 0) {						/* Free cluster */
+			if (++ncl == tcl) break;		/* Found a large enough free block */
+		} else {
+			scl = clst; ncl = 0;
+		}
+		if (clst >= fs->n_fatent) {			/* Wrap around, a block can't */
+			scl = clst = 2; ncl = 0;
+		}
+		if (clst == stcl) break;			/* No large enough free block */
+	}
+
+	if (ncl == tcl) {						/* Allocate the block as a chain */
+		for (clst = scl, n = tcl; n; clst++, n--) {
+			res = put_fat(fs, clst, (n == 1) ? 0x0FFFFFFF : clst + 1);
+			if (res != FR_OK) LEAVE_FF(fs, res);
+		}
+		if (lcl) {							/* Link it to the file */
+			res = put_fat(fs, lcl, scl);
+			if (res != FR_OK) LEAVE_FF(fs, res);
+		} else {
+			fp->sclust = scl;
+		}
+		fs->last_clust = scl + tcl - 1;		/* Update FSINFO */
+		if (fs->free_clust != 0xFFFFFFFF) {
+			fs->free_clust -= tcl;
+			fs->fsi_flag |= 1;
+		}
+		if (lcl && lcl + 1 == scl && fp->crun_end == scl) {
+			fp->crun_end = scl + tcl;		/* Extend the known run */
+		} else {
+			fp->crun_start = (lcl && lcl + 1 == scl) ? lcl : scl;
+			fp->crun_end = scl + tcl;
+		}
+	} else {								/* Fragmented free space, allocate one by one */
+		for (n = tcl; n; n--) {
+			clst = create_chain(fs, lcl);
+			if (clst == 0) LEAVE_FF(fs, FR_DENIED);	/* Disk full */
+			if (clst == 1) LEAVE_FF(fs, FR_INT_ERR);
+			if (clst == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+			if (!lcl) fp->sclust = clst;
+			lcl = clst;
+		}
+	}
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Remove the Clusters Past the End of File                              */
+/*-----------------------------------------------------------------------*/
+/* Clusters allocated by f_expand() past the end of file are removed, so
+   that they are not lost once the file is closed. If the file is empty its
+   whole cluster chain is removed, as an empty file has no start cluster */
+
+FRESULT f_trim (
+	FIL* fp		/* Pointer to the file object */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD csz, tcl, clst, ncl;
+
+
+	res = validate(fp);						/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->err)							/* Check error */
+		LEAVE_FF(fp->fs, (FRESULT)fp->err);
+	if (!(fp->flag & FA_WRITE))				/* Check access mode */
+		LEAVE_FF(fp->fs, FR_DENIED);
+	fs = fp->fs;
+	miosix::Lock<miosix::FastMutex> l(*fs->mutex);
+	if (!fp->sclust) LEAVE_FF(fs, FR_OK);	/* No cluster allocated */
+
+	csz = (DWORD)fs->csize * SS(fs);
+	tcl = fp->fsize / csz + ((fp->fsize % csz) ? 1 : 0);	/* Number of clusters in use */
+	if (tcl == 0) {							/* Empty file, remove the entire chain */
+		res = remove_chain(fs, fp->sclust);
+		fp->sclust = 0;
+		fp->flag |= FA__WRITTEN;
+	} else {
+		for (clst = fp->sclust; --tcl; ) {	/* Follow the chain to the last cluster in use */
+			if (clst >= fp->crun_start && clst + 1 < fp->crun_end) {	/* Next one is in the known run */
+				clst++;
+				continue;
+			}
+			clst = get_fat(fs, clst);
+			if (clst == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+			if (clst < 2 || clst >= fs->n_fatent) LEAVE_FF(fs, FR_INT_ERR);
+		}
+		ncl = get_fat(fs, clst);
+		if (ncl == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+		if (ncl == 1) LEAVE_FF(fs, FR_INT_ERR);
+		if (ncl < fs->n_fatent) {			/* Remove the clusters past it */
+			res = put_fat(fs, clst, 0x0FFFFFFF);
+			if (res == FR_OK) res = remove_chain(fs, ncl);
+		}
+	}
+	fp->crun_start = fp->crun_end = 0;		/* The run may be removed */
+	if (res != FR_OK) fp->err = (FRESULT)res;
+
+	LEAVE_FF(fs, res);
+}
+
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Scan the FAT to Build the Free Cluster Map                            */
+/*-----------------------------------------------------------------------*/
+/* The next nsect sectors of the FAT are scanned, to clear the bits of the
+   free cluster map of those with no free cluster, and to count the free
+   clusters. Once the whole FAT is scanned, the count replaces free_clust,
+   that may come from a stale FSINFO. The sectors are read into buf, that
+   must hold nsect sectors, not through the window so as not to evict the
+   FAT sectors being used. Must be called with the volume lock held */
+
+FRESULT f_scanfree (
+	FATFS* fs,		/* File system object */
+	BYTE* buf,		/* Buffer for the FAT sectors */
+	UINT nsect		/* Number of FAT sectors to scan */
+)
+{
+	DWORD sect, clst, ecl, nfree;
+	UINT n;
+	BYTE *p;
+
+
+	if (!fs->fmap || fs->fmap_scan >= fs->fsize) return FR_OK;	/* Nothing left to scan */
+	sect = fs->fmap_scan;
+	if (nsect > fs->fsize - sect) nsect = fs->fsize - sect;
+	if (disk_read(fs->drv, buf, fs->fatbase + sect, nsect)) {
+		fs->fmap_scan = 0xFFFFFFFF;	/* Give up, the map stays valid but the count does not */
+		return FR_DISK_ERR;
+	}
+	if (fs->wflag && fs->winsect - (fs->fatbase + sect) < nsect)	/* The window has newer data */
+		mem_cpy(buf + (fs->winsect - fs->fatbase - sect) * SS(fs), fs->win, SS(fs));
+
+	for (n = 0; n < nsect; n++, sect++) {
+		clst = sect * (SS(fs) / 4);
+		ecl = clst + SS(fs) / 4;
+		if (ecl > fs->n_fatent) ecl = fs->n_fatent;	/* The FAT may have unused entries at the end */
+		if (clst < 2) clst = 2;
+		p = buf + n * SS(fs) + clst % (SS(fs) / 4) * 4;
+		for (nfree = 0; clst < ecl; clst++, p += 4)
+			if ((LD_DWORD(p) & 0x0FFFFFFF) == 0) nfree++;
+		if (!nfree) fs->fmap[sect / 8] &= ~(1 << (sect % 8));
+		fs->fmap_free += nfree;
+	}
+	fs->fmap_scan = sect;
+	if (sect == fs->fsize && fs->free_clust != fs->fmap_free) {	/* Scan completed, update FSINFO */
+		fs->free_clust = fs->fmap_free;
+		fs->fsi_flag |= 1;
+	}
+
+	return FR_OK;
+}
+
 #endif /* !_FS_READONLY */
 
 
@@ -3034,7 +3503,7 @@ FRESULT f_lseek (
 					tcl = cl; ncl = 0; ulen += 2;	/* Top, length and used items */
 					do {
 						pcl = cl; ncl++;
-						cl = get_fat(fp->fs, cl);
+						cl = get_fat_locked(fp, cl);
 						if (cl <= 1) ABORT(fp->fs, FR_INT_ERR);
 						if (cl == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
 					} while (cl == pcl + 1);
@@ -3100,7 +3569,7 @@ FRESULT f_lseek (
 				clst = fp->sclust;						/* start from the first cluster */
 #if !_FS_READONLY
 				if (clst == 0) {						/* If no cluster chain, create a new chain */
-					clst = create_chain(fp->fs, 0);
+					clst = create_chain_locked(fp, 0);
 					if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
 					if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
 					fp->sclust = clst;
@@ -3112,13 +3581,13 @@ FRESULT f_lseek (
 				while (ofs > bcs) {						/* Cluster following loop */
 #if !_FS_READONLY
 					if (fp->flag & FA_WRITE) {			/* Check if in write mode or not */
-						clst = create_chain(fp->fs, clst);	/* Force stretch if in write mode */
+						clst = create_chain_locked(fp, clst);	/* Force stretch if in write mode */
 						if (clst == 0) {				/* When disk gets full, clip file size */
 							ofs = bcs; break;
 						}
 					} else
 #endif
-						clst = get_fat(fp->fs, clst);	/* Follow cluster chain if not in write mode */
+						clst = get_fat_locked(fp, clst);	/* Follow cluster chain if not in write mode */
 					if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
 					if (clst <= 1 || clst >= fp->fs->n_fatent) ABORT(fp->fs, FR_INT_ERR);
 					fp->clust = clst;
@@ -3418,6 +3887,7 @@ FRESULT f_truncate (
 		if (fp->fsize > fp->fptr) {
 			fp->fsize = fp->fptr;	/* Set file size to current R/W point */
 			fp->flag |= FA__WRITTEN;
+			fp->crun_start = fp->crun_end = 0;	/* The run may be removed */
 			if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
 				res = remove_chain(fp->fs, fp->sclust);
 				fp->sclust = 0;
@@ -3508,6 +3978,10 @@ FRESULT f_unlink (
 				if (res == FR_OK) {
 					if (dclst)				/* Remove the cluster chain if exist */
 						res = remove_chain(dj.fs, dclst);
+#if _DCACHE_SIZE
+					if (dclst)				/* Its clusters may become another directory */
+						dcache_remove(dj.fs, dclst, 0xFFFF);
+#endif
 					if (res == FR_OK) res = sync_fs(dj.fs);
 				}
 			}
@@ -37,6 +37,8 @@
 
 #include <filesystem/file.h>
 #include "config/miosix_settings.h"
+#include "diskio.h"
+#include "kernel/sync.h"
 
 #include "integer.h"	/* Basic integer types */
 #include "ffconf.h"		/* FatFs configuration options */
@@ -105,6 +107,19 @@ typedef struct {
 #endif
 
 
+/* Directory entry cache item (DCENT) */
+
+#if _DCACHE_SIZE
+typedef struct {
+	DWORD	sclust;			/* Start cluster of the directory (0:root) */
+	DWORD	hash;			/* Hash of the name looked up */
+	WORD	index;			/* Index of the SFN entry (0xFFFF:unused item) */
+	WORD	lfn_idx;		/* Index of the first LFN entry (0xFFFF:no LFN) */
+} DCENT;
+#endif
+
+
+
 /* File system object structure (FATFS) */
 
 struct FATFS {
@@ -125,6 +140,9 @@ struct FATFS {
 #if !_FS_READONLY
 	DWORD	last_clust;		/* Last allocated cluster */
 	DWORD	free_clust;		/* Number of free clusters */
+	BYTE*	fmap;			/* Bitmap of FAT sectors that may have free clusters (FAT32 only, NULL:no map) */
+	DWORD	fmap_scan;		/* Number of FAT sectors scanned by f_scanfree() */
+	DWORD	fmap_free;		/* Free clusters in the scanned FAT sectors */
 #endif
 #if _FS_RPATH
 	DWORD	cdir;			/* Current directory start cluster (0:root) */
@@ -143,7 +161,12 @@ struct FATFS {
 #if _FS_LOCK
     FILESEM	Files[_FS_LOCK];/* Open object lock semaphores */
 #endif
-    miosix::intrusive_ref_ptr<miosix::FileBase> drv; /* drive device */
+#if _DCACHE_SIZE
+	DCENT	dcache[_DCACHE_SIZE];	/* Where the last names looked up by path were found */
+	UINT	dcache_next;	/* Next item of dcache[] to replace */
+#endif
+    DiskDrive drv; /* drive the volume is on */
+    miosix::FastMutex *mutex; /* volume lock, for FAT, directory and window access */
 };
 
 
@@ -160,6 +183,8 @@ typedef struct {
 	DWORD	sclust;			/* File data start cluster (0:no data cluster, always 0 when fsize is 0) */
 	DWORD	clust;			/* Current cluster of fpter */
 	DWORD	dsect;			/* Current data sector of fpter */
+	DWORD	crun_start;		/* Run of contiguous clusters in the chain, crun_start to */
+	DWORD	crun_end;		/* crun_end-1, followed without reading the FAT (Zeroed on file open) */
 #if !_FS_READONLY
 	DWORD	dir_sect;		/* Sector containing the directory entry */
 	BYTE*	dir_ptr;		/* Pointer to the directory entry in the window */
@@ -254,6 +279,10 @@ FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);
 FRESULT f_lseek (FIL* fp, DWORD ofs);								/* Move file pointer of a file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of a writing file */
+FRESULT f_datasync (FIL* fp);										/* Flush cached data, but not the directory entry */
+FRESULT f_expand (FIL* fp, DWORD fsz);								/* Allocate a contiguous block to the file */
+FRESULT f_trim (FIL* fp);											/* Remove the clusters past the end of file */
+FRESULT f_scanfree (FATFS* fs, BYTE* buf, UINT nsect);				/* Scan part of the FAT to build the free cluster map */
 FRESULT f_opendir (FATFS *fs, DIR_* dp, const /*TCHAR*/char *path);						/* Open a directory */
 FRESULT f_closedir (DIR_* dp);										/* Close an open directory */
 FRESULT f_readdir (DIR_* dp, FILINFO* fno);							/* Read a directory item */
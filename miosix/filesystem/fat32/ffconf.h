@@ -44,10 +44,17 @@
 /* To enable f_mkfs() function, set _USE_MKFS to 1 and set _FS_READONLY to 0 */
 
 
-#define	_USE_FASTSEEK	0	/* 0:Disable or 1:Enable */
+#define	_USE_FASTSEEK	1	/* 0:Disable or 1:Enable */
 /* To enable fast seek feature, set _USE_FASTSEEK to 1. */
 
 
+#define	_DCACHE_SIZE	16	/* 0:Disable or number of items */
+/* To remember where the last _DCACHE_SIZE names looked up by path were found
+/  in their directories, so that finding them again does not scan the whole
+/  directory, set _DCACHE_SIZE to the number of names. Each item takes 12 bytes
+/  in the file system object. */
+
+
 #define _USE_LABEL		0	/* 0:Disable or 1:Enable */
 /* To enable volume label functions, set _USE_LAVEL to 1 */
 
@@ -212,7 +219,10 @@
 
 //Note by TFT: this is very useful, as it avoids the danger of opening the same
 //file for writing multiple times
-#define	_FS_LOCK	8	/* 0:Disable or >=1:Enable */
+//The value must be at least MAX_OPEN_FILES in miosix_settings.h, otherwise
+//FatFs fails opening files before the file descriptor table is full. This is
+//checked in fat32.cpp
+#define	_FS_LOCK	64	/* 0:Disable or >=1:Enable */
 /* To enable file lock control feature, set _FS_LOCK to 1 or greater.
    The value defines how many files can be opened simultaneously. */
 
@@ -27,6 +27,7 @@
 
 #include "file.h"
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <fcntl.h>
 #include "file_access.h"
@@ -48,8 +49,63 @@ FileBase::FileBase(intrusive_ref_ptr<FilesystemBase> parent) : parent(parent)
     if(parent) parent->newFileOpened();
 }
 
+ssize_t FileBase::writev(const struct iovec *iov, int iovcnt)
+{
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_len==0) continue;
+        ssize_t result=write(iov[i].iov_base,iov[i].iov_len);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+}
+
+ssize_t FileBase::readv(const struct iovec *iov, int iovcnt)
+{
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_len==0) continue;
+        ssize_t result=read(iov[i].iov_base,iov[i].iov_len);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+}
+
 #ifdef WITH_FILESYSTEM
 
+ssize_t FileBase::pwrite(const void *data, size_t len, off_t pos)
+{
+    off_t old=lseek(0,SEEK_CUR);
+    if(old<0) return old==-EBADF ? -ESPIPE : old;
+    off_t result=lseek(pos,SEEK_SET);
+    if(result<0) return result;
+    ssize_t written=write(data,len);
+    lseek(old,SEEK_SET);
+    return written;
+}
+
+ssize_t FileBase::pread(void *data, size_t len, off_t pos)
+{
+    off_t old=lseek(0,SEEK_CUR);
+    if(old<0) return old==-EBADF ? -ESPIPE : old;
+    off_t result=lseek(pos,SEEK_SET);
+    if(result<0) return result;
+    ssize_t bytesRead=read(data,len);
+    lseek(old,SEEK_SET);
+    return bytesRead;
+}
+
+int FileBase::fallocate(int mode, off_t offset, off_t len)
+{
+    return -ENODEV; //Not a regular file
+}
+
 int FileBase::isatty() const
 {
     return 0;
@@ -68,6 +124,11 @@ int FileBase::ioctl(int cmd, void *arg)
     return -ENOTTY; //Means the operation does not apply to this descriptor
 }
 
+short FileBase::poll(short events, PollEntry *entry)
+{
+    return events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+}
+
 int FileBase::getdents(void *dp, int len)
 {
     return -EBADF;
@@ -165,6 +226,19 @@ FilesystemBase::FilesystemBase() :
 #endif //WITH_FILESYSTEM
         parentFsMountpointInode(1), openFileCount(0) {}
 
+int FilesystemBase::mkfifo(StringPart& name, int mode)
+{
+    return -EPERM; //Default implementation, for filesystems without FIFOs
+}
+
+int FilesystemBase::statvfs(struct statvfs *buf)
+{
+    //Default implementation, for filesystems without a notion of free space
+    memset(buf,0,sizeof(struct statvfs));
+    buf->f_fsid=filesystemId;
+    return 0;
+}
+
 int FilesystemBase::readlink(StringPart& name, string& target)
 {
     return -EINVAL; //Default implementation, for filesystems without symlinks
@@ -26,13 +26,80 @@
  ***************************************************************************/
 
 #include <dirent.h>
+#include <limits.h>
 #include <sys/stat.h>
 #include "kernel/intrusive.h"
+#include "filesystem/poll_queue.h"
 #include "config/miosix_settings.h"
 
 #ifndef FILE_H
 #define	FILE_H
 
+#if __has_include(<sys/uio.h>)
+#include <sys/uio.h>
+#else //__has_include(<sys/uio.h>)
+/**
+ * Buffer descriptor for readv() and writev(), provided here as the C library
+ * lacks sys/uio.h
+ */
+struct iovec
+{
+    void *iov_base; ///< Buffer
+    size_t iov_len; ///< Buffer size
+};
+
+extern "C" {
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+}
+#endif //__has_include(<sys/uio.h>)
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif //IOV_MAX
+
+#if __has_include(<sys/statvfs.h>)
+#include <sys/statvfs.h>
+#else //__has_include(<sys/statvfs.h>)
+/**
+ * Filesystem information returned by statvfs(), provided here as the C
+ * library lacks sys/statvfs.h
+ */
+struct statvfs
+{
+    unsigned long f_bsize;   ///< Filesystem block size
+    unsigned long f_frsize;  ///< Fragment size, the unit of f_blocks
+    unsigned long f_blocks;  ///< Size of the filesystem, in f_frsize units
+    unsigned long f_bfree;   ///< Number of free blocks
+    unsigned long f_bavail;  ///< Number of free blocks for unprivileged users
+    unsigned long f_files;   ///< Number of inodes
+    unsigned long f_ffree;   ///< Number of free inodes
+    unsigned long f_favail;  ///< Number of free inodes for unprivileged users
+    unsigned long f_fsid;    ///< Filesystem id
+    unsigned long f_flag;    ///< Mount flags
+    unsigned long f_namemax; ///< Maximum file name length
+};
+
+#define ST_RDONLY 0x1
+#define ST_NOSUID 0x2
+
+extern "C" {
+int statvfs(const char *path, struct statvfs *buf);
+int fstatvfs(int fd, struct statvfs *buf);
+}
+#endif //__has_include(<sys/statvfs.h>)
+
+#ifndef FALLOC_FL_KEEP_SIZE
+/// fallocate() mode to allocate space past the end of file, without changing
+/// the file size
+#define FALLOC_FL_KEEP_SIZE 0x01
+
+extern "C" {
+int fallocate(int fd, int mode, off_t offset, off_t len);
+int posix_fallocate(int fd, off_t offset, off_t len);
+}
+#endif //FALLOC_FL_KEEP_SIZE
+
 namespace miosix {
 
 // Forward decls
@@ -71,8 +138,56 @@ public:
      */
     virtual ssize_t read(void *data, size_t len)=0;
     
+    /**
+     * Write data from multiple buffers to the file, as a single write.
+     * The default implementation calls write() once per buffer, files should
+     * override it if they can do better.
+     * \param iov buffers to write, already validated by the caller
+     * \param iovcnt number of buffers
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Read data from the file into multiple buffers, as a single read.
+     * The default implementation calls read() once per buffer, files should
+     * override it if they can do better.
+     * \param iov buffers to fill, already validated by the caller
+     * \param iovcnt number of buffers
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt);
+    
     #ifdef WITH_FILESYSTEM
     
+    /**
+     * Write data at a given position without moving the file pointer, if the
+     * file supports random-access.
+     * The default implementation uses lseek() and write(), so it is not atomic
+     * with respect to other accesses to the file, files should override it.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file, must be positive
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+    
+    /**
+     * Read data from a given position without moving the file pointer, if the
+     * file supports random-access.
+     * The default implementation uses lseek() and read(), so it is not atomic
+     * with respect to other accesses to the file, files should override it.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file, must be positive
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+    
     /**
      * Move file pointer, if the file supports random-access.
      * \param pos offset to sum to the beginning of the file, current position
@@ -82,6 +197,17 @@ public:
      * completed, or a negative number in case of errors
      */
     virtual off_t lseek(off_t pos, int whence)=0;
+
+    /**
+     * Allocate disk space for a range of the file, so that writing to it
+     * won't fail for lack of space, if the file supports it.
+     * \param mode 0 to extend the file with zeros if the range goes past the
+     * end of file, or FALLOC_FL_KEEP_SIZE to leave the file size unchanged
+     * \param offset start of the range
+     * \param len length of the range, must be positive
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fallocate(int mode, off_t offset, off_t len);
     
     /**
      * Return file information.
@@ -124,6 +250,21 @@ public:
      */
     virtual int getdents(void *dp, int len);
     
+    /**
+     * Check whether the file is ready for reading or writing, used to
+     * implement poll() and select().
+     * The default implementation reports the file as always readable and
+     * writable, as is the case for regular files. Files that can block must
+     * override it, and if entry is not nullptr, add it to a PollQueue they
+     * notify when their readiness changes, before checking readiness.
+     * \param events the events the caller is interested in (POLLIN, ...)
+     * \param entry entry to add to the PollQueue of the file, or nullptr if
+     * the caller only wants to check readiness
+     * \return the subset of events that are ready, plus POLLERR and POLLHUP
+     * if applicable
+     */
+    virtual short poll(short events, PollEntry *entry);
+    
     /**
      * \return a pointer to the parent filesystem
      */
@@ -307,6 +448,22 @@ public:
      */
     virtual int rmdir(StringPart& name)=0;
     
+    /**
+     * Create a named FIFO
+     * \param name FIFO name
+     * \param mode FIFO permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int mkfifo(StringPart& name, int mode);
+
+    /**
+     * Obtain information on the filesystem, such as the free space.
+     * The default implementation only fills in the filesystem id
+     * \param buf filesystem information is stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int statvfs(struct statvfs *buf);
+    
     /**
      * Follows a symbolic link
      * \param path path identifying a symlink, relative to the local filesystem
@@ -27,11 +27,13 @@
 
 #include "file_access.h"
 #include <vector>
+#include <memory>
 #include <climits>
 #include <fcntl.h>
 #include "console/console_device.h"
 #include "mountpointfs/mountpointfs.h"
 #include "fat32/fat32.h"
+#include "pipe/pipe.h"
 #include "kernel/logging.h"
 #ifdef WITH_PROCESSES
 #include "kernel/process.h"
@@ -45,8 +47,8 @@ namespace miosix {
 
 /*
  * A note on the use of strings in this file. This file uses three string
- * types: C string, C++ std::string and StringPart which is an efficent
- * in-place substring of either a C or C++ string.
+ * types: C string, PathBuffer and StringPart which is an efficent
+ * in-place substring of either a C string or a PathBuffer.
  * 
  * The functions which are meant to be used by clients of the filesystem
  * API take file names as C strings. This is becase that's the signature
@@ -55,8 +57,8 @@ namespace miosix {
  * requires a writable scratchpad string to be able to remove
  * useless path components, such as "/./", go backwards when a "/../" is
  * found, and follow symbolic links. To this end, all these functions
- * make a copy of the passed string into a temporary C++ string that
- * will be deallocated as soon as the function returns.
+ * make a copy of the passed string into a PathBuffer on the stack, which
+ * does not allocate memory unless the path is long.
  * Resolving a path, however, requires to scan all its path components
  * one by one, checking if the path up to that point is a symbolic link
  * or a mountpoint of a filesystem.
@@ -74,19 +76,31 @@ namespace miosix {
 //
 
 FileDescriptorTable::FileDescriptorTable()
-    : mutex(FastMutex::RECURSIVE), cwd("/")
+    : mutex(FastMutex::RECURSIVE), cwd("/"), chunks(), usedFds(),
+      maxOpenFiles(MAX_OPEN_FILES), retired(nullptr)
 {
     FilesystemManager::instance().addFileDescriptorTable(this);
-    files[0]=files[1]=files[2]=intrusive_ref_ptr<FileBase>(
-        new TerminalDevice(DefaultConsole::instance().get()));
+    chunks[0]=new FileChunk;
+    chunks[0]->files[0]=chunks[0]->files[1]=chunks[0]->files[2]=
+        intrusive_ref_ptr<FileBase>(
+            new TerminalDevice(DefaultConsole::instance().get()));
+    usedFds[0]=0x7;
 }
 
 FileDescriptorTable::FileDescriptorTable(const FileDescriptorTable& rhs)
-    : mutex(FastMutex::RECURSIVE), cwd(rhs.cwd)
+    : mutex(FastMutex::RECURSIVE), cwd(rhs.cwd), chunks(), usedFds(),
+      maxOpenFiles(rhs.maxOpenFiles), retired(nullptr)
 {
     //No need to lock the mutex since we are in a constructor and there can't
     //be pointers to this in other threads yet
-    for(int i=0;i<MAX_OPEN_FILES;i++) this->files[i]=atomic_load(&rhs.files[i]);
+    for(int i=0;i<MAX_OPEN_FILES;i++)
+    {
+        intrusive_ref_ptr<FileBase> file=rhs.getFile(i);
+        if(!file) continue;
+        growTable(i);
+        *entry(i)=file;
+        useFd(i);
+    }
     FilesystemManager::instance().addFileDescriptorTable(this);
 }
 
@@ -94,45 +108,184 @@ FileDescriptorTable& FileDescriptorTable::operator=(
         const FileDescriptorTable& rhs)
 {
     Lock<FastMutex> l(mutex);
+    maxOpenFiles=rhs.maxOpenFiles;
     for(int i=0;i<MAX_OPEN_FILES;i++)
-        atomic_store(&this->files[i],atomic_load(&rhs.files[i]));
+    {
+        intrusive_ref_ptr<FileBase> file=rhs.getFile(i);
+        if(!file)
+        {
+            if(entry(i)==nullptr) continue;
+            intrusive_ref_ptr<FileBase> old=atomic_exchange(entry(i),file);
+            if(old) freeFd(i);
+            retireFile(old);
+        } else {
+            growTable(i);
+            retireFile(atomic_exchange(entry(i),file));
+            useFd(i);
+        }
+    }
     return *this;
 }
 
 int FileDescriptorTable::open(const char* name, int flags, int mode)
 {
     if(name==0 || name[0]=='\0') return -EFAULT;
+    //Reserve the file descriptor first, to fail early if the table is full,
+    //before any side effect of O_CREAT
+    int fd=reserveFd();
+    if(fd<0) return fd;
+    //The file is opened without holding the mutex, as opening a FIFO blocks
+    //until another thread opens the other end, possibly through this table
+    intrusive_ref_ptr<FileBase> file;
+    int result;
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        PathBuffer path;
+        result=absolutePath(name,path);
+        if(result==0)
+        {
+            ResolvedPath openData=
+                FilesystemManager::instance().resolvePath(path);
+            if(openData.result<0) result=openData.result;
+            else {
+                StringPart sp(path.data(),string::npos,openData.off);
+                result=openData.fs->open(file,sp,flags,mode);
+            }
+        }
+    #ifndef __NO_EXCEPTIONS
+    } catch(...) {
+        //Out of memory, don't leak the reserved file descriptor
+        Lock<FastMutex> l(mutex);
+        freeFd(fd);
+        throw;
+    }
+    #endif //__NO_EXCEPTIONS
     Lock<FastMutex> l(mutex);
-    for(int i=3;i<MAX_OPEN_FILES;i++)
+    if(result<0)
     {
-        if(files[i]) continue;
-        //Found an empty file descriptor
-        string path=absolutePath(name);
-        if(path.empty()) return -ENAMETOOLONG;
-        ResolvedPath openData=FilesystemManager::instance().resolvePath(path);
-        if(openData.result<0) return openData.result;
-        StringPart sp(path,string::npos,openData.off);
-        int result=openData.fs->open(files[i],sp,flags,mode);
-        if(result==0) return i; //The file descriptor
-        else return result; //The error code
+        freeFd(fd);
+        return result; //The error code
     }
-    return -ENFILE;
+    atomic_store(entry(fd),file);
+    return fd;
 }
 
 int FileDescriptorTable::close(int fd)
 {
-    //No need to lock the mutex when deleting
-    if(fd<0 || fd>=MAX_OPEN_FILES) return -EBADF;
     intrusive_ref_ptr<FileBase> toClose;
-    toClose=atomic_exchange(files+fd,intrusive_ref_ptr<FileBase>());
-    if(!toClose) return -EBADF; //File entry was not open
+    {
+        Lock<FastMutex> l(mutex);
+        intrusive_ref_ptr<FileBase> *e=entry(fd);
+        if(e==nullptr) return -EBADF;
+        toClose=atomic_exchange(e,intrusive_ref_ptr<FileBase>());
+        if(!toClose) return -EBADF; //File entry was not open
+        freeFd(fd);
+    }
+    //The file is released without holding the mutex, as closing a file may
+    //block, for example to flush buffered data
+    retireFile(toClose);
     return 0;
 }
 
 void FileDescriptorTable::closeAll()
 {
-    for(int i=0;i<MAX_OPEN_FILES;i++)
-        atomic_exchange(files+i,intrusive_ref_ptr<FileBase>());
+    for(int i=0;i<MAX_OPEN_FILES;i++) close(i);
+}
+
+int FileDescriptorTable::setMaxOpenFiles(int n)
+{
+    if(n<3 || n>MAX_OPEN_FILES) return -EINVAL;
+    Lock<FastMutex> l(mutex);
+    for(int i=n;i<MAX_OPEN_FILES;i++)
+        if(usedFds[i/32] & (1u<<(i%32))) return -EBUSY;
+    maxOpenFiles=n;
+    return 0;
+}
+
+int FileDescriptorTable::pipe(int fds[2])
+{
+    if(fds==0) return -EFAULT;
+    //Allocate first, so that no file descriptor is reserved if it throws
+    intrusive_ref_ptr<Pipe> p(new Pipe);
+    p->open(O_RDONLY,false);
+    p->open(O_WRONLY,false);
+    intrusive_ref_ptr<FilesystemBase> noFs;
+    intrusive_ref_ptr<FileBase> rdFile(new PipeFile(noFs,p,O_RDONLY));
+    intrusive_ref_ptr<FileBase> wrFile(new PipeFile(noFs,p,O_WRONLY));
+    Lock<FastMutex> l(mutex);
+    int rd=reserveFd();
+    if(rd<0) return rd;
+    int wr;
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        wr=reserveFd(); //May throw if growing the table
+    #ifndef __NO_EXCEPTIONS
+    } catch(...) {
+        freeFd(rd);
+        throw;
+    }
+    #endif //__NO_EXCEPTIONS
+    if(wr<0)
+    {
+        freeFd(rd);
+        return wr;
+    }
+    atomic_store(entry(rd),rdFile);
+    atomic_store(entry(wr),wrFile);
+    fds[0]=rd;
+    fds[1]=wr;
+    return 0;
+}
+
+int FileDescriptorTable::poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    if(fds==0 && nfds>0) return -EFAULT;
+    if(nfds>MAX_OPEN_FILES) return -EINVAL;
+    long long deadline=timeout<0 ? -1 : getTime()+timeout*1000000LL;
+    //Files are kept referenced while waiting, so that their PollQueue is not
+    //deallocated if they are closed by another thread
+    struct Polled
+    {
+        intrusive_ref_ptr<FileBase> file;
+        PollEntry entry;
+    };
+    //The poller must outlive the entries, which are removed from the
+    //PollQueue when polled is deallocated
+    Poller poller(Thread::getCurrentThread());
+    unique_ptr<Polled[]> polled(new Polled[nfds]);
+    for(nfds_t i=0;i<nfds;i++)
+    {
+        polled[i].entry.setPoller(&poller);
+        if(fds[i].fd>=0) polled[i].file=getFile(fds[i].fd);
+    }
+    //Register to the files' PollQueue only the first time, they stay
+    //registered until polled is deallocated
+    bool first=true;
+    for(;;)
+    {
+        int ready=0;
+        for(nfds_t i=0;i<nfds;i++)
+        {
+            fds[i].revents=0;
+            if(fds[i].fd<0) continue;
+            if(!polled[i].file)
+            {
+                fds[i].revents=POLLNVAL;
+                ready++;
+                continue;
+            }
+            short events=fds[i].events | POLLERR | POLLHUP;
+            short revents=polled[i].file->poll(events,
+                (first && timeout!=0) ? &polled[i].entry : nullptr);
+            fds[i].revents=revents & events;
+            if(fds[i].revents) ready++;
+        }
+        first=false;
+        if(ready>0 || timeout==0) return ready;
+        if(poller.wait(deadline)==false) return 0;
+    }
 }
 
 int FileDescriptorTable::getcwd(char *buf, size_t len)
@@ -156,53 +309,69 @@ int FileDescriptorTable::chdir(const char* name)
     if(name[0]!='/') len+=cwd.length();
     if(len>PATH_MAX) return -ENAMETOOLONG;
     
-    string newCwd;
-    newCwd.reserve(len);
-    if(name[0]=='/') newCwd=name;
-    else {
-        newCwd=cwd;
-        newCwd+=name;
-    }
+    PathBuffer newCwd;
+    if(name[0]!='/') newCwd.assign(cwd.c_str(),cwd.length());
+    newCwd.append(name,strlen(name));
     ResolvedPath openData=FilesystemManager::instance().resolvePath(newCwd);
     if(openData.result<0) return openData.result;
-    struct stat st;
-    StringPart sp(newCwd,string::npos,openData.off);
-    if(int result=openData.fs->lstat(sp,&st)) return result;
-    if(!S_ISDIR(st.st_mode)) return -ENOTDIR;
+    {
+        struct stat st;
+        StringPart sp(newCwd.data(),string::npos,openData.off);
+        if(int result=openData.fs->lstat(sp,&st)) return result;
+        if(!S_ISDIR(st.st_mode)) return -ENOTDIR;
+    }
     //NOTE: put after resolvePath() as it strips trailing /
     //Also put after lstat() as it fails if path has a trailing slash
-    newCwd+='/';
-    cwd=newCwd;
+    cwd=newCwd.c_str();
+    cwd+='/';
     return 0;
 }
 
 int FileDescriptorTable::mkdir(const char *name, int mode)
 {
     if(name==0 || name[0]=='\0') return -EFAULT;
-    string path=absolutePath(name);
-    if(path.empty()) return -ENAMETOOLONG;
+    PathBuffer path;
+    if(int result=absolutePath(name,path)) return result;
     ResolvedPath openData=FilesystemManager::instance().resolvePath(path,true);
     if(openData.result<0) return openData.result;
-    StringPart sp(path,string::npos,openData.off);
+    StringPart sp(path.data(),string::npos,openData.off);
     return openData.fs->mkdir(sp,mode);
 }
 
-int FileDescriptorTable::rmdir(const char *name)
+int FileDescriptorTable::mkfifo(const char *name, int mode)
 {
     if(name==0 || name[0]=='\0') return -EFAULT;
-    string path=absolutePath(name);
-    if(path.empty()) return -ENAMETOOLONG;
+    PathBuffer path;
+    if(int result=absolutePath(name,path)) return result;
     ResolvedPath openData=FilesystemManager::instance().resolvePath(path,true);
     if(openData.result<0) return openData.result;
-    StringPart sp(path,string::npos,openData.off);
-    return openData.fs->rmdir(sp);
+    StringPart sp(path.data(),string::npos,openData.off);
+    return openData.fs->mkfifo(sp,mode);
+}
+
+int FileDescriptorTable::statvfs(const char *name, struct statvfs *buf)
+{
+    if(name==0 || name[0]=='\0' || buf==0) return -EFAULT;
+    PathBuffer path;
+    if(int result=absolutePath(name,path)) return result;
+    ResolvedPath openData=FilesystemManager::instance().resolvePath(path,true);
+    if(openData.result<0) return openData.result;
+    return openData.fs->statvfs(buf);
+}
+
+int FileDescriptorTable::rmdir(const char *name)
+{
+    if(name==0 || name[0]=='\0') return -EFAULT;
+    PathBuffer path;
+    if(int result=absolutePath(name,path)) return result;
+    return FilesystemManager::instance().rmdirHelper(path);
 }
 
 int FileDescriptorTable::unlink(const char *name)
 {
     if(name==0 || name[0]=='\0') return -EFAULT;
-    string path=absolutePath(name);
-    if(path.empty()) return -ENAMETOOLONG;
+    PathBuffer path;
+    if(int result=absolutePath(name,path)) return result;
     return FilesystemManager::instance().unlinkHelper(path);
 }
 
@@ -210,17 +379,17 @@ int FileDescriptorTable::rename(const char *oldName, const char *newName)
 {
     if(oldName==0 || oldName[0]=='\0') return -EFAULT;
     if(newName==0 || newName[0]=='\0') return -EFAULT;
-    string oldPath=absolutePath(oldName);
-    string newPath=absolutePath(newName);
-    if(oldPath.empty() || newPath.empty()) return -ENAMETOOLONG;
+    PathBuffer oldPath, newPath;
+    if(int result=absolutePath(oldName,oldPath)) return result;
+    if(int result=absolutePath(newName,newPath)) return result;
     return FilesystemManager::instance().renameHelper(oldPath,newPath);
 }
 
 int FileDescriptorTable::statImpl(const char* name, struct stat* pstat, bool f)
 {
     if(name==0 || name[0]=='\0' || pstat==0) return -EFAULT;
-    string path=absolutePath(name);
-    if(path.empty()) return -ENAMETOOLONG;
+    PathBuffer path;
+    if(int result=absolutePath(name,path)) return result;
     return FilesystemManager::instance().statHelper(path,pstat,f);
 }
 
@@ -230,16 +399,99 @@ FileDescriptorTable::~FileDescriptorTable()
     //There's no need to lock the mutex and explicitly close files eventually
     //left open, because if there are other threads accessing this while we are
     //being deleted we have bigger problems anyway
+    while(retired)
+    {
+        RetiredFile *r=retired;
+        retired=r->next;
+        delete r;
+    }
+    for(int i=0;i<numChunks;i++) delete chunks[i];
+}
+
+int FileDescriptorTable::reserveFd()
+{
+    Lock<FastMutex> l(mutex);
+    for(int i=0;i<bitmapWords;i++)
+    {
+        unsigned int used=usedFds[i];
+        if(i==0) used|=0x7; //Never allocate stdin, stdout and stderr
+        if(used==0xffffffff) continue;
+        int fd=i*32+__builtin_ctz(~used);
+        if(fd>=maxOpenFiles) break;
+        growTable(fd);
+        useFd(fd);
+        return fd;
+    }
+    return -EMFILE;
+}
+
+void FileDescriptorTable::growTable(int fd)
+{
+    int i=fd/FILE_TABLE_CHUNK_SIZE;
+    if(chunks[i]) return;
+    FileChunk *chunk=new FileChunk;
+    chunks[i]=chunk; //Publish the chunk after it has been constructed
+}
+
+void FileDescriptorTable::retireFile(intrusive_ref_ptr<FileBase> file)
+{
+    if(!file) return;
+    if(retired) reclaimFiles();
+    //Common case, no thread is borrowing the file, release it now
+    if(Thread::isHazardPointer(file.get())==false) return;
+    RetiredFile *r=new (nothrow) RetiredFile;
+    if(r==nullptr)
+    {
+        //Out of memory, wait for the borrowing thread to complete instead
+        while(Thread::isHazardPointer(file.get())) Thread::sleep(1);
+        return;
+    }
+    r->file=file;
+    Lock<FastMutex> l(mutex);
+    r->next=retired;
+    retired=r;
 }
 
-string FileDescriptorTable::absolutePath(const char* path)
+void FileDescriptorTable::reclaimFiles()
+{
+    RetiredFile *toDelete=nullptr;
+    {
+        Lock<FastMutex> l(mutex);
+        for(RetiredFile * volatile *r=&retired;*r;)
+        {
+            if(Thread::isHazardPointer((*r)->file.get())) r=&(*r)->next;
+            else {
+                RetiredFile *x=*r;
+                *r=x->next;
+                x->next=toDelete;
+                toDelete=x;
+            }
+        }
+    }
+    //Release the files without holding the mutex, as closing a file may
+    //block, for example to flush buffered data
+    while(toDelete)
+    {
+        RetiredFile *x=toDelete;
+        toDelete=x->next;
+        delete x;
+    }
+}
+
+int FileDescriptorTable::absolutePath(const char* path, PathBuffer& result)
 {
     size_t len=strlen(path);
-    if(len>PATH_MAX) return "";
-    if(path[0]=='/') return path;
+    if(len>PATH_MAX) return -ENAMETOOLONG;
+    if(path[0]=='/')
+    {
+        result.assign(path,len);
+        return 0;
+    }
     Lock<FastMutex> l(mutex);
-    if(len+cwd.length()>PATH_MAX) return "";
-    return cwd+path;
+    if(len+cwd.length()>PATH_MAX) return -ENAMETOOLONG;
+    result.assign(cwd.c_str(),cwd.length());
+    result.append(path,len);
+    return 0;
 }
 
 /**
@@ -250,10 +502,9 @@ class PathResolution
 public:
     /**
      * Constructor
-     * \param fs map of all mounted filesystems
+     * \param fsm the filesystem manager, whose mutex must be locked
      */
-    PathResolution(const map<StringPart,intrusive_ref_ptr<FilesystemBase> >& fs)
-            : filesystems(fs) {}
+    PathResolution(FilesystemManager& fsm) : fsm(fsm) {}
     
     /**
      * The main purpose of this class, resolve a path
@@ -263,7 +514,7 @@ public:
      * \param followLastSymlink if true, follow last symlink
      * \return a resolved path
      */
-    ResolvedPath resolvePath(string& path, bool followLastSymlink);
+    ResolvedPath resolvePath(PathBuffer& path, bool followLastSymlink);
     
 private:
     /**
@@ -272,16 +523,18 @@ private:
      * \param slash path[slash] is the / character after the ..
      * \return 0 on success, a negative number on error
      */
-    int upPathComponent(string& path, size_t slash);
+    int upPathComponent(PathBuffer& path, size_t slash);
     
     /**
      * Handle a normal path component in a path, i.e, a path component
      * that is neither //, /./ or /../
      * \param path path string
+     * \param start path[start] is the first char of the path component
      * \param followIfSymlink if true, follow symbolic links
      * \return 0 on success, or a negative number on error
      */
-    int normalPathComponent(string& path, bool followIfSymlink);
+    int normalPathComponent(PathBuffer& path, size_t start,
+            bool followIfSymlink);
     
     /**
      * Follow a symbolic link
@@ -289,17 +542,18 @@ private:
      * must be a symbolic link (verified by the caller).
      * \return 0 on success, a negative number on failure
      */
-    int followSymlink(string& path);
+    int followSymlink(PathBuffer& path);
     
     /**
-     * Find to which filesystem this path belongs
+     * Find to which filesystem the path up to index belongs, walking the
+     * trie of mountpoints from the root
      * \param path path string.
      * \return 0 on success, a negative number on failure
      */
-    int recursiveFindFs(string& path);
+    int recursiveFindFs(PathBuffer& path);
 
-    /// Mounted filesystems
-    const map<StringPart,intrusive_ref_ptr<FilesystemBase> >& filesystems;
+    /// The filesystem manager, for mountpoints and the path prefix cache
+    FilesystemManager& fsm;
     
     /// Pointer to root filesystem
     intrusive_ref_ptr<FilesystemBase> root;
@@ -307,6 +561,10 @@ private:
     /// Current filesystem while looking up path
     intrusive_ref_ptr<FilesystemBase> fs;
     
+    /// Trie node of the path looked up so far, nullptr if no mountpoint can
+    /// be found further down the path
+    const FilesystemManager::MountpointNode *node;
+    
     /// True if current filesystem supports symlinks
     bool syms;
     
@@ -326,20 +584,34 @@ private:
     static const int maxLinkToFollow=2;
 };
 
-ResolvedPath PathResolution::resolvePath(string& path, bool followLastSymlink)
+ResolvedPath PathResolution::resolvePath(PathBuffer& path, bool followLastSymlink)
 {
-    map<StringPart,intrusive_ref_ptr<FilesystemBase> >::const_iterator it;
-    it=filesystems.find(StringPart("/"));
-    if(it==filesystems.end()) return ResolvedPath(-ENOENT); //should not happen
-    root=fs=it->second;
+    node=fsm.mountpoints;
+    if(node==nullptr || !node->fs) return ResolvedPath(-ENOENT); //should not happen
+    root=fs=node->fs;
     syms=fs->supportsSymlinks();
     index=1;       //Skip leading /
     indexIntoFs=1; //NOTE: caller must ensure path[0]=='/'
     depthIntoFs=1;
     linksFollowed=0;
+    //Skip the part of the path that has already been resolved, if cached
+    if(auto cached=fsm.findCachedPrefix(path))
+    {
+        fs=cached->fs;
+        syms=fs->supportsSymlinks();
+        node=cached->node;
+        index=cached->len+1;
+        indexIntoFs=cached->indexIntoFs;
+        depthIntoFs=cached->depthIntoFs;
+    }
+    //The directory prefix can be cached only if it has been resolved as is
+    bool cacheable=true;
+    FilesystemManager::CachedPrefix prefix;
+    prefix.len=0;
+    FilesystemBase *prefixFs=nullptr;
     for(;;)
     {
-        size_t slash=path.find_first_of('/',index);
+        size_t slash=path.find('/',index);
         //cout<<path.substr(0,slash)<<endl;
         //Last component (no trailing /)
         if(slash==string::npos) slash=path.length(); //NOTE: one past the last
@@ -348,23 +620,43 @@ ResolvedPath PathResolution::resolvePath(string& path, bool followLastSymlink)
         {
             //Path component is empty, caused by double slash, remove it
             path.erase(index,1);
+            cacheable=false;
         } else if(slash-index==1 && path[index]=='.')
         {
             path.erase(index,2); //Path component is ".", ignore
+            cacheable=false;
         } else if(slash-index==2 && path[index]=='.' && path[index+1]=='.')
         {
             int result=upPathComponent(path,slash);
             if(result<0) return ResolvedPath(result);
+            cacheable=false;
         } else {
+            size_t start=index;
             index=slash+1; //NOTE: if(slash==string::npos) two past the last
             // follow=followLastSymlink for "/link", but is true for "/link/"
             bool follow=index>path.length() ? followLastSymlink : true;
-            int result=normalPathComponent(path,follow);
+            int result=normalPathComponent(path,start,follow);
             if(result<0) return ResolvedPath(result);
+            if(linksFollowed>0) cacheable=false;
+            if(cacheable && index<path.length())
+            {
+                //Not the last component, remember the state after it. The
+                //filesystem is not copied here to save atomic operations
+                prefixFs=fs.get();
+                prefix.len=slash;
+                prefix.node=node;
+                prefix.indexIntoFs=indexIntoFs;
+                prefix.depthIntoFs=depthIntoFs;
+            }
         }
         //Last component
         if(index>=path.length())
         {
+            if(cacheable && prefix.len>0)
+            {
+                prefix.fs=prefixFs;
+                fsm.addCachedPrefix(path,prefix);
+            }
             //Remove trailing /
             size_t last=path.length()-1;
             if(path[last]=='/')
@@ -378,33 +670,29 @@ ResolvedPath PathResolution::resolvePath(string& path, bool followLastSymlink)
     }
 }
 
-int PathResolution::upPathComponent(string& path, size_t slash)
+int PathResolution::upPathComponent(PathBuffer& path, size_t slash)
 {
     if(index<=1) return -ENOENT; //root dir has no parent
-    size_t removeStart=path.find_last_of('/',index-2);
+    size_t removeStart=path.rfind('/',index-2);
     if(removeStart==string::npos) return -ENOENT; //should not happen
     path.erase(removeStart,slash-removeStart);
     index=removeStart+1;
     //This may happen when merging a path like "/dir/.."
-    if(path.empty()) path='/';
-    //This may happen if the new last path component is a fs, e.g. "/dev/null/.."
-    if(indexIntoFs>path.length()) indexIntoFs=path.length();
-    if(--depthIntoFs>0) return 0;
-    
-    //Depth went to zero, escape current filesystem
+    if(path.empty()) path.assign("/",1);
+    //Find again the filesystem and trie node, as the path went backwards
     return recursiveFindFs(path);
 }
 
-int PathResolution::normalPathComponent(string& path, bool followIfSymlink)
+int PathResolution::normalPathComponent(PathBuffer& path, size_t start,
+        bool followIfSymlink)
 {
-    map<StringPart,intrusive_ref_ptr<FilesystemBase> >::const_iterator it;
-    it=filesystems.find(StringPart(path,index-1));
-    if(it!=filesystems.end())
+    if(node) node=node->find(path.c_str()+start,index-1-start);
+    if(node && node->fs)
     {
         //Jumped to a new filesystem. Not stat-ing the path as we're
         //relying on mount not allowing to mount a filesystem on anything
         //but a directory.
-        fs=it->second;
+        fs=node->fs;
         syms=fs->supportsSymlinks();
         indexIntoFs=index>path.length() ? index-1 : index;
         depthIntoFs=1;
@@ -415,7 +703,7 @@ int PathResolution::normalPathComponent(string& path, bool followIfSymlink)
     {
         struct stat st;
         {
-            StringPart sp(path,index-1,indexIntoFs);
+            StringPart sp(path.data(),index-1,indexIntoFs);
             if(int res=fs->lstat(sp,&st)<0) return res;
         }
         if(S_ISLNK(st.st_mode)) return followSymlink(path);
@@ -424,72 +712,60 @@ int PathResolution::normalPathComponent(string& path, bool followIfSymlink)
     return 0;
 }
 
-int PathResolution::followSymlink(string& path)
+int PathResolution::followSymlink(PathBuffer& path)
 {
     if(++linksFollowed>=maxLinkToFollow) return -ELOOP;
     string target;
     {
-        StringPart sp(path,index-1,indexIntoFs);
+        StringPart sp(path.data(),index-1,indexIntoFs);
         if(int res=fs->readlink(sp,target)<0) return res;
     }
     if(target.empty()) return -ENOENT; //Should not happen
     if(target[0]=='/')
     {
-        //Symlink is absolute
-        size_t newPathLen=target.length()+path.length()-index+1;
-        if(newPathLen>PATH_MAX) return -ENAMETOOLONG;
-        string newPath;
-        newPath.reserve(newPathLen);
-        newPath=target;
-        if(index<=path.length())
-            newPath.insert(newPath.length(),path,index-1,string::npos);
-        path.swap(newPath);
+        //Symlink is absolute, replace everything up to the link
+        size_t end=index<=path.length() ? index-1 : path.length();
+        if(path.replace(0,end,target.c_str(),target.length())==false)
+            return -ENAMETOOLONG;
         fs=root;
         syms=root->supportsSymlinks();
+        node=fsm.mountpoints;
         index=1;
         indexIntoFs=1;
         depthIntoFs=1;
     } else {
-        //Symlink is relative
-        size_t removeStart=path.find_last_of('/',index-2);
-        size_t newPathLen=path.length()-(index-removeStart-2)+target.length();
-        if(newPathLen>PATH_MAX) return -ENAMETOOLONG;
-        string newPath;
-        newPath.reserve(newPathLen);
-        newPath.insert(0,path,0,removeStart+1);
-        newPath+=target;
-        if(index<=path.length())
-            newPath.insert(newPath.length(),path,index-1,string::npos);
-        path.swap(newPath);
+        //Symlink is relative, replace the last path component
+        size_t removeStart=path.rfind('/',index-2);
+        size_t end=index<=path.length() ? index-1 : path.length();
+        if(path.replace(removeStart+1,end-removeStart-1,target.c_str(),
+                target.length())==false) return -ENAMETOOLONG;
         index=removeStart+1;
-        depthIntoFs--;
+        //Find again the trie node, as the path went backwards
+        return recursiveFindFs(path);
     }
     return 0;
 }
 
-int PathResolution::recursiveFindFs(string& path)
+int PathResolution::recursiveFindFs(PathBuffer& path)
 {
+    node=fsm.mountpoints;
+    fs=root;
+    indexIntoFs=1;
     depthIntoFs=1;
-    size_t backIndex=index;
-    for(;;)
+    //Walk the path components before index, the last one may end either
+    //with a / or at the end of the path
+    for(size_t start=1;start<index && start<path.length();)
     {
-        backIndex=path.find_last_of('/',backIndex-1);
-        if(backIndex==string::npos) return -ENOENT; //should not happpen
-        if(backIndex==0)
+        size_t slash=path.find('/',start);
+        if(slash==string::npos) slash=path.length();
+        if(node) node=node->find(path.c_str()+start,slash-start);
+        if(node && node->fs)
         {
-            fs=root;
-            indexIntoFs=1;
-            break;
-        }
-        map<StringPart,intrusive_ref_ptr<FilesystemBase> >::const_iterator it;
-        it=filesystems.find(StringPart(path,backIndex));
-        if(it!=filesystems.end())
-        {
-            fs=it->second;
-            indexIntoFs=backIndex+1;
-            break;
-        }
-        depthIntoFs++;
+            fs=node->fs;
+            indexIntoFs=min(slash+1,path.length());
+            depthIntoFs=1;
+        } else depthIntoFs++;
+        start=slash+1;
     }
     syms=fs->supportsSymlinks();
     return 0;
@@ -511,20 +787,24 @@ int FilesystemManager::kmount(const char* path, intrusive_ref_ptr<FilesystemBase
     Lock<FastMutex> l(mutex);
     size_t len=strlen(path);
     if(len>PATH_MAX) return -ENAMETOOLONG;
-    string temp(path);
-    if(!(temp=="/" && filesystems.empty())) //Skip check when mounting /
+    if(!(strcmp(path,"/")==0 && filesystems.empty())) //Skip check when mounting /
     {
         struct stat st;
+        PathBuffer temp;
+        temp.assign(path,len);
         if(int result=statHelper(temp,&st,false)) return result;
         if(!S_ISDIR(st.st_mode)) return -ENOTDIR;
-        string parent=temp+"/..";
+        PathBuffer parent;
+        parent.assign(path,len);
+        if(parent.append("/..",3)==false) return -ENAMETOOLONG;
         if(int result=statHelper(parent,&st,false)) return result;
         fs->setParentFsMountpointInode(st.st_ino);
     }
-    if(filesystems.insert(make_pair(StringPart(temp),fs)).second==false)
+    if(filesystems.insert(make_pair(StringPart(path),fs)).second==false)
         return -EBUSY; //Means already mounted
-    else
-        return 0;
+    rebuildMountpoints();
+    invalidatePathCache();
+    return 0;
 }
 
 int FilesystemManager::umount(const char* path, bool force)
@@ -611,8 +891,10 @@ int FilesystemManager::umount(const char* path, bool force)
     }
     
     //It is now safe to umount all filesystems
+    invalidatePathCache();
     for(it5=fsToUmount.begin();it5!=fsToUmount.end();++it5)
         filesystems.erase(*it5);
+    rebuildMountpoints();
     return 0;
 }
 
@@ -625,22 +907,34 @@ void FilesystemManager::umountAll()
     #else //WITH_PROCESSES
     getFileDescriptorTable().closeAll();
     #endif //WITH_PROCESSES
+    invalidatePathCache();
     filesystems.clear();
+    rebuildMountpoints();
 }
 
-ResolvedPath FilesystemManager::resolvePath(string& path, bool followLastSymlink)
+ResolvedPath FilesystemManager::resolvePath(PathBuffer& path,
+        bool followLastSymlink)
 {
     //see man path_resolution. This code supports arbitrarily mounted
     //filesystems, symbolic links resolution, but no hardlinks to directories
-    if(path.length()>PATH_MAX) return ResolvedPath(-ENAMETOOLONG);
     if(path.empty() || path[0]!='/') return ResolvedPath(-ENOENT);
 
     Lock<FastMutex> l(mutex);
-    PathResolution pr(filesystems);
+    PathResolution pr(*this);
     return pr.resolvePath(path,followLastSymlink);
 }
 
-int FilesystemManager::unlinkHelper(string& path)
+ResolvedPath FilesystemManager::resolvePath(string& path, bool followLastSymlink)
+{
+    PathBuffer buffer;
+    if(buffer.assign(path.c_str(),path.length())==false)
+        return ResolvedPath(-ENAMETOOLONG);
+    ResolvedPath result=resolvePath(buffer,followLastSymlink);
+    if(result.result==0) path=buffer.c_str();
+    return result;
+}
+
+int FilesystemManager::unlinkHelper(PathBuffer& path)
 {
     //Do everything while keeping the mutex locked to prevent someone to
     //concurrently mount a filesystem on the directory we're unlinking
@@ -648,20 +942,41 @@ int FilesystemManager::unlinkHelper(string& path)
     ResolvedPath openData=resolvePath(path,true);
     if(openData.result<0) return openData.result;
     //After resolvePath() so path is in canonical form and symlinks are followed
-    if(filesystems.find(StringPart(path))!=filesystems.end()) return -EBUSY;
-    StringPart sp(path,string::npos,openData.off);
-    return openData.fs->unlink(sp);
+    if(filesystems.find(StringPart(path.c_str()))!=filesystems.end())
+        return -EBUSY;
+    StringPart sp(path.data(),string::npos,openData.off);
+    int result=openData.fs->unlink(sp);
+    //The unlinked path may have been a cached directory
+    if(result==0) invalidatePathCache();
+    return result;
+}
+
+int FilesystemManager::rmdirHelper(PathBuffer& path)
+{
+    //Do everything while keeping the mutex locked to prevent someone to
+    //concurrently mount a filesystem on the directory we're removing
+    Lock<FastMutex> l(mutex);
+    ResolvedPath openData=resolvePath(path,true);
+    if(openData.result<0) return openData.result;
+    //After resolvePath() so path is in canonical form and symlinks are followed
+    if(filesystems.find(StringPart(path.c_str()))!=filesystems.end())
+        return -EBUSY;
+    StringPart sp(path.data(),string::npos,openData.off);
+    int result=openData.fs->rmdir(sp);
+    //The removed directory may have been cached
+    if(result==0) invalidatePathCache();
+    return result;
 }
 
-int FilesystemManager::statHelper(string& path, struct stat *pstat, bool f)
+int FilesystemManager::statHelper(PathBuffer& path, struct stat *pstat, bool f)
 {
     ResolvedPath openData=resolvePath(path,f);
     if(openData.result<0) return openData.result;
-    StringPart sp(path,string::npos,openData.off);
+    StringPart sp(path.data(),string::npos,openData.off);
     return openData.fs->lstat(sp,pstat);
 }
 
-int FilesystemManager::renameHelper(string& oldPath, string& newPath)
+int FilesystemManager::renameHelper(PathBuffer& oldPath, PathBuffer& newPath)
 {
     //Do everything while keeping the mutex locked to prevent someone to
     //concurrently mount a filesystem on the directory we're renaming
@@ -674,15 +989,115 @@ int FilesystemManager::renameHelper(string& oldPath, string& newPath)
     if(oldOpenData.fs!=newOpenData.fs) return -EXDEV; //Can't rename across fs
     
     //After resolvePath() so path is in canonical form and symlinks are followed
-    if(filesystems.find(StringPart(oldPath))!=filesystems.end()) return -EBUSY;
-    if(filesystems.find(StringPart(newPath))!=filesystems.end()) return -EBUSY;
+    if(filesystems.find(StringPart(oldPath.c_str()))!=filesystems.end())
+        return -EBUSY;
+    if(filesystems.find(StringPart(newPath.c_str()))!=filesystems.end())
+        return -EBUSY;
     
-    StringPart oldSp(oldPath,string::npos,oldOpenData.off);
-    StringPart newSp(newPath,string::npos,newOpenData.off);
+    StringPart oldSp(oldPath.data(),string::npos,oldOpenData.off);
+    StringPart newSp(newPath.data(),string::npos,newOpenData.off);
     
     //Can't rename a directory into a subdirectory of itself
     if(newSp.startsWith(oldSp)) return -EINVAL;
-    return oldOpenData.fs->rename(oldSp,newSp);
+    int result=oldOpenData.fs->rename(oldSp,newSp);
+    //The renamed path may have been a cached directory
+    if(result==0) invalidatePathCache();
+    return result;
+}
+
+void FilesystemManager::rebuildMountpoints()
+{
+    deleteMountpoints(mountpoints);
+    mountpoints=nullptr;
+    map<StringPart,intrusive_ref_ptr<FilesystemBase> >::iterator it;
+    for(it=filesystems.begin();it!=filesystems.end();++it)
+    {
+        if(mountpoints==nullptr)
+        {
+            mountpoints=new MountpointNode;
+            mountpoints->name="";
+            mountpoints->len=0;
+            mountpoints->child=mountpoints->sibling=nullptr;
+        }
+        //Keys are absolute paths without trailing /, or "/" for the root
+        MountpointNode *node=mountpoints;
+        const char *path=it->first.c_str();
+        size_t start=1;
+        while(path[start]!='\0')
+        {
+            const char *slash=strchr(path+start,'/');
+            size_t len=slash ? slash-(path+start) : strlen(path+start);
+            MountpointNode *child=const_cast<MountpointNode*>(
+                node->find(path+start,len));
+            if(child==nullptr)
+            {
+                child=new MountpointNode;
+                child->name=path+start;
+                child->len=len;
+                child->child=nullptr;
+                child->sibling=node->child;
+                node->child=child;
+            }
+            node=child;
+            start+=len;
+            if(path[start]=='/') start++;
+        }
+        node->fs=it->second;
+    }
+}
+
+void FilesystemManager::deleteMountpoints(MountpointNode *node)
+{
+    while(node)
+    {
+        deleteMountpoints(node->child);
+        MountpointNode *next=node->sibling;
+        delete node;
+        node=next;
+    }
+}
+
+void FilesystemManager::invalidatePathCache()
+{
+    for(int i=0;i<pathCacheSize;i++)
+    {
+        pathCache[i].len=0;
+        pathCache[i].fs.reset();
+    }
+}
+
+const FilesystemManager::CachedPrefix *FilesystemManager::findCachedPrefix(
+        const PathBuffer& path)
+{
+    CachedPrefix *result=nullptr;
+    for(int i=0;i<pathCacheSize;i++)
+    {
+        CachedPrefix& c=pathCache[i];
+        //The prefix must be followed by a / and at least another path component
+        if(c.len==0 || c.len+1>=path.length() || path[c.len]!='/') continue;
+        if(result && result->len>=c.len) continue;
+        if(memcmp(c.path,path.c_str(),c.len)==0) result=&c;
+    }
+    if(result) result->lastUse=++pathCacheClock;
+    return result;
+}
+
+void FilesystemManager::addCachedPrefix(const PathBuffer& path,
+        const CachedPrefix& prefix)
+{
+    if(prefix.len>sizeof(prefix.path)) return;
+    CachedPrefix *victim=&pathCache[0];
+    for(int i=0;i<pathCacheSize;i++)
+    {
+        CachedPrefix& c=pathCache[i];
+        //Already cached, happens when resuming from the cached prefix itself
+        if(c.len==prefix.len && memcmp(c.path,path.c_str(),c.len)==0) return;
+        if(c.len==0) { victim=&c; break; }
+        if(c.lastUse<victim->lastUse) victim=&c;
+    }
+    *victim=prefix;
+    memcpy(victim->path,path.c_str(),prefix.len);
+    victim->lastUse=++pathCacheClock;
 }
 
 short int FilesystemManager::getFilesystemId()
@@ -717,21 +1132,16 @@ basicFilesystemSetup(intrusive_ref_ptr<Device> dev)
     #endif //WITH_DEVFS
     
     bootlog("Mounting Fat32Fs as /sd ... ");
-    bool fat32failed=false;
-    intrusive_ref_ptr<FileBase> disk;
+    bool fat32failed=!dev;
     #ifdef WITH_DEVFS
     if(dev) devfs->addDevice("sda",dev);
-    StringPart sda("sda");
-    if(devfs->open(disk,sda,O_RDWR,0)<0) fat32failed=true;
-    #else //WITH_DEVFS
-    if(dev && dev->open(disk,intrusive_ref_ptr<FilesystemBase>(0),O_RDWR,0)<0)
-        fat32failed=true;
     #endif //WITH_DEVFS
     
+    //Fat32Fs accesses the device directly, not through a file opened on it
     intrusive_ref_ptr<Fat32Fs> fat32;
     if(fat32failed==false)
     {
-        fat32=new Fat32Fs(disk);
+        fat32=new Fat32Fs(dev);
         if(fat32->mountFailed()) fat32failed=true;
     }
     if(fat32failed==false)
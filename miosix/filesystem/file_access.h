@@ -36,6 +36,7 @@
 #include "file.h"
 #include "stringpart.h"
 #include "devfs/devfs.h"
+#include "ioctl.h"
 #include "kernel/sync.h"
 #include "kernel/intrusive.h"
 #include "config/miosix_settings.h"
@@ -123,6 +124,21 @@ public:
      */
     void closeAll();
     
+    /**
+     * \return the maximum number of files that can be open at the same time
+     * through this table
+     */
+    int getMaxOpenFiles() const { return maxOpenFiles; }
+    
+    /**
+     * Set the maximum number of files that can be open at the same time
+     * through this table. The table grows on demand up to this limit
+     * \param n the new limit, from 3 to MAX_OPEN_FILES
+     * \return 0 on success, or a negative number on failure. EBUSY is
+     * returned if a file descriptor greater or equal to n is in use
+     */
+    int setMaxOpenFiles(int n);
+    
     /**
      * Write data to the file, if the file supports writing.
      * \param data the data to write
@@ -136,7 +152,7 @@ public:
         //Important, since len is specified by standard to be unsigned, but the
         //return value has to be signed
         if(static_cast<ssize_t>(len)<0) return -EINVAL;
-        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        FileRef file(*this,fd);
         if(!file) return -EBADF;
         return file->write(data,len);
     }
@@ -154,7 +170,7 @@ public:
         //Important, since len is specified by standard to be unsigned, but the
         //return value has to be signed
         if(static_cast<ssize_t>(len)<0) return -EINVAL;
-        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        FileRef file(*this,fd);
         if(!file) return -EBADF;
         return file->read(data,len);
     }
@@ -169,11 +185,77 @@ public:
      */
     off_t lseek(int fd, off_t pos, int whence)
     {
-        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        FileRef file(*this,fd);
         if(!file) return -EBADF;
         return file->lseek(pos,whence);
     }
     
+    /**
+     * Write data from multiple buffers to the file, as a single write.
+     * \param iov buffers to write
+     * \param iovcnt number of buffers
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+    {
+        if(int result=checkIovec(iov,iovcnt)) return result;
+        FileRef file(*this,fd);
+        if(!file) return -EBADF;
+        return file->writev(iov,iovcnt);
+    }
+    
+    /**
+     * Read data from the file into multiple buffers, as a single read.
+     * \param iov buffers to fill
+     * \param iovcnt number of buffers
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+    {
+        if(int result=checkIovec(iov,iovcnt)) return result;
+        FileRef file(*this,fd);
+        if(!file) return -EBADF;
+        return file->readv(iov,iovcnt);
+    }
+    
+    /**
+     * Write data at a given position without moving the file pointer, if the
+     * file supports random-access.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    ssize_t pwrite(int fd, const void *data, size_t len, off_t pos)
+    {
+        if(data==0) return -EFAULT;
+        if(static_cast<ssize_t>(len)<0 || pos<0) return -EINVAL;
+        FileRef file(*this,fd);
+        if(!file) return -EBADF;
+        return file->pwrite(data,len,pos);
+    }
+    
+    /**
+     * Read data from a given position without moving the file pointer, if the
+     * file supports random-access.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    ssize_t pread(int fd, void *data, size_t len, off_t pos)
+    {
+        if(data==0) return -EFAULT;
+        if(static_cast<ssize_t>(len)<0 || pos<0) return -EINVAL;
+        FileRef file(*this,fd);
+        if(!file) return -EBADF;
+        return file->pread(data,len,pos);
+    }
+    
     /**
      * Return file information.
      * \param pstat pointer to stat struct
@@ -182,7 +264,7 @@ public:
     int fstat(int fd, struct stat *pstat) const
     {
         if(pstat==0) return -EFAULT;
-        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        FileRef file(*this,fd);
         if(!file) return -EBADF;
         return file->fstat(pstat);
     }
@@ -194,7 +276,7 @@ public:
      */
     int isatty(int fd) const
     {
-        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        FileRef file(*this,fd);
         if(!file) return -EBADF;
         return file->isatty();
     }
@@ -229,7 +311,7 @@ public:
      */
     int fcntl(int fd, int cmd, int opt)
     {
-        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        FileRef file(*this,fd);
         if(!file) return -EBADF;
         return file->fcntl(cmd,opt);
     }
@@ -243,10 +325,41 @@ public:
     int ioctl(int fd, int cmd, void *arg)
     {
         //arg unchecked here, as some ioctl don't use it
-        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        FileRef file(*this,fd);
         if(!file) return -EBADF;
         return file->ioctl(cmd,arg);
     }
+
+    /**
+     * Write back to the disk the data written to a file and its metadata
+     * \param fd file descriptor
+     * \return 0 on success, or a negative number on failure
+     */
+    int fsync(int fd) { return syncHelper(fd,IOCTL_SYNC); }
+
+    /**
+     * Write back to the disk the data written to a file, and only the
+     * metadata needed to read it back
+     * \param fd file descriptor
+     * \return 0 on success, or a negative number on failure
+     */
+    int fdatasync(int fd) { return syncHelper(fd,IOCTL_DATASYNC); }
+
+    /**
+     * Allocate disk space for a range of a file
+     * \param fd file descriptor
+     * \param mode 0 or FALLOC_FL_KEEP_SIZE
+     * \param offset start of the range
+     * \param len length of the range
+     * \return 0 on success, or a negative number on failure
+     */
+    int fallocate(int fd, int mode, off_t offset, off_t len)
+    {
+        if(offset<0 || len<=0) return -EINVAL;
+        FileRef file(*this,fd);
+        if(!file) return -EBADF;
+        return file->fallocate(mode,offset,len);
+    }
     
     /**
      * List directory content
@@ -260,11 +373,30 @@ public:
     {
         if(dp==0) return -EFAULT;
         if(reinterpret_cast<unsigned>(dp) & 0x3) return -EFAULT; //Not aligned
-        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        FileRef file(*this,fd);
         if(!file) return -EBADF;
         return file->getdents(dp,len);
     }
     
+    /**
+     * Wait until one of a set of files is ready for reading or writing
+     * \param fds files to wait for and events of interest. On return, the
+     * revents field is filled with the events that occurred
+     * \param nfds number of elements of fds
+     * \param timeout timeout in milliseconds, 0 to return immediately, or a
+     * negative number to wait forever
+     * \return the number of elements of fds with nonzero revents, 0 on
+     * timeout, or a negative number on failure
+     */
+    int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+    
+    /**
+     * Create an anonymous pipe
+     * \param fds on success, fds[0] is the read end and fds[1] the write end
+     * \return 0 on success, or a negative number on failure
+     */
+    int pipe(int fds[2]);
+    
     /**
      * Return current directory
      * \param buf the current directory is stored here
@@ -295,6 +427,38 @@ public:
      */
     int rmdir(const char *name);
     
+    /**
+     * Create a named FIFO
+     * \param name FIFO to create
+     * \param mode FIFO permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    int mkfifo(const char *name, int mode);
+
+    /**
+     * Obtain information on the filesystem a file is on
+     * \param name path of a file in the filesystem
+     * \param buf filesystem information is stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    int statvfs(const char *name, struct statvfs *buf);
+
+    /**
+     * Obtain information on the filesystem an open file is on
+     * \param fd file descriptor
+     * \param buf filesystem information is stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    int fstatvfs(int fd, struct statvfs *buf)
+    {
+        if(buf==nullptr) return -EFAULT;
+        FileRef file(*this,fd);
+        if(!file) return -EBADF;
+        //Files such as pipes don't belong to a filesystem
+        if(!file->getParent()) return -EINVAL;
+        return file->getParent()->statvfs(buf);
+    }
+    
     /**
      * Remove a file or directory
      * \param name file or directory to remove
@@ -319,8 +483,7 @@ public:
      */
     intrusive_ref_ptr<FileBase> getFile(int fd) const
     {
-        if(fd<0 || fd>=MAX_OPEN_FILES) return intrusive_ref_ptr<FileBase>();
-        return atomic_load(files+fd);
+        return atomic_load(entry(fd));
     }
     
     /**
@@ -329,13 +492,169 @@ public:
     ~FileDescriptorTable();
     
 private:
+    /**
+     * A file looked up in the table for the duration of a single operation.
+     * The common case borrows the file without touching its reference count,
+     * by publishing it in the hazard slot of the current thread. If the slot
+     * is already in use, as when an operation on a file is nested in another
+     * one, a refcounted pointer is used instead
+     */
+    class FileRef
+    {
+    public:
+        /**
+         * Constructor
+         * \param table the file descriptor table
+         * \param fd file descriptor, index into the table
+         */
+        FileRef(const FileDescriptorTable& table, int fd) : table(table),
+                borrowed(nullptr)
+        {
+            if(Thread::getHazardPointer()==nullptr)
+                borrowed=table.borrowFile(fd);
+            else ref=table.getFile(fd);
+        }
+
+        /**
+         * \return true if the file descriptor was not open
+         */
+        bool operator!() const { return borrowed==nullptr && !ref; }
+
+        /**
+         * \return the file
+         */
+        FileBase *operator->() const { return borrowed ? borrowed : ref.get(); }
+
+        /**
+         * Destructor
+         */
+        ~FileRef() { if(borrowed) table.releaseFile(); }
+
+    private:
+        FileRef(const FileRef&);
+        FileRef& operator= (const FileRef&);
+
+        const FileDescriptorTable& table;
+        FileBase *borrowed;              ///< The borrowed file, if any
+        intrusive_ref_ptr<FileBase> ref; ///< Used if the slot was in use
+    };
+
+    /**
+     * The table is allocated in chunks of file descriptors, as it grows
+     */
+    struct FileChunk
+    {
+        intrusive_ref_ptr<FileBase> files[FILE_TABLE_CHUNK_SIZE];
+    };
+    
+    static const int numChunks=
+        (MAX_OPEN_FILES+FILE_TABLE_CHUNK_SIZE-1)/FILE_TABLE_CHUNK_SIZE;
+    static const int bitmapWords=(MAX_OPEN_FILES+31)/32;
+    
+    /**
+     * \param fd file descriptor, index into the table
+     * \return the table entry, or nullptr if the index is out of bounds or
+     * the chunk containing it has not been allocated
+     */
+    intrusive_ref_ptr<FileBase> *entry(int fd) const
+    {
+        if(fd<0 || fd>=MAX_OPEN_FILES) return nullptr;
+        FileChunk *chunk=chunks[fd/FILE_TABLE_CHUNK_SIZE];
+        if(chunk==nullptr) return nullptr;
+        return &chunk->files[fd%FILE_TABLE_CHUNK_SIZE];
+    }
+    
+    /**
+     * Reserve the lowest free file descriptor, starting from 3, growing the
+     * table if needed. The file is then stored with atomic_store()
+     * \return the file descriptor, or a negative number on failure
+     */
+    int reserveFd();
+    
+    /**
+     * Mark a file descriptor as free. Must be called with the mutex locked
+     * \param fd file descriptor, index into the table
+     */
+    void freeFd(int fd) { usedFds[fd/32] &= ~(1u<<(fd%32)); }
+    
+    /**
+     * Mark a file descriptor as in use. Must be called with the mutex locked
+     * \param fd file descriptor, index into the table
+     */
+    void useFd(int fd) { usedFds[fd/32] |= 1u<<(fd%32); }
+    
+    /**
+     * Allocate the chunk containing a file descriptor, if not already
+     * allocated. Must be called with the mutex locked
+     * \param fd file descriptor, index into the table
+     */
+    void growTable(int fd);
+    
+    /**
+     * A file removed from the table while a thread was still borrowing it
+     */
+    struct RetiredFile
+    {
+        intrusive_ref_ptr<FileBase> file;
+        RetiredFile *next;
+    };
+
+    /**
+     * Borrow a file, publishing it in the hazard slot of the current thread.
+     * The slot must be empty, and releaseFile() must be called when the
+     * returned file is no longer used
+     * \param fd file descriptor, index into the table
+     * \return the file, or nullptr if the file descriptor is not open, in
+     * which case the slot is left empty
+     */
+    FileBase *borrowFile(int fd) const
+    {
+        intrusive_ref_ptr<FileBase> *e=entry(fd);
+        if(e==nullptr) return nullptr;
+        for(;;)
+        {
+            FileBase *result=atomic_peek(e);
+            if(result==nullptr) break;
+            Thread::setHazardPointer(result);
+            //If the entry did not change after the hazard pointer has been
+            //published, close() will see the hazard pointer and defer the
+            //release of the file. Both accesses are volatile, so they are
+            //not reordered
+            if(atomic_peek(e)==result) return result;
+        }
+        Thread::setHazardPointer(nullptr);
+        return nullptr;
+    }
+
+    /**
+     * Release a file previously returned by borrowFile()
+     */
+    void releaseFile() const
+    {
+        Thread::setHazardPointer(nullptr);
+        //Reclaiming retired files does not change the content of the table
+        if(retired) const_cast<FileDescriptorTable*>(this)->reclaimFiles();
+    }
+
+    /**
+     * Release a file removed from the table, deferring the release if a
+     * thread is still borrowing it
+     * \param file the file removed from the table
+     */
+    void retireFile(intrusive_ref_ptr<FileBase> file);
+
+    /**
+     * Release the retired files that are no longer being borrowed
+     */
+    void reclaimFiles();
+
     /**
      * Append cwd to path if it is not an absolute path
      * \param path an absolute or relative path, must not be null
-     * \return an absolute path, or an empty string if the path would exceed
-     * PATH_MAX
+     * \param result the absolute path is stored here
+     * \return 0 on success, or -ENAMETOOLONG if the path would exceed PATH_MAX
      */
-    std::string absolutePath(const char *path);
+    int absolutePath(const char *path, PathBuffer& result);
     
     /**
      * Return file information (implements both stat and lstat)
@@ -347,12 +666,60 @@ private:
      */
     int statImpl(const char *name, struct stat *pstat, bool f);
     
+    /**
+     * Implements both fsync and fdatasync
+     * \param fd file descriptor
+     * \param cmd IOCTL_SYNC or IOCTL_DATASYNC
+     * \return 0 on success, or a negative number on failure
+     */
+    int syncHelper(int fd, int cmd)
+    {
+        FileRef file(*this,fd);
+        if(!file) return -EBADF;
+        int result=file->ioctl(cmd,nullptr);
+        //Files such as pipes have nothing to write back
+        return result==-ENOTTY ? -EINVAL : result;
+    }
+    
+    /**
+     * Validate the buffers passed to readv() or writev()
+     * \param iov buffers
+     * \param iovcnt number of buffers
+     * \return 0 if valid, or a negative number on failure
+     */
+    static int checkIovec(const struct iovec *iov, int iovcnt)
+    {
+        if(iovcnt<0 || iovcnt>IOV_MAX) return -EINVAL;
+        if(iovcnt>0 && iov==0) return -EFAULT;
+        //The total size has to fit in the signed return value
+        size_t total=0;
+        for(int i=0;i<iovcnt;i++)
+        {
+            if(iov[i].iov_len>0 && iov[i].iov_base==0) return -EFAULT;
+            total+=iov[i].iov_len;
+            if(static_cast<ssize_t>(total)<0 || total<iov[i].iov_len)
+                return -EINVAL;
+        }
+        return 0;
+    }
+    
     FastMutex mutex; ///< Locks on writes to file object pointers, not on accesses
     
     std::string cwd; ///< Current working directory
     
-    /// Holds the mapping between fd and file objects
-    intrusive_ref_ptr<FileBase> files[MAX_OPEN_FILES];
+    /// Holds the mapping between fd and file objects. Chunks are only
+    /// deallocated by the destructor, so that borrowFile() can access them
+    /// without locking the mutex
+    FileChunk * volatile chunks[numChunks];
+    
+    /// Bitmap of file descriptors in use or reserved, protected by mutex
+    unsigned int usedFds[bitmapWords];
+    
+    /// Maximum number of open files, protected by mutex
+    int maxOpenFiles;
+
+    /// Files closed while being borrowed, protected by mutex
+    RetiredFile * volatile retired;
 };
 
 /**
@@ -423,6 +790,16 @@ public:
      *(the one that does not end with a /, if it exists, has to be followed)
      * \return the resolved path
      */
+    ResolvedPath resolvePath(PathBuffer& path, bool followLastSymlink=true);
+    
+    /**
+     * Resolve a path to identify the filesystem it belongs. Same as the other
+     * overload, for callers that have the path in an std::string
+     * \param path an absolute path name, that must start with '/'
+     * \param followLastSymlink true if the symlink in the last path component
+     *(the one that does not end with a /, if it exists, has to be followed)
+     * \return the resolved path
+     */
     ResolvedPath resolvePath(std::string& path, bool followLastSymlink=true);
     
     /**
@@ -432,7 +809,16 @@ public:
      * \param path path of file or directory to unlink
      * \return 0 on success, or a neagtive number on failure
      */
-    int unlinkHelper(std::string& path);
+    int unlinkHelper(PathBuffer& path);
+    
+    /**
+     * \internal
+     * Helper function to remove a directory. Only meant to be used by
+     * FileDescriptorTable::rmdir()
+     * \param path path of the directory to remove
+     * \return 0 on success, or a neagtive number on failure
+     */
+    int rmdirHelper(PathBuffer& path);
     
     /**
      * \internal
@@ -444,7 +830,7 @@ public:
      * false to not follow it (lstat)
      * \return 0 on success, or a negative number on failure
      */
-    int statHelper(std::string& path, struct stat *pstat, bool f);
+    int statHelper(PathBuffer& path, struct stat *pstat, bool f);
     
     /**
      * \internal
@@ -454,7 +840,7 @@ public:
      * \param newPath path of file or directory to unlink
      * \return 0 on success, or a neagtive number on failure
      */
-    int renameHelper(std::string& oldPath, std::string& newPath);
+    int renameHelper(PathBuffer& oldPath, PathBuffer& newPath);
     
     /**
      * \internal
@@ -500,16 +886,102 @@ private:
     /**
      * Constructor, private as it is a singleton
      */
-    FilesystemManager() : mutex(FastMutex::RECURSIVE) {}
+    FilesystemManager() : mutex(FastMutex::RECURSIVE), mountpoints(nullptr),
+            pathCacheClock(0) {}
     
     FilesystemManager(const FilesystemManager&);
     FilesystemManager& operator=(const FilesystemManager&);
     
+    /**
+     * A node in the trie of mountpoints. There is one node for each path
+     * component of each mountpoint, the root node is the "/" mountpoint
+     */
+    struct MountpointNode
+    {
+        /**
+         * \param s a path component, not null terminated
+         * \param n length of the path component
+         * \return the child node for that path component, or nullptr
+         */
+        const MountpointNode *find(const char *s, size_t n) const
+        {
+            for(const MountpointNode *c=child;c;c=c->sibling)
+                if(c->len==n && memcmp(c->name,s,n)==0) return c;
+            return nullptr;
+        }
+        
+        const char *name; ///< Path component, points into a filesystems key
+        size_t len;       ///< Length of the path component
+        intrusive_ref_ptr<FilesystemBase> fs; ///< Filesystem mounted here
+        MountpointNode *child;   ///< First child
+        MountpointNode *sibling; ///< Next child of the same parent
+    };
+    
+    /**
+     * A directory prefix of a previously resolved path, together with the
+     * state of the path resolution after that prefix, so that resolving other
+     * paths in the same directory does not need to resolve the prefix again
+     */
+    struct CachedPrefix
+    {
+        intrusive_ref_ptr<FilesystemBase> fs; ///< Filesystem of the prefix
+        const MountpointNode *node;   ///< Trie node of the prefix, or nullptr
+        unsigned short len;           ///< Prefix length, 0 if the entry is empty
+        unsigned short indexIntoFs;   ///< Start of relative path into fs
+        unsigned short depthIntoFs;   ///< Path components into fs
+        unsigned int lastUse;         ///< For least recently used replacement
+        char path[48];                ///< The prefix, not null terminated
+    };
+    
+    /**
+     * Rebuild the trie of mountpoints from filesystems. Must be called with
+     * the mutex locked every time filesystems is modified
+     */
+    void rebuildMountpoints();
+    
+    /**
+     * Deallocate a trie of mountpoints
+     * \param node root of the trie
+     */
+    static void deleteMountpoints(MountpointNode *node);
+    
+    /**
+     * Empty the cache of resolved path prefixes. Must be called with the mutex
+     * locked every time a filesystem is mounted or unmounted, and every time a
+     * path is renamed, unlinked or removed, as it may replace a cached
+     * directory with a symlink
+     */
+    void invalidatePathCache();
+    
+    /**
+     * Must be called with the mutex locked
+     * \param path an absolute path
+     * \return the longest cached directory prefix of path, or nullptr
+     */
+    const CachedPrefix *findCachedPrefix(const PathBuffer& path);
+    
+    /**
+     * Add a directory prefix to the cache of resolved path prefixes, replacing
+     * the least recently used entry. Must be called with the mutex locked
+     * \param path an absolute path, that has been resolved without removing
+     * path components or following symlinks
+     * \param prefix the cached entry, with all the fields except path and
+     * lastUse filled in. Prefixes too long to fit are not cached
+     */
+    void addCachedPrefix(const PathBuffer& path, const CachedPrefix& prefix);
+    
     FastMutex mutex; ///< To protect against concurrent access
     
     /// Mounted filesystem
     std::map<StringPart,intrusive_ref_ptr<FilesystemBase> > filesystems;
     
+    /// Trie of mountpoints, to find mountpoints in a path in linear time
+    MountpointNode *mountpoints;
+    
+    static const int pathCacheSize=4; ///< Number of cached path prefixes
+    CachedPrefix pathCache[pathCacheSize]; ///< Resolved path prefixes
+    unsigned int pathCacheClock;     ///< Incremented at every cache access
+    
     #ifdef WITH_PROCESSES
     std::list<FileDescriptorTable*> fileTables; ///< Process file tables
     #endif //WITH_PROCESSES
@@ -518,6 +990,8 @@ private:
     #endif //WITH_DEVFS
 
     static int devCount; ///< For assigning filesystemId to filesystems
+    
+    friend class PathResolution;
 };
 
 /**
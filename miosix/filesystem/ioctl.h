@@ -37,7 +37,9 @@ enum Ioctl
     IOCTL_TCSETATTR_NOW=102,
     IOCTL_TCSETATTR_FLUSH=103,
     IOCTL_TCSETATTR_DRAIN=104,
-    IOCTL_FLUSH=105
+    IOCTL_FLUSH=105,
+    IOCTL_FAST_SEEK=106,
+    IOCTL_DATASYNC=107
 };
 
 }
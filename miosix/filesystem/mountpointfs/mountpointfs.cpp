@@ -30,6 +30,7 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include "filesystem/stringpart.h"
+#include "kernel/slab.h"
 
 using namespace std;
 
@@ -40,7 +41,8 @@ namespace miosix {
 /**
  * Directory class for MountpointFs 
  */
-class MountpointFsDirectory : public DirectoryBase
+class MountpointFsDirectory : public DirectoryBase,
+        public SlabAllocated<MountpointFsDirectory>
 {
 public:
     /**
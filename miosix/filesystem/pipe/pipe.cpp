@@ -0,0 +1,286 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#include "pipe.h"
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <errno.h>
+
+using namespace std;
+
+#ifdef WITH_FILESYSTEM
+
+namespace miosix {
+
+/**
+ * \param flags file open flags
+ * \return true if the flags allow reading
+ */
+static inline bool isReader(int flags)
+{
+    return (flags & O_ACCMODE)==O_RDONLY || (flags & O_ACCMODE)==O_RDWR;
+}
+
+/**
+ * \param flags file open flags
+ * \return true if the flags allow writing
+ */
+static inline bool isWriter(int flags)
+{
+    return (flags & O_ACCMODE)==O_WRONLY || (flags & O_ACCMODE)==O_RDWR;
+}
+
+//
+// class Pipe
+//
+
+Pipe::Pipe() : readers(0), writers(0), head(0), used(0) {}
+
+int Pipe::open(int flags, bool rendezvous)
+{
+    bool reader=isReader(flags), writer=isWriter(flags);
+    {
+        Lock<FastMutex> l(mutex);
+        if(rendezvous && writer && !reader && (flags & O_NONBLOCK) && readers==0)
+            return -ENXIO;
+        if(reader) readers++;
+        if(writer) writers++;
+        cond.broadcast();
+        if(rendezvous && reader!=writer && (writer || !(flags & O_NONBLOCK)))
+        {
+            if(reader) while(writers==0) cond.wait(l);
+            else while(readers==0) cond.wait(l);
+        }
+    }
+    pollQueue.notify();
+    return 0;
+}
+
+void Pipe::close(int flags)
+{
+    {
+        Lock<FastMutex> l(mutex);
+        if(isReader(flags)) readers--;
+        if(isWriter(flags)) writers--;
+        //Data left in a FIFO when all its ends are closed is discarded
+        if(readers==0 && writers==0) head=used=0;
+        cond.broadcast();
+    }
+    pollQueue.notify();
+}
+
+ssize_t Pipe::read(void *data, size_t len, bool nonblock)
+{
+    if(len==0) return 0;
+    size_t n;
+    {
+        Lock<FastMutex> l(mutex);
+        while(used==0)
+        {
+            if(writers==0) return 0; //End of file
+            if(nonblock) return -EAGAIN;
+            cond.wait(l);
+        }
+        n=min<size_t>(len,used);
+        //Data may wrap around the end of the ring, so copy it in two parts
+        size_t first=min<size_t>(n,PIPE_BUFFER_SIZE-head);
+        memcpy(data,buffer+head,first);
+        memcpy(reinterpret_cast<char*>(data)+first,buffer,n-first);
+        used-=n;
+        head=used==0 ? 0 : (head+n) % PIPE_BUFFER_SIZE;
+        cond.broadcast();
+    }
+    pollQueue.notify();
+    return n;
+}
+
+ssize_t Pipe::write(const void *data, size_t len, bool nonblock)
+{
+    if(len==0) return 0;
+    const char *d=reinterpret_cast<const char*>(data);
+    size_t written=0;
+    Lock<FastMutex> l(mutex);
+    while(written<len)
+    {
+        if(readers==0) return written>0 ? written : -EPIPE;
+        //Writes that fit in the buffer are atomic, so wait for room for all
+        //of the data, while longer ones are split in as many parts as needed
+        size_t needed=len<=PIPE_BUFFER_SIZE ? len : 1;
+        size_t space=PIPE_BUFFER_SIZE-used;
+        if(space<needed)
+        {
+            if(nonblock) return written>0 ? written : -EAGAIN;
+            cond.wait(l);
+            continue;
+        }
+        size_t n=min(len-written,space);
+        size_t tail=(head+used) % PIPE_BUFFER_SIZE;
+        size_t first=min<size_t>(n,PIPE_BUFFER_SIZE-tail);
+        memcpy(buffer+tail,d+written,first);
+        memcpy(buffer,d+written+first,n-first);
+        used+=n;
+        written+=n;
+        cond.broadcast();
+        {
+            Unlock<FastMutex> u(l);
+            pollQueue.notify();
+        }
+    }
+    return written;
+}
+
+short Pipe::poll(short events, PollEntry *entry, int flags)
+{
+    pollQueue.add(entry);
+    Lock<FastMutex> l(mutex);
+    short result=0;
+    if(isReader(flags))
+    {
+        if(used>0) result|=events & (POLLIN | POLLRDNORM);
+        if(writers==0) result|=POLLHUP;
+    }
+    if(isWriter(flags))
+    {
+        if(readers==0) result|=POLLERR;
+        else if(used<PIPE_BUFFER_SIZE) result|=events & (POLLOUT | POLLWRNORM);
+    }
+    return result;
+}
+
+//
+// class PipeFile
+//
+
+ssize_t PipeFile::write(const void *data, size_t len)
+{
+    if(isWriter(flags)==false) return -EBADF;
+    return pipe->write(data,len,flags & O_NONBLOCK);
+}
+
+ssize_t PipeFile::read(void *data, size_t len)
+{
+    if(isReader(flags)==false) return -EBADF;
+    return pipe->read(data,len,flags & O_NONBLOCK);
+}
+
+ssize_t PipeFile::pwrite(const void *data, size_t len, off_t pos)
+{
+    return -ESPIPE;
+}
+
+ssize_t PipeFile::pread(void *data, size_t len, off_t pos)
+{
+    return -ESPIPE;
+}
+
+off_t PipeFile::lseek(off_t pos, int whence)
+{
+    return -ESPIPE;
+}
+
+int PipeFile::fstat(struct stat *pstat) const
+{
+    memset(pstat,0,sizeof(struct stat));
+    pstat->st_dev=dev;
+    pstat->st_ino=ino;
+    pstat->st_mode=S_IFIFO | 0600; //prw-------
+    pstat->st_nlink=1;
+    pstat->st_blksize=PIPE_BUFFER_SIZE;
+    return 0;
+}
+
+int PipeFile::fcntl(int cmd, int opt)
+{
+    switch(cmd)
+    {
+        case F_GETFL:
+            return flags;
+        case F_SETFL:
+            //Only O_NONBLOCK can be changed
+            flags=(flags & ~O_NONBLOCK) | (opt & O_NONBLOCK);
+            return 0;
+        default:
+            return FileBase::fcntl(cmd,opt);
+    }
+}
+
+short PipeFile::poll(short events, PollEntry *entry)
+{
+    return pipe->poll(events,entry,flags);
+}
+
+PipeFile::~PipeFile()
+{
+    pipe->close(flags);
+}
+
+#ifdef WITH_DEVFS
+
+//
+// class FifoDevice
+//
+
+FifoDevice::FifoDevice(int mode) : Device(Device::STREAM),
+        pipe(new Pipe), mode(mode) {}
+
+int FifoDevice::open(intrusive_ref_ptr<FileBase>& file,
+        intrusive_ref_ptr<FilesystemBase> fs, int flags, int mode)
+{
+    if(int result=pipe->open(flags,true)) return result;
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        file=intrusive_ref_ptr<FileBase>(new PipeFile(fs,pipe,
+                flags & (O_ACCMODE | O_NONBLOCK),st_ino,st_dev));
+    #ifndef __NO_EXCEPTIONS
+    } catch(...) {
+        //The end counts as open until the PipeFile closes it
+        pipe->close(flags);
+        throw;
+    }
+    #endif //__NO_EXCEPTIONS
+    return 0;
+}
+
+int FifoDevice::fstat(struct stat *pstat) const
+{
+    memset(pstat,0,sizeof(struct stat));
+    pstat->st_dev=st_dev;
+    pstat->st_ino=st_ino;
+    pstat->st_mode=S_IFIFO | (mode & 0777);
+    pstat->st_nlink=1;
+    pstat->st_blksize=PIPE_BUFFER_SIZE;
+    return 0;
+}
+
+#endif //WITH_DEVFS
+
+} //namespace miosix
+
+#endif //WITH_FILESYSTEM
@@ -0,0 +1,253 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#include "filesystem/file.h"
+#include "filesystem/devfs/devfs.h"
+#include "kernel/sync.h"
+#include "kernel/slab.h"
+#include "config/miosix_settings.h"
+
+#ifdef WITH_FILESYSTEM
+
+namespace miosix {
+
+/**
+ * The buffer shared by the two ends of a pipe or FIFO. Data is copied
+ * directly between the caller's buffer and a ring buffer, with a single lock
+ * acquisition per read or write.
+ */
+class Pipe : public IntrusiveRefCounted
+{
+public:
+    /**
+     * Constructor
+     */
+    Pipe();
+
+    /**
+     * Open one or both ends of the pipe
+     * \param flags O_RDONLY, O_WRONLY or O_RDWR, optionally with O_NONBLOCK
+     * \param rendezvous if true, as required for FIFOs, wait for the other
+     * end to be opened. Opening the read end in non blocking mode does not
+     * wait, while opening the write end in non blocking mode fails with ENXIO
+     * if the read end is not open
+     * \return 0 on success, or a negative number on failure
+     */
+    int open(int flags, bool rendezvous);
+
+    /**
+     * Close one or both ends of the pipe
+     * \param flags the same flags passed to open()
+     */
+    void close(int flags);
+
+    /**
+     * Read data from the pipe. Blocks if the pipe is empty and the write end
+     * is open, returns 0 if the pipe is empty and the write end is closed.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param nonblock if true return EAGAIN instead of blocking
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    ssize_t read(void *data, size_t len, bool nonblock);
+
+    /**
+     * Write data to the pipe. Writes of up to PIPE_BUFFER_SIZE bytes are
+     * atomic, longer writes may be interleaved with writes from other
+     * threads.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param nonblock if true return EAGAIN instead of blocking
+     * \return the number of written characters, or a negative number in case
+     * of errors. EPIPE is returned if the read end is closed
+     */
+    ssize_t write(const void *data, size_t len, bool nonblock);
+
+    /**
+     * Check whether the pipe is ready for reading or writing
+     * \param events the events the caller is interested in
+     * \param entry entry to add to the PollQueue of the pipe, or nullptr
+     * \param flags the flags the polled end was opened with
+     * \return the subset of events that are ready
+     */
+    short poll(short events, PollEntry *entry, int flags);
+
+private:
+    Pipe(const Pipe&);
+    Pipe& operator= (const Pipe&);
+
+    FastMutex mutex;           ///< Protects all fields
+    ConditionVariable cond;    ///< Signaled when data or open ends change
+    PollQueue pollQueue;       ///< Threads polling the pipe
+    unsigned int readers;      ///< Number of open read ends
+    unsigned int writers;      ///< Number of open write ends
+    unsigned int head;         ///< Index of first byte in the ring buffer
+    unsigned int used;         ///< Number of bytes in the ring buffer
+    char buffer[PIPE_BUFFER_SIZE]; ///< Ring buffer
+};
+
+/**
+ * One end of a pipe or FIFO
+ */
+class PipeFile : public FileBase, public SlabAllocated<PipeFile>
+{
+public:
+    /**
+     * Constructor. The end must have already been opened through
+     * Pipe::open(), it is closed by the destructor
+     * \param parent the filesystem to which this file belongs, if any
+     * \param pipe the pipe
+     * \param flags O_RDONLY, O_WRONLY or O_RDWR, optionally with O_NONBLOCK
+     * \param ino inode, for FIFOs
+     * \param dev device, for FIFOs
+     */
+    PipeFile(intrusive_ref_ptr<FilesystemBase> parent,
+            intrusive_ref_ptr<Pipe> pipe, int flags, unsigned int ino=0,
+            short dev=0) : FileBase(parent), pipe(pipe), flags(flags),
+            ino(ino), dev(dev) {}
+
+    /**
+     * Write data to the pipe.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t write(const void *data, size_t len);
+
+    /**
+     * Read data from the pipe.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t read(void *data, size_t len);
+
+    /**
+     * Pipes do not support random access.
+     * \return -ESPIPE
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+
+    /**
+     * Pipes do not support random access.
+     * \return -ESPIPE
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+
+    /**
+     * Pipes do not support random access.
+     * \return -ESPIPE
+     */
+    virtual off_t lseek(off_t pos, int whence);
+
+    /**
+     * Return file information.
+     * \param pstat pointer to stat struct
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fstat(struct stat *pstat) const;
+
+    /**
+     * Perform various operations on a file descriptor. F_GETFL and F_SETFL
+     * are supported, to set or clear O_NONBLOCK
+     * \param cmd specifies the operation to perform
+     * \param opt optional argument that some operation require
+     * \return the exact return value depends on CMD, -1 is returned on error
+     */
+    virtual int fcntl(int cmd, int opt);
+
+    /**
+     * Check whether the pipe is ready for reading or writing
+     * \param events the events the caller is interested in
+     * \param entry entry to add to the PollQueue of the pipe, or nullptr
+     * \return the subset of events that are ready
+     */
+    virtual short poll(short events, PollEntry *entry);
+
+    /**
+     * Destructor
+     */
+    ~PipeFile();
+
+private:
+    intrusive_ref_ptr<Pipe> pipe; ///< The pipe
+    int flags;                    ///< Open flags
+    unsigned int ino;             ///< Inode, for FIFOs
+    short dev;                    ///< Device, for FIFOs
+};
+
+#ifdef WITH_DEVFS
+
+/**
+ * A named FIFO, created in DevFs by mkfifo(). Every open() returns a new end
+ * of the same Pipe.
+ */
+class FifoDevice : public Device
+{
+public:
+    /**
+     * Constructor
+     * \param mode file permissions
+     */
+    FifoDevice(int mode);
+
+    /**
+     * Open an end of the FIFO
+     * \param file the file object will be stored here, if the call succeeds
+     * \param fs pointer to the DevFs
+     * \param flags file flags (open for reading, writing, ...)
+     * \param mode file permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int open(intrusive_ref_ptr<FileBase>& file,
+            intrusive_ref_ptr<FilesystemBase> fs, int flags, int mode);
+
+    /**
+     * Obtain information for the FIFO
+     * \param pstat file information is stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fstat(struct stat *pstat) const;
+
+private:
+    intrusive_ref_ptr<Pipe> pipe; ///< The pipe
+    int mode;                     ///< File permissions
+};
+
+#endif //WITH_DEVFS
+
+} //namespace miosix
+
+#endif //WITH_FILESYSTEM
+
+#endif //PIPE_H
@@ -0,0 +1,117 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#include "poll_queue.h"
+#include "kernel/kernel.h"
+
+namespace miosix {
+
+//
+// class Poller
+//
+
+bool Poller::wait(long long absoluteTimeNs)
+{
+    FastInterruptDisableLock dLock;
+    while(woken==false)
+    {
+        waiting=true;
+        if(absoluteTimeNs<0)
+        {
+            Thread::IRQwait();
+            {
+                FastInterruptEnableLock eLock(dLock);
+                Thread::yield();
+            }
+        } else {
+            auto result=Thread::IRQenableIrqAndTimedWait(dLock,absoluteTimeNs);
+            if(result==TimedWaitResult::Timeout && woken==false)
+            {
+                waiting=false;
+                return false;
+            }
+        }
+        waiting=false;
+    }
+    woken=false;
+    return true;
+}
+
+//
+// class PollEntry
+//
+
+void PollEntry::remove()
+{
+    if(queue==nullptr) return;
+    FastInterruptDisableLock dLock;
+    queue->entries.erase(IntrusiveList<PollEntry>::iterator(this));
+    queue=nullptr;
+}
+
+//
+// class PollQueue
+//
+
+void PollQueue::add(PollEntry *entry)
+{
+    if(entry==nullptr || entry->poller==nullptr) return;
+    entry->remove();
+    FastInterruptDisableLock dLock;
+    entry->queue=this;
+    entries.push_back(entry);
+}
+
+void PollQueue::notify()
+{
+    bool hppw=false;
+    {
+        FastInterruptDisableLock dLock;
+        IRQnotify(hppw);
+    }
+    if(hppw) Thread::yield();
+}
+
+void PollQueue::IRQnotify(bool& hppw)
+{
+    for(auto it=entries.begin();it!=entries.end();++it)
+    {
+        Poller *p=(*it)->poller;
+        if(p->woken) continue;
+        p->woken=true;
+        //Wake the thread only if blocked in Poller::wait(), not to cause
+        //spurious wakeups if it is blocked elsewhere, i.e. on a mutex
+        if(p->waiting==false) continue;
+        p->waiting=false;
+        p->thread->IRQwakeup();
+        if(p->thread->IRQgetPriority()>
+            Thread::IRQgetCurrentThread()->IRQgetPriority()) hppw=true;
+    }
+}
+
+} //namespace miosix
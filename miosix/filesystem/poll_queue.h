@@ -0,0 +1,208 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#ifndef POLL_QUEUE_H
+#define POLL_QUEUE_H
+
+#include "kernel/intrusive.h"
+
+#if __has_include(<poll.h>)
+#include <poll.h>
+#else //__has_include(<poll.h>)
+/**
+ * File descriptor and events for poll(), provided here as the C library lacks
+ * poll.h
+ */
+struct pollfd
+{
+    int fd;        ///< File descriptor, ignored if negative
+    short events;  ///< Requested events
+    short revents; ///< Returned events
+};
+
+typedef unsigned int nfds_t;
+
+#define POLLIN     0x001
+#define POLLPRI    0x002
+#define POLLOUT    0x004
+#define POLLERR    0x008
+#define POLLHUP    0x010
+#define POLLNVAL   0x020
+#define POLLRDNORM 0x040
+#define POLLRDBAND 0x080
+#define POLLWRNORM 0x100
+#define POLLWRBAND 0x200
+
+extern "C" int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+#endif //__has_include(<poll.h>)
+
+namespace miosix {
+
+// Forward decls
+class Thread;
+class PollQueue;
+
+/**
+ * \addtogroup Sync
+ * \{
+ */
+
+/**
+ * A thread waiting in poll(). Shared by all the PollEntry of the thread.
+ */
+class Poller
+{
+public:
+    /**
+     * Constructor
+     * \param thread the polling thread
+     */
+    Poller(Thread *thread) : thread(thread), woken(false), waiting(false) {}
+
+    /**
+     * Wait until a PollQueue the poller is registered to is notified.
+     * Returns immediately if one was notified since the last call.
+     * Cannot be used inside an IRQ.
+     * \param absoluteTimeNs absolute time after which the wait times out, or
+     * a negative number to wait forever
+     * \return false on timeout
+     */
+    bool wait(long long absoluteTimeNs);
+
+private:
+    Poller(const Poller&);
+    Poller& operator= (const Poller&);
+
+    friend class PollQueue;
+
+    Thread *thread;       ///< Polling thread
+    volatile bool woken;  ///< True if notified since last wait()
+    volatile bool waiting;///< True while the thread is blocked in wait()
+};
+
+/**
+ * Links a Poller to one of the PollQueue it is waiting on. A thread polling
+ * many files uses one PollEntry per file.
+ */
+class PollEntry : public IntrusiveListItem
+{
+public:
+    /**
+     * Constructor
+     */
+    PollEntry() : poller(nullptr), queue(nullptr) {}
+
+    /**
+     * \param poller the poller this entry belongs to
+     */
+    void setPoller(Poller *poller) { this->poller=poller; }
+
+    /**
+     * Remove the entry from the PollQueue it was added to, if any.
+     * Cannot be used inside an IRQ.
+     */
+    void remove();
+
+    /**
+     * Destructor, removes the entry from its PollQueue
+     */
+    ~PollEntry() { remove(); }
+
+private:
+    PollEntry(const PollEntry&);
+    PollEntry& operator= (const PollEntry&);
+
+    friend class PollQueue;
+
+    Poller *poller;   ///< Poller this entry belongs to
+    PollQueue *queue; ///< Queue this entry is in, or nullptr
+};
+
+/**
+ * The list of threads polling a file or device. Files and devices that can
+ * block on read or write own one, add the PollEntry passed to their poll()
+ * member function to it, and notify it from the code paths, including IRQs,
+ * that make them readable or writable.
+ */
+class PollQueue
+{
+public:
+    /**
+     * Constructor
+     */
+    PollQueue() {}
+
+    /**
+     * Add an entry to the queue. To avoid missing notifications, poll()
+     * implementations must call this before checking readiness.
+     * Cannot be used inside an IRQ.
+     * \param entry entry to add, if nullptr this function does nothing
+     */
+    void add(PollEntry *entry);
+
+    /**
+     * Wake all the threads polling this queue.
+     * Cannot be used inside an IRQ.
+     */
+    void notify();
+
+    /**
+     * Wake all the threads polling this queue.
+     * Can ONLY be used inside an IRQ, or when interrupts are disabled.
+     * \param hppw is not modified if no thread is woken or if the woken
+     * threads have a lower or equal priority than the currently running
+     * thread, else is set to true
+     */
+    void IRQnotify(bool& hppw);
+
+    /**
+     * Wake all the threads polling this queue.
+     * Can ONLY be used inside an IRQ, or when interrupts are disabled.
+     */
+    void IRQnotify()
+    {
+        bool hppw=false;
+        IRQnotify(hppw);
+    }
+
+private:
+    PollQueue(const PollQueue&);
+    PollQueue& operator= (const PollQueue&);
+
+    friend class PollEntry;
+
+    IntrusiveList<PollEntry> entries; ///< Registered entries
+};
+
+/**
+ * \}
+ */
+
+} //namespace miosix
+
+#endif //POLL_QUEUE_H
@@ -182,4 +182,47 @@ void StringPart::assign(const StringPart& rhs)
     owner=true;
 }
 
+//
+// class PathBuffer
+//
+
+bool PathBuffer::replace(size_t pos, size_t count, const char *s, size_t n)
+{
+    pos=min(pos,len);
+    count=min(count,len-pos);
+    size_t newLen=len-count+n;
+    if(newLen>PATH_MAX) return false;
+    if(newLen>=capacity)
+    {
+        //Directly allocate room for the longest path, so that this happens
+        //at most once
+        char *newBuffer=new char[PATH_MAX+1];
+        memcpy(newBuffer,buffer,len+1);
+        buffer=newBuffer;
+        capacity=PATH_MAX+1;
+    }
+    //Also moves the terminating '\0'
+    memmove(buffer+pos+n,buffer+pos+count,len-pos-count+1);
+    memcpy(buffer+pos,s,n);
+    len=newLen;
+    return true;
+}
+
+size_t PathBuffer::find(char c, size_t pos) const
+{
+    if(pos>=len) return std::string::npos;
+    const void *index=memchr(buffer+pos,c,len-pos);
+    if(index==0) return std::string::npos;
+    return reinterpret_cast<const char*>(index)-buffer;
+}
+
+size_t PathBuffer::rfind(char c, size_t pos) const
+{
+    if(len==0) return std::string::npos;
+    pos=min(pos,len-1);
+    const void *index=memrchr(buffer,c,pos+1);
+    if(index==0) return std::string::npos;
+    return reinterpret_cast<const char*>(index)-buffer;
+}
+
 } //namespace miosix
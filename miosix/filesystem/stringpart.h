@@ -30,6 +30,7 @@
 
 #include <string>
 #include <cstring>
+#include <climits>
 
 namespace miosix {
 
@@ -211,6 +212,121 @@ private:
     enum { CPPSTR, CSTR, CCSTR }; ///< Possible values fot type
 };
 
+/**
+ * \internal
+ * A buffer where paths are built and resolved in-place. Paths shorter than
+ * inlineSize are stored within the object itself, so that the common case of
+ * resolving a short path on the stack requires no memory allocation. Longer
+ * paths, up to PATH_MAX, are moved to the heap.
+ * 
+ * In-place substrings of the path can be taken with
+ * StringPart(path.data(),idx,off). The path must not be modified while such
+ * StringParts are alive.
+ */
+class PathBuffer
+{
+public:
+    /**
+     * Constructor, the path is empty
+     */
+    PathBuffer() : buffer(inlineBuffer), len(0), capacity(inlineSize)
+    {
+        inlineBuffer[0]='\0';
+    }
+    
+    /**
+     * Replace part of the path, like std::string::replace()
+     * \param pos first character to replace
+     * \param count number of characters to replace
+     * \param s characters to insert, must not point inside the path
+     * \param n number of characters to insert
+     * \return false if the path would be longer than PATH_MAX, in which case
+     * the path is not modified
+     */
+    bool replace(size_t pos, size_t count, const char *s, size_t n);
+    
+    /**
+     * Replace the whole path
+     * \param s characters to store, must not point inside the path
+     * \param n number of characters to store
+     * \return false if the path would be longer than PATH_MAX
+     */
+    bool assign(const char *s, size_t n) { return replace(0,len,s,n); }
+    
+    /**
+     * Append to the path
+     * \param s characters to append, must not point inside the path
+     * \param n number of characters to append
+     * \return false if the path would be longer than PATH_MAX
+     */
+    bool append(const char *s, size_t n) { return replace(len,0,s,n); }
+    
+    /**
+     * Erase part of the path, like std::string::erase()
+     * \param pos first character to erase
+     * \param count number of characters to erase
+     */
+    void erase(size_t pos, size_t count) { replace(pos,count,"",0); }
+    
+    /**
+     * \param c char to find
+     * \param pos index where to start the search
+     * \return the index of the first occurrence of c at or after pos, or
+     * std::string::npos
+     */
+    size_t find(char c, size_t pos) const;
+    
+    /**
+     * \param c char to find
+     * \param pos index where to start the search, going backwards
+     * \return the index of the last occurrence of c at or before pos, or
+     * std::string::npos
+     */
+    size_t rfind(char c, size_t pos) const;
+    
+    /**
+     * \return the path length
+     */
+    size_t length() const { return len; }
+    
+    /**
+     * \return true if the path is empty
+     */
+    bool empty() const { return len==0; }
+    
+    /**
+     * \param index index into the path
+     * \return the character at the given index
+     */
+    char operator[] (size_t index) const { return buffer[index]; }
+    
+    /**
+     * \return the path as a modifiable C string, to construct StringParts
+     */
+    char *data() { return buffer; }
+    
+    /**
+     * \return the path as a C string
+     */
+    const char *c_str() const { return buffer; }
+    
+    /**
+     * Destructor
+     */
+    ~PathBuffer() { if(buffer!=inlineBuffer) delete[] buffer; }
+    
+private:
+    PathBuffer(const PathBuffer&);
+    PathBuffer& operator= (const PathBuffer&);
+    
+    static const size_t inlineSize=64;
+    
+    char *buffer;                  ///< Either inlineBuffer or heap allocated
+    size_t len;                    ///< Path length
+    size_t capacity;               ///< Buffer size, including the '\0'
+    char inlineBuffer[inlineSize]; ///< Storage for short paths
+};
+
 } //namespace miosix
 
 #endif //STRINGPART_H
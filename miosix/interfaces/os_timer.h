@@ -29,6 +29,7 @@
 
 #include "kernel/timeconversion.h"
 #include "kernel/scheduler/timer_interrupt.h"
+#include "kernel/time_page.h"
 
 /**
  * \addtogroup Interfaces
@@ -116,6 +117,49 @@ void IRQosTimerSetTime(long long ns) noexcept;
  */
 unsigned int osTimerGetFrequency();
 
+/**
+ * \internal
+ * It is used by the kernel, and should not be used by end users.
+ * Used together with IRQosTimerGetTick2ns() to export the time to processes
+ * through the time page, so that they can read it without a syscall.
+ * Can be called with interrupts disabled or within an interrupt.
+ * \return the current time in timer ticks
+ */
+long long IRQosTimerGetTick() noexcept;
+
+/**
+ * \internal
+ * It is used by the kernel, and should not be used by end users.
+ * \return the factor that converts the value returned by IRQosTimerGetTick()
+ * to nanoseconds, as done by TimeConversion::tick2ns()
+ */
+TimeConversionFactor IRQosTimerGetTick2ns() noexcept;
+
+/**
+ * \internal
+ * Hardware timer registers that processes can read through the MPU to compute
+ * the time without a syscall, see kernel/time_page.h
+ */
+struct OsTimerRegisters
+{
+    const volatile unsigned int *counter; ///< 32 bit counter register
+    const volatile unsigned int *status;  ///< Register with the overflow flag
+    unsigned int overflowMask;            ///< Overflow flag bit in *status
+};
+
+/**
+ * \internal
+ * It is used by the kernel, and should not be used by end users.
+ * Timers whose 32 bit counter and overflow flag can be read without side
+ * effects export them, so that processes can extend the counter to 64 bit
+ * in the same way as TimerAdapter::IRQgetTimeTick().
+ * Can be called with interrupts disabled or within an interrupt.
+ * \param regs filled with the timer registers
+ * \param upperTick filled with the upper 32 bits of the timer, in ticks
+ * \return false if processes can't read the timer
+ */
+bool IRQosTimerGetRegisters(OsTimerRegisters& regs, long long& upperTick) noexcept;
+
 } //namespace internal
 
 /**
@@ -178,6 +222,46 @@ public:
     miosix::TimeConversion tc;
     bool lateIrq=false;
     
+    /**
+     * Derived classes whose timer can be read by processes shall hide these
+     * three functions, see IRQosTimerGetRegisters(). Only 32 bit timers are
+     * supported.
+     * \return the address of the timer counter register
+     */
+    static const volatile unsigned int *IRQgetTimerCounterAddress()
+    {
+        return nullptr;
+    }
+    
+    /**
+     * \return the address of the register holding the overflow flag
+     */
+    static const volatile unsigned int *IRQgetOverflowFlagAddress()
+    {
+        return nullptr;
+    }
+    
+    /**
+     * \return the overflow flag bit in the register returned by
+     * IRQgetOverflowFlagAddress()
+     */
+    static unsigned int IRQgetOverflowFlagMask() { return 0; }
+    
+    /**
+     * \param regs filled with the timer registers processes can read
+     * \param upperTick filled with the upper bits of the timer
+     * \return false if the derived class does not export its registers
+     */
+    bool IRQgetRegisters(internal::OsTimerRegisters& regs, long long& upperTick)
+    {
+        if(bits!=32 || D::IRQgetTimerCounterAddress()==nullptr) return false;
+        regs.counter=D::IRQgetTimerCounterAddress();
+        regs.status=D::IRQgetOverflowFlagAddress();
+        regs.overflowMask=D::IRQgetOverflowFlagMask();
+        upperTick=upperTimeTick;
+        return true;
+    }
+    
     /**
      * \return the current time in ticks
      */
@@ -258,6 +342,9 @@ public:
             upperTimeTick = tick & upperMask;
             D::IRQsetTimerCounter(static_cast<unsigned int>(tick & lowerMask));
             D::IRQclearOverflowFlag();
+            #ifdef WITH_PROCESSES
+            IRQupdateTimePageUpperTick(upperTimeTick);
+            #endif //WITH_PROCESSES
             //Adjust also when the next interrupt will be fired
             long long nextIrqTick = IRQgetIrqTick();
             if(nextIrqTick>oldTick)
@@ -324,6 +411,9 @@ public:
         {
             D::IRQclearOverflowFlag();
             upperTimeTick += upperIncr;
+            #ifdef WITH_PROCESSES
+            IRQupdateTimePageUpperTick(upperTimeTick);
+            #endif //WITH_PROCESSES
         }
     }
     
@@ -397,6 +487,21 @@ unsigned int osTimerGetFrequency()                 \
     return timer.IRQTimerFrequency();              \
 }                                                  \
                                                    \
+long long IRQosTimerGetTick() noexcept             \
+{                                                  \
+    return timer.IRQgetTimeTick();                 \
+}                                                  \
+                                                   \
+TimeConversionFactor IRQosTimerGetTick2ns() noexcept \
+{                                                  \
+    return timer.tc.getTick2nsConversion();        \
+}                                                  \
+                                                   \
+bool IRQosTimerGetRegisters(OsTimerRegisters& regs, long long& upperTick) noexcept \
+{                                                  \
+    return timer.IRQgetRegisters(regs,upperTick);  \
+}                                                  \
+                                                   \
 } //namespace internal
 
 /**
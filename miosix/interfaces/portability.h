@@ -147,10 +147,18 @@ public:
     
     /**
      * \return the third syscall parameter. The returned result is meaningful
-     * only if the syscall (identified through its id) has three parameters
+     * only if the syscall (identified through its id) has three or more
+     * parameters
      */
     unsigned int getThirdParameter() const;
     
+    /**
+     * \return the fourth syscall parameter. The returned result is meaningful
+     * only if the syscall (identified through its id) has four parameters.
+     * Together with the third parameter it allows to pass a 64 bit value
+     */
+    unsigned int getFourthParameter() const;
+    
     /**
      * Set the value that will be returned by the syscall.
      * Invalidates parameters so must be called only after the syscall
@@ -71,6 +71,9 @@ void errorHandler(Error e)
         case INTERRUPTS_ENABLED_AT_BOOT:
             IRQerrorLog("\r\n***Interrupts enabled at boot\r\n");
             break;
+        case HEAP_CORRUPTED:
+            IRQerrorLog("\r\n***Heap corrupted\r\n");
+            break;
         default:
             break;
     }
@@ -64,7 +64,11 @@ enum Error
 
     /// Interrupts are wrongly enabled during boot
     /// Error is UNRECOVERABLE
-    INTERRUPTS_ENABLED_AT_BOOT
+    INTERRUPTS_ENABLED_AT_BOOT,
+
+    /// A double free or a buffer overflow was found while deallocating
+    /// memory<br>Error is UNRECOVERABLE
+    HEAP_CORRUPTED
 };
 
 /**
@@ -0,0 +1,138 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#include "heap_regions.h"
+#include <cstdlib>
+#include "kernel.h"
+#include "tlsf.h"
+
+using namespace std;
+
+//These are defined in the linker script, only by boards that have additional
+//heap regions, so they are weak, and their address is nullptr if undefined
+extern char _fast_heap_start asm("_fast_heap_start") __attribute__((weak));
+extern char _fast_heap_end asm("_fast_heap_end") __attribute__((weak));
+extern char _dma_heap_start asm("_dma_heap_start") __attribute__((weak));
+extern char _dma_heap_end asm("_dma_heap_end") __attribute__((weak));
+extern char _bulk_heap_start asm("_bulk_heap_start") __attribute__((weak));
+extern char _bulk_heap_end asm("_bulk_heap_end") __attribute__((weak));
+
+namespace miosix {
+
+/**
+ * \internal
+ * An additional heap region
+ */
+struct HeapRegion
+{
+    constexpr HeapRegion() : start(nullptr), end(nullptr) {}
+
+    Tlsf heap;  ///< Allocator for this region
+    char *start;///< Region start, nullptr if not defined
+    char *end;  ///< Region end
+};
+
+/// \internal The Fast, Dma and Bulk regions, in this order
+static HeapRegion regions[3];
+/// \internal True once the regions have been given to their allocators
+static bool initialized=false;
+
+/**
+ * \internal
+ * Initialize a region from the linker script symbols
+ */
+static void initRegion(HeapRegion& r, char *start, char *end)
+{
+    if(start==nullptr || end<=start) return;
+    r.start=start;
+    r.end=end;
+    r.heap.addRegion(start,end-start);
+}
+
+/**
+ * \internal
+ * Must be called with the kernel paused
+ * \param kind kind of memory
+ * \return the region for this kind of memory, or nullptr if not defined
+ */
+static HeapRegion *getRegion(MemoryKind kind)
+{
+    if(initialized==false)
+    {
+        initialized=true;
+        initRegion(regions[0],&_fast_heap_start,&_fast_heap_end);
+        initRegion(regions[1],&_dma_heap_start,&_dma_heap_end);
+        initRegion(regions[2],&_bulk_heap_start,&_bulk_heap_end);
+    }
+    if(kind==MemoryKind::Default) return nullptr;
+    HeapRegion *result=&regions[static_cast<int>(kind)-1];
+    return result->start ? result : nullptr;
+}
+
+void *malloc_region(MemoryKind kind, size_t size)
+{
+    {
+        PauseKernelLock dLock;
+        HeapRegion *r=getRegion(kind);
+        void *result=r ? r->heap.allocate(size) : nullptr;
+        if(result) return result;
+    }
+    //The region is not defined or full, fall back to the main heap
+    return malloc(size);
+}
+
+void free_region(void *ptr)
+{
+    char *p=reinterpret_cast<char*>(ptr);
+    {
+        PauseKernelLock dLock;
+        for(auto& r : regions)
+        {
+            if(p<r.start || p>=r.end) continue;
+            r.heap.deallocate(ptr);
+            return;
+        }
+    }
+    free(ptr);
+}
+
+bool hasHeapRegion(MemoryKind kind)
+{
+    PauseKernelLock dLock;
+    return getRegion(kind)!=nullptr;
+}
+
+size_t getHeapRegionFree(MemoryKind kind)
+{
+    PauseKernelLock dLock;
+    HeapRegion *r=getRegion(kind);
+    if(r==nullptr) return 0;
+    return r->heap.getRegionSize()-r->heap.getUsedSize();
+}
+
+} //namespace miosix
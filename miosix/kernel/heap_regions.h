@@ -0,0 +1,166 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#ifndef HEAP_REGIONS_H
+#define HEAP_REGIONS_H
+
+#include <cstddef>
+#ifndef __NO_EXCEPTIONS
+#include <new>
+#endif //__NO_EXCEPTIONS
+#include "error.h"
+
+namespace miosix {
+
+/**
+ * \addtogroup Util
+ * \{
+ */
+
+/**
+ * Kinds of memory that can be requested with malloc_region().<br>
+ * Other than the main heap, boards can provide additional heap regions by
+ * defining in their linker script the symbols
+ * - _fast_heap_start and _fast_heap_end for the Fast region
+ * - _dma_heap_start and _dma_heap_end for the Dma region
+ * - _bulk_heap_start and _bulk_heap_end for the Bulk region
+ * 
+ * When a region is not defined, or it is full, allocations fall back to the
+ * main heap, that must thus be DMA capable.
+ */
+enum class MemoryKind
+{
+    Default, ///< The main heap, the same as malloc()
+    Fast,    ///< Fastest RAM, may not be DMA capable (e.g. the STM32F4 CCM)
+    Dma,     ///< RAM that is guaranteed to be DMA capable
+    Bulk     ///< Large, possibly slower RAM (e.g. external SDRAM)
+};
+
+/**
+ * Allocate memory from a heap region. Each region is managed by its own
+ * TLSF allocator, so allocating and deallocating has a bounded time.
+ * Memory allocated with this function must be deallocated with free_region().
+ * Like malloc(), it cannot be called from an interrupt.
+ * \param kind kind of memory to allocate
+ * \param size size of the memory to allocate
+ * \return the allocated memory, aligned to 8 bytes, or nullptr
+ */
+void *malloc_region(MemoryKind kind, std::size_t size);
+
+/**
+ * Deallocate memory allocated with malloc_region().
+ * \param ptr memory to deallocate, or nullptr
+ */
+void free_region(void *ptr);
+
+/**
+ * \param kind kind of memory
+ * \return true if the board linker script defines a region for this kind of
+ * memory, false if allocations of this kind come from the main heap
+ */
+bool hasHeapRegion(MemoryKind kind);
+
+/**
+ * \param kind kind of memory
+ * \return the free memory in the region, 0 if the region is not defined
+ */
+std::size_t getHeapRegionFree(MemoryKind kind);
+
+/**
+ * Allocator for STL containers, to place their content in a heap region,
+ * for example
+ * \code
+ * std::vector<int,RegionAllocator<int,MemoryKind::Bulk>> v;
+ * \endcode
+ * \param T type of the allocated objects
+ * \param Kind kind of memory
+ */
+template<typename T, MemoryKind Kind>
+class RegionAllocator
+{
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind
+    {
+        typedef RegionAllocator<U,Kind> other;
+    };
+
+    RegionAllocator() noexcept {}
+
+    template<typename U>
+    RegionAllocator(const RegionAllocator<U,Kind>&) noexcept {}
+
+    /**
+     * \param n number of objects
+     * \return memory for n objects
+     * \throws std::bad_alloc if out of memory
+     */
+    T *allocate(std::size_t n)
+    {
+        void *result=nullptr;
+        if(n<=static_cast<std::size_t>(-1)/sizeof(T))
+            result=malloc_region(Kind,n*sizeof(T));
+        #ifndef __NO_EXCEPTIONS
+        if(result==nullptr) throw std::bad_alloc();
+        #else //__NO_EXCEPTIONS
+        if(result==nullptr) errorHandler(OUT_OF_MEMORY);
+        #endif //__NO_EXCEPTIONS
+        return static_cast<T*>(result);
+    }
+
+    /**
+     * \param p memory returned by allocate()
+     * \param n number of objects
+     */
+    void deallocate(T *p, std::size_t n) noexcept
+    {
+        free_region(p);
+    }
+};
+
+template<typename T, typename U, MemoryKind Kind>
+bool operator==(const RegionAllocator<T,Kind>&, const RegionAllocator<U,Kind>&)
+{
+    return true;
+}
+
+template<typename T, typename U, MemoryKind Kind>
+bool operator!=(const RegionAllocator<T,Kind>&, const RegionAllocator<U,Kind>&)
+{
+    return false;
+}
+
+/**
+ * \}
+ */
+
+} //namespace miosix
+
+#endif //HEAP_REGIONS_H
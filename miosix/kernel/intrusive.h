@@ -329,6 +329,17 @@ public:
      */
     intrusive_ref_ptr atomic_exchange(intrusive_ref_ptr& r);
     
+    /**
+     * \internal
+     * This is just an implementation detail.
+     * Use the free function atomic_peek instead.
+     * \return the managed pointer, without touching the reference count
+     */
+    T *atomic_peek() const
+    {
+        return *reinterpret_cast<T * const volatile*>(&object);
+    }
+    
     /**
      * Destructor
      */
@@ -634,6 +645,22 @@ intrusive_ref_ptr<T> atomic_exchange(intrusive_ref_ptr<T> *p,
     return p->atomic_exchange(r);
 }
 
+/**
+ * Allows concurrent access to an instance of intrusive_ref_ptr.
+ * Reads the pointer stored in *p without incrementing the reference count, so
+ * the returned pointer may be dangling as soon as another thread performs an
+ * atomic_store() or atomic_exchange() on *p. The caller needs some other means
+ * to keep the pointed object alive, such as hazard pointers.
+ * \param p pointer to an intrusive_ref_ptr shared among threads
+ * \return the pointer stored in *p
+ */
+template<typename T>
+T *atomic_peek(const intrusive_ref_ptr<T> *p)
+{
+    if(p==0) return nullptr;
+    return p->atomic_peek();
+}
+
 template <typename T>
 class IntrusiveList; //Forward declaration
 
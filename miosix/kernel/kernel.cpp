@@ -286,6 +286,24 @@ void IRQaddToSleepingList(SleepData *x)
     //    ContextSwitchTimer::instance().IRQsetNextInterrupt(sleepingList->front()->wakeup_time);
 }
 
+/**
+ * \internal
+ * Used by Thread::IRQwakeup() to remove a thread that is doing a timed wait
+ * from the sleeping list before its timeout expires.
+ * Also clears thread SLEEP_FLAG. Interrupts must be disabled prior to calling
+ * this function.
+ */
+void IRQremoveFromSleepingList(Thread *t)
+{
+    for(auto it=sleepingList->begin();it!=sleepingList->end();++it)
+    {
+        if((*it)->p!=t) continue;
+        sleepingList->erase(it);
+        break;
+    }
+    t->flags.IRQsetSleep(false);
+}
+
 /**
  * \internal
  * Called to check if it's time to wake some thread.
@@ -308,6 +326,8 @@ bool IRQwakeThreads(long long currentTime)
         if((*it)->p == nullptr) ++it; //Only csRecord has p==nullptr
         else {
             (*it)->p->flags.IRQsetSleep(false); //Wake thread
+            //Thread doing a timed wait whose timeout expired
+            if((*it)->p->flags.isWaiting()) (*it)->p->flags.IRQsetWait(false);
             if (const_cast<Thread*>(cur)->getPriority() < (*it)->p->getPriority())
                 result = true;
             it = sleepingList->erase(it);
@@ -415,6 +435,32 @@ void Thread::nanoSleepUntil(long long absoluteTimeNs)
     Thread::yield();
 }
 
+TimedWaitResult Thread::IRQenableIrqAndTimedWait(
+        FastInterruptDisableLock& dLock, long long absoluteTimeNs)
+{
+    SleepData d;
+    IRQprepareTimedWait(d,absoluteTimeNs);
+    {
+        FastInterruptEnableLock eLock(dLock);
+        Thread::yield();
+    }
+    return IRQgetTime()>=d.wakeup_time ? TimedWaitResult::Timeout
+                                       : TimedWaitResult::NoTimeout;
+}
+
+TimedWaitResult Thread::IRQenableIrqAndTimedWait(
+        InterruptDisableLock& dLock, long long absoluteTimeNs)
+{
+    SleepData d;
+    IRQprepareTimedWait(d,absoluteTimeNs);
+    {
+        InterruptEnableLock eLock(dLock);
+        Thread::yield();
+    }
+    return IRQgetTime()>=d.wakeup_time ? TimedWaitResult::Timeout
+                                       : TimedWaitResult::NoTimeout;
+}
+
 Thread *Thread::getCurrentThread()
 {
     Thread *result=const_cast<Thread*>(cur);
@@ -493,7 +539,7 @@ void Thread::wakeup()
     //pausing the kernel is not enough because of IRQwait and IRQwakeup
     {
         FastInterruptDisableLock lock;
-        this->flags.IRQsetWait(false);
+        this->IRQwakeup();
     }
     #ifdef SCHED_TYPE_EDF
     yield();//The other thread might have a closer deadline
@@ -504,7 +550,7 @@ void Thread::PKwakeup()
 {
     //pausing the kernel is not enough because of IRQwait and IRQwakeup
     FastInterruptDisableLock lock;
-    this->flags.IRQsetWait(false);
+    this->IRQwakeup();
 }
 
 void Thread::detach()
@@ -601,6 +647,9 @@ void Thread::IRQwait()
 
 void Thread::IRQwakeup()
 {
+    //A thread that is both waiting and sleeping is doing a timed wait
+    if(this->flags.isWaiting() && this->flags.isSleeping())
+        IRQremoveFromSleepingList(this);
     this->flags.IRQsetWait(false);
 }
 
@@ -670,6 +719,7 @@ void Thread::IRQhandleSvc(unsigned int svcNumber)
     {
         const_cast<Thread*>(cur)->flags.IRQsetUserspace(true);
         ::ctxsave=cur->userCtxsave;
+        IRQupdateTimePage();
         //We know it's not the kernel, so the cast is safe
         static_cast<Process*>(cur->proc)->mpu.IRQenable();
     } else {
@@ -750,6 +800,17 @@ Thread *Thread::allocateIdleThread()
     return idle;
 }
 
+void Thread::IRQprepareTimedWait(SleepData& d, long long absoluteTimeNs)
+{
+    //Same lower bound as nanoSleepUntil(), see the comment there
+    d.p=const_cast<Thread*>(cur);
+    d.wakeup_time=std::max(absoluteTimeNs,100000LL);
+    //The thread is both in the wait status and in the sleeping list, whichever
+    //of IRQwakeup() and IRQwakeThreads() comes first clears both conditions
+    d.p->flags.IRQsetWait(true);
+    IRQaddToSleepingList(&d);//Also sets SLEEP_FLAG
+}
+
 struct _reent *Thread::getCReent()
 {
     return getCurrentThread()->cReentrancyData;
@@ -810,6 +871,20 @@ void Thread::setupUserspaceContext(unsigned int entry, unsigned int *gotBase,
 
 #endif //WITH_PROCESSES
 
+#ifdef WITH_FILESYSTEM
+
+/// List of all threads, used to scan hazard slots
+static Thread *allThreads=nullptr;
+
+bool Thread::isHazardPointer(const void *p)
+{
+    PauseKernelLock lock;
+    for(Thread *t=allThreads;t;t=t->nextThread) if(t->hazard==p) return true;
+    return false;
+}
+
+#endif //WITH_FILESYSTEM
+
 Thread::Thread(unsigned int *watermark, unsigned int stacksize,
                bool defaultReent) : schedData(), flags(), savedPriority(0),
                mutexLocked(0), mutexWaiting(0), watermark(watermark),
@@ -825,6 +900,12 @@ Thread::Thread(unsigned int *watermark, unsigned int stacksize,
     proc=kernel;
     userCtxsave=nullptr;
     #endif //WITH_PROCESSES
+    #ifdef WITH_FILESYSTEM
+    hazard=nullptr;
+    PauseKernelLock lock;
+    nextThread=allThreads;
+    allThreads=this;
+    #endif //WITH_FILESYSTEM
 }
 
 Thread::~Thread()
@@ -837,6 +918,15 @@ Thread::~Thread()
     #ifdef WITH_PROCESSES
     if(userCtxsave) delete[] userCtxsave;
     #endif //WITH_PROCESSES
+    #ifdef WITH_FILESYSTEM
+    PauseKernelLock lock;
+    for(Thread **t=&allThreads;*t;t=&(*t)->nextThread)
+    {
+        if(*t!=this) continue;
+        *t=nextThread;
+        break;
+    }
+    #endif //WITH_FILESYSTEM
 }
 
 //
@@ -414,6 +414,15 @@ long long getTime() noexcept;
  */
 long long IRQgetTime() noexcept;
 
+/**
+ * Possible return values of timed wait operations
+ */
+enum class TimedWaitResult
+{
+    NoTimeout, ///< The thread was woken up before the timeout
+    Timeout    ///< The wait timed out
+};
+
 //Forwrd declaration
 struct SleepData;
 class MemoryProfiling;
@@ -699,6 +708,43 @@ public:
      */
     void IRQwakeup();
 
+    /**
+     * Put the current thread in wait status until either IRQwakeup() (or
+     * wakeup()) is called on it, or the absolute time absoluteTimeNs is
+     * reached, whichever comes first.<br>
+     * Unlike IRQwait(), this function does not return immediately: it must be
+     * called with interrupts disabled through dLock, and it enables them back
+     * while the thread is waiting. Interrupts are disabled again when this
+     * function returns.
+     *
+     * \code
+     * FastInterruptDisableLock dLock;
+     * waiting=Thread::IRQgetCurrentThread();
+     * auto result=Thread::IRQenableIrqAndTimedWait(dLock,deadline);
+     * \endcode
+     * \param dLock the FastInterruptDisableLock that disabled interrupts
+     * \param absoluteTimeNs absolute time after which the wait times out
+     * \return TimedWaitResult::Timeout if the thread was woken up because the
+     * timeout expired
+     *
+     * CANNOT be called when the kernel is paused.
+     */
+    static TimedWaitResult IRQenableIrqAndTimedWait(
+            FastInterruptDisableLock& dLock, long long absoluteTimeNs);
+
+    /**
+     * Same as IRQenableIrqAndTimedWait(FastInterruptDisableLock&, long long)
+     * but for code that disabled interrupts with an InterruptDisableLock.
+     * \param dLock the InterruptDisableLock that disabled interrupts
+     * \param absoluteTimeNs absolute time after which the wait times out
+     * \return TimedWaitResult::Timeout if the thread was woken up because the
+     * timeout expired
+     *
+     * CANNOT be called when the kernel is paused.
+     */
+    static TimedWaitResult IRQenableIrqAndTimedWait(
+            InterruptDisableLock& dLock, long long absoluteTimeNs);
+
     /**
      * Same as exists() but is meant to be called only inside an IRQ or when
      * interrupts are disabled.
@@ -719,6 +765,39 @@ public:
      * \return the size of the stack of the current thread.
      */
     static int getStackSize();
+
+    #ifdef WITH_FILESYSTEM
+
+    /**
+     * \internal
+     * Publish a pointer in the hazard slot of the current thread, to tell
+     * other threads that the object it points to is being used without
+     * holding a reference to it. Only one pointer per thread can be published
+     * \param p pointer to publish, or nullptr to clear the slot
+     */
+    static void setHazardPointer(const void *p)
+    {
+        getCurrentThread()->hazard=p;
+    }
+
+    /**
+     * \internal
+     * \return the pointer in the hazard slot of the current thread
+     */
+    static const void *getHazardPointer()
+    {
+        return getCurrentThread()->hazard;
+    }
+
+    /**
+     * \internal
+     * \param p a pointer
+     * \return true if p is currently published in the hazard slot of any
+     * thread. The check is O(n) in the number of threads
+     */
+    static bool isHazardPointer(const void *p);
+
+    #endif //WITH_FILESYSTEM
     
     #ifdef WITH_PROCESSES
 
@@ -990,6 +1069,14 @@ private:
      */
     static struct _reent *getCReent();
 
+    /**
+     * Common part of the IRQenableIrqAndTimedWait() overloads, puts the
+     * current thread both in the wait status and in the sleeping list.
+     * \param d sleep list entry, must stay in scope till the thread wakes
+     * \param absoluteTimeNs absolute time after which the wait times out
+     */
+    static void IRQprepareTimedWait(SleepData& d, long long absoluteTimeNs);
+
     //Thread data
     SchedulerData schedData; ///< Scheduler data, only used by class Scheduler
     ThreadFlags flags;///< thread status
@@ -1025,12 +1112,20 @@ private:
     ///pointer is null
     unsigned int *userCtxsave;
     #endif //WITH_PROCESSES
+    #ifdef WITH_FILESYSTEM
+    ///Hazard slot, see setHazardPointer()
+    const void * volatile hazard;
+    ///Next thread in the list of all threads, to scan hazard slots
+    Thread *nextThread;
+    #endif //WITH_FILESYSTEM
     
     //friend functions
     //Needs access to watermark, ctxsave
     friend void miosix_private::IRQstackOverflowCheck();
     //Need access to status
     friend void IRQaddToSleepingList(SleepData *x);
+    //Need access to status
+    friend void IRQremoveFromSleepingList(Thread *t);
     //Needs access to status
     friend bool IRQwakeThreads(long long currentTick);
     //Needs access to watermark, status, next
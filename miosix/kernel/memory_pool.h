@@ -0,0 +1,253 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include "kernel.h"
+#include "error.h"
+#include "intrusive.h"
+
+namespace miosix {
+
+/**
+ * \addtogroup Sync
+ * \{
+ */
+
+/**
+ * A fixed-block memory pool of N objects of type T, that can be used to pass
+ * data between threads and IRQs without copying it.<br>
+ * Allocating and deallocating a block is O(1) and never touches the heap, so
+ * it can be done both from threads and from within IRQs. A typical use is an
+ * IRQ that allocates a block, fills it, and then passes the pointer to a
+ * thread through a Queue<T*,N>. The thread then deallocates the block once
+ * it is done with it.<br>
+ * The N objects are constructed once when the pool is constructed and
+ * destroyed when the pool is destroyed. Allocating and deallocating a block
+ * does not call any constructor or destructor, so the content of a block
+ * when it is allocated is what was left by its previous user.<br>
+ * Any number of threads can wait for a block to become available.<br>
+ * Dynamically creating a MemoryPool with new or on the stack must be done
+ * with care, to avoid deleting a pool with a waiting thread, or while some
+ * of its blocks are still in use.
+ * \tparam T the type of the blocks
+ * \tparam N the number of blocks in the pool. Value 0 is forbidden
+ */
+template<typename T, unsigned int N>
+class MemoryPool
+{
+public:
+    /**
+     * Constructor, all the blocks are free.
+     */
+    MemoryPool() : numFree(N)
+    {
+        for(unsigned int i=0;i<N;i++) freeBlocks[i]=&blocks[i];
+    }
+
+    /**
+     * \return the number of blocks that are currently free
+     */
+    unsigned int available() const { return numFree; }
+
+    /**
+     * \return the total number of blocks of the pool
+     */
+    unsigned int capacity() const { return N; }
+
+    /**
+     * \return true if all the blocks are currently allocated
+     */
+    bool isEmpty() const { return numFree==0; }
+
+    /**
+     * Allocate a block. If no block is available, sleep until one is
+     * deallocated.<br>
+     * Cannot be used inside an IRQ.
+     * \return the allocated block
+     */
+    T *allocate();
+
+    /**
+     * Allocate a block. If no block is available, sleep until one is
+     * deallocated or until the given absolute time is reached.<br>
+     * Cannot be used inside an IRQ.
+     * \param absoluteTimeNs absolute time, in nanoseconds, after which the
+     * allocation fails
+     * \return the allocated block, or nullptr on timeout
+     */
+    T *timedAllocate(long long absoluteTimeNs);
+
+    /**
+     * Allocate a block only if one is available. This function never blocks.
+     * <br>Cannot be used inside an IRQ.
+     * \return the allocated block, or nullptr if no block is available
+     */
+    T *tryAllocate()
+    {
+        FastInterruptDisableLock dLock;
+        return IRQallocate();
+    }
+
+    /**
+     * Allocate a block only if one is available.<br>
+     * Can ONLY be used inside an IRQ, or when interrupts are disabled.
+     * \return the allocated block, or nullptr if no block is available
+     */
+    T *IRQallocate()
+    {
+        if(numFree==0) return nullptr;
+        return freeBlocks[--numFree];
+    }
+
+    /**
+     * Return a block to the pool, waking a thread waiting for a block, if any.
+     * <br>Cannot be used inside an IRQ.
+     * \param block a block previously allocated from this pool
+     */
+    void deallocate(T *block)
+    {
+        FastInterruptDisableLock dLock;
+        IRQdeallocate(block);
+    }
+
+    /**
+     * Return a block to the pool, waking a thread waiting for a block, if any.
+     * <br>Can ONLY be used inside an IRQ, or when interrupts are disabled.
+     * \param block a block previously allocated from this pool
+     */
+    void IRQdeallocate(T *block);
+
+    /**
+     * Return a block to the pool, waking a thread waiting for a block, if any.
+     * <br>Can ONLY be used inside an IRQ, or when interrupts are disabled.
+     * \param block a block previously allocated from this pool
+     * \param hppw is not modified if no thread is woken or if the woken thread
+     * has a lower or equal priority than the currently running thread, else is
+     * set to true
+     */
+    void IRQdeallocate(T *block, bool& hppw);
+
+private:
+    MemoryPool(const MemoryPool&);
+    MemoryPool& operator= (const MemoryPool&);
+
+    /**
+     * To allow multiple threads waiting for a block
+     */
+    struct WaitingThread : public IntrusiveListItem
+    {
+        Thread *t; ///< Thread waiting
+    };
+
+    /**
+     * Wake the first thread waiting for a block, if any.
+     * Must be called when interrupts are disabled
+     * \return the woken thread, or nullptr
+     */
+    Thread *IRQwakeWaitingThread()
+    {
+        if(waiting.empty()) return nullptr;
+        Thread *t=waiting.front()->t;
+        waiting.pop_front();
+        t->IRQwakeup();
+        return t;
+    }
+
+    T blocks[N];                         ///< Storage for the blocks
+    T *freeBlocks[N];                    ///< Stack of free blocks
+    volatile unsigned int numFree;       ///< Number of free blocks
+    IntrusiveList<WaitingThread> waiting;///< Threads waiting for a block
+};
+
+template<typename T, unsigned int N>
+T *MemoryPool<T,N>::allocate()
+{
+    FastInterruptDisableLock dLock;
+    while(numFree==0)
+    {
+        WaitingThread w;
+        w.t=Thread::IRQgetCurrentThread();
+        waiting.push_back(&w);
+        Thread::IRQwait();
+        {
+            FastInterruptEnableLock eLock(dLock);
+            Thread::yield();
+        }
+        //Spurious wakeup, the list may still contain w
+        waiting.erase(typename IntrusiveList<WaitingThread>::iterator(&w));
+    }
+    return freeBlocks[--numFree];
+}
+
+template<typename T, unsigned int N>
+T *MemoryPool<T,N>::timedAllocate(long long absoluteTimeNs)
+{
+    FastInterruptDisableLock dLock;
+    while(numFree==0)
+    {
+        WaitingThread w;
+        w.t=Thread::IRQgetCurrentThread();
+        waiting.push_back(&w);
+        auto result=Thread::IRQenableIrqAndTimedWait(dLock,absoluteTimeNs);
+        //On timeout or spurious wakeup the list may still contain w
+        waiting.erase(typename IntrusiveList<WaitingThread>::iterator(&w));
+        if(result==TimedWaitResult::Timeout && numFree==0) return nullptr;
+    }
+    return freeBlocks[--numFree];
+}
+
+template<typename T, unsigned int N>
+void MemoryPool<T,N>::IRQdeallocate(T *block)
+{
+    //Catch blocks not belonging to this pool and double frees
+    if(block<&blocks[0] || block>=&blocks[N] || numFree>=N)
+        errorHandler(UNEXPECTED);
+    freeBlocks[numFree++]=block;
+    IRQwakeWaitingThread();
+}
+
+template<typename T, unsigned int N>
+void MemoryPool<T,N>::IRQdeallocate(T *block, bool& hppw)
+{
+    if(block<&blocks[0] || block>=&blocks[N] || numFree>=N)
+        errorHandler(UNEXPECTED);
+    freeBlocks[numFree++]=block;
+    Thread *t=IRQwakeWaitingThread();
+    if(t && Thread::IRQgetCurrentThread()->IRQgetPriority() <
+            t->IRQgetPriority()) hppw=true;
+}
+
+//This partial specialization is meant to to produce compiler errors in case an
+//attempt is made to instantiate a MemoryPool with zero size, as it is forbidden
+template<typename T> class MemoryPool<T,0> {};
+
+/**
+ * \}
+ */
+
+} //namespace miosix
@@ -491,6 +491,98 @@ bool Process::handleSvc(miosix_private::SyscallParameters sp)
                 } else sp.setReturnValue(-EFAULT);
                 break;
             }
+            case SYS_WRITEV:
+            case SYS_READV:
+            {
+                int fd=sp.getFirstParameter();
+                const struct iovec *iov=reinterpret_cast<const struct iovec*>(
+                    sp.getSecondParameter());
+                int iovcnt=sp.getThirdParameter();
+                bool isWrite=sp.getSyscallId()==SYS_WRITEV;
+                if(iovcnt<0 || iovcnt>IOV_MAX)
+                {
+                    sp.setReturnValue(-EINVAL);
+                    break;
+                }
+                if(validateIovec(iov,iovcnt,isWrite)==false)
+                {
+                    sp.setReturnValue(-EFAULT);
+                    break;
+                }
+                ssize_t result;
+                if(isWrite) result=fileTable.writev(fd,iov,iovcnt);
+                else result=fileTable.readv(fd,iov,iovcnt);
+                sp.setReturnValue(result);
+                break;
+            }
+            case SYS_PWRITE:
+            case SYS_PREAD:
+            {
+                int fd=sp.getFirstParameter();
+                const struct iovec *iov=reinterpret_cast<const struct iovec*>(
+                    sp.getSecondParameter());
+                //The 64 bit offset is passed in the third (low word) and
+                //fourth (high word) parameters
+                unsigned long long offset=sp.getFourthParameter();
+                offset=offset<<32 | sp.getThirdParameter();
+                off_t pos=static_cast<off_t>(offset);
+                bool isWrite=sp.getSyscallId()==SYS_PWRITE;
+                if(validateIovec(iov,1,isWrite)==false)
+                {
+                    sp.setReturnValue(-EFAULT);
+                    break;
+                }
+                ssize_t result;
+                if(isWrite)
+                    result=fileTable.pwrite(fd,iov->iov_base,iov->iov_len,pos);
+                else result=fileTable.pread(fd,iov->iov_base,iov->iov_len,pos);
+                sp.setReturnValue(result);
+                break;
+            }
+            case SYS_POLL:
+            {
+                struct pollfd *fds=reinterpret_cast<struct pollfd*>(
+                    sp.getFirstParameter());
+                nfds_t nfds=sp.getSecondParameter();
+                int timeout=sp.getThirdParameter();
+                if(nfds>MAX_OPEN_FILES)
+                {
+                    sp.setReturnValue(-EINVAL);
+                    break;
+                }
+                if(mpu.withinForWriting(fds,nfds*sizeof(struct pollfd)))
+                {
+                    int result=fileTable.poll(fds,nfds,timeout);
+                    sp.setReturnValue(result);
+                } else sp.setReturnValue(-EFAULT);
+                break;
+            }
+            case SYS_PIPE:
+            {
+                int *fds=reinterpret_cast<int*>(sp.getFirstParameter());
+                if(mpu.withinForWriting(fds,2*sizeof(int)))
+                {
+                    int result=fileTable.pipe(fds);
+                    sp.setReturnValue(result);
+                } else sp.setReturnValue(-EFAULT);
+                break;
+            }
+            case SYS_MKFIFO:
+            {
+                const char *str;
+                str=reinterpret_cast<const char*>(sp.getFirstParameter());
+                if(mpu.withinForReading(str))
+                {
+                    int result=fileTable.mkfifo(str,sp.getSecondParameter());
+                    sp.setReturnValue(result);
+                } else sp.setReturnValue(-EFAULT);
+                break;
+            }
+            case SYS_TIMEPAGE:
+            {
+                sp.setReturnValue(reinterpret_cast<unsigned int>(getTimePage()));
+                break;
+            }
             default:
                 exitCode=SIGSYS; //Bad syscall
                 #ifdef WITH_ERRLOG
@@ -504,6 +596,24 @@ bool Process::handleSvc(miosix_private::SyscallParameters sp)
     return true;
 }
 
+bool Process::validateIovec(const struct iovec *iov, int iovcnt, bool isWrite)
+{
+    if(mpu.withinForReading(iov,iovcnt*sizeof(struct iovec))==false)
+        return false;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(isWrite)
+        {
+            if(mpu.withinForReading(iov[i].iov_base,iov[i].iov_len)==false)
+                return false;
+        } else {
+            if(mpu.withinForWriting(iov[i].iov_base,iov[i].iov_len)==false)
+                return false;
+        }
+    }
+    return true;
+}
+
 pid_t Process::getNewPid()
 {
     Processes& p=Processes::instance();
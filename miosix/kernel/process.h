@@ -36,6 +36,7 @@
 #include "kernel.h"
 #include "sync.h"
 #include "elf_program.h"
+#include "time_page.h"
 #include "config/miosix_settings.h"
 #include "filesystem/file_access.h"
 
@@ -80,7 +81,18 @@ enum Syscalls
     SYS_MKDIR=19,
     SYS_RMDIR=20,
     SYS_UNLINK=21,
-    SYS_RENAME=22
+    SYS_RENAME=22,
+    SYS_WRITEV=23,
+    SYS_READV=24,
+    // pwrite and pread take fd, a pointer to a single struct iovec describing
+    // the buffer, and the 64 bit file offset, low word in r2, high word in r12
+    SYS_PWRITE=25,
+    SYS_PREAD=26,
+    SYS_POLL=27,
+    SYS_PIPE=28,
+    SYS_MKFIFO=29,
+    // Returns the address of the time page, see time_page.h
+    SYS_TIMEPAGE=30
 };
 
 //Forware decl
@@ -190,6 +202,17 @@ private:
      */
     bool handleSvc(miosix_private::SyscallParameters sp);
     
+    /**
+     * Check that an array of struct iovec and the buffers it points to are
+     * within the process memory
+     * \param iov array of buffers
+     * \param iovcnt number of buffers
+     * \param isWrite true if the buffers will be written to a file, so they
+     * need to be readable, false if they need to be writable
+     * \return true if the array and buffers are valid
+     */
+    bool validateIovec(const struct iovec *iov, int iovcnt, bool isWrite);
+    
     /**
      * \return an unique pid that is not zero and is not already in use in the
      * system, used to assign a pid to a new process.<br>
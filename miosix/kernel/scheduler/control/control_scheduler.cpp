@@ -259,6 +259,7 @@ unsigned int ControlScheduler::IRQfindNextThread()
                 miosix_private::MPUConfiguration::IRQdisable();
             } else {
                 ctxsave=cur->userCtxsave;
+                IRQupdateTimePage();
                 //A kernel thread is never in userspace, so the cast is safe
                 static_cast<Process*>(cur->proc)->mpu.IRQenable();
             }
@@ -697,6 +698,7 @@ unsigned int ControlScheduler::IRQfindNextThread()
                 MPUConfiguration::IRQdisable();
             } else {
                 ctxsave=cur->userCtxsave;
+                IRQupdateTimePage();
                 //A kernel thread is never in userspace, so the cast is safe
                 static_cast<Process*>(cur->proc)->mpu.IRQenable();
             }
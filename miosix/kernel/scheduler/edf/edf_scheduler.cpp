@@ -145,6 +145,7 @@ unsigned int EDFScheduler::IRQfindNextThread()
                 MPUConfiguration::IRQdisable();
             } else {
                 ctxsave=cur->userCtxsave;
+                IRQupdateTimePage();
                 //A kernel thread is never in userspace, so the cast is safe
                 static_cast<Process*>(cur->proc)->mpu.IRQenable();
             }
@@ -244,6 +244,7 @@ unsigned int PriorityScheduler::IRQfindNextThread()
                     MPUConfiguration::IRQdisable();
                 } else {
                     ctxsave=cur->userCtxsave;
+                    IRQupdateTimePage();
                     //A kernel thread is never in userspace, so the cast is safe
                     static_cast<Process*>(cur->proc)->mpu.IRQenable();
                 }
@@ -0,0 +1,164 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#include "slab.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "kernel.h"
+
+using namespace std;
+
+namespace miosix {
+
+//
+// class ObjectCache
+//
+
+ObjectCache *ObjectCache::caches=nullptr;
+
+ObjectCache::ObjectCache(const char *name, size_t size,
+        unsigned int objectsPerSlab, void (*init)(void*)) : name(name),
+        objectSize(size), linkOffset(0), objectsPerSlab(objectsPerSlab),
+        init(init),
+        freeList(nullptr), slabs(nullptr), numFree(0), numSlabs(0), inUse(0),
+        peakInUse(0), allocations(0)
+{
+    //Free objects store a pointer, and objects must be 8 byte aligned
+    objectSize=(objectSize+7) & ~7;
+    if(init)
+    {
+        linkOffset=objectSize;
+        objectSize+=(sizeof(FreeObject)+7) & ~7;
+    } else if(objectSize<sizeof(FreeObject)) objectSize=8;
+    if(this->objectsPerSlab==0)
+    {
+        this->objectsPerSlab=512/objectSize;
+        if(this->objectsPerSlab==0) this->objectsPerSlab=1;
+    }
+    PauseKernelLock dLock;
+    next=caches;
+    caches=this;
+}
+
+void *ObjectCache::allocate()
+{
+    PauseKernelLock dLock;
+    if(freeList==nullptr && PKgrow()==false) return nullptr;
+    FreeObject *f=freeList;
+    freeList=f->next;
+    numFree--;
+    inUse++;
+    allocations++;
+    if(inUse>peakInUse) peakInUse=inUse;
+    return reinterpret_cast<char*>(f)-linkOffset;
+}
+
+void ObjectCache::deallocate(void *object)
+{
+    if(object==nullptr) return;
+    FreeObject *f=reinterpret_cast<FreeObject*>(
+        reinterpret_cast<char*>(object)+linkOffset);
+    PauseKernelLock dLock;
+    f->next=freeList;
+    freeList=f;
+    numFree++;
+    inUse--;
+}
+
+bool ObjectCache::reserve(unsigned int n)
+{
+    PauseKernelLock dLock;
+    while(numFree<n) if(PKgrow()==false) return false;
+    return true;
+}
+
+void ObjectCache::printStats()
+{
+    iprintf("Object caches:\n%8s %8s %8s %8s %8s %10s  name\n",
+            "size","per slab","slabs","in use","peak","allocs");
+    //Caches are never deallocated while the kernel is running, so the list
+    //can be walked without pausing the kernel while printing
+    for(ObjectCache *c=caches;c;c=c->next)
+    {
+        iprintf("%8u %8u %8u %8u %8u %10u  ",c->objectSize,c->objectsPerSlab,
+                c->numSlabs,c->inUse,c->peakInUse,c->allocations);
+        //For SlabAllocated<T> caches, print only T
+        const char *n=c->name;
+        const char *t=strstr(n,"T = ");
+        if(t)
+        {
+            t+=4;
+            int len=strcspn(t,";]");
+            iprintf("%.*s\n",len,t);
+        } else iprintf("%s\n",n);
+    }
+}
+
+ObjectCache::~ObjectCache()
+{
+    PauseKernelLock dLock;
+    for(ObjectCache **c=&caches;*c;c=&(*c)->next)
+    {
+        if(*c!=this) continue;
+        *c=next;
+        break;
+    }
+    if(inUse!=0) return; //Objects still in use, slabs are leaked
+    while(slabs)
+    {
+        Slab *s=slabs;
+        slabs=s->next;
+        free(s);
+    }
+}
+
+bool ObjectCache::PKgrow()
+{
+    //The slab header is rounded up to keep objects 8 byte aligned
+    const size_t headerSize=(sizeof(Slab)+7) & ~7;
+    char *mem=reinterpret_cast<char*>(
+        malloc(headerSize+objectsPerSlab*objectSize));
+    if(mem==nullptr) return false;
+    Slab *s=reinterpret_cast<Slab*>(mem);
+    s->next=slabs;
+    slabs=s;
+    numSlabs++;
+    for(unsigned int i=0;i<objectsPerSlab;i++)
+    {
+        char *object=mem+headerSize+i*objectSize;
+        if(init) init(object);
+        FreeObject *f=reinterpret_cast<FreeObject*>(object+linkOffset);
+        f->next=freeList;
+        freeList=f;
+    }
+    numFree+=objectsPerSlab;
+    return true;
+}
+
+} //namespace miosix
@@ -0,0 +1,239 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <cstddef>
+#ifndef __NO_EXCEPTIONS
+#include <new>
+#endif //__NO_EXCEPTIONS
+#include "error.h"
+
+namespace miosix {
+
+/**
+ * \addtogroup Util
+ * \{
+ */
+
+/**
+ * A cache of fixed size objects, allocated in slabs of one or more objects
+ * from the heap. Deallocated objects are kept in the cache for reuse and
+ * slabs are never returned to the heap, so once the cache has grown to the
+ * peak number of objects in use, allocating and deallocating is O(1) and
+ * does not touch the heap, avoiding its fragmentation.<br>
+ * Optionally, an init function can be run once on each object when its slab
+ * is allocated, instead of every time the object is allocated. Objects are
+ * then returned by allocate() in the state the previous user left them, which
+ * allows to cache their construction if users restore that state before
+ * deallocating them.<br>
+ * Like malloc, it cannot be used inside an interrupt.
+ */
+class ObjectCache
+{
+public:
+    /**
+     * Constructor
+     * \param name name of the cache, printed by printStats()
+     * \param size object size
+     * \param objectsPerSlab number of objects allocated at a time, if 0 it is
+     * chosen so that slabs are around 512 bytes
+     * \param init if not nullptr, called on each object when its slab is
+     * allocated
+     */
+    ObjectCache(const char *name, std::size_t size,
+            unsigned int objectsPerSlab=0, void (*init)(void*)=nullptr);
+
+    /**
+     * Allocate an object
+     * \return the object, or nullptr if out of memory
+     */
+    void *allocate();
+
+    /**
+     * Return an object to the cache
+     * \param object object previously allocated from this cache
+     */
+    void deallocate(void *object);
+
+    /**
+     * Grow the cache so that at least n objects can be allocated without
+     * touching the heap
+     * \param n number of objects
+     * \return false if out of memory
+     */
+    bool reserve(unsigned int n);
+
+    /**
+     * \return the cache name
+     */
+    const char *getName() const { return name; }
+
+    /**
+     * \return the object size, rounded up for alignment
+     */
+    std::size_t getObjectSize() const { return objectSize; }
+
+    /**
+     * \return the number of slabs allocated from the heap
+     */
+    unsigned int getSlabs() const { return numSlabs; }
+
+    /**
+     * \return the number of objects in use
+     */
+    unsigned int getInUse() const { return inUse; }
+
+    /**
+     * \return the maximum number of objects ever in use at the same time
+     */
+    unsigned int getPeakInUse() const { return peakInUse; }
+
+    /**
+     * \return the number of allocations ever made
+     */
+    unsigned int getAllocations() const { return allocations; }
+
+    /**
+     * Print statistics of all the object caches
+     */
+    static void printStats();
+
+    /**
+     * Destructor. Slabs are returned to the heap only if no object is in use
+     */
+    ~ObjectCache();
+
+private:
+    ObjectCache(const ObjectCache&);
+    ObjectCache& operator= (const ObjectCache&);
+
+    /**
+     * Link of a free object, stored in the object itself, or after the object
+     * if it has an init function, so as not to overwrite its cached state
+     */
+    struct FreeObject
+    {
+        FreeObject *next;
+    };
+
+    /**
+     * Header of a slab, followed by the objects
+     */
+    struct Slab
+    {
+        Slab *next;
+    };
+
+    /**
+     * Allocate a new slab, must be called with the kernel paused
+     * \return false if out of memory
+     */
+    bool PKgrow();
+
+    const char *name;            ///< Cache name
+    std::size_t objectSize;      ///< Object size, rounded up
+    std::size_t linkOffset;      ///< Offset of FreeObject in the object
+    unsigned int objectsPerSlab; ///< Objects in each slab
+    void (*init)(void*);         ///< Object init function, or nullptr
+    FreeObject *freeList;        ///< List of free objects
+    Slab *slabs;                 ///< List of slabs
+    unsigned int numFree;        ///< Number of free objects
+    unsigned int numSlabs;       ///< Number of slabs
+    unsigned int inUse;          ///< Number of objects in use
+    unsigned int peakInUse;      ///< Peak of inUse
+    unsigned int allocations;    ///< Number of allocations
+    ObjectCache *next;           ///< List of all caches, for printStats()
+    static ObjectCache *caches;  ///< List of all caches
+};
+
+/**
+ * Deriving a class from this one makes it allocate its instances from an
+ * ObjectCache dedicated to the class instead of the heap, for example
+ * \code
+ * class Foo : public Bar, public SlabAllocated<Foo> { ... };
+ * \endcode
+ * Classes derived from Foo that are larger than Foo are allocated from the
+ * heap, as they do not fit in the cache of Foo.
+ * \param T the class that derives from this one
+ */
+template<typename T>
+class SlabAllocated
+{
+public:
+    /**
+     * Allocate an object from the cache
+     * \param size object size
+     * \throws std::bad_alloc if out of memory
+     */
+    static void *operator new(std::size_t size)
+    {
+        if(size!=sizeof(T)) return ::operator new(size);
+        void *result=cache().allocate();
+        #ifndef __NO_EXCEPTIONS
+        if(result==nullptr) throw std::bad_alloc();
+        #else //__NO_EXCEPTIONS
+        if(result==nullptr) errorHandler(OUT_OF_MEMORY);
+        #endif //__NO_EXCEPTIONS
+        return result;
+    }
+
+    /**
+     * Return an object to the cache
+     * \param ptr object to deallocate
+     * \param size object size
+     */
+    static void operator delete(void *ptr, std::size_t size) noexcept
+    {
+        if(ptr==nullptr) return;
+        if(size!=sizeof(T)) ::operator delete(ptr);
+        else cache().deallocate(ptr);
+    }
+
+    /**
+     * \return the cache of class T. Its name is the name of this function,
+     * from which printStats() extracts the name of T
+     */
+    static ObjectCache& cache()
+    {
+        static ObjectCache c(__PRETTY_FUNCTION__,sizeof(T));
+        return c;
+    }
+
+protected:
+    SlabAllocated() {}
+};
+
+/**
+ * \}
+ */
+
+} //namespace miosix
+
+#endif //SLAB_H
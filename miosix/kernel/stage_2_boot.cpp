@@ -43,6 +43,7 @@ start the kernel and filesystem.
 #include "filesystem/file_access.h"
 #include "error.h"
 #include "logging.h"
+#include "time_page.h"
 // settings for miosix
 #include "config/miosix_settings.h"
 #include "util/util.h"
@@ -128,6 +129,9 @@ extern "C" void _init()
     if(areInterruptsEnabled()) errorHandler(INTERRUPTS_ENABLED_AT_BOOT);
     IRQbspInit();
     internal::IRQosTimerInit();
+    #ifdef WITH_PROCESSES
+    IRQinitTimePage();
+    #endif //WITH_PROCESSES
     #ifdef WITH_DEEP_SLEEP
     IRQdeepSleepInit();
     #endif // WITH_DEEP_SLEEP
@@ -420,6 +420,40 @@ void ConditionVariable::wait(FastMutex& m)
     IRQdoMutexLockToDepth(m.get(),dLock,depth);
 }
 
+TimedWaitResult ConditionVariable::timedWait(FastMutex& m,
+        long long absoluteTimeNs)
+{
+    FastInterruptDisableLock dLock;
+    
+    WaitingData w;
+    w.p=Thread::getCurrentThread();
+    w.next=0;
+    //Add entry to tail of list
+    if(first==0)
+    {
+        first=last=&w;
+    } else {
+       last->next=&w;
+       last=&w;
+    }
+    //Unlike wait(), the thread is put in the wait status and not in the
+    //condition wait status, so that it can also be woken by the timeout.
+    //signal() and broadcast() wake it up with IRQwakeup()
+    unsigned int depth=IRQdoMutexUnlockAllDepthLevels(m.get());
+    TimedWaitResult result=Thread::IRQenableIrqAndTimedWait(dLock,
+            absoluteTimeNs);
+    //On timeout we are still in the list, remove ourselves
+    for(WaitingData *prev=0, *it=first;it!=0;prev=it, it=it->next)
+    {
+        if(it!=&w) continue;
+        if(prev) prev->next=it->next; else first=it->next;
+        if(last==it) last=prev;
+        break;
+    }
+    IRQdoMutexLockToDepth(m.get(),dLock,depth);
+    return result;
+}
+
 void ConditionVariable::signal()
 {
     bool hppw=false;
@@ -431,6 +465,7 @@ void ConditionVariable::signal()
         if(first==0) return;
         //Wakeup
         first->p->flags.IRQsetCondWait(false);
+        first->p->IRQwakeup(); //In case it is in timedWait()
         //Check for priority issues
         if(Thread::IRQgetCurrentThread()->IRQgetPriority() <
                 first->p->IRQgetPriority()) hppw=true;
@@ -453,6 +488,7 @@ void ConditionVariable::broadcast()
         {
             //Wakeup
             first->p->flags.IRQsetCondWait(false);
+            first->p->IRQwakeup(); //In case it is in timedWait()
             //Check for priority issues
             if(Thread::IRQgetCurrentThread()->IRQgetPriority() <
                 first->p->IRQgetPriority()) hppw=true;
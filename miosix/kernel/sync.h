@@ -432,6 +432,30 @@ public:
      */
     void wait(FastMutex& m);
 
+    /**
+     * Unlock the mutex and wait until woken or until the timeout expires.
+     * If more threads call wait() or timedWait() they must do so specifying
+     * the same mutex, otherwise the behaviour is undefined.
+     * \param l A Lock instance that locked a FastMutex
+     * \param absoluteTimeNs absolute time after which the wait times out
+     * \return TimedWaitResult::Timeout if the wait timed out
+     */
+    template<typename T>
+    TimedWaitResult timedWait(Lock<T>& l, long long absoluteTimeNs)
+    {
+        return timedWait(l.get(),absoluteTimeNs);
+    }
+
+    /**
+     * Unlock the FastMutex and wait until woken or until the timeout expires.
+     * If more threads call wait() or timedWait() they must do so specifying
+     * the same mutex, otherwise the behaviour is undefined.
+     * \param m a locked FastMutex
+     * \param absoluteTimeNs absolute time after which the wait times out
+     * \return TimedWaitResult::Timeout if the wait timed out
+     */
+    TimedWaitResult timedWait(FastMutex& m, long long absoluteTimeNs);
+
     /**
      * Wakeup one waiting thread.
      * Currently implemented policy is fifo.
@@ -0,0 +1,99 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#include "time_page.h"
+#include "interfaces/os_timer.h"
+#include "interfaces/portability.h"
+#include <algorithm>
+
+#ifdef WITH_PROCESSES
+
+namespace miosix {
+
+//MPU regions must be aligned to their size
+static TimePage timePage __attribute__((aligned(32)));
+
+void IRQinitTimePage()
+{
+    TimeConversionFactor tick2ns=internal::IRQosTimerGetTick2ns();
+    timePage.tick2nsInt=tick2ns.integerPart();
+    timePage.tick2nsFrac=tick2ns.fractionalPart();
+    internal::OsTimerRegisters regs;
+    long long upperTick;
+    if(internal::IRQosTimerGetRegisters(regs,upperTick))
+    {
+        //Map the smallest MPU region containing both registers
+        auto counter=reinterpret_cast<unsigned int>(regs.counter);
+        auto status=reinterpret_cast<unsigned int>(regs.status);
+        unsigned int first=std::min(counter,status);
+        unsigned int last=std::max(counter,status)+sizeof(unsigned int);
+        unsigned int size=32;
+        while((first & ~(size-1))+size<last) size*=2;
+        IRQconfigureSharedDeviceRegion(
+            reinterpret_cast<const void*>(first & ~(size-1)),size);
+        timePage.counter=regs.counter;
+        timePage.status=regs.status;
+        timePage.overflowMask=regs.overflowMask;
+        IRQupdateTimePageUpperTick(upperTick);
+    } else IRQupdateTimePage();
+    IRQconfigureSharedRegion(&timePage,sizeof(TimePage));
+}
+
+void IRQupdateTimePage()
+{
+    timePage.sequence++;
+    asm volatile("":::"memory");
+    if(timePage.counter==nullptr)
+    {
+        long long tick=internal::IRQosTimerGetTick();
+        timePage.tickLo=static_cast<unsigned int>(tick);
+        timePage.tickHi=static_cast<unsigned int>(tick>>32);
+    }
+    asm volatile("":::"memory");
+    timePage.sequence++;
+}
+
+void IRQupdateTimePageUpperTick(long long upperTick)
+{
+    if(timePage.counter==nullptr) return;
+    timePage.sequence++;
+    asm volatile("":::"memory");
+    timePage.tickLo=static_cast<unsigned int>(upperTick);
+    timePage.tickHi=static_cast<unsigned int>(upperTick>>32);
+    asm volatile("":::"memory");
+    timePage.sequence++;
+}
+
+const TimePage *getTimePage()
+{
+    return &timePage;
+}
+
+} //namespace miosix
+
+#endif //WITH_PROCESSES
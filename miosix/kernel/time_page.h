@@ -0,0 +1,104 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#pragma once
+
+#include "config/miosix_settings.h"
+
+#ifdef WITH_PROCESSES
+
+namespace miosix {
+
+/**
+ * \internal
+ * The time page is a 32 byte memory area that the kernel exports to all
+ * processes as read-only through the MPU, so that processes can read the
+ * monotonic clock without a syscall.<br>
+ * If the os timer exports its registers through IRQosTimerGetRegisters(), they
+ * are also mapped read-only through the MPU. The page then holds the upper 32
+ * bits of the timer, updated by the timer overflow interrupt, and processes
+ * extend the hardware counter with the same pending bit trick used by
+ * TimerAdapter::IRQgetTimeTick(). Otherwise, the page holds a snapshot of the
+ * os timer taken every time a userspace thread is resumed, and the resolution
+ * seen by a process that runs without blocking is the scheduler time slice.
+ * <br>In both cases processes convert ticks to nanoseconds using the same
+ * fixed point factor used by TimeConversion::tick2ns().<br>
+ * The sequence counter is odd while the page is being updated. Readers must
+ * retry if it is odd, or if it changed while they were reading, as the kernel
+ * may update the page from an interrupt while a process is reading it. It also
+ * advances every time a userspace thread is resumed, including on return from
+ * a syscall.
+ * <br>This layout is shared with userspace, see
+ * _tools/processes/process_template/crt1.cpp
+ */
+struct TimePage
+{
+    volatile unsigned int sequence; ///< Sequence counter
+    volatile unsigned int tickLo;   ///< Upper bits or snapshot, low word
+    volatile unsigned int tickHi;   ///< Upper bits or snapshot, high word
+    unsigned int tick2nsInt;        ///< Tick to ns factor, integer part
+    unsigned int tick2nsFrac;       ///< Tick to ns factor, fractional part
+    const volatile unsigned int *counter; ///< Timer counter, or nullptr
+    const volatile unsigned int *status;  ///< Register with the overflow flag
+    unsigned int overflowMask;            ///< Overflow flag bit in *status
+};
+
+static_assert(sizeof(TimePage)==32,"TimePage must be 32 bytes");
+
+/**
+ * \internal
+ * Initialize the time page and make it visible to processes.
+ * Called at boot after the os timer has been initialized.
+ */
+void IRQinitTimePage();
+
+/**
+ * \internal
+ * Update the os timer snapshot in the time page, if processes can't read the
+ * timer counter, and advance the sequence counter.
+ * Called with interrupts disabled every time a userspace thread is resumed.
+ */
+void IRQupdateTimePage();
+
+/**
+ * \internal
+ * Update the upper bits of the os timer in the time page, if processes can
+ * read the timer counter.
+ * Called by the os timer every time the upper bits change.
+ * \param upperTick the upper bits of the os timer, in ticks
+ */
+void IRQupdateTimePageUpperTick(long long upperTick);
+
+/**
+ * \return the time page
+ */
+const TimePage *getTimePage();
+
+} //namespace miosix
+
+#endif //WITH_PROCESSES
@@ -0,0 +1,483 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#include "tlsf.h"
+#include <cstring>
+#include <cstdint>
+
+#ifdef TEST_ALLOC
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+#endif //TEST_ALLOC
+
+using namespace std;
+
+namespace miosix {
+
+void Tlsf::addRegion(void *start, size_t size)
+{
+    char *s=reinterpret_cast<char*>(start);
+    char *e=s+size;
+    Block *b;
+    if(sentinel && s==regionEnd)
+    {
+        //Contiguous with the last region, the old sentinel becomes the
+        //header of the new block, which keeps its prevFreeBit
+        b=sentinel;
+    } else {
+        //The user pointer of the first block must be aligned
+        uintptr_t p=reinterpret_cast<uintptr_t>(s)+headerSize;
+        p=(p+alignment-1) & ~(alignment-1);
+        b=reinterpret_cast<Block*>(p-headerSize);
+        if(reinterpret_cast<char*>(b)+headerSize>e) return;
+        b->header=0;
+    }
+    if(e<reinterpret_cast<char*>(b)+headerSize) return;
+    size_t bs=(e-headerSize-reinterpret_cast<char*>(b)) & ~(alignment-1);
+    //Larger blocks do not fit in the free lists, the rest of the region is lost
+    if(bs>=size_t(1)<<flMax) bs=(size_t(1)<<flMax)-alignment;
+    if(bs<minBlockSize) return;
+    setSize(b,bs);
+    sentinel=next(b);
+    sentinel->header=0; //Size zero and allocated, so it is never coalesced
+    regionEnd=e;
+    regionSize+=bs;
+    release(b);
+}
+
+void *Tlsf::allocate(size_t size)
+{
+    size_t bs=blockSize(size);
+    if(bs==0) return nullptr;
+    size_t s=roundUp(bs);
+    Block *b=findFree(s);
+    //If moreCore returns memory that is not contiguous it takes two attempts
+    for(int i=0;i<2 && b==nullptr;i++)
+    {
+        if(grow(s)==false) return nullptr;
+        b=findFree(s);
+    }
+    if(b==nullptr) return nullptr;
+    b->header&=~freeBit;
+    next(b)->header&=~prevFreeBit;
+    usedSize+=Tlsf::size(b);
+    trim(b,bs);
+    if(usedSize>peakUsedSize) peakUsedSize=usedSize;
+    return toPtr(b);
+}
+
+void *Tlsf::allocateAligned(size_t align, size_t size)
+{
+    if(align<=alignment) return allocate(size);
+    if((align & (align-1)) || align>maxSize) return nullptr;
+    size_t bs=blockSize(size);
+    if(bs==0) return nullptr;
+    //Allocate enough to leave before the aligned pointer a gap that is
+    //either zero or large enough to be a free block
+    char *p=reinterpret_cast<char*>(allocate(bs+align+minBlockSize));
+    if(p==nullptr) return nullptr;
+    Block *b=toBlock(p);
+    uintptr_t a=reinterpret_cast<uintptr_t>(p);
+    uintptr_t aligned=(a+align-1) & ~(align-1);
+    if(aligned!=a)
+    {
+        while(aligned-a<minBlockSize) aligned+=align;
+        size_t gap=aligned-a;
+        Block *nb=toBlock(reinterpret_cast<void*>(aligned));
+        nb->header=Tlsf::size(b)-gap;
+        setSize(b,gap);
+        usedSize-=gap;
+        release(b);
+        b=nb;
+    }
+    trim(b,bs);
+    return toPtr(b);
+}
+
+void *Tlsf::reallocate(void *ptr, size_t size)
+{
+    if(ptr==nullptr) return allocate(size);
+    size_t bs=blockSize(size);
+    if(bs==0) return nullptr;
+    Block *b=toBlock(ptr);
+    size_t cur=Tlsf::size(b);
+    if(cur>=bs)
+    {
+        trim(b,bs);
+        return ptr;
+    }
+    //Try to grow in place by absorbing the following block
+    Block *n=next(b);
+    if(isFree(n) && cur+Tlsf::size(n)>=bs)
+    {
+        removeFree(n);
+        setSize(b,cur+Tlsf::size(n));
+        next(b)->header&=~prevFreeBit;
+        usedSize+=Tlsf::size(n);
+        trim(b,bs);
+        if(usedSize>peakUsedSize) peakUsedSize=usedSize;
+        return ptr;
+    }
+    void *result=allocate(size);
+    if(result==nullptr) return nullptr;
+    memcpy(result,ptr,cur-headerSize);
+    deallocate(ptr);
+    return result;
+}
+
+void Tlsf::deallocate(void *ptr)
+{
+    if(ptr==nullptr) return;
+    Block *b=toBlock(ptr);
+    usedSize-=size(b);
+    release(b);
+}
+
+size_t Tlsf::usableSize(const void *ptr)
+{
+    if(ptr==nullptr) return 0;
+    return size(toBlock(ptr))-headerSize;
+}
+
+size_t Tlsf::getLargestFreeBlock() const
+{
+    if(flBitmap==0) return 0;
+    unsigned int fl=31-__builtin_clz(flBitmap);
+    unsigned int sl=31-__builtin_clz(slBitmap[fl]);
+    size_t result=0;
+    for(Block *b=heads[fl][sl];b;b=b->nextFree)
+        if(size(b)>result) result=size(b);
+    return result-headerSize;
+}
+
+size_t Tlsf::getTopFreeBlock() const
+{
+    if(sentinel==nullptr || isPrevFree(sentinel)==false) return 0;
+    return size(prev(sentinel))-headerSize;
+}
+
+size_t Tlsf::blockSize(size_t size)
+{
+    if(size>maxSize) return 0;
+    size_t result=(size+headerSize+alignment-1) & ~(alignment-1);
+    return result<minBlockSize ? minBlockSize : result;
+}
+
+size_t Tlsf::roundUp(size_t s)
+{
+    if(s<smallSize) return s;
+    unsigned int f=sizeof(unsigned long)*8-1-__builtin_clzl(s);
+    size_t round=(size_t(1)<<(f-slLog2))-1;
+    return (s+round) & ~round;
+}
+
+void Tlsf::mapping(size_t s, unsigned int& fl, unsigned int& sl)
+{
+    if(s<smallSize)
+    {
+        fl=0;
+        sl=s>>alignLog2;
+    } else {
+        unsigned int f=sizeof(unsigned long)*8-1-__builtin_clzl(s);
+        fl=f-flShift+1;
+        sl=(s>>(f-slLog2)) ^ slCount;
+    }
+}
+
+void Tlsf::insertFree(Block *b)
+{
+    unsigned int fl,sl;
+    mapping(size(b),fl,sl);
+    b->prevFree=nullptr;
+    b->nextFree=heads[fl][sl];
+    if(b->nextFree) b->nextFree->prevFree=b;
+    heads[fl][sl]=b;
+    flBitmap|=1<<fl;
+    slBitmap[fl]|=1<<sl;
+    freeBlocks++;
+}
+
+void Tlsf::removeFree(Block *b)
+{
+    unsigned int fl,sl;
+    mapping(size(b),fl,sl);
+    if(b->nextFree) b->nextFree->prevFree=b->prevFree;
+    if(b->prevFree) b->prevFree->nextFree=b->nextFree;
+    else {
+        heads[fl][sl]=b->nextFree;
+        if(heads[fl][sl]==nullptr)
+        {
+            slBitmap[fl]&=~(1<<sl);
+            if(slBitmap[fl]==0) flBitmap&=~(1<<fl);
+        }
+    }
+    freeBlocks--;
+}
+
+Tlsf::Block *Tlsf::findFree(size_t s)
+{
+    unsigned int fl,sl;
+    mapping(s,fl,sl);
+    if(fl>=flCount) return nullptr;
+    unsigned int slMap=slBitmap[fl] & (~0u<<sl);
+    if(slMap==0)
+    {
+        unsigned int flMap=flBitmap & (~0u<<(fl+1));
+        if(flMap==0) return nullptr;
+        fl=__builtin_ctz(flMap);
+        slMap=slBitmap[fl];
+    }
+    Block *b=heads[fl][__builtin_ctz(slMap)];
+    removeFree(b);
+    return b;
+}
+
+void Tlsf::release(Block *b)
+{
+    b->header|=freeBit;
+    if(isPrevFree(b))
+    {
+        Block *p=prev(b);
+        removeFree(p);
+        setSize(p,size(p)+size(b));
+        b=p;
+    }
+    Block *n=next(b);
+    if(isFree(n))
+    {
+        removeFree(n);
+        setSize(b,size(b)+size(n));
+        n=next(b);
+    }
+    reinterpret_cast<Block**>(n)[-1]=b;
+    n->header|=prevFreeBit;
+    insertFree(b);
+}
+
+void Tlsf::trim(Block *b, size_t s)
+{
+    size_t cur=size(b);
+    if(cur-s<minBlockSize) return;
+    setSize(b,s);
+    Block *r=next(b);
+    r->header=cur-s;
+    usedSize-=cur-s;
+    release(r);
+}
+
+bool Tlsf::grow(size_t s)
+{
+    if(moreCore==nullptr) return false;
+    //If the last block is free, it will be merged with the new memory
+    size_t incr=s;
+    if(sentinel && isPrevFree(sentinel))
+    {
+        size_t last=size(prev(sentinel));
+        incr=last<s ? s-last : 0;
+    }
+    if(incr<minBlockSize) incr=minBlockSize;
+    incr=(incr+alignment-1) & ~(alignment-1);
+    void *result=moreCore(incr);
+    if(result==nullptr) return false;
+    addRegion(result,incr);
+    return true;
+}
+
+} //namespace miosix
+
+#ifdef TEST_ALLOC
+
+using namespace miosix;
+
+/*
+ * Stress test comparing the fragmentation of Tlsf with the one of the host
+ * malloc. Newlib malloc and glibc malloc both derive from Doug Lea's malloc,
+ * so the host malloc is a reasonable stand-in for newlib when run with mmap
+ * disabled. Both allocators get their memory through sbrk(), and the peak
+ * sbrk() footprint is compared with the peak amount of live memory.
+ * Build with
+ * g++ -std=c++14 -O2 -DTEST_ALLOC -o tlsf_test tlsf.cpp
+ */
+
+static char arena[16*1024*1024];
+static char *arenaBrk=arena;
+
+static void *testMoreCore(ptrdiff_t incr)
+{
+    if(arenaBrk+incr>arena+sizeof(arena)) return nullptr;
+    char *result=arenaBrk;
+    arenaBrk+=incr;
+    return result;
+}
+
+/**
+ * Deterministic random number generator, so that both allocators see
+ * exactly the same sequence of operations
+ */
+class Random
+{
+public:
+    Random() : x(0x12345678) {}
+    unsigned int operator()()
+    {
+        x^=x<<13; x^=x>>17; x^=x<<5;
+        return x;
+    }
+private:
+    unsigned int x;
+};
+
+/**
+ * Mostly small blocks, some medium ones and few large ones, which is the
+ * typical pattern of strings, containers and I/O buffers
+ */
+static size_t randomSize(Random& r)
+{
+    unsigned int p=r()%100;
+    if(p<70) return 1+r()%64;
+    if(p<95) return 64+r()%1024;
+    return 1024+r()%16384;
+}
+
+struct Slot
+{
+    unsigned char *p;
+    size_t size;
+};
+
+static void fill(const Slot& s, unsigned int i)
+{
+    memset(s.p,static_cast<unsigned char>(i),s.size);
+}
+
+static void check(const Slot& s, unsigned int i)
+{
+    for(size_t j=0;j<s.size;j++)
+    {
+        if(s.p[j]==static_cast<unsigned char>(i)) continue;
+        printf("Corruption detected\n");
+        exit(1);
+    }
+}
+
+struct Result
+{
+    size_t peakLive;
+    size_t peakFootprint;
+    double maxLatency;
+};
+
+template<typename Alloc, typename Free, typename Realloc, typename Memalign,
+         typename Footprint>
+static Result stress(Alloc alloc, Free dealloc, Realloc realloc_,
+        Memalign memalign_, Footprint footprint)
+{
+    const unsigned int numSlots=2000;
+    const unsigned int numOps=4000000;
+    Random r;
+    vector<Slot> slots(numSlots,Slot{nullptr,0});
+    size_t live=0;
+    Result result={0,0,0};
+    for(unsigned int op=0;op<numOps;op++)
+    {
+        unsigned int i=r()%numSlots;
+        Slot& s=slots[i];
+        unsigned int kind=r()%16;
+        auto t1=chrono::steady_clock::now();
+        if(s.p==nullptr)
+        {
+            s.size=randomSize(r);
+            if(kind==0) s.p=reinterpret_cast<unsigned char*>(memalign_(64,s.size));
+            else s.p=reinterpret_cast<unsigned char*>(alloc(s.size));
+            if(s.p==nullptr) { printf("Out of memory\n"); exit(1); }
+            live+=s.size;
+        } else if(kind<3) {
+            check(s,i);
+            size_t newSize=randomSize(r);
+            void *p=realloc_(s.p,newSize);
+            if(p==nullptr) { printf("Out of memory\n"); exit(1); }
+            s.p=reinterpret_cast<unsigned char*>(p);
+            live=live-s.size+newSize;
+            s.size=newSize;
+        } else {
+            check(s,i);
+            dealloc(s.p);
+            live-=s.size;
+            s.p=nullptr;
+            s.size=0;
+        }
+        auto t2=chrono::steady_clock::now();
+        double latency=chrono::duration<double,micro>(t2-t1).count();
+        if(latency>result.maxLatency) result.maxLatency=latency;
+        if(s.p) fill(s,i);
+        if(live>result.peakLive) result.peakLive=live;
+        size_t fp=footprint();
+        if(fp>result.peakFootprint) result.peakFootprint=fp;
+    }
+    for(unsigned int i=0;i<numSlots;i++) if(slots[i].p) dealloc(slots[i].p);
+    return result;
+}
+
+static void print(const char *name, const Result& r)
+{
+    printf("%s: peak live %zu, peak footprint %zu, overhead %.1f%%, "
+           "max latency %.1fus\n",name,r.peakLive,r.peakFootprint,
+           100.0*(r.peakFootprint-r.peakLive)/r.peakLive,r.maxLatency);
+}
+
+static Tlsf tlsf(testMoreCore);
+
+int main()
+{
+    Result t=stress([](size_t s){ return tlsf.allocate(s); },
+                    [](void *p){ tlsf.deallocate(p); },
+                    [](void *p, size_t s){ return tlsf.reallocate(p,s); },
+                    [](size_t a, size_t s){ return tlsf.allocateAligned(a,s); },
+                    []{ return static_cast<size_t>(arenaBrk-arena); });
+    if(tlsf.getUsedSize()!=0) { printf("Leak detected\n"); return 1; }
+    if(tlsf.getFreeBlocks()!=1) { printf("Not coalesced\n"); return 1; }
+    print("tlsf",t);
+
+    mallopt(M_MMAP_MAX,0);
+    mallopt(M_TRIM_THRESHOLD,-1);
+    char *base=reinterpret_cast<char*>(sbrk(0));
+    Result m=stress([](size_t s){ return malloc(s); },
+                    [](void *p){ free(p); },
+                    [](void *p, size_t s){ return realloc(p,s); },
+                    [](size_t a, size_t s){ return memalign(a,s); },
+                    [base]{ return static_cast<size_t>(
+                        reinterpret_cast<char*>(sbrk(0))-base); });
+    print("malloc",m);
+    return 0;
+}
+
+#endif //TEST_ALLOC
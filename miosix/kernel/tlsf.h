@@ -0,0 +1,293 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#ifndef TLSF_H
+#define TLSF_H
+
+#include <cstddef>
+
+namespace miosix {
+
+/**
+ * \addtogroup Util
+ * \{
+ */
+
+/**
+ * Two-Level Segregated Fit memory allocator.<br>
+ * Free blocks are kept in lists segregated by size, indexed by a first level
+ * (power of two) and a second level (linear subdivision of the power of two)
+ * bitmap, so that finding a suitable free block, splitting it and coalescing
+ * a freed block with its neighbours all take a bounded, O(1), time regardless
+ * of the heap size and of the number of allocated blocks. Coupled with the
+ * good-fit policy this also keeps fragmentation low over long uptimes.<br>
+ * Memory is given to the allocator as regions, either explicitly with
+ * addRegion() or on demand through the moreCore callback, which has the same
+ * semantics as sbrk(). Contiguous regions are merged, so a heap grown through
+ * sbrk() is seen as a single region.<br>
+ * This class is not thread safe, locking is up to the caller.<br>
+ * Define TEST_ALLOC when compiling tlsf.cpp to build a stress test to run on
+ * the development machine, that compares its fragmentation with the one of
+ * the host malloc.
+ */
+class Tlsf
+{
+public:
+    /**
+     * Constructor. The constructor is constexpr, so that a global allocator
+     * is usable before global constructors are run.
+     * \param moreCore function called to get more memory when an allocation
+     * fails. It has the same semantics as sbrk(), but returns nullptr on
+     * failure. Can be nullptr if the allocator should not grow by itself
+     */
+    constexpr Tlsf(void *(*moreCore)(std::ptrdiff_t)=nullptr)
+        : moreCore(moreCore), sentinel(nullptr), regionEnd(nullptr),
+          regionSize(0), usedSize(0), peakUsedSize(0), freeBlocks(0),
+          flBitmap(0), slBitmap(), heads() {}
+
+    /**
+     * Add a memory region to the allocator. If the region starts where the
+     * last added region ends, the two are merged.
+     * \param start start of the region
+     * \param size size of the region
+     */
+    void addRegion(void *start, std::size_t size);
+
+    /**
+     * Allocate memory, with the same semantics as malloc()
+     * \param size size of the memory to allocate
+     * \return the allocated memory, aligned to 8 bytes, or nullptr
+     */
+    void *allocate(std::size_t size);
+
+    /**
+     * Allocate aligned memory, with the same semantics as memalign()
+     * \param align alignment, must be a power of two
+     * \param size size of the memory to allocate
+     * \return the allocated memory, or nullptr
+     */
+    void *allocateAligned(std::size_t align, std::size_t size);
+
+    /**
+     * Resize memory, with the same semantics as realloc()
+     * \param ptr memory previously allocated, or nullptr
+     * \param size new size
+     * \return the resized memory, or nullptr, in which case ptr is left
+     * untouched
+     */
+    void *reallocate(void *ptr, std::size_t size);
+
+    /**
+     * Deallocate memory, with the same semantics as free()
+     * \param ptr memory previously allocated, or nullptr
+     */
+    void deallocate(void *ptr);
+
+    /**
+     * \param ptr memory previously allocated
+     * \return the number of bytes that can be used starting at ptr, which
+     * can be larger than the requested size
+     */
+    static std::size_t usableSize(const void *ptr);
+
+    /**
+     * \param ptr memory previously allocated
+     * \return false if the memory has already been deallocated. The check
+     * uses the block header, so it is reliable only until the memory is
+     * allocated again
+     */
+    static bool isAllocated(const void *ptr) { return !isFree(toBlock(ptr)); }
+
+    /**
+     * \return the total size of the regions managed by the allocator
+     */
+    std::size_t getRegionSize() const { return regionSize; }
+
+    /**
+     * \return the total size of the allocated blocks, including their
+     * bookkeeping overhead
+     */
+    std::size_t getUsedSize() const { return usedSize; }
+
+    /**
+     * \return the maximum value getUsedSize() ever reached
+     */
+    std::size_t getPeakUsedSize() const { return peakUsedSize; }
+
+    /**
+     * \return the number of free blocks
+     */
+    unsigned int getFreeBlocks() const { return freeBlocks; }
+
+    /**
+     * \return the largest allocation that would succeed without calling
+     * moreCore. Only the list of the largest size class is scanned
+     */
+    std::size_t getLargestFreeBlock() const;
+
+    /**
+     * \return the largest allocation that would succeed from the free block
+     * at the end of the last region, which can be extended through moreCore,
+     * or 0 if the last block is allocated
+     */
+    std::size_t getTopFreeBlock() const;
+
+private:
+    Tlsf(const Tlsf&);
+    Tlsf& operator= (const Tlsf&);
+
+    /**
+     * Block header. The size of allocated blocks and the free list pointers
+     * of free blocks share the same memory. Free blocks also have a pointer
+     * to themselves in their last word, so that the following block can find
+     * them when coalescing.
+     */
+    struct Block
+    {
+        std::size_t header; ///< Block size including header, and flags
+        Block *nextFree;    ///< Next block in free list, only if free
+        Block *prevFree;    ///< Prev block in free list, only if free
+    };
+
+    static const unsigned int alignLog2=3;
+    static const std::size_t alignment=1<<alignLog2;
+    static const std::size_t headerSize=sizeof(std::size_t);
+    static const std::size_t minBlockSize=(sizeof(Block)+sizeof(Block*)
+                                          +alignment-1) & ~(alignment-1);
+    static const unsigned int slLog2=4;       ///< 16 second level lists
+    static const unsigned int slCount=1<<slLog2;
+    static const unsigned int flShift=slLog2+alignLog2;
+    static const unsigned int flMax=26;       ///< Blocks up to 64MByte
+    static const unsigned int flCount=flMax-flShift+1;
+    static const std::size_t smallSize=1<<flShift;
+    static const std::size_t maxSize=std::size_t(1)<<(flMax-1);
+    static const std::size_t freeBit=1;     ///< This block is free
+    static const std::size_t prevFreeBit=2; ///< Previous block is free
+
+    static std::size_t size(const Block *b) { return b->header & ~(alignment-1); }
+    static bool isFree(const Block *b) { return b->header & freeBit; }
+    static bool isPrevFree(const Block *b) { return b->header & prevFreeBit; }
+
+    static void setSize(Block *b, std::size_t s)
+    {
+        b->header=s | (b->header & (alignment-1));
+    }
+
+    static Block *next(const Block *b)
+    {
+        return reinterpret_cast<Block*>(
+            reinterpret_cast<char*>(const_cast<Block*>(b))+size(b));
+    }
+
+    /**
+     * \param b a block whose previous block is free
+     * \return the previous block
+     */
+    static Block *prev(const Block *b)
+    {
+        return reinterpret_cast<Block* const*>(b)[-1];
+    }
+
+    static void *toPtr(Block *b)
+    {
+        return reinterpret_cast<char*>(b)+headerSize;
+    }
+
+    static Block *toBlock(const void *ptr)
+    {
+        return reinterpret_cast<Block*>(
+            const_cast<char*>(reinterpret_cast<const char*>(ptr))-headerSize);
+    }
+
+    /**
+     * \param size allocation size requested by the user
+     * \return the block size, or 0 if too large
+     */
+    static std::size_t blockSize(std::size_t size);
+
+    /**
+     * \param s block size
+     * \return the smallest block size such that all blocks in the free list
+     * it maps to are at least s bytes
+     */
+    static std::size_t roundUp(std::size_t s);
+
+    /**
+     * Compute the free list indices for a block size
+     */
+    static void mapping(std::size_t s, unsigned int& fl, unsigned int& sl);
+
+    void insertFree(Block *b);
+    void removeFree(Block *b);
+
+    /**
+     * Find and remove from the free lists a block of at least s bytes
+     * \param s block size, rounded with roundUp()
+     * \return the block, or nullptr
+     */
+    Block *findFree(std::size_t s);
+
+    /**
+     * Mark a block as free, coalesce it with its neighbours and put it in
+     * the free lists. Does not update usedSize
+     */
+    void release(Block *b);
+
+    /**
+     * Split the tail of an allocated block, if large enough, and release it
+     * \param b allocated block
+     * \param s size to keep
+     */
+    void trim(Block *b, std::size_t s);
+
+    /**
+     * Get more memory through moreCore
+     * \param s block size that should become allocatable
+     * \return false if no memory could be obtained
+     */
+    bool grow(std::size_t s);
+
+    void *(*moreCore)(std::ptrdiff_t); ///< Callback to get more memory
+    Block *sentinel;                   ///< End of the last region
+    char *regionEnd;                   ///< End of the last region
+    std::size_t regionSize;            ///< Total size of the regions
+    std::size_t usedSize;              ///< Size of allocated blocks
+    std::size_t peakUsedSize;          ///< Peak of usedSize
+    unsigned int freeBlocks;           ///< Number of free blocks
+    unsigned int flBitmap;             ///< First level bitmap
+    unsigned int slBitmap[flCount];    ///< Second level bitmaps
+    Block *heads[flCount][slCount];    ///< Free lists
+};
+
+/**
+ * \}
+ */
+
+} //namespace miosix
+
+#endif //TLSF_H
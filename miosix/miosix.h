@@ -38,6 +38,9 @@
 #include <kernel/kernel.h>
 #include <kernel/sync.h>
 #include <kernel/queue.h>
+#include <kernel/memory_pool.h>
+#include <kernel/heap_regions.h>
+#include <kernel/slab.h>
 /* Utilities */
 #include <util/util.h>
 /* Settings */
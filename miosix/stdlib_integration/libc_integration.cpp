@@ -28,6 +28,9 @@
 
 #include "libc_integration.h"
 #include <stdexcept>
+#include <memory>
+#include <limits>
+#include <algorithm>
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
@@ -38,6 +41,8 @@
 #include <sys/times.h>
 #include <sys/stat.h>
 #include <sys/fcntl.h>
+#include <sys/select.h>
+#include <malloc.h>
 //// Settings
 #include "config/miosix_settings.h"
 //// Filesystem
@@ -46,6 +51,9 @@
 #include "kernel/logging.h"
 //// kernel interface
 #include "kernel/kernel.h"
+#include "kernel/tlsf.h"
+#include "util/util.h"
+#include "util/heap_trace.h"
 #include "interfaces/bsp.h"
 #include "interfaces/os_timer.h"
 
@@ -225,6 +233,318 @@ void __malloc_unlock()
     miosix::restartKernel();
 }
 
+#ifdef WITH_TLSF_ALLOCATOR
+
+/**
+ * \internal
+ * Called by the TLSF allocator to grow the heap
+ */
+static void *tlsfMoreCore(ptrdiff_t incr)
+{
+    void *result=_sbrk_r(miosix::getReent(),incr);
+    if(result==reinterpret_cast<void*>(-1)) return nullptr;
+    return result;
+}
+
+/// \internal The heap. The constructor is constexpr, so it is usable even
+/// before global constructors are called
+static miosix::Tlsf tlsfHeap(tlsfMoreCore);
+
+#ifdef WITH_HEAP_TRACE
+/// \internal Bytes added to each allocation to store the call site
+static const size_t traceTagSize=miosix::HeapTrace::tagSize;
+
+/**
+ * \internal
+ * \param mem memory that is being deallocated
+ * \return its usable size, or 0 if it is not allocated
+ */
+static unsigned int traceUsableSize(void *mem)
+{
+    if(miosix::Tlsf::isAllocated(mem)==false) return 0;
+    return miosix::Tlsf::usableSize(mem);
+}
+#else //WITH_HEAP_TRACE
+static const size_t traceTagSize=0;
+#endif //WITH_HEAP_TRACE
+
+//Replacing the reentrant versions of the allocation functions is enough to
+//replace newlib malloc, as malloc(), free(), ... just call them. The kernel is
+//paused as it was with newlib malloc, so the same restrictions apply: NEVER
+//use malloc inside an interrupt.
+
+/**
+ * \internal
+ * Allocate memory from the TLSF heap
+ * \param ptr reentrancy structure, to set errno
+ * \param align alignment, 0 if no particular alignment is required
+ * \param size size to allocate
+ * \param caller call site, for heap tracing
+ */
+static void *tlsfAllocate(struct _reent *ptr, size_t align, size_t size,
+        const void *caller)
+{
+    void *result=nullptr;
+    {
+        miosix::PauseKernelLock dLock;
+        if(size<=static_cast<size_t>(-1)-traceTagSize)
+        {
+            if(align==0) result=tlsfHeap.allocate(size+traceTagSize);
+            else result=tlsfHeap.allocateAligned(align,size+traceTagSize);
+        }
+        #ifdef WITH_HEAP_TRACE
+        if(result) miosix::HeapTrace::PKallocated(caller,result,size,
+                miosix::Tlsf::usableSize(result));
+        else miosix::HeapTrace::PKfailed(caller,size);
+        #endif //WITH_HEAP_TRACE
+    }
+    if(result==nullptr) ptr->_errno=ENOMEM;
+    return result;
+}
+
+/**
+ * \internal
+ * Deallocate memory from the TLSF heap
+ * \param mem memory to deallocate
+ * \param caller call site, for heap tracing
+ */
+static void tlsfDeallocate(void *mem, const void *caller)
+{
+    if(mem==nullptr) return;
+    miosix::PauseKernelLock dLock;
+    #ifdef WITH_HEAP_TRACE
+    unsigned int size;
+    if(miosix::HeapTrace::PKdeallocated(caller,mem,traceUsableSize(mem),
+            size)==false)
+    {
+        //Deallocating would corrupt the free lists
+        miosix::errorHandler(miosix::HEAP_CORRUPTED);
+        return;
+    }
+    #endif //WITH_HEAP_TRACE
+    tlsfHeap.deallocate(mem);
+}
+
+/**
+ * \internal
+ * Resize memory from the TLSF heap
+ * \param ptr reentrancy structure, to set errno
+ * \param mem memory to resize
+ * \param size new size
+ * \param caller call site, for heap tracing
+ */
+static void *tlsfReallocate(struct _reent *ptr, void *mem, size_t size,
+        const void *caller)
+{
+    if(mem==nullptr) return tlsfAllocate(ptr,0,size,caller);
+    void *result=nullptr;
+    {
+        miosix::PauseKernelLock dLock;
+        #ifdef WITH_HEAP_TRACE
+        unsigned int oldUsable=traceUsableSize(mem);
+        unsigned int oldSize;
+        if(miosix::HeapTrace::PKdeallocated(caller,mem,oldUsable,
+                oldSize)==false)
+        {
+            //Reallocating would corrupt the free lists
+            miosix::errorHandler(miosix::HEAP_CORRUPTED);
+            return nullptr;
+        }
+        #endif //WITH_HEAP_TRACE
+        if(size<=static_cast<size_t>(-1)-traceTagSize)
+            result=tlsfHeap.reallocate(mem,size+traceTagSize);
+        #ifdef WITH_HEAP_TRACE
+        if(result) miosix::HeapTrace::PKallocated(caller,result,size,
+                miosix::Tlsf::usableSize(result));
+        else {
+            //The old block is still allocated
+            miosix::HeapTrace::PKfailed(caller,size);
+            miosix::HeapTrace::PKallocated(caller,mem,oldSize,oldUsable);
+        }
+        #endif //WITH_HEAP_TRACE
+    }
+    if(result==nullptr) ptr->_errno=ENOMEM;
+    return result;
+}
+
+/**
+ * \internal
+ * _malloc_r, allocate memory
+ */
+void *_malloc_r(struct _reent *ptr, size_t size)
+{
+    return tlsfAllocate(ptr,0,size,__builtin_return_address(0));
+}
+
+/**
+ * \internal
+ * _free_r, deallocate memory
+ */
+void _free_r(struct _reent *ptr, void *mem)
+{
+    tlsfDeallocate(mem,__builtin_return_address(0));
+}
+
+/**
+ * \internal
+ * _realloc_r, resize memory
+ */
+void *_realloc_r(struct _reent *ptr, void *mem, size_t size)
+{
+    return tlsfReallocate(ptr,mem,size,__builtin_return_address(0));
+}
+
+/**
+ * \internal
+ * Allocate zeroed memory
+ */
+static void *tlsfCallocate(struct _reent *ptr, size_t num, size_t size,
+        const void *caller)
+{
+    if(size!=0 && num>static_cast<size_t>(-1)/size)
+    {
+        ptr->_errno=ENOMEM;
+        return nullptr;
+    }
+    void *result=tlsfAllocate(ptr,0,num*size,caller);
+    if(result) memset(result,0,num*size);
+    return result;
+}
+
+/**
+ * \internal
+ * _calloc_r, allocate zeroed memory
+ */
+void *_calloc_r(struct _reent *ptr, size_t num, size_t size)
+{
+    return tlsfCallocate(ptr,num,size,__builtin_return_address(0));
+}
+
+/**
+ * \internal
+ * _memalign_r, allocate aligned memory
+ */
+void *_memalign_r(struct _reent *ptr, size_t align, size_t size)
+{
+    return tlsfAllocate(ptr,align,size,__builtin_return_address(0));
+}
+
+/**
+ * \internal
+ * _valloc_r, allocate memory aligned to a page, there are no pages so use
+ * the same value as newlib
+ */
+void *_valloc_r(struct _reent *ptr, size_t size)
+{
+    return tlsfAllocate(ptr,4096,size,__builtin_return_address(0));
+}
+
+/**
+ * \internal
+ * _pvalloc_r, as _valloc_r but also rounds the size
+ */
+void *_pvalloc_r(struct _reent *ptr, size_t size)
+{
+    return tlsfAllocate(ptr,4096,(size+4095) & ~4095,
+            __builtin_return_address(0));
+}
+
+#ifdef WITH_HEAP_TRACE
+
+//The non reentrant versions are replaced too only when tracing, so that the
+//recorded call site is the caller of malloc() and not malloc() itself.
+//Note that operator new calls malloc() as a tail call when optimizations are
+//enabled, so the call site is the caller of operator new.
+
+void *malloc(size_t size)
+{
+    return tlsfAllocate(miosix::getReent(),0,size,__builtin_return_address(0));
+}
+
+void free(void *mem)
+{
+    tlsfDeallocate(mem,__builtin_return_address(0));
+}
+
+void *realloc(void *mem, size_t size)
+{
+    return tlsfReallocate(miosix::getReent(),mem,size,
+            __builtin_return_address(0));
+}
+
+void *calloc(size_t num, size_t size)
+{
+    return tlsfCallocate(miosix::getReent(),num,size,
+            __builtin_return_address(0));
+}
+
+void *memalign(size_t align, size_t size)
+{
+    return tlsfAllocate(miosix::getReent(),align,size,
+            __builtin_return_address(0));
+}
+
+#endif //WITH_HEAP_TRACE
+
+/**
+ * \internal
+ * _malloc_usable_size_r, return the usable size of an allocated memory block
+ */
+size_t _malloc_usable_size_r(struct _reent *ptr, void *mem)
+{
+    if(mem==nullptr) return 0;
+    return miosix::Tlsf::usableSize(mem)-traceTagSize;
+}
+
+/**
+ * \internal
+ * _mallinfo_r, return heap statistics. The meaning of the fields is as close
+ * as possible as the one of newlib malloc, fields that have no meaning for
+ * TLSF are left to zero
+ */
+struct mallinfo _mallinfo_r(struct _reent *ptr)
+{
+    struct mallinfo result;
+    memset(&result,0,sizeof(result));
+    miosix::PauseKernelLock dLock;
+    result.arena=tlsfHeap.getRegionSize();
+    result.ordblks=tlsfHeap.getFreeBlocks();
+    result.usmblks=tlsfHeap.getPeakUsedSize();
+    result.uordblks=tlsfHeap.getUsedSize();
+    result.fordblks=tlsfHeap.getRegionSize()-tlsfHeap.getUsedSize();
+    result.keepcost=tlsfHeap.getTopFreeBlock();
+    return result;
+}
+
+/**
+ * \internal
+ * _malloc_trim_r, memory is never returned to sbrk
+ */
+int _malloc_trim_r(struct _reent *ptr, size_t pad)
+{
+    return 0;
+}
+
+/**
+ * \internal
+ * _malloc_stats_r, print heap statistics
+ */
+void _malloc_stats_r(struct _reent *ptr)
+{
+    miosix::MemoryProfiling::print();
+}
+
+/**
+ * \internal
+ * _mallopt_r, there are no tunable parameters
+ */
+int _mallopt_r(struct _reent *ptr, int param, int value)
+{
+    return 0;
+}
+
+#endif //WITH_TLSF_ALLOCATOR
+
 /**
  * \internal
  * __getreent(), return the reentrancy structure of the current thread.
@@ -389,23 +709,177 @@ int _read_r(struct _reent *ptr, int fd, void *buf, size_t cnt)
     #endif //WITH_FILESYSTEM
 }
 
-int read(int fd, void *buf, size_t cnt)
+int read(int fd, void *buf, size_t cnt)
+{
+    return _read_r(miosix::getReent(),fd,buf,cnt);
+}
+
+/**
+ * \internal
+ * _lseek_r, move file pointer
+ */
+off_t _lseek_r(struct _reent *ptr, int fd, off_t pos, int whence)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        off_t result=miosix::getFileDescriptorTable().lseek(fd,pos,whence);
+        if(result>=0) return result;
+        ptr->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        ptr->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    ptr->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+off_t lseek(int fd, off_t pos, int whence)
+{
+    return _lseek_r(miosix::getReent(),fd,pos,whence);
+}
+
+/**
+ * \internal
+ * _writev_r, write to a file from multiple buffers
+ */
+ssize_t _writev_r(struct _reent *ptr, int fd, const struct iovec *iov,
+        int iovcnt)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().writev(fd,iov,iovcnt);
+        if(result>=0) return result;
+        ptr->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        ptr->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    if(fd==STDOUT_FILENO || fd==STDERR_FILENO)
+    {
+        ssize_t result=
+            miosix::DefaultConsole::instance().getTerminal()->writev(iov,iovcnt);
+        if(result>=0) return result;
+        ptr->_errno=-result;
+        return -1;
+    } else {
+        ptr->_errno=EBADF;
+        return -1;
+    }
+    #endif //WITH_FILESYSTEM
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    return _writev_r(miosix::getReent(),fd,iov,iovcnt);
+}
+
+/**
+ * \internal
+ * _readv_r, read from a file into multiple buffers
+ */
+ssize_t _readv_r(struct _reent *ptr, int fd, const struct iovec *iov,
+        int iovcnt)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().readv(fd,iov,iovcnt);
+        if(result>=0) return result;
+        ptr->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        ptr->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    if(fd==STDIN_FILENO)
+    {
+        ssize_t result=
+            miosix::DefaultConsole::instance().getTerminal()->readv(iov,iovcnt);
+        if(result>=0) return result;
+        ptr->_errno=-result;
+        return -1;
+    } else {
+        ptr->_errno=EBADF;
+        return -1;
+    }
+    #endif //WITH_FILESYSTEM
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    return _readv_r(miosix::getReent(),fd,iov,iovcnt);
+}
+
+/**
+ * \internal
+ * _pwrite_r, write to a file at a given position
+ */
+ssize_t _pwrite_r(struct _reent *ptr, int fd, const void *buf, size_t cnt,
+        off_t pos)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().pwrite(fd,buf,cnt,pos);
+        if(result>=0) return result;
+        ptr->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        ptr->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    ptr->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t cnt, off_t pos)
 {
-    return _read_r(miosix::getReent(),fd,buf,cnt);
+    return _pwrite_r(miosix::getReent(),fd,buf,cnt,pos);
 }
 
 /**
  * \internal
- * _lseek_r, move file pointer
+ * _pread_r, read from a file at a given position
  */
-off_t _lseek_r(struct _reent *ptr, int fd, off_t pos, int whence)
+ssize_t _pread_r(struct _reent *ptr, int fd, void *buf, size_t cnt,
+        off_t pos)
 {
     #ifdef WITH_FILESYSTEM
 
     #ifndef __NO_EXCEPTIONS
     try {
     #endif //__NO_EXCEPTIONS
-        off_t result=miosix::getFileDescriptorTable().lseek(fd,pos,whence);
+        ssize_t result=miosix::getFileDescriptorTable().pread(fd,buf,cnt,pos);
         if(result>=0) return result;
         ptr->_errno=-result;
         return -1;
@@ -422,9 +896,9 @@ off_t _lseek_r(struct _reent *ptr, int fd, off_t pos, int whence)
     #endif //WITH_FILESYSTEM
 }
 
-off_t lseek(int fd, off_t pos, int whence)
+ssize_t pread(int fd, void *buf, size_t cnt, off_t pos)
 {
-    return _lseek_r(miosix::getReent(),fd,pos,whence);
+    return _pread_r(miosix::getReent(),fd,buf,cnt,pos);
 }
 
 /**
@@ -632,6 +1106,114 @@ int ioctl(int fd, int cmd, void *arg)
     return _ioctl_r(miosix::getReent(),fd,cmd,arg);
 }
 
+/**
+ * \internal
+ * fsync, write back file data and metadata to the disk
+ */
+int fsync(int fd)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().fsync(fd);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * fdatasync, write back file data to the disk
+ */
+int fdatasync(int fd)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().fdatasync(fd);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * fallocate, allocate disk space for a range of a file
+ */
+int fallocate(int fd, int mode, off_t offset, off_t len)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().fallocate(fd,mode,offset,len);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * posix_fallocate, allocate disk space for a range of a file. Unlike most
+ * functions, returns the error number instead of setting errno
+ */
+int posix_fallocate(int fd, off_t offset, off_t len)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        return -miosix::getFileDescriptorTable().fallocate(fd,0,offset,len);
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        return ENOMEM;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    return EBADF;
+    #endif //WITH_FILESYSTEM
+}
+
 /**
  * \internal
  * _getcwd_r, return current directory
@@ -764,6 +1346,90 @@ int rmdir(const char *path)
     return _rmdir_r(miosix::getReent(),path);
 }
 
+/**
+ * \internal
+ * mkfifo, create a named FIFO
+ */
+int mkfifo(const char *path, mode_t mode)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().mkfifo(path,mode);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=ENOENT;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * statvfs, obtain information on a filesystem
+ */
+int statvfs(const char *path, struct statvfs *buf)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().statvfs(path,buf);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=ENOENT;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * fstatvfs, obtain information on the filesystem of an open file
+ */
+int fstatvfs(int fd, struct statvfs *buf)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().fstatvfs(fd,buf);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
 /**
  * \internal
  * _link_r: create hardlinks
@@ -873,6 +1539,150 @@ int getdents(unsigned int fd, struct dirent *dirp, unsigned int count)
     #endif //WITH_FILESYSTEM
 }
 
+/**
+ * \internal
+ * pipe, create an anonymous pipe
+ */
+int pipe(int fds[2])
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().pipe(fds);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=ENOSYS;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * poll, wait for one of a set of files to become ready
+ */
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().poll(fds,nfds,timeout);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=ENOSYS;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * select, implemented on top of poll
+ */
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+        struct timeval *timeout)
+{
+    if(nfds<0 || nfds>FD_SETSIZE)
+    {
+        miosix::getReent()->_errno=EINVAL;
+        return -1;
+    }
+    int timeoutMs=-1;
+    if(timeout)
+    {
+        if(timeout->tv_sec<0 || timeout->tv_usec<0)
+        {
+            miosix::getReent()->_errno=EINVAL;
+            return -1;
+        }
+        long long ms=static_cast<long long>(timeout->tv_sec)*1000+
+                     (timeout->tv_usec+999)/1000;
+        timeoutMs=min<long long>(ms,numeric_limits<int>::max());
+    }
+    auto eventsOf=[=](int fd)->short {
+        short events=0;
+        if(readfds && FD_ISSET(fd,readfds)) events|=POLLIN;
+        if(writefds && FD_ISSET(fd,writefds)) events|=POLLOUT;
+        if(exceptfds && FD_ISSET(fd,exceptfds)) events|=POLLPRI;
+        return events;
+    };
+    int n=0;
+    for(int i=0;i<nfds;i++) if(eventsOf(i)) n++;
+    unique_ptr<struct pollfd[]> fds(new (nothrow) struct pollfd[n]);
+    if(!fds && n>0)
+    {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    for(int i=0,j=0;i<nfds;i++)
+    {
+        short events=eventsOf(i);
+        if(events==0) continue;
+        fds[j].fd=i;
+        fds[j].events=events;
+        fds[j].revents=0;
+        j++;
+    }
+    int result=poll(fds.get(),n,timeoutMs);
+    if(result<0) return result;
+    //Check all descriptors before touching the sets, which must be left
+    //unchanged on error
+    for(int i=0;i<n;i++)
+    {
+        if(fds[i].revents & POLLNVAL)
+        {
+            miosix::getReent()->_errno=EBADF;
+            return -1;
+        }
+    }
+    if(readfds) FD_ZERO(readfds);
+    if(writefds) FD_ZERO(writefds);
+    if(exceptfds) FD_ZERO(exceptfds);
+    result=0;
+    for(int i=0;i<n;i++)
+    {
+        short revents=fds[i].revents;
+        if(readfds && (fds[i].events & POLLIN) &&
+           (revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            FD_SET(fds[i].fd,readfds);
+            result++;
+        }
+        if(writefds && (fds[i].events & POLLOUT) &&
+           (revents & (POLLOUT | POLLERR)))
+        {
+            FD_SET(fds[i].fd,writefds);
+            result++;
+        }
+        if(exceptfds && (fds[i].events & POLLPRI) && (revents & POLLPRI))
+        {
+            FD_SET(fds[i].fd,exceptfds);
+            result++;
+        }
+    }
+    return result;
+}
+
 
 
 
@@ -1116,6 +1926,31 @@ pid_t forkexecve(const char *path, char *const argv[], char *const env[])
 }
 #endif
 
+namespace miosix {
+
+unsigned int getLargestFreeHeapBlock()
+{
+    //The memory not yet obtained through sbrk is contiguous with the free
+    //block at the top of the heap, if any
+    extern char _heap_end asm("_heap_end"); //defined in the linker script
+    PauseKernelLock dLock;
+    char *curHeapEnd=reinterpret_cast<char*>(_sbrk_r(getReent(),0));
+    unsigned int unused=&_heap_end-curHeapEnd;
+    #ifdef WITH_TLSF_ALLOCATOR
+    unsigned int top=tlsfHeap.getTopFreeBlock()+unused;
+    unsigned int largest=tlsfHeap.getLargestFreeBlock();
+    if(top>largest) largest=top;
+    return largest>traceTagSize ? largest-traceTagSize : 0;
+    #else //WITH_TLSF_ALLOCATOR
+    //Newlib does not expose its free lists, only the top block size is known,
+    //so this is a lower bound
+    struct mallinfo mallocData=_mallinfo_r(getReent());
+    return mallocData.keepcost+unused;
+    #endif //WITH_TLSF_ALLOCATOR
+}
+
+} //namespace miosix
+
 
 
 
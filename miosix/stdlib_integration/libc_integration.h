@@ -47,6 +47,13 @@ namespace miosix {
  */
 unsigned int getMaxHeap();
 
+/**
+ * \internal
+ * \return the largest block that can be allocated from the heap. What you'd
+ * want to call is most likely MemoryProfiling::getLargestFreeHeapBlock().
+ */
+unsigned int getLargestFreeHeapBlock();
+
 /**
  * \internal
  * Used by the kernel during the boot process to switch the C standard library
@@ -0,0 +1,234 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#include "heap_trace.h"
+#include <cstdio>
+#include <cstring>
+#include "kernel/kernel.h"
+
+#ifdef WITH_HEAP_TRACE
+
+namespace miosix {
+
+extern bool kernel_started; //Defined in kernel.cpp
+
+/**
+ * \internal
+ * Statistics of a call site
+ */
+struct HeapTraceSite
+{
+    const void *caller;         ///< Call site, nullptr if entry unused
+    unsigned int allocs;        ///< Number of allocations
+    unsigned int frees;         ///< Number of deallocations
+    unsigned int failures;      ///< Number of failed allocations
+    unsigned int liveBytes;     ///< Bytes currently allocated
+    unsigned int peakLiveBytes; ///< Peak of liveBytes
+};
+
+/**
+ * \internal
+ * A recorded heap operation
+ */
+struct HeapTraceEvent
+{
+    const void *caller; ///< Call site
+    const void *ptr;    ///< Allocated or deallocated block
+    const void *thread; ///< Thread, nullptr if the kernel was not started
+    unsigned int size;  ///< Requested size
+    char type;          ///< 'a' allocation, 'f' free, 'x' failed allocation
+};
+
+/**
+ * \internal
+ * Stored in the last bytes of each allocated block
+ */
+struct HeapTraceTag
+{
+    unsigned int size;   ///< Requested size
+    unsigned short site; ///< Index in the call site table
+    unsigned short magic;///< To detect buffer overflows and double frees
+};
+
+static_assert(sizeof(HeapTraceTag)==HeapTrace::tagSize,"Wrong tag size");
+
+static const unsigned short tagMagic=0xa5e3;
+///The last entry accounts for all call sites that did not fit in the table
+static HeapTraceSite sites[HEAP_TRACE_SITES+1];
+static HeapTraceEvent events[HEAP_TRACE_EVENTS];
+static unsigned int numEvents=0;     ///< Number of events ever recorded
+static unsigned int liveBytes=0;     ///< Bytes currently allocated
+static unsigned int peakLiveBytes=0; ///< Peak of liveBytes
+
+/**
+ * \internal
+ * \param caller a call site
+ * \return the call site index in the open addressing hash table, adding it
+ * if it is not yet there
+ */
+static unsigned int findSite(const void *caller)
+{
+    //Return addresses are at least two byte aligned
+    unsigned int h=(reinterpret_cast<unsigned long>(caller)>>1)*2654435761u;
+    h^=h>>16;
+    for(unsigned int i=0;i<HEAP_TRACE_SITES;i++)
+    {
+        unsigned int j=(h+i)%HEAP_TRACE_SITES;
+        if(sites[j].caller==caller) return j;
+        if(sites[j].caller!=nullptr) continue;
+        sites[j].caller=caller;
+        return j;
+    }
+    return HEAP_TRACE_SITES;
+}
+
+/**
+ * \internal
+ * Add an event to the ring buffer
+ */
+static void record(char type, const void *caller, const void *ptr,
+        unsigned int size)
+{
+    HeapTraceEvent& e=events[numEvents++ % HEAP_TRACE_EVENTS];
+    e.caller=caller;
+    e.ptr=ptr;
+    //Before the kernel is started getting the current thread would allocate
+    e.thread=kernel_started ? Thread::IRQgetCurrentThread() : nullptr;
+    e.size=size;
+    e.type=type;
+}
+
+//
+// HeapTrace class
+//
+
+void HeapTrace::dump()
+{
+    unsigned int live,peak,n;
+    {
+        PauseKernelLock dLock;
+        live=liveBytes;
+        peak=peakLiveBytes;
+        n=numEvents;
+    }
+    iprintf("heap_trace begin\nlive %u peak %u\n",live,peak);
+    //Printing may block, so entries are copied one at a time with the kernel
+    //paused, and printed with the kernel running
+    for(unsigned int i=0;i<=HEAP_TRACE_SITES;i++)
+    {
+        HeapTraceSite s;
+        {
+            PauseKernelLock dLock;
+            s=sites[i];
+        }
+        if(s.allocs==0 && s.failures==0) continue;
+        iprintf("site 0x%08x allocs %u frees %u failures %u live %u peak %u\n",
+                reinterpret_cast<unsigned int>(s.caller),s.allocs,s.frees,
+                s.failures,s.liveBytes,s.peakLiveBytes);
+    }
+    unsigned int first=n>HEAP_TRACE_EVENTS ? n-HEAP_TRACE_EVENTS : 0;
+    for(unsigned int i=first;i<n;i++)
+    {
+        HeapTraceEvent e;
+        {
+            PauseKernelLock dLock;
+            //Stop if overwritten by events recorded while printing
+            if(numEvents-i>HEAP_TRACE_EVENTS) continue;
+            e=events[i % HEAP_TRACE_EVENTS];
+        }
+        iprintf("event %u %c 0x%08x 0x%08x %u 0x%08x\n",i,e.type,
+                reinterpret_cast<unsigned int>(e.caller),
+                reinterpret_cast<unsigned int>(e.ptr),e.size,
+                reinterpret_cast<unsigned int>(e.thread));
+    }
+    iprintf("heap_trace end\n");
+}
+
+unsigned int HeapTrace::getLiveBytes()
+{
+    return liveBytes;
+}
+
+unsigned int HeapTrace::getPeakLiveBytes()
+{
+    return peakLiveBytes;
+}
+
+void HeapTrace::PKallocated(const void *caller, void *ptr, unsigned int size,
+        unsigned int usable)
+{
+    unsigned int i=findSite(caller);
+    HeapTraceSite& s=sites[i];
+    s.allocs++;
+    s.liveBytes+=size;
+    if(s.liveBytes>s.peakLiveBytes) s.peakLiveBytes=s.liveBytes;
+    liveBytes+=size;
+    if(liveBytes>peakLiveBytes) peakLiveBytes=liveBytes;
+    HeapTraceTag tag;
+    tag.size=size;
+    tag.site=i;
+    tag.magic=tagMagic;
+    memcpy(reinterpret_cast<char*>(ptr)+usable-tagSize,&tag,sizeof(tag));
+    record('a',caller,ptr,size);
+}
+
+bool HeapTrace::PKdeallocated(const void *caller, void *ptr,
+        unsigned int usable, unsigned int& size)
+{
+    //The allocator reuses the memory of deallocated blocks, tag included, so
+    //double frees are reported by the allocator passing usable=0
+    HeapTraceTag tag;
+    char *where=reinterpret_cast<char*>(ptr)+usable-tagSize;
+    if(usable>=tagSize) memcpy(&tag,where,sizeof(tag));
+    if(usable<tagSize || tag.magic!=tagMagic || tag.site>HEAP_TRACE_SITES
+        || tag.size>usable-tagSize)
+    {
+        //Double free or buffer overflow
+        record('f',caller,ptr,0);
+        return false;
+    }
+    HeapTraceSite& s=sites[tag.site];
+    s.frees++;
+    s.liveBytes-=tag.size;
+    liveBytes-=tag.size;
+    tag.magic=0;
+    memcpy(where,&tag,sizeof(tag));
+    record('f',caller,ptr,tag.size);
+    size=tag.size;
+    return true;
+}
+
+void HeapTrace::PKfailed(const void *caller, unsigned int size)
+{
+    sites[findSite(caller)].failures++;
+    record('x',caller,nullptr,size);
+}
+
+} //namespace miosix
+
+#endif //WITH_HEAP_TRACE
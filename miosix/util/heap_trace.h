@@ -0,0 +1,131 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+
+#ifndef HEAP_TRACE_H
+#define HEAP_TRACE_H
+
+#include "config/miosix_settings.h"
+
+#ifdef WITH_HEAP_TRACE
+
+namespace miosix {
+
+/**
+ * \addtogroup Util
+ * \{
+ */
+
+/**
+ * When WITH_HEAP_TRACE is defined in miosix_settings.h, every heap allocation
+ * is recorded by this class. For each call site (identified by the return
+ * address of the malloc, calloc, realloc, memalign or of the newlib function
+ * that called the allocator) it keeps the number of allocations and
+ * deallocations, the bytes it currently keeps allocated and their peak. It
+ * also keeps the last HEAP_TRACE_EVENTS heap operations in a ring buffer,
+ * including the thread that did them.<br>
+ * Call sites are identified by addresses, to translate them into source
+ * file and line, capture the output of dump() and process it on the
+ * development machine with the miosix/_tools/heap_trace/heap_trace.pl script,
+ * that uses addr2line on the elf file.
+ */
+class HeapTrace
+{
+public:
+    /**
+     * Print the recorded information, in the format parsed by heap_trace.pl
+     */
+    static void dump();
+
+    /**
+     * \return the number of bytes currently allocated, as requested by the
+     * caller, so without the allocator overhead
+     */
+    static unsigned int getLiveBytes();
+
+    /**
+     * \return the maximum value getLiveBytes() ever reached
+     */
+    static unsigned int getPeakLiveBytes();
+
+    /**
+     * \internal
+     * Number of bytes that the allocator must add at the end of each block,
+     * to store which call site allocated it
+     */
+    static const unsigned int tagSize=8;
+
+    /**
+     * \internal
+     * Called by the allocator after a block has been allocated, with the
+     * kernel paused. Writes the tag at the end of the block.
+     * \param caller call site
+     * \param ptr allocated block
+     * \param size size requested by the caller
+     * \param usable usable size of the block, at least size+tagSize
+     */
+    static void PKallocated(const void *caller, void *ptr, unsigned int size,
+            unsigned int usable);
+
+    /**
+     * \internal
+     * Called by the allocator before a block is deallocated, with the kernel
+     * paused
+     * \param caller call site
+     * \param ptr block that is being deallocated
+     * \param usable usable size of the block, or 0 if the allocator knows
+     * that the block is not allocated
+     * \param size the size originally requested for the block is stored here
+     * \return false if the block was already deallocated or its tag was
+     * overwritten by a buffer overflow. In this case the allocator must not
+     * deallocate the block, as it would corrupt the heap
+     */
+    static bool PKdeallocated(const void *caller, void *ptr,
+            unsigned int usable, unsigned int& size);
+
+    /**
+     * \internal
+     * Called by the allocator when an allocation fails, with the kernel paused
+     * \param caller call site
+     * \param size size requested by the caller
+     */
+    static void PKfailed(const void *caller, unsigned int size);
+
+private:
+    //All member functions static, disallow creating instances
+    HeapTrace();
+};
+
+/**
+ * \}
+ */
+
+} //namespace miosix
+
+#endif //WITH_HEAP_TRACE
+
+#endif //HEAP_TRACE_H
@@ -32,6 +32,7 @@
 #include <cstdio>
 #include <malloc.h>
 #include "util.h"
+#include "heap_trace.h"
 #include "kernel/kernel.h"
 #include "stdlib_integration/libc_integration.h"
 #include "config/miosix_settings.h" //For WATERMARK_FILL and STACK_FILL
@@ -65,6 +66,17 @@ void MemoryProfiling::print()
             curFreeStack,absFreeStack,
             heapSize,heapSize-curFreeHeap,heapSize-absFreeHeap,
             curFreeHeap,absFreeHeap);
+    iprintf("Largest free block: %u\n"
+            "Fragmentation: %u%%\n",
+            getLargestFreeHeapBlock(),getHeapFragmentation());
+    #ifdef WITH_TLSF_ALLOCATOR
+    struct mallinfo mallocData=_mallinfo_r(__getreent());
+    iprintf("Free blocks: %u\n",mallocData.ordblks);
+    #endif //WITH_TLSF_ALLOCATOR
+    #ifdef WITH_HEAP_TRACE
+    iprintf("Traced live bytes (current/max): %u/%u\n",
+            HeapTrace::getLiveBytes(),HeapTrace::getPeakLiveBytes());
+    #endif //WITH_HEAP_TRACE
 }
 
 unsigned int MemoryProfiling::getStackSize()
@@ -131,6 +143,19 @@ unsigned int MemoryProfiling::getCurrentFreeHeap()
     return getHeapSize()-mallocData.uordblks;
 }
 
+unsigned int MemoryProfiling::getLargestFreeHeapBlock()
+{
+    return miosix::getLargestFreeHeapBlock();
+}
+
+unsigned int MemoryProfiling::getHeapFragmentation()
+{
+    unsigned int freeHeap=getCurrentFreeHeap();
+    unsigned int largest=getLargestFreeHeapBlock();
+    if(freeHeap==0 || largest>=freeHeap) return 0;
+    return 100-(100ull*largest)/freeHeap;
+}
+
 /**
  * \internal
  * used by memDump
@@ -96,6 +96,22 @@ public:
      */
     static unsigned int getCurrentFreeHeap();
 
+    /**
+     * \return the largest block that can currently be allocated from the heap.
+     * <br>With newlib malloc this is a lower bound, as newlib only reports the
+     * size of the free block at the top of the heap. With the TLSF allocator
+     * (WITH_TLSF_ALLOCATOR in miosix_settings.h) it is exact.
+     */
+    static unsigned int getLargestFreeHeapBlock();
+
+    /**
+     * \return heap fragmentation in percent, computed as
+     * 100*(1-largest free block/current free heap). It is 0 when all the free
+     * heap can be allocated in a single block, and approaches 100 as the free
+     * heap is split in many small blocks.
+     */
+    static unsigned int getHeapFragmentation();
+
 private:
     //All member functions static, disallow creating instances
     MemoryProfiling();